@@ -0,0 +1,357 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include <llhdl/structure.h>
+
+#include "generators.h"
+
+static struct llhdl_node *new_signal(struct llhdl_module *m, int type, int vectorsize, const char *fmt, int index)
+{
+	char name[32];
+
+	sprintf(name, fmt, index);
+	return llhdl_create_signal(m, type, name, 0, vectorsize);
+}
+
+static struct llhdl_node *logic(int op, struct llhdl_node *a, struct llhdl_node *b)
+{
+	struct llhdl_node *operands[2];
+
+	operands[0] = a;
+	operands[1] = b;
+	return llhdl_create_logic(op, operands);
+}
+
+static struct llhdl_node *slice(struct llhdl_node *source, int start, int end)
+{
+	struct llhdl_slice s;
+
+	s.source = source;
+	s.start = start;
+	s.end = end;
+	return llhdl_create_vect(0, 1, &s);
+}
+
+static struct llhdl_node *mux2(struct llhdl_node *select, struct llhdl_node *a, struct llhdl_node *b)
+{
+	struct llhdl_node *sources[2];
+
+	sources[0] = a;
+	sources[1] = b;
+	return llhdl_create_mux(2, select, sources);
+}
+
+static int log2_ceil(int n)
+{
+	int r;
+
+	r = 0;
+	while((1 << r) < n)
+		r++;
+	return r;
+}
+
+static struct llhdl_module *new_module(const char *name, int size)
+{
+	struct llhdl_module *m;
+	char mname[32];
+
+	m = llhdl_new_module();
+	sprintf(mname, "%s%d", name, size);
+	llhdl_set_module_name(m, mname);
+	return m;
+}
+
+static struct llhdl_module *gen_arith(const char *name, int op, int size, int result_size)
+{
+	struct llhdl_module *m;
+	struct llhdl_node *a, *b, *r;
+
+	m = new_module(name, size);
+	a = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "a", 0, size);
+	b = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "b", 0, size);
+	r = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_OUT, "r", 0, result_size);
+	r->p.signal.source = logic(op, a, b);
+	return m;
+}
+
+static struct llhdl_module *gen_adder(int size, struct bench_params *p)
+{
+	return gen_arith("adder", LLHDL_EXTLOGIC_ADD, size, size+1);
+}
+
+static struct llhdl_module *gen_multiplier(int size, struct bench_params *p)
+{
+	return gen_arith("multiplier", LLHDL_EXTLOGIC_MUL, size, 2*size);
+}
+
+#define DATA_WIDTH 8
+
+/* Each output selects one of the inputs */
+static struct llhdl_module *gen_crossbar(int size, struct bench_params *p)
+{
+	struct llhdl_module *m;
+	struct llhdl_node **inputs, **sources;
+	struct llhdl_node *sel, *o;
+	int i, j;
+	int sel_width, nsources;
+
+	m = new_module("crossbar", size);
+	sel_width = log2_ceil(size);
+	if(sel_width == 0)
+		sel_width = 1;
+	nsources = 1 << sel_width;
+	inputs = alloc_size(size*sizeof(struct llhdl_node *));
+	sources = alloc_size(nsources*sizeof(struct llhdl_node *));
+	for(i=0;i<size;i++)
+		inputs[i] = new_signal(m, LLHDL_SIGNAL_PORT_IN, DATA_WIDTH, "i%d", i);
+	for(i=0;i<size;i++) {
+		sel = new_signal(m, LLHDL_SIGNAL_PORT_IN, sel_width, "sel%d", i);
+		o = new_signal(m, LLHDL_SIGNAL_PORT_OUT, DATA_WIDTH, "o%d", i);
+		for(j=0;j<nsources;j++)
+			sources[j] = inputs[j % size];
+		o->p.signal.source = llhdl_create_mux(nsources, sel, sources);
+	}
+	free(sources);
+	free(inputs);
+	return m;
+}
+
+/* if(c[0]) o = d0; else if(c[1]) o = d1; ... else o = dflt; as a single expression */
+static struct llhdl_module *gen_priority(int size, struct bench_params *p)
+{
+	struct llhdl_module *m;
+	struct llhdl_node *c, *d, *o, *e;
+	int i;
+
+	m = new_module("priority", size);
+	c = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "c", 0, size);
+	e = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "dflt", 0, DATA_WIDTH);
+	o = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_OUT, "o", 0, DATA_WIDTH);
+	for(i=size-1;i>=0;i--) {
+		d = new_signal(m, LLHDL_SIGNAL_PORT_IN, DATA_WIDTH, "d%d", i);
+		e = mux2(slice(c, i, i), e, d);
+	}
+	o->p.signal.source = e;
+	return m;
+}
+
+#define REGFILE_WIDTH 32
+
+/* One write port and one asynchronous read port */
+static struct llhdl_module *gen_regfile(int size, struct bench_params *p)
+{
+	struct llhdl_module *m;
+	struct llhdl_node *clk, *we, *waddr, *wdata, *raddr, *rdata;
+	struct llhdl_node **regs;
+	struct llhdl_node *sel, *bit;
+	int i, j;
+	int addr_width, nregs;
+
+	addr_width = log2_ceil(size);
+	if(addr_width == 0)
+		addr_width = 1;
+	nregs = 1 << addr_width;
+	m = new_module("regfile", nregs);
+	clk = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "clk", 0, 1);
+	we = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "we", 0, 1);
+	waddr = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "waddr", 0, addr_width);
+	wdata = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "wdata", 0, REGFILE_WIDTH);
+	raddr = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "raddr", 0, addr_width);
+	rdata = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_OUT, "rdata", 0, REGFILE_WIDTH);
+	regs = alloc_size(nregs*sizeof(struct llhdl_node *));
+	for(i=0;i<nregs;i++) {
+		regs[i] = new_signal(m, LLHDL_SIGNAL_INTERNAL, REGFILE_WIDTH, "r%d", i);
+		/* address decoder */
+		sel = we;
+		for(j=0;j<addr_width;j++) {
+			bit = slice(waddr, j, j);
+			if(!(i & (1 << j)))
+				bit = llhdl_create_logic(LLHDL_LOGIC_NOT, &bit);
+			sel = logic(LLHDL_LOGIC_AND, sel, bit);
+		}
+		regs[i]->p.signal.source = llhdl_create_fd(clk, mux2(sel, regs[i], wdata));
+	}
+	rdata->p.signal.source = llhdl_create_mux(nregs, raddr, regs);
+	free(regs);
+	return m;
+}
+
+#define DAG_INPUTS 8
+
+struct dag {
+	struct llhdl_node **nodes;
+	int nnodes;
+	int *urn;
+	int nurn;
+	int *fanout;
+	double bias;
+};
+
+/* With the fanout bias, operands are drawn from the operands already used,
+ * which makes the probability of being chosen grow with the fanout.
+ */
+static struct llhdl_node *dag_pick(struct dag *d)
+{
+	int i;
+
+	if((d->nurn > 0) && ((double)random()/RAND_MAX < d->bias))
+		i = d->urn[random() % d->nurn];
+	else
+		i = random() % d->nnodes;
+	d->urn[d->nurn++] = i;
+	d->fanout[i]++;
+	return d->nodes[i];
+}
+
+static struct llhdl_node *dag_expr(struct dag *d, struct llhdl_node *clk)
+{
+	struct llhdl_node *a, *b, *e;
+	int op, bit;
+
+	/* draw the operands in a fixed order, so that the design only depends on the seed */
+	op = random() % 6;
+	a = dag_pick(d);
+	b = dag_pick(d);
+	switch(op) {
+		case 0:
+			e = logic(LLHDL_LOGIC_AND, a, b);
+			break;
+		case 1:
+			e = logic(LLHDL_LOGIC_OR, a, b);
+			break;
+		case 2:
+			e = logic(LLHDL_LOGIC_XOR, a, b);
+			break;
+		case 3:
+			e = slice(logic(LLHDL_EXTLOGIC_ADD, a, b), 0, DATA_WIDTH-1);
+			break;
+		case 4:
+			e = slice(logic(LLHDL_EXTLOGIC_SUB, a, b), 0, DATA_WIDTH-1);
+			break;
+		default:
+			bit = random() % DATA_WIDTH;
+			e = mux2(slice(dag_pick(d), bit, bit), a, b);
+			break;
+	}
+	if(random() % 10 < 3)
+		e = llhdl_create_fd(clk, e);
+	return e;
+}
+
+/* Random DAG of word-level operators, with the sinks XOR-reduced to one output */
+static struct llhdl_module *gen_random(int size, struct bench_params *p)
+{
+	struct llhdl_module *m;
+	struct llhdl_node *clk, *o;
+	struct llhdl_node **sinks;
+	struct dag d;
+	int i, nsinks, nreduce;
+
+	m = new_module("random", size);
+	srandom(p->seed);
+	d.nodes = alloc_size((DAG_INPUTS+size)*sizeof(struct llhdl_node *));
+	d.fanout = alloc_size((DAG_INPUTS+size)*sizeof(int));
+	d.urn = alloc_size(3*size*sizeof(int));
+	d.nnodes = 0;
+	d.nurn = 0;
+	d.bias = p->fanout_bias;
+	memset(d.fanout, 0, (DAG_INPUTS+size)*sizeof(int));
+
+	clk = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_IN, "clk", 0, 1);
+	for(i=0;i<DAG_INPUTS;i++)
+		d.nodes[d.nnodes++] = new_signal(m, LLHDL_SIGNAL_PORT_IN, DATA_WIDTH, "i%d", i);
+	for(i=0;i<size;i++) {
+		o = new_signal(m, LLHDL_SIGNAL_INTERNAL, DATA_WIDTH, "t%d", i);
+		o->p.signal.source = dag_expr(&d, clk);
+		d.nodes[d.nnodes++] = o;
+	}
+
+	sinks = alloc_size(size*sizeof(struct llhdl_node *));
+	nsinks = 0;
+	for(i=DAG_INPUTS;i<d.nnodes;i++)
+		if(d.fanout[i] == 0)
+			sinks[nsinks++] = d.nodes[i];
+	nreduce = 0;
+	while(nsinks > 1) {
+		for(i=0;i<nsinks/2;i++) {
+			o = new_signal(m, LLHDL_SIGNAL_INTERNAL, DATA_WIDTH, "x%d", nreduce++);
+			o->p.signal.source = logic(LLHDL_LOGIC_XOR, sinks[2*i], sinks[2*i+1]);
+			sinks[i] = o;
+		}
+		if(nsinks & 1) {
+			sinks[i] = sinks[nsinks-1];
+			i++;
+		}
+		nsinks = i;
+	}
+	o = llhdl_create_signal(m, LLHDL_SIGNAL_PORT_OUT, "o", 0, DATA_WIDTH);
+	o->p.signal.source = sinks[0];
+
+	free(sinks);
+	free(d.urn);
+	free(d.fanout);
+	free(d.nodes);
+	return m;
+}
+
+static const int adder_sizes[] = {8, 16, 32, 64, 128, 256, 0};
+static const int multiplier_sizes[] = {4, 8, 16, 24, 32, 0};
+static const int crossbar_sizes[] = {2, 4, 6, 8, 12, 0};
+static const int priority_sizes[] = {2, 4, 6, 8, 0};
+static const int regfile_sizes[] = {2, 4, 8, 16, 0};
+static const int random_sizes[] = {100, 200, 400, 800, 1600, 0};
+
+struct bench_generator bench_generators[] = {
+	{
+		.handle = "adder",
+		.description = "N-bit adder",
+		.default_sizes = adder_sizes,
+		.generate = gen_adder
+	},
+	{
+		.handle = "multiplier",
+		.description = "N-bit by N-bit multiplier",
+		.default_sizes = multiplier_sizes,
+		.generate = gen_multiplier
+	},
+	{
+		.handle = "crossbar",
+		.description = "N by N crossbar of 8-bit muxes",
+		.default_sizes = crossbar_sizes,
+		.generate = gen_crossbar
+	},
+	{
+		.handle = "priority",
+		.description = "If-else chain of N conditions",
+		.default_sizes = priority_sizes,
+		.generate = gen_priority
+	},
+	{
+		.handle = "regfile",
+		.description = "Register file of N 32-bit registers",
+		.default_sizes = regfile_sizes,
+		.generate = gen_regfile
+	},
+	{
+		.handle = "random",
+		.description = "Random DAG of N 8-bit operators",
+		.default_sizes = random_sizes,
+		.generate = gen_random
+	},
+	{
+		.handle = NULL
+	}
+};
+
+struct bench_generator *bench_get_generator(const char *handle)
+{
+	int i;
+
+	for(i=0;bench_generators[i].handle!=NULL;i++)
+		if(strcmp(bench_generators[i].handle, handle) == 0)
+			return &bench_generators[i];
+	return NULL;
+}
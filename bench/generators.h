@@ -0,0 +1,22 @@
+#ifndef __GENERATORS_H
+#define __GENERATORS_H
+
+#include <llhdl/structure.h>
+
+struct bench_params {
+	unsigned int seed;
+	double fanout_bias;	/* < 0: uniform operand choice, 1: preferential attachment */
+};
+
+struct bench_generator {
+	const char *handle;
+	const char *description;
+	const int *default_sizes;	/* < terminated by 0 */
+	struct llhdl_module *(*generate)(int size, struct bench_params *p);
+};
+
+extern struct bench_generator bench_generators[];
+
+struct bench_generator *bench_get_generator(const char *handle);
+
+#endif /* __GENERATORS_H */
@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include <netlist/net.h>
+#include <netlist/manager.h>
+
+#include "flow.h"
+#include "harness.h"
+
+const char *bench_stage_names[] = {
+	"parse",
+	"metamap",
+	"prune",
+	"write"
+};
+
+const char *bench_status_names[] = {
+	"ok",
+	"failed",
+	"timeout"
+};
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static long int peak_kb()
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+/* Results fit in a single atomic write to the pipe */
+static void send_result(int fd, struct bench_result *r)
+{
+	if(write(fd, r, sizeof(struct bench_result)) != sizeof(struct bench_result))
+		_exit(EXIT_FAILURE);
+}
+
+/* The parent keeps the last result sent, so that it knows which stage failed */
+static void end_stage(int fd, struct bench_result *r, double *t)
+{
+	double t2;
+
+	t2 = now();
+	r->time[r->stage] = t2 - *t;
+	r->peak_kb[r->stage] = peak_kb();
+	r->stage++;
+	send_result(fd, r);
+	*t = t2;
+}
+
+static void run_child(int fd, struct flow_settings *settings, struct bench_result *r)
+{
+	struct flow_sc sc;
+	struct netlist_instance *inst;
+	struct netlist_net *net;
+	double t;
+
+	t = now();
+	flow_parse(&sc, settings);
+	end_stage(fd, r, &t);
+	flow_metamap(&sc);
+	end_stage(fd, r, &t);
+	flow_prune(&sc);
+	end_stage(fd, r, &t);
+	flow_write(&sc);
+	end_stage(fd, r, &t);
+
+	r->instances = 0;
+	for(inst=sc.netlist->ihead;inst!=NULL;inst=inst->next)
+		r->instances++;
+	r->nets = 0;
+	for(net=sc.netlist->nhead;net!=NULL;net=net->next)
+		r->nets++;
+	flow_free(&sc);
+	r->status = BENCH_OK;
+	send_result(fd, r);
+}
+
+/* The flow exits on errors and leaks on purpose, hence one process per run,
+ * which also gives each run its own peak memory.
+ */
+static int run_once(struct flow_settings *settings, int time_limit, struct bench_result *r)
+{
+	int fds[2];
+	pid_t pid;
+	int status;
+	struct bench_result r2;
+
+	if(pipe(fds) == -1) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	fflush(NULL);
+	pid = fork();
+	if(pid == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	memset(r, 0, sizeof(struct bench_result));
+	r->status = BENCH_FAILED;
+	if(pid == 0) {
+		close(fds[0]);
+		alarm(time_limit);
+		run_child(fds[1], settings, r);
+		_exit(EXIT_SUCCESS);
+	}
+	close(fds[1]);
+	while(read(fds[0], &r2, sizeof(struct bench_result)) == sizeof(struct bench_result))
+		*r = r2;
+	close(fds[0]);
+	waitpid(pid, &status, 0);
+	if(!WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS) || (r->status != BENCH_OK)) {
+		if(WIFSIGNALED(status) && (WTERMSIG(status) == SIGALRM))
+			r->status = BENCH_TIMEOUT;
+		else
+			r->status = BENCH_FAILED;
+		/* Failing after the last stage is counted against it */
+		if(r->stage == BENCH_STAGE_COUNT)
+			r->stage--;
+	}
+	return r->status == BENCH_OK;
+}
+
+void bench_run(struct flow_settings *settings, const char *lhd, const char *edf, int runs, int time_limit, struct bench_result *r)
+{
+	struct flow_settings s;
+	struct bench_result r2;
+	int i, j;
+
+	s = *settings;
+	s.input_lhd = (char *)lhd;
+	s.output_anl = NULL;
+	s.output_edf = (char *)edf;
+	s.output_dot = NULL;
+	s.output_sym = NULL;
+
+	if(!run_once(&s, time_limit, r))
+		return;
+	for(i=1;i<runs;i++) {
+		if(!run_once(&s, time_limit, &r2)) {
+			*r = r2;
+			return;
+		}
+		for(j=0;j<BENCH_STAGE_COUNT;j++) {
+			if(r2.time[j] < r->time[j])
+				r->time[j] = r2.time[j];
+			if(r2.peak_kb[j] > r->peak_kb[j])
+				r->peak_kb[j] = r2.peak_kb[j];
+		}
+	}
+}
+
+void bench_report_begin(struct bench_report *report, FILE *fd, int format)
+{
+	int i;
+
+	report->fd = fd;
+	report->format = format;
+	report->count = 0;
+	if(format == BENCH_FORMAT_CSV) {
+		fprintf(fd, "generator,size,seed,status,failed_stage");
+		for(i=0;i<BENCH_STAGE_COUNT;i++)
+			fprintf(fd, ",%s_time,%s_peak_kb", bench_stage_names[i], bench_stage_names[i]);
+		fprintf(fd, ",instances,nets\n");
+	} else
+		fprintf(fd, "[");
+}
+
+void bench_report_add(struct bench_report *report, const char *generator, int size, unsigned int seed, struct bench_result *r)
+{
+	FILE *fd = report->fd;
+	int i;
+
+	if(report->format == BENCH_FORMAT_CSV) {
+		fprintf(fd, "%s,%d,%u,%s,%s", generator, size, seed, bench_status_names[r->status],
+			r->status != BENCH_OK ? bench_stage_names[r->stage] : "");
+		for(i=0;i<BENCH_STAGE_COUNT;i++)
+			fprintf(fd, ",%.6f,%ld", r->time[i], r->peak_kb[i]);
+		fprintf(fd, ",%d,%d\n", r->instances, r->nets);
+	} else {
+		fprintf(fd, "%s\n\t{\"generator\": \"%s\", \"size\": %d, \"seed\": %u, \"status\": \"%s\",\n",
+			report->count > 0 ? "," : "", generator, size, seed, bench_status_names[r->status]);
+		if(r->status != BENCH_OK)
+			fprintf(fd, "\t\"failed_stage\": \"%s\",\n", bench_stage_names[r->stage]);
+		fprintf(fd, "\t\"stages\": {");
+		for(i=0;i<BENCH_STAGE_COUNT;i++)
+			fprintf(fd, "%s\"%s\": {\"time\": %.6f, \"peak_kb\": %ld}", i > 0 ? ", " : "",
+				bench_stage_names[i], r->time[i], r->peak_kb[i]);
+		fprintf(fd, "},\n\t\"instances\": %d, \"nets\": %d}", r->instances, r->nets);
+	}
+	fflush(fd);
+	report->count++;
+}
+
+void bench_report_end(struct bench_report *report)
+{
+	if(report->format == BENCH_FORMAT_JSON)
+		fprintf(report->fd, "\n]\n");
+}
@@ -0,0 +1,56 @@
+#ifndef __HARNESS_H
+#define __HARNESS_H
+
+#include <stdio.h>
+
+#include "flow.h"
+
+enum {
+	BENCH_STAGE_PARSE,
+	BENCH_STAGE_METAMAP,
+	BENCH_STAGE_PRUNE,
+	BENCH_STAGE_WRITE,
+	BENCH_STAGE_COUNT
+};
+
+extern const char *bench_stage_names[];
+
+enum {
+	BENCH_OK,
+	BENCH_FAILED,
+	BENCH_TIMEOUT
+};
+
+extern const char *bench_status_names[];
+
+struct bench_result {
+	int status;
+	int stage;				/* < stage that failed or timed out, BENCH_STAGE_COUNT if none */
+	double time[BENCH_STAGE_COUNT];		/* < seconds, best of the runs */
+	long int peak_kb[BENCH_STAGE_COUNT];	/* < peak resident memory at the end of the stage */
+	int instances;
+	int nets;
+};
+
+/* Runs the flow on the given .lhd file in a child process, writing the EDIF netlist to edf.
+ * Each run is killed after time_limit seconds, if not 0.
+ * When a run fails, the stages it completed are kept in the result.
+ */
+void bench_run(struct flow_settings *settings, const char *lhd, const char *edf, int runs, int time_limit, struct bench_result *r);
+
+enum {
+	BENCH_FORMAT_CSV,
+	BENCH_FORMAT_JSON
+};
+
+struct bench_report {
+	FILE *fd;
+	int format;
+	int count;
+};
+
+void bench_report_begin(struct bench_report *report, FILE *fd, int format);
+void bench_report_add(struct bench_report *report, const char *generator, int size, unsigned int seed, struct bench_result *r);
+void bench_report_end(struct bench_report *report);
+
+#endif /* __HARNESS_H */
@@ -0,0 +1,274 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <util.h>
+
+#include <banner/banner.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/interchange.h>
+#include <tilm/tilm.h>
+
+#include "flow.h"
+#include "options.h"
+#include "generators.h"
+#include "harness.h"
+
+static void list_generators()
+{
+	int i;
+
+	for(i=0;bench_generators[i].handle!=NULL;i++)
+		printf("     %s: %s\n", bench_generators[i].handle, bench_generators[i].description);
+}
+
+static void help()
+{
+	banner("Benchmark suite");
+	printf("Usage: llhdl-bench [parameters]\n\n");
+	printf("Generates parametric designs and records the time and peak memory of each stage\n");
+	printf("of the Spartan-6 mapping flow (parse, metamap, prune, write) over size sweeps.\n");
+	printf("Parameters are:\n");
+	printf("  -h Display this help text and exit.\n");
+	printf("  -g <generator,...>: Run only these generators (default: all). Supported values are:\n");
+	list_generators();
+	printf("  -s <size,...>: Sizes to sweep (default: per generator).\n");
+	printf("  -r <n>: Run each design n times and keep the best times (default: 1).\n");
+	printf("  -t <seconds>: Stop each run after that time (default: no limit).\n");
+	printf("  -S <seed>: Seed of the random generators (default: 1).\n");
+	printf("  -b <bias>: Fanout bias of the random DAGs, from 0 (uniform) to 1 (preferential).\n");
+	printf("  -F <csv|json>: Select the output format (default: csv).\n");
+	printf("  -o <output>: Write the results to this file (default: standard output).\n");
+	printf("  -d <dir>: Keep the generated designs and netlists in this directory.\n");
+	printf("  -f <[no-]option>: Enable or disable mapper options. Supported options are:\n");
+	flow_list_options();
+	printf("  -l <algo>: Select LUT mapping algorithm. Supported values are:\n");
+	flow_list_lutmappers();
+	printf("  -i <n>: Use at most that many LUT inputs (3-6, default: %d)\n", flow_settings.lut_max_inputs);
+}
+
+static int *parse_sizes(char *str)
+{
+	int *sizes;
+	int n;
+	char *s, *saveptr;
+
+	sizes = alloc_size((strlen(str)/2+2)*sizeof(int));
+	n = 0;
+	for(s=strtok_r(str, ",", &saveptr);s!=NULL;s=strtok_r(NULL, ",", &saveptr)) {
+		sizes[n] = atoi(s);
+		if(sizes[n] <= 0) {
+			fprintf(stderr, "Invalid size: %s\n", s);
+			exit(EXIT_FAILURE);
+		}
+		n++;
+	}
+	sizes[n] = 0;
+	return sizes;
+}
+
+static void run_generator(struct bench_generator *g, const int *sizes, struct bench_params *params,
+	const char *dir, int keep, int runs, int time_limit, struct bench_report *report)
+{
+	struct llhdl_module *m;
+	struct bench_result r;
+	char *lhd, *edf;
+	int i;
+
+	for(i=0;sizes[i]!=0;i++) {
+		if(asprintf(&lhd, "%s/%s%d.lhd", dir, g->handle, sizes[i]) == -1)
+			abort();
+		if(asprintf(&edf, "%s/%s%d.edf", dir, g->handle, sizes[i]) == -1)
+			abort();
+		m = g->generate(sizes[i], params);
+		llhdl_write_file(m, lhd);
+		llhdl_free_module(m);
+
+		bench_run(&flow_settings, lhd, edf, runs, time_limit, &r);
+		bench_report_add(report, g->handle, sizes[i], params->seed, &r);
+		if(r.status == BENCH_OK)
+			fprintf(stderr, "%s %d: %.3fs, %ldkB\n", g->handle, sizes[i],
+				r.time[BENCH_STAGE_PARSE] + r.time[BENCH_STAGE_METAMAP]
+				+ r.time[BENCH_STAGE_PRUNE] + r.time[BENCH_STAGE_WRITE],
+				r.peak_kb[BENCH_STAGE_WRITE]);
+		else
+			fprintf(stderr, "%s %d: %s in %s\n", g->handle, sizes[i], bench_status_names[r.status],
+				bench_stage_names[r.stage]);
+
+		if(!keep) {
+			unlink(lhd);
+			unlink(edf);
+		}
+		free(lhd);
+		free(edf);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *generators;
+	int *sizes;
+	int runs;
+	int time_limit;
+	int format;
+	char *output;
+	char *keep_dir;
+	char tmp_dir[] = "/tmp/llhdl-bench-XXXXXX";
+	const char *dir;
+	struct bench_params params;
+	struct bench_generator *g;
+	struct bench_report report;
+	FILE *fd;
+	struct stat st;
+	char *s, *saveptr;
+	int i;
+
+	generators = NULL;
+	sizes = NULL;
+	runs = 1;
+	time_limit = 0;
+	format = BENCH_FORMAT_CSV;
+	output = NULL;
+	keep_dir = NULL;
+	params.seed = 1;
+	params.fanout_bias = 0.5;
+	while((opt = getopt(argc, argv, "hg:s:r:t:S:b:F:o:d:f:l:i:")) != -1) {
+		switch(opt) {
+			case 'h':
+				help();
+				exit(EXIT_SUCCESS);
+				break;
+			case 'g':
+				generators = optarg;
+				break;
+			case 's':
+				free(sizes);
+				sizes = parse_sizes(optarg);
+				break;
+			case 'r':
+				runs = atoi(optarg);
+				if(runs < 1) {
+					fprintf(stderr, "Invalid number of runs.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 't':
+				time_limit = atoi(optarg);
+				if(time_limit < 0) {
+					fprintf(stderr, "Invalid time limit.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'S':
+				params.seed = strtoul(optarg, NULL, 0);
+				break;
+			case 'b':
+				params.fanout_bias = atof(optarg);
+				if((params.fanout_bias < 0.0) || (params.fanout_bias > 1.0)) {
+					fprintf(stderr, "The fanout bias must be between 0 and 1.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'F':
+				if(strcmp(optarg, "csv") == 0)
+					format = BENCH_FORMAT_CSV;
+				else if(strcmp(optarg, "json") == 0)
+					format = BENCH_FORMAT_JSON;
+				else {
+					fprintf(stderr, "Unknown output format: %s\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			case 'd':
+				keep_dir = optarg;
+				break;
+			case 'f':
+				flow_handle_option(optarg);
+				break;
+			case 'l':
+				flow_settings.lut_mapper = tilm_get_mapper_by_handle(optarg);
+				if(flow_settings.lut_mapper < 0) {
+					fprintf(stderr, "Unknown LUT mapping algorithm: %s. Use -h to list supported algorithms.\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'i':
+				flow_settings.lut_max_inputs = atoi(optarg);
+				if((flow_settings.lut_max_inputs < 3) || (flow_settings.lut_max_inputs > 6)) {
+					fprintf(stderr, "Invalid number of maximum LUT inputs.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			default:
+				fprintf(stderr, "Invalid option passed. Use -h for help.\n");
+				exit(EXIT_FAILURE);
+				break;
+		}
+	}
+	if(optind != argc) {
+		fprintf(stderr, "llhdl-bench: too many arguments. Use -h for help.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if(keep_dir != NULL) {
+		/* Check the directory once, rather than failing in the middle of a sweep */
+		if((mkdir(keep_dir, 0777) == -1) && (errno != EEXIST)) {
+			perror(keep_dir);
+			exit(EXIT_FAILURE);
+		}
+		if((stat(keep_dir, &st) == -1) || !S_ISDIR(st.st_mode) || (access(keep_dir, W_OK) == -1)) {
+			fprintf(stderr, "Cannot write designs to %s\n", keep_dir);
+			exit(EXIT_FAILURE);
+		}
+		dir = keep_dir;
+	} else {
+		dir = mkdtemp(tmp_dir);
+		if(dir == NULL) {
+			perror("mkdtemp");
+			exit(EXIT_FAILURE);
+		}
+	}
+	if(output != NULL) {
+		fd = fopen(output, "w");
+		if(fd == NULL) {
+			perror("fopen");
+			exit(EXIT_FAILURE);
+		}
+	} else
+		fd = stdout;
+
+	bench_report_begin(&report, fd, format);
+	if(generators == NULL) {
+		for(i=0;bench_generators[i].handle!=NULL;i++) {
+			g = &bench_generators[i];
+			run_generator(g, sizes != NULL ? sizes : g->default_sizes, &params,
+				dir, keep_dir != NULL, runs, time_limit, &report);
+		}
+	} else {
+		for(s=strtok_r(generators, ",", &saveptr);s!=NULL;s=strtok_r(NULL, ",", &saveptr)) {
+			g = bench_get_generator(s);
+			if(g == NULL) {
+				fprintf(stderr, "Unknown generator: %s. Use -h to list supported generators.\n", s);
+				exit(EXIT_FAILURE);
+			}
+			run_generator(g, sizes != NULL ? sizes : g->default_sizes, &params,
+				dir, keep_dir != NULL, runs, time_limit, &report);
+		}
+	}
+	bench_report_end(&report);
+
+	if(fd != stdout)
+		fclose(fd);
+	if(keep_dir == NULL)
+		rmdir(dir);
+	free(sizes);
+
+	return 0;
+}
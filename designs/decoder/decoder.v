@@ -0,0 +1,43 @@
+module decoder(
+	input clk,
+	output reg led1,
+	output reg led2,
+	input btn1,
+	input btn2
+);
+
+reg [26:0] count;
+always @(posedge clk)
+	count <= count + 27'd1;
+
+/* debounce */
+reg btn1_r;
+reg [2:0] mode;
+always @(posedge clk) begin
+	if(count[20]) begin
+		btn1_r <= btn1;
+		if(btn1 & ~btn1_r)
+			mode <= mode + 3'd1;
+	end
+end
+
+always @(*) begin
+	case(mode)
+		3'd0: led1 = count[26];
+		3'd1, 3'd2: led1 = count[25];
+		3'd3: led1 = count[26] & count[23];
+		default: led1 = count[24];
+	endcase
+end
+
+/* the selector is too wide for a single mux */
+always @(*) begin
+	casez(count[26:16])
+		11'b1??????????: led2 = 1'b1;
+		11'b01?????????: led2 = btn2;
+		11'b001????????: led2 = count[15];
+		default: led2 = 1'b0;
+	endcase
+end
+
+endmodule
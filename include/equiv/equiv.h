@@ -0,0 +1,57 @@
+#ifndef __EQUIV_EQUIV_H
+#define __EQUIV_EQUIV_H
+
+#include <llhdl/structure.h>
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/symbol.h>
+
+/*
+ * Equivalence checking between a LLHDL module and a netlist mapped from it.
+ * Ports are matched by name, and registers through the names of the signals
+ * they drive in the symbol store, completed by comparing their traces in a
+ * simulation from reset. Registers start at 0 and all clocks are assumed
+ * to tick together.
+ */
+
+enum {
+	EQUIV_EQUIVALENT,
+	EQUIV_DIFFERENT,	/* < a mismatch was found by simulation */
+	EQUIV_UNDECIDED		/* < some points could not be proven */
+};
+
+enum {
+	EQUIV_POINT_OUTPUT,
+	EQUIV_POINT_REGISTER
+};
+
+struct equiv_failure {
+	int type;
+	char *name;
+	int status;	/* < EQUIV_DIFFERENT or EQUIV_UNDECIDED */
+	int cycle;	/* < cycle of the mismatch, if different */
+	struct equiv_failure *next;
+};
+
+struct equiv_result {
+	int status;
+	int inputs;
+	int outputs;
+	int registers_ref;
+	int registers_impl;
+	int register_pairs;
+	int and_nodes;
+	int merged;
+	int sat_calls;
+	struct equiv_failure *failures;
+};
+
+/* Check <m>, which must be flat, against <netlist>. The symbols must hold pointers to the nets in their user field,
+ * which is the case when the netlist has been mapped in the same process.
+ * <conflict_limit> bounds the effort of the SAT solver on each output or register.
+ */
+int equiv_check(struct llhdl_module *m, struct netlist_manager *netlist, struct netlist_sym_store *symbols,
+	long int conflict_limit, struct equiv_result *r);
+void equiv_free_result(struct equiv_result *r);
+
+#endif /* __EQUIV_EQUIV_H */
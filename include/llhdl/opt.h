@@ -0,0 +1,36 @@
+#ifndef __LLHDL_OPT_H
+#define __LLHDL_OPT_H
+
+#include <llhdl/structure.h>
+
+enum {
+	LLHDL_OPT_FOLD = 0,
+	LLHDL_OPT_SIMPLIFY,
+	LLHDL_OPT_MUX,
+	LLHDL_OPT_NARROW,
+	LLHDL_OPT_CSE,
+	LLHDL_OPT_DEAD,
+	LLHDL_OPT_COUNT /* must be last */
+};
+
+#define LLHDL_OPT_ALL ((1 << LLHDL_OPT_COUNT) - 1)
+
+/* Optimization pass. Returns the number of changes made to the module. */
+typedef int (*llhdl_opt_c)(struct llhdl_module *m);
+
+struct llhdl_opt_desc {
+	const char *handle;
+	const char *description;
+	llhdl_opt_c run;
+};
+
+extern struct llhdl_opt_desc llhdl_opt_passes[];
+
+int llhdl_opt_get_pass_by_handle(const char *handle);
+
+/* Run the passes selected by the bitmask <passes> until no further changes are made.
+ * Returns the total number of changes.
+ */
+int llhdl_optimize(struct llhdl_module *m, unsigned int passes);
+
+#endif /* __LLHDL_OPT_H */
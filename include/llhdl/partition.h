@@ -0,0 +1,23 @@
+#ifndef __LLHDL_PARTITION_H
+#define __LLHDL_PARTITION_H
+
+#include <llhdl/structure.h>
+
+/* Moves the signals of the top-level module <m> into at most <k> new definitions
+ * of similar size, instantiated by <m>, cutting as few signal bits as possible.
+ * Signals that are ports of <m> or that are read by several partitions stay in <m>,
+ * connected to output ports of the definitions. Expressions that are too large
+ * to balance the partitions are first split into new internal signals.
+ * The new definitions are appended to the definitions of <m>.
+ * Returns the first one, or NULL if there was nothing to partition.
+ */
+struct llhdl_module *llhdl_partition(struct llhdl_module *m, int k);
+
+/* Moves each cone of <m> into a new definition, the same way. A cone is a signal
+ * with a source, together with the internal signals that only it reads, recursively.
+ * Unlike the partitions above, the cones of a design do not depend on its size,
+ * so that an edit leaves the cones it does not touch unchanged.
+ */
+struct llhdl_module *llhdl_partition_cones(struct llhdl_module *m);
+
+#endif /* __LLHDL_PARTITION_H */
@@ -0,0 +1,12 @@
+#ifndef __LLHDL_RETIME_H
+#define __LLHDL_RETIME_H
+
+#include <llhdl/structure.h>
+
+/* Move the registers of the main clock domain to minimize the estimated clock period.
+ * Returns the new period, and the original one in <period_before> if not NULL.
+ * Both are -1 if the module contains no register.
+ */
+int llhdl_retime(struct llhdl_module *m, int *period_before);
+
+#endif /* __LLHDL_RETIME_H */
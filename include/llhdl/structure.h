@@ -1,15 +1,26 @@
 #ifndef __LLHDL_STRUCTURE_H
 #define __LLHDL_STRUCTURE_H
 
+#include <stdint.h>
 #include <gmp.h>
 
 struct llhdl_node;
 struct llhdl_module;
+struct llhdl_instance;
+
+/* Constants of up to LLHDL_CONSTANT_INLINE_BITS bits are stored in the node,
+ * wider ones in a GMP integer. Use the accessors of tools.h to read them.
+ */
+#define LLHDL_CONSTANT_INLINE_BITS 64
+#define LLHDL_CONSTANT_INLINE(n) ((n)->p.constant.vectorsize <= LLHDL_CONSTANT_INLINE_BITS)
 
 struct llhdl_node_constant {
 	int sign;
 	int vectorsize;
-	mpz_t value;
+	union {
+		uint64_t bits; /* < inline, reduced to vectorsize bits */
+		mpz_t big;
+	} v;
 };
 
 enum {
@@ -23,6 +34,7 @@ struct llhdl_node_signal {
 	int sign;
 	int vectorsize;
 	struct llhdl_node *source;
+	struct llhdl_instance *driver; /* < instance driving this signal through an output port */
 	struct llhdl_node *next;
 	int is_clock;
 	char name[];
@@ -81,6 +93,7 @@ enum {
 
 struct llhdl_node {
 	int type;
+	unsigned int mark; /* < epoch of the last traversal that visited this node, see tools.h */
 	void *user;
 	union {
 		struct llhdl_node_constant constant;
@@ -92,9 +105,30 @@ struct llhdl_node {
 	} p;
 };
 
+struct llhdl_connection {
+	struct llhdl_node *port; /* < port signal of the definition */
+	struct llhdl_node *signal; /* < signal of the instantiating module */
+};
+
+struct llhdl_instance {
+	struct llhdl_module *definition;
+	struct llhdl_instance *next;
+	int nconnections;
+	struct llhdl_connection *connections;
+	char name[];
+};
+
+/*
+ * A design is a top-level module, which owns the definitions of the modules
+ * instantiated in the design. Definitions can instantiate the definitions
+ * that precede them in the list.
+ */
 struct llhdl_module {
 	char *name;
 	struct llhdl_node *head;
+	struct llhdl_instance *ihead;
+	struct llhdl_module *dhead; /* < definitions, top-level module only */
+	struct llhdl_module *next; /* < next definition */
 };
 
 int llhdl_get_logic_arity(int op);
@@ -102,8 +136,11 @@ int llhdl_get_logic_arity(int op);
 struct llhdl_module *llhdl_new_module();
 void llhdl_free_module(struct llhdl_module *m);
 void llhdl_set_module_name(struct llhdl_module *m, const char *name);
+void llhdl_add_definition(struct llhdl_module *top, struct llhdl_module *d);
+struct llhdl_module *llhdl_find_definition(struct llhdl_module *top, const char *name);
 
 struct llhdl_node *llhdl_create_constant(mpz_t value, int sign, int vectorsize);
+struct llhdl_node *llhdl_create_constant_ui(uint64_t value, int sign, int vectorsize);
 struct llhdl_node *llhdl_create_signal(struct llhdl_module *m, int type, const char *name, int sign, int vectorsize);
 struct llhdl_node *llhdl_create_logic(int op, struct llhdl_node **operands);
 struct llhdl_node *llhdl_create_mux(int nsources, struct llhdl_node *select, struct llhdl_node **sources);
@@ -114,4 +151,9 @@ void llhdl_free_signal(struct llhdl_node *n);
 
 struct llhdl_node *llhdl_find_signal(struct llhdl_module *m, const char *name);
 
+struct llhdl_instance *llhdl_create_instance(struct llhdl_module *m, struct llhdl_module *definition, const char *name);
+void llhdl_connect(struct llhdl_instance *inst, struct llhdl_node *port, struct llhdl_node *signal);
+struct llhdl_node *llhdl_find_connection(struct llhdl_instance *inst, struct llhdl_node *port);
+void llhdl_free_instance(struct llhdl_instance *inst);
+
 #endif /* __LLHDL_STRUCTURE_H */
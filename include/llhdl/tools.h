@@ -12,10 +12,103 @@ int llhdl_equiv(struct llhdl_node *a, struct llhdl_node *b);
 int llhdl_get_sign(struct llhdl_node *n);
 int llhdl_get_vectorsize(struct llhdl_node *n);
 
+/*
+ * Vector sizes and signs recorded for the nodes they were computed on,
+ * so that querying each node of a deep expression stays linear overall.
+ * The recorded values remain valid only while the recorded nodes
+ * and their operands are neither modified nor freed.
+ */
+struct llhdl_size_entry {
+	struct llhdl_node *n;
+	int vectorsize;
+	int sign;
+};
+
+struct llhdl_size_cache {
+	unsigned int mask;
+	unsigned int count;
+	struct llhdl_size_entry *entries;
+};
+
+void llhdl_size_cache_init(struct llhdl_size_cache *c);
+void llhdl_size_cache_free(struct llhdl_size_cache *c);
+int llhdl_get_sign_cached(struct llhdl_size_cache *c, struct llhdl_node *n);
+int llhdl_get_vectorsize_cached(struct llhdl_size_cache *c, struct llhdl_node *n);
+
+/* Integer value of a constant, with its bits interpreted according to its sign */
+void llhdl_get_constant_value(mpz_t r, struct llhdl_node *n);
+/* Bits of a constant as an unsigned integer */
+void llhdl_get_constant_bits(mpz_t r, struct llhdl_node *n);
+/* Bit <bit> of a constant, which must be lower than its vector size */
+int llhdl_get_constant_bit(struct llhdl_node *n, int bit);
+/* Low 64 bits of a constant */
+uint64_t llhdl_get_constant_ui(struct llhdl_node *n);
+
+/*
+ * Depth-first traversal of expressions, with an explicit stack.
+ * Each traversal takes a new epoch, stored in the nodes it visits, so that a node
+ * reachable through several paths is visited only once.
+ * By default, signals are leaves and are visited at each reference.
+ * With LLHDL_TRAVERSE_SIGNALS, the traversal continues into the sources of the signals
+ * and visits each signal once; a post-order traversal then gives topological order.
+ */
+enum {
+	LLHDL_ORDER_PRE,	/* < nodes before their operands */
+	LLHDL_ORDER_POST	/* < nodes after their operands */
+};
+
+#define LLHDL_TRAVERSE_SIGNALS	1
+
+#define LLHDL_TRAVERSAL_LOCAL	16
+
+struct llhdl_frame {
+	struct llhdl_node **slot;
+	int next;		/* < next operand to visit, negative before the visit or after a skip */
+};
+
+struct llhdl_traversal {
+	int order;
+	int flags;
+	unsigned int epoch;
+	int current;		/* < frame of the last returned node */
+	int depth;
+	int size;
+	struct llhdl_frame *stack;
+	struct llhdl_frame local[LLHDL_TRAVERSAL_LOCAL]; /* < avoids allocations for small expressions */
+};
+
+unsigned int llhdl_new_epoch();
+/* Slot of operand <i> of <n>, or NULL past the last one. Signals have no operands. */
+struct llhdl_node **llhdl_get_operand(struct llhdl_node *n, int i);
+
+void llhdl_traversal_init(struct llhdl_traversal *t, int order, int flags);
+/* Adds a root. Pending roots and operands are visited last in, first out. */
+void llhdl_traversal_push(struct llhdl_traversal *t, struct llhdl_node **slot);
+/* Returns the slot of the next node, or NULL at the end.
+ * In pre-order, the node may be replaced through the slot: the operands
+ * are taken from the slot when the traversal resumes.
+ */
+struct llhdl_node **llhdl_traversal_next(struct llhdl_traversal *t);
+/* Pre-order only: do not visit the operands of the last returned node */
+void llhdl_traversal_skip(struct llhdl_traversal *t);
+/* Pre-order only: number of ancestors of the last returned node, if a single root was pushed */
+int llhdl_traversal_level(struct llhdl_traversal *t);
+void llhdl_traversal_free(struct llhdl_traversal *t);
+
+/* Signals of <m> in topological order (sources before readers), terminated by NULL.
+ * Registers are followed like the other nodes, cycles are broken arbitrarily.
+ */
+struct llhdl_node **llhdl_sort_signals(struct llhdl_module *m);
+
 typedef int (*llhdl_walk_c)(struct llhdl_node **n, void *user);
 int llhdl_walk(llhdl_walk_c walk_c, void *user, struct llhdl_node **n);
 int llhdl_walk_module(llhdl_walk_c walk_c, void *user, struct llhdl_module *m);
 
+/* Replaces the instances by the contents of their definitions, prefixing the signal names
+ * with the instance names ("inst/signal"). The definitions are freed.
+ */
+void llhdl_flatten(struct llhdl_module *m);
+
 void llhdl_clear_clocks(struct llhdl_module *m);
 void llhdl_identify_clocks(struct llhdl_module *m);
 void llhdl_mark_clock(struct llhdl_node *n, int c);
@@ -2,6 +2,7 @@
 #define __MAPKIT_MAPKIT_H
 
 #include <llhdl/structure.h>
+#include <llhdl/tools.h>
 
 /* Process callback. Called on every node in attempt to map them. */
 typedef void (*mapkit_process_c)(struct llhdl_node **n, void *user);
@@ -19,7 +20,7 @@ struct mapkit_process_desc {
 struct mapkit_result {
 	int ninput_nodes;
 	struct llhdl_node ***input_nodes;
-	void **input_nets;
+	void **input_nets;	/* < NULL for the bits that are not read */
 	void **output_nets;
 };
 
@@ -46,6 +47,7 @@ struct mapkit_sc {
 	mapkit_signal_c signal_c;
 	mapkit_join_c join_c;
 	void *user;
+	struct llhdl_size_cache sizes;	/* < mapping never frees nodes nor changes their sizes */
 };
 
 #define MAPKIT_CALL_CONSTANT(_sc, v) ((_sc)->constant_c(v, (_sc)->user))
@@ -56,6 +58,10 @@ struct mapkit_sc *mapkit_new(struct llhdl_module *module, mapkit_constant_c cons
 void mapkit_register_process(struct mapkit_sc *sc, mapkit_process_c process_c, mapkit_free_c free_c, void *user);
 void mapkit_free(struct mapkit_sc *sc);
 
+/* Vector size and sign of a node of the module being mapped */
+int mapkit_get_vectorsize(struct mapkit_sc *sc, struct llhdl_node *n);
+int mapkit_get_sign(struct mapkit_sc *sc, struct llhdl_node *n);
+
 struct mapkit_result *mapkit_create_result(int ninput_nodes, int ninput_nets, int noutput_nets);
 void mapkit_free_result(struct mapkit_result *r);
 void *mapkit_find_input_net(struct mapkit_result *r, struct llhdl_node *n, int bit);
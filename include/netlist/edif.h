@@ -2,6 +2,8 @@
 #define __NETLIST_EDIF_H
 
 #include <netlist/manager.h>
+#include <netlist/io.h>
+#include <netlist/symbol.h>
 
 enum {
 	EDIF_FLAVOR_VANILLA,
@@ -17,6 +19,23 @@ struct edif_param {
 };
 
 void netlist_m_edif_fd(struct netlist_manager *m, FILE *fd, struct edif_param *param);
+/* The output is compressed with gzip if <filename> ends with ".gz" */
 void netlist_m_edif_file(struct netlist_manager *m, const char *filename, struct edif_param *param);
 
+struct edif_read_param {
+	struct netlist_primitive *primitives;	/* < leaf cells, matched by name */
+	int nprimitives;
+	struct netlist_iop_manager *iops;	/* < for the top-level ports */
+	struct netlist_sym_store *symbols;	/* < can be NULL */
+};
+
+/* Reads the design of an EDIF 2.0.0 netlist into <m>, flattening its hierarchy.
+ * Top-level ports become I/O primitives, with elements of arrays named "name_i".
+ * Instance properties set the attributes that the primitives have, others are ignored.
+ * Nets ('N') and instances ('I') are added to the symbol store with their
+ * hierarchical names ("instance/name").
+ * The input is decompressed if <filename> ends with ".gz".
+ */
+void netlist_m_edif_read_file(struct netlist_manager *m, const char *filename, struct edif_read_param *param);
+
 #endif /* __NETLIST_EDIF_H */
@@ -23,7 +23,7 @@ struct netlist_instance {
 	unsigned int uid;		/* < unique identifier */
 	int dont_touch;			/* < do not prune */
 	struct netlist_primitive *p;	/* < what primitive we are an instance of */
-	char **attributes;		/* < attributes of this instance */
+	char **attributes;		/* < attributes of this instance (interned, do not modify) */
 	struct netlist_instance *next;	/* < next instance in this manager */
 };
 
@@ -37,6 +37,7 @@ struct netlist_branch {
 struct netlist_net {
 	unsigned int uid;		/* < unique identifier */
 	struct netlist_branch *head;	/* < first branch on this net */
+	struct netlist_branch *tail;	/* < last branch on this net, if there is a first one */
 	struct netlist_net *joined;	/* < redirect if this net has been joined, NULL otherwise */
 	struct netlist_net *next;	/* < next net in this manager */
 };
@@ -5,14 +5,23 @@
 
 struct netlist_sym {
 	struct netlist_sym *next;
+	struct netlist_sym *name_next;	/* < next symbol in the same bucket of the name index */
+	struct netlist_sym *uid_next;	/* < next symbol in the same bucket of the uid index */
 	void *user;
 	unsigned int uid;
 	char type;
 	char name[];
 };
 
+/* Symbols are listed from the last added, and indexed by name and by uid.
+ * Lookups return the last added symbol that matches.
+ */
 struct netlist_sym_store {
 	struct netlist_sym *head;
+	unsigned int count;
+	unsigned int mask;		/* < number of buckets - 1 */
+	struct netlist_sym **names;
+	struct netlist_sym **uids;
 };
 
 struct netlist_sym_store *netlist_sym_newstore();
@@ -0,0 +1,42 @@
+#ifndef __SIM_BLAST_H
+#define __SIM_BLAST_H
+
+#include <llhdl/structure.h>
+
+/*
+ * Bit-level compilation of a flat LLHDL module, shared by the simulator
+ * and the equivalence checker.
+ * Bits are integers chosen by the client, 0 and 1 being the constants.
+ * Gates with a constant operand or two identical operands are folded,
+ * the others are created through the client callbacks.
+ */
+
+#define BLAST_ZERO	0
+#define BLAST_ONE	1
+
+enum {
+	BLAST_NOT,
+	BLAST_AND,
+	BLAST_OR,
+	BLAST_XOR,
+	BLAST_MUX	/* < c ? b : a */
+};
+
+struct blast_ops {
+	/* One bit of an input port */
+	int (*input)(void *user, struct llhdl_node *signal, int bit);
+	int (*gate)(void *user, int op, int a, int b, int c);
+	/* Fills the state bits of a register and returns a handle for it.
+	 * <signal> is the signal the register drives directly, or NULL.
+	 */
+	void *(*fd)(void *user, struct llhdl_node *fd, struct llhdl_node *signal, int vectorsize, int *state);
+	/* Next state of a register, once all signals are compiled */
+	void (*next_state)(void *user, void *handle, struct llhdl_node *fd, int vectorsize, int *next_state);
+};
+
+/* Leaves an array with the bits of each signal in its user field.
+ * The caller frees these arrays and clears the user fields.
+ */
+void blast_module(struct llhdl_module *m, struct blast_ops *ops, void *user);
+
+#endif /* __SIM_BLAST_H */
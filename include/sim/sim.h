@@ -0,0 +1,53 @@
+#ifndef __SIM_SIM_H
+#define __SIM_SIM_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+#include <llhdl/structure.h>
+
+/*
+ * Compiled cycle simulator.
+ * Each bit of the design is held in a 64-bit word, so that 64 independent
+ * test vectors (lanes) are simulated at once.
+ */
+
+#define SIM_LANES 64
+
+typedef uint64_t sim_word;
+
+struct sim_sc;
+
+struct sim_signal {
+	struct llhdl_node *signal;
+	int vectorsize;
+	int *slots;
+	struct sim_signal *next;
+};
+
+/* Compile the module, which must be flat.
+ * The module must not be modified while the simulator exists.
+ */
+struct sim_sc *sim_new(struct llhdl_module *m);
+void sim_free(struct sim_sc *sc);
+
+struct sim_signal *sim_get_signals(struct sim_sc *sc);
+struct sim_signal *sim_find_signal(struct sim_sc *sc, const char *name);
+int sim_get_instruction_count(struct sim_sc *sc);
+
+/* Access to one bit of a signal, in all lanes */
+void sim_set(struct sim_sc *sc, struct sim_signal *s, int bit, sim_word v);
+sim_word sim_get(struct sim_sc *sc, struct sim_signal *s, int bit);
+
+/* Access to the value of a signal in one lane (two's complement, unsigned) */
+void sim_set_lane(struct sim_sc *sc, struct sim_signal *s, int lane, mpz_t v);
+void sim_get_lane(struct sim_sc *sc, struct sim_signal *s, int lane, mpz_t r);
+
+/* Set all registers to 0 */
+void sim_reset(struct sim_sc *sc);
+/* Settle the combinational logic after the inputs have changed */
+void sim_eval(struct sim_sc *sc);
+/* Active edge of <clock>, or of all clocks if NULL. Call sim_eval() afterwards. */
+void sim_clock(struct sim_sc *sc, struct llhdl_node *clock);
+
+#endif /* __SIM_SIM_H */
@@ -0,0 +1,178 @@
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include "aig.h"
+
+static void *resize(void *p, size_t s)
+{
+	p = realloc(p, s);
+	if(p == NULL)
+		abort();
+	return p;
+}
+
+static unsigned int hash(aig_lit x, aig_lit y)
+{
+	return x*0x9e3779b1U ^ y*0x85ebca6bU;
+}
+
+static void rehash(struct aig *a, int hash_size)
+{
+	int i;
+	unsigned int h;
+
+	free(a->hash_table);
+	a->hash_size = hash_size;
+	a->hash_table = alloc_size(hash_size*sizeof(int));
+	memset(a->hash_table, 0, hash_size*sizeof(int));
+	for(i=1;i<a->nnodes;i++) {
+		if(a->fanin0[i] == AIG_INPUT)
+			continue;
+		h = hash(a->fanin0[i], a->fanin1[i]) & (hash_size - 1);
+		a->hash_next[i] = a->hash_table[h];
+		a->hash_table[h] = i;
+	}
+}
+
+struct aig *aig_new()
+{
+	struct aig *a;
+
+	a = alloc_type(struct aig);
+	a->size = 1024;
+	a->fanin0 = alloc_size(a->size*sizeof(aig_lit));
+	a->fanin1 = alloc_size(a->size*sizeof(aig_lit));
+	a->hash_next = alloc_size(a->size*sizeof(int));
+	a->nnodes = 1;
+	a->fanin0[0] = AIG_FALSE;
+	a->fanin1[0] = AIG_FALSE;
+	a->hash_next[0] = 0;
+	a->hash_table = NULL;
+	rehash(a, 1024);
+	return a;
+}
+
+void aig_free(struct aig *a)
+{
+	free(a->fanin0);
+	free(a->fanin1);
+	free(a->hash_next);
+	free(a->hash_table);
+	free(a);
+}
+
+static int new_node(struct aig *a, aig_lit fanin0, aig_lit fanin1)
+{
+	int n;
+
+	if(a->nnodes == a->size) {
+		a->size *= 2;
+		a->fanin0 = resize(a->fanin0, a->size*sizeof(aig_lit));
+		a->fanin1 = resize(a->fanin1, a->size*sizeof(aig_lit));
+		a->hash_next = resize(a->hash_next, a->size*sizeof(int));
+	}
+	n = a->nnodes++;
+	a->fanin0[n] = fanin0;
+	a->fanin1[n] = fanin1;
+	a->hash_next[n] = 0;
+	return n;
+}
+
+aig_lit aig_input(struct aig *a)
+{
+	return 2*new_node(a, AIG_INPUT, AIG_INPUT);
+}
+
+int aig_is_input(struct aig *a, int node)
+{
+	return a->fanin0[node] == AIG_INPUT;
+}
+
+aig_lit aig_and(struct aig *a, aig_lit x, aig_lit y)
+{
+	aig_lit t;
+	unsigned int h;
+	int n;
+
+	if(x > y) {
+		t = x;
+		x = y;
+		y = t;
+	}
+	if(x == AIG_FALSE) return AIG_FALSE;
+	if(x == AIG_TRUE) return y;
+	if(x == y) return x;
+	if(x == aig_not(y)) return AIG_FALSE;
+
+	h = hash(x, y) & (a->hash_size - 1);
+	for(n=a->hash_table[h];n!=0;n=a->hash_next[n])
+		if((a->fanin0[n] == x) && (a->fanin1[n] == y))
+			return 2*n;
+	n = new_node(a, x, y);
+	a->hash_next[n] = a->hash_table[h];
+	a->hash_table[h] = n;
+	if(a->nnodes > a->hash_size)
+		rehash(a, 2*a->hash_size);
+	return 2*n;
+}
+
+aig_lit aig_or(struct aig *a, aig_lit x, aig_lit y)
+{
+	return aig_not(aig_and(a, aig_not(x), aig_not(y)));
+}
+
+aig_lit aig_xor(struct aig *a, aig_lit x, aig_lit y)
+{
+	return aig_or(a, aig_and(a, x, aig_not(y)), aig_and(a, aig_not(x), y));
+}
+
+aig_lit aig_mux(struct aig *a, aig_lit s, aig_lit x0, aig_lit x1)
+{
+	if(x0 == x1) return x0;
+	if(s == AIG_FALSE) return x0;
+	if(s == AIG_TRUE) return x1;
+	if(x0 == aig_not(x1)) return aig_xor(a, s, x0);
+	return aig_or(a, aig_and(a, s, x1), aig_and(a, aig_not(s), x0));
+}
+
+void aig_simulate(struct aig *a, uint64_t *values, int words, int from)
+{
+	int i, w;
+	uint64_t *v, *v0, *v1;
+	uint64_t c0, c1;
+
+	if(from < 1)
+		from = 1;
+	memset(values, 0, words*sizeof(uint64_t));
+	for(i=from;i<a->nnodes;i++) {
+		if(a->fanin0[i] == AIG_INPUT)
+			continue;
+		v = &values[i*words];
+		v0 = &values[aig_node(a->fanin0[i])*words];
+		v1 = &values[aig_node(a->fanin1[i])*words];
+		c0 = aig_is_complement(a->fanin0[i]) ? ~(uint64_t)0 : 0;
+		c1 = aig_is_complement(a->fanin1[i]) ? ~(uint64_t)0 : 0;
+		for(w=0;w<words;w++)
+			v[w] = (v0[w] ^ c0) & (v1[w] ^ c1);
+	}
+}
+
+void aig_simulate_word(struct aig *a, uint64_t *values, int words, int word)
+{
+	int i;
+	uint64_t v0, v1;
+
+	values[word] = 0;
+	for(i=1;i<a->nnodes;i++) {
+		if(a->fanin0[i] == AIG_INPUT)
+			continue;
+		v0 = values[aig_node(a->fanin0[i])*words + word];
+		v1 = values[aig_node(a->fanin1[i])*words + word];
+		if(aig_is_complement(a->fanin0[i]))
+			v0 = ~v0;
+		if(aig_is_complement(a->fanin1[i]))
+			v1 = ~v1;
+		values[i*words + word] = v0 & v1;
+	}
+}
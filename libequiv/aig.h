@@ -0,0 +1,51 @@
+#ifndef __AIG_H
+#define __AIG_H
+
+#include <stdint.h>
+
+/*
+ * And-inverter graph with structural hashing.
+ * A literal is twice the node index, plus one if complemented.
+ * Node 0 is the constant 0. Nodes are created in topological order.
+ */
+
+typedef unsigned int aig_lit;
+
+#define AIG_FALSE	0
+#define AIG_TRUE	1
+#define AIG_INPUT	((aig_lit)-1) /* < fanin0 value marking an input node */
+
+#define aig_not(l)		((l) ^ 1)
+#define aig_not_cond(l, c)	((l) ^ ((c) ? 1 : 0))
+#define aig_node(l)		((l) >> 1)
+#define aig_is_complement(l)	((l) & 1)
+
+struct aig {
+	int nnodes;
+	int size;
+	aig_lit *fanin0;
+	aig_lit *fanin1;
+	int *hash_next;
+	int *hash_table;
+	int hash_size;
+};
+
+struct aig *aig_new();
+void aig_free(struct aig *a);
+
+aig_lit aig_input(struct aig *a);
+int aig_is_input(struct aig *a, int node);
+aig_lit aig_and(struct aig *a, aig_lit x, aig_lit y);
+aig_lit aig_or(struct aig *a, aig_lit x, aig_lit y);
+aig_lit aig_xor(struct aig *a, aig_lit x, aig_lit y);
+/* s ? x1 : x0 */
+aig_lit aig_mux(struct aig *a, aig_lit s, aig_lit x0, aig_lit x1);
+
+/* Bit-parallel simulation of nodes <from> and above.
+ * <values> holds <words> words per node, inputs must be set by the caller.
+ */
+void aig_simulate(struct aig *a, uint64_t *values, int words, int from);
+/* Same, but only for the word at index <word> */
+void aig_simulate_word(struct aig *a, uint64_t *values, int words, int word);
+
+#endif /* __AIG_H */
@@ -0,0 +1,721 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/symbol.h>
+#include <equiv/equiv.h>
+
+#include "internal.h"
+#include "sat.h"
+
+/*
+ * Both designs are first simulated from reset, which finds most bugs and gives
+ * each register a trace used to pair the registers that were not matched by name.
+ * Paired registers then share their state variable, and the outputs and the next
+ * states of paired registers are proven equal by SAT sweeping: nodes that look
+ * equivalent in a random simulation are proven so in topological order and merged,
+ * so that each proof only involves the logic that differs. Pairs whose next states
+ * cannot be proven are dropped until the remaining ones form an inductive invariant.
+ * Registers that stay at zero during the simulation are likewise assumed constant
+ * until their next state is found to differ from zero.
+ */
+
+#define SEQ_CYCLES	64
+#define SWEEP_WORDS	5	/* < the last word collects counterexamples */
+#define SWEEP_CONFLICTS	100
+#define SOLVER_RECYCLE	5000
+
+static uint64_t random_word()
+{
+	return ((uint64_t)random() << 42) ^ ((uint64_t)random() << 21) ^ (uint64_t)random();
+}
+
+static uint64_t lit_value(uint64_t *values, int words, aig_lit l, int w)
+{
+	uint64_t v;
+
+	v = values[aig_node(l)*words + w];
+	return aig_is_complement(l) ? ~v : v;
+}
+
+static void add_failure(struct equiv_result *r, int type, const char *name, int status, int cycle)
+{
+	struct equiv_failure *f, **tail;
+
+	f = alloc_type(struct equiv_failure);
+	f->type = type;
+	f->name = stralloc(name);
+	f->status = status;
+	f->cycle = cycle;
+	f->next = NULL;
+	tail = &r->failures;
+	while(*tail != NULL)
+		tail = &(*tail)->next;
+	*tail = f;
+}
+
+static struct name_table *index_points(struct equiv_point *p)
+{
+	struct name_table *t;
+
+	t = names_new();
+	for(;p!=NULL;p=p->next)
+		names_add(t, p->name, p);
+	return t;
+}
+
+static uint64_t trace_step(uint64_t trace, uint64_t value)
+{
+	return (trace ^ value)*0x100000001b3ULL + 1;
+}
+
+/* Simulation from reset of the models with unshared registers */
+static void simulate_sequential(struct equiv_model *model)
+{
+	struct aig *a = model->aig;
+	struct name_table *impl_outputs;
+	struct equiv_point *p, *q;
+	uint64_t *values;
+	int cycle;
+	int i, side;
+
+	impl_outputs = index_points(model->outputs[SIDE_IMPL]);
+	values = alloc_size(a->nnodes*sizeof(uint64_t));
+	for(cycle=0;cycle<SEQ_CYCLES;cycle++) {
+		for(i=1;i<a->nnodes;i++)
+			if(aig_is_input(a, i))
+				values[i] = random_word();
+		for(side=0;side<2;side++)
+			for(p=model->registers[side];p!=NULL;p=p->next) {
+				values[aig_node(p->lit)] = p->value;
+				p->trace = trace_step(p->trace, p->value);
+			}
+		aig_simulate(a, values, 1, 1);
+		for(p=model->outputs[SIDE_REF];p!=NULL;p=p->next) {
+			q = names_lookup(impl_outputs, p->name);
+			if((q != NULL) && (p->mismatch < 0)
+			  && (lit_value(values, 1, p->lit, 0) != lit_value(values, 1, q->lit, 0)))
+				p->mismatch = cycle;
+		}
+		for(p=model->registers[SIDE_IMPL];p!=NULL;p=p->next) {
+			q = names_lookup(model->ref_registers, p->name);
+			if((q != NULL) && (p->mismatch < 0) && (p->value != q->value))
+				p->mismatch = cycle;
+		}
+		for(side=0;side<2;side++)
+			for(p=model->registers[side];p!=NULL;p=p->next)
+				p->value = lit_value(values, 1, p->next_state, 0);
+	}
+	free(values);
+	names_free(impl_outputs);
+}
+
+/* Assumption on the state: a register stays 0 (ref is NULL),
+ * or an implementation register has the value of a reference register.
+ */
+struct pair {
+	int side;
+	char *name;
+	char *ref;
+	int by_name;
+	int dropped;
+};
+
+static int cmp_trace(const void *a, const void *b)
+{
+	const struct equiv_point *pa = *(struct equiv_point * const *)a;
+	const struct equiv_point *pb = *(struct equiv_point * const *)b;
+
+	if(pa->trace < pb->trace) return -1;
+	if(pa->trace > pb->trace) return 1;
+	return 0;
+}
+
+static void add_pair(struct pair *pairs, int *npairs, int side, char *name, char *ref, int by_name)
+{
+	pairs[*npairs].side = side;
+	pairs[*npairs].name = name;
+	pairs[*npairs].ref = ref;
+	pairs[*npairs].by_name = by_name;
+	pairs[*npairs].dropped = 0;
+	(*npairs)++;
+}
+
+/* Registers that were 0 during the whole simulation are assumed constant.
+ * Implementation registers are also paired with reference registers by name
+ * when their traces agree, and by trace otherwise.
+ */
+static struct pair *make_pairs(struct equiv_model *model, int *npairs)
+{
+	struct equiv_point **sorted;
+	struct equiv_point *p, *ref, **found;
+	struct pair *pairs;
+	uint64_t zero;
+	int i, n, side;
+
+	zero = 0;
+	for(i=0;i<SEQ_CYCLES;i++)
+		zero = trace_step(zero, 0);
+
+	n = model->nregisters[SIDE_REF];
+	sorted = alloc_size((n+1)*sizeof(struct equiv_point *));
+	i = 0;
+	for(p=model->registers[SIDE_REF];p!=NULL;p=p->next)
+		sorted[i++] = p;
+	qsort(sorted, n, sizeof(struct equiv_point *), cmp_trace);
+
+	pairs = alloc_size((n+2*model->nregisters[SIDE_IMPL]+1)*sizeof(struct pair));
+	*npairs = 0;
+	for(side=0;side<2;side++)
+		for(p=model->registers[side];p!=NULL;p=p->next)
+			if(p->trace == zero)
+				add_pair(pairs, npairs, side, p->name, NULL, 0);
+	for(p=model->registers[SIDE_IMPL];p!=NULL;p=p->next) {
+		ref = names_lookup(model->ref_registers, p->name);
+		if((ref != NULL) && (ref->trace == p->trace))
+			add_pair(pairs, npairs, SIDE_IMPL, p->name, ref->name, 1);
+		else if(p->trace != zero) {
+			found = bsearch(&p, sorted, n, sizeof(struct equiv_point *), cmp_trace);
+			if(found != NULL)
+				add_pair(pairs, npairs, SIDE_IMPL, p->name, (*found)->name, 0);
+		}
+	}
+	free(sorted);
+	return pairs;
+}
+
+struct sweeper {
+	struct aig *aig;
+	int words;
+	uint64_t *values;
+	char *cone;
+	aig_lit *repr;
+	int *class_heads;
+	int *class_next;
+	unsigned int class_mask;
+	int cex_bit;
+
+	struct sat *solver;
+	int *vars;
+	int nvars;
+	int *loaded;
+	int nloaded;
+
+	int merged;
+	int sat_calls;
+};
+
+static aig_lit repr_lit(struct sweeper *s, aig_lit l)
+{
+	return s->repr[aig_node(l)] ^ aig_is_complement(l);
+}
+
+/* Signatures are normalized to have their first bit cleared */
+static uint64_t phase(struct sweeper *s, int n)
+{
+	return s->values[n*s->words] & 1 ? ~(uint64_t)0 : 0;
+}
+
+static unsigned int signature_hash(struct sweeper *s, int n)
+{
+	uint64_t h, p;
+	int w;
+
+	p = phase(s, n);
+	h = 0;
+	for(w=0;w<s->words;w++)
+		h = (h ^ (s->values[n*s->words + w] ^ p))*0x100000001b3ULL;
+	return (h >> 32) & s->class_mask;
+}
+
+static int same_signature(struct sweeper *s, int a, int b)
+{
+	uint64_t pa, pb;
+	int w;
+
+	pa = phase(s, a);
+	pb = phase(s, b);
+	for(w=0;w<s->words;w++)
+		if((s->values[a*s->words + w] ^ pa) != (s->values[b*s->words + w] ^ pb))
+			return 0;
+	return 1;
+}
+
+static void class_insert(struct sweeper *s, int n)
+{
+	unsigned int h;
+
+	h = signature_hash(s, n);
+	s->class_next[n] = s->class_heads[h];
+	s->class_heads[h] = n;
+}
+
+static int class_find(struct sweeper *s, int n)
+{
+	int c;
+
+	for(c=s->class_heads[signature_hash(s, n)];c>=0;c=s->class_next[c])
+		if(same_signature(s, c, n))
+			return c;
+	return -1;
+}
+
+/* Representatives of nodes below <limit> */
+static void class_rebuild(struct sweeper *s, int limit)
+{
+	int i;
+
+	for(i=0;i<=(int)s->class_mask;i++)
+		s->class_heads[i] = -1;
+	for(i=0;i<limit;i++)
+		if(s->cone[i] && (s->repr[i] == 2*i))
+			class_insert(s, i);
+}
+
+static int new_var(struct sweeper *s, int n)
+{
+	s->vars[n] = s->nvars++;
+	s->loaded[s->nloaded++] = n;
+	sat_reserve(s->solver, s->nvars);
+	return s->vars[n];
+}
+
+/* Loads the node, with its fanins replaced by their representatives */
+static int load(struct sweeper *s, int n)
+{
+	struct aig *a = s->aig;
+	aig_lit f0, f1;
+	int v0, v1, v;
+	int clause[3];
+
+	if(s->vars[n] >= 0)
+		return s->vars[n];
+	if(n == 0) {
+		v = new_var(s, n);
+		clause[0] = 2*v+1;
+		sat_add_clause(s->solver, clause, 1);
+		return v;
+	}
+	if(aig_is_input(a, n))
+		return new_var(s, n);
+	f0 = repr_lit(s, a->fanin0[n]);
+	f1 = repr_lit(s, a->fanin1[n]);
+	v0 = 2*load(s, aig_node(f0)) + aig_is_complement(f0);
+	v1 = 2*load(s, aig_node(f1)) + aig_is_complement(f1);
+	v = new_var(s, n);
+	clause[0] = 2*v+1;
+	clause[1] = v0;
+	sat_add_clause(s->solver, clause, 2);
+	clause[1] = v1;
+	sat_add_clause(s->solver, clause, 2);
+	clause[0] = 2*v;
+	clause[1] = v0^1;
+	clause[2] = v1^1;
+	sat_add_clause(s->solver, clause, 3);
+	return v;
+}
+
+static void recycle_solver(struct sweeper *s)
+{
+	int i;
+
+	if(s->solver != NULL) {
+		if(s->nvars < SOLVER_RECYCLE)
+			return;
+		sat_free(s->solver);
+	}
+	for(i=0;i<s->nloaded;i++)
+		s->vars[s->loaded[i]] = -1;
+	s->nloaded = 0;
+	s->nvars = 0;
+	s->solver = sat_new();
+}
+
+/* Records the model of the last satisfiable call in the counterexample word,
+ * and updates the signatures.
+ */
+static void add_counterexample(struct sweeper *s)
+{
+	struct aig *a = s->aig;
+	uint64_t *v;
+	uint64_t bit;
+	int i;
+
+	bit = (uint64_t)1 << s->cex_bit;
+	s->cex_bit = (s->cex_bit + 1) % 64;
+	for(i=0;i<s->nloaded;i++)
+		if(aig_is_input(a, s->loaded[i])) {
+			v = &s->values[s->loaded[i]*s->words + s->words-1];
+			if(sat_model_value(s->solver, s->vars[s->loaded[i]]))
+				*v |= bit;
+			else
+				*v &= ~bit;
+		}
+	aig_simulate_word(a, s->values, s->words, s->words-1);
+}
+
+/* Proves that the reduced node <n> has the value of the literal <l>,
+ * where <l> only involves representatives.
+ */
+static int prove(struct sweeper *s, aig_lit n, aig_lit l, long int conflict_limit)
+{
+	int x, y;
+	int assumptions[2];
+	int r;
+
+	x = 2*load(s, aig_node(n)) + aig_is_complement(n);
+	y = 2*load(s, aig_node(l)) + aig_is_complement(l);
+	s->sat_calls++;
+	assumptions[0] = x;
+	assumptions[1] = y^1;
+	r = sat_solve(s->solver, assumptions, 2, conflict_limit);
+	if(r != SAT_UNSAT)
+		return r;
+	s->sat_calls++;
+	assumptions[0] = x^1;
+	assumptions[1] = y;
+	return sat_solve(s->solver, assumptions, 2, conflict_limit);
+}
+
+static void sweep_node(struct sweeper *s, int n)
+{
+	int c;
+	aig_lit l;
+	int r;
+
+	c = class_find(s, n);
+	if(c >= 0) {
+		l = 2*c ^ ((phase(s, n) != phase(s, c)) ? 1 : 0);
+		recycle_solver(s);
+		r = prove(s, 2*n, l, SWEEP_CONFLICTS);
+		if(r == SAT_UNSAT) {
+			s->repr[n] = l;
+			s->merged++;
+			return;
+		}
+		if(r == SAT_SAT) {
+			add_counterexample(s);
+			class_rebuild(s, n);
+		}
+	}
+	class_insert(s, n);
+}
+
+static void sweeper_init(struct sweeper *s, struct aig *a, aig_lit *miters, int nmiters)
+{
+	unsigned int size;
+	int i, w;
+
+	s->aig = a;
+	s->words = SWEEP_WORDS;
+	s->values = alloc_size(a->nnodes*s->words*sizeof(uint64_t));
+	for(i=1;i<a->nnodes;i++)
+		if(aig_is_input(a, i))
+			for(w=0;w<s->words;w++)
+				s->values[i*s->words + w] = random_word();
+	aig_simulate(a, s->values, s->words, 1);
+	s->cex_bit = 0;
+
+	s->cone = alloc_size0(a->nnodes);
+	s->cone[0] = 1;
+	for(i=0;i<nmiters;i++)
+		s->cone[aig_node(miters[i])] = 1;
+	for(i=a->nnodes-1;i>0;i--)
+		if(s->cone[i] && !aig_is_input(a, i)) {
+			s->cone[aig_node(a->fanin0[i])] = 1;
+			s->cone[aig_node(a->fanin1[i])] = 1;
+		}
+
+	s->repr = alloc_size(a->nnodes*sizeof(aig_lit));
+	for(i=0;i<a->nnodes;i++)
+		s->repr[i] = 2*i;
+	for(size=1024;size<2*(unsigned int)a->nnodes;size*=2);
+	s->class_mask = size - 1;
+	s->class_heads = alloc_size(size*sizeof(int));
+	s->class_next = alloc_size(a->nnodes*sizeof(int));
+	class_rebuild(s, 0);
+
+	s->solver = NULL;
+	s->vars = alloc_size(a->nnodes*sizeof(int));
+	for(i=0;i<a->nnodes;i++)
+		s->vars[i] = -1;
+	s->loaded = alloc_size(a->nnodes*sizeof(int));
+	s->nloaded = 0;
+	s->nvars = 0;
+	recycle_solver(s);
+
+	s->merged = 0;
+	s->sat_calls = 0;
+}
+
+static void sweeper_free(struct sweeper *s)
+{
+	sat_free(s->solver);
+	free(s->values);
+	free(s->cone);
+	free(s->repr);
+	free(s->class_heads);
+	free(s->class_next);
+	free(s->vars);
+	free(s->loaded);
+}
+
+static void sweep(struct sweeper *s)
+{
+	int i;
+
+	for(i=0;i<s->aig->nnodes;i++) {
+		if(!s->cone[i])
+			continue;
+		if((i == 0) || aig_is_input(s->aig, i))
+			class_insert(s, i);
+		else
+			sweep_node(s, i);
+	}
+}
+
+/* Returns SAT_UNSAT if the literals are proven equal */
+static int check_miter(struct sweeper *s, aig_lit a, aig_lit b, long int conflict_limit)
+{
+	aig_lit ra, rb;
+
+	ra = repr_lit(s, a);
+	rb = repr_lit(s, b);
+	if(ra == rb)
+		return SAT_UNSAT;
+	if(ra == aig_not(rb))
+		return SAT_SAT;
+	recycle_solver(s);
+	return prove(s, ra, rb, conflict_limit);
+}
+
+enum {
+	FAILED_PARTNER = 1,
+	FAILED_CONSTANT = 2
+};
+
+/* Proves the outputs, and the assumptions for the next state.
+ * Returns the number of assumptions that failed, which are flagged in the proof field of the registers.
+ */
+static int prove_model(struct equiv_model *model, long int conflict_limit, struct equiv_result *r)
+{
+	struct name_table *impl_outputs;
+	struct equiv_point *p, *q;
+	struct sweeper s;
+	aig_lit *miters;
+	int nmiters;
+	int failed;
+	int side;
+
+	impl_outputs = index_points(model->outputs[SIDE_IMPL]);
+	miters = alloc_size((2*model->noutputs[SIDE_REF] + 3*model->nregisters[SIDE_IMPL]
+		+ model->nregisters[SIDE_REF] + 1)*sizeof(aig_lit));
+	nmiters = 0;
+	for(p=model->outputs[SIDE_REF];p!=NULL;p=p->next) {
+		q = names_lookup(impl_outputs, p->name);
+		if(q != NULL) {
+			miters[nmiters++] = p->lit;
+			miters[nmiters++] = q->lit;
+		}
+	}
+	for(side=0;side<2;side++)
+		for(p=model->registers[side];p!=NULL;p=p->next) {
+			if(p->partner != NULL) {
+				miters[nmiters++] = p->next_state;
+				miters[nmiters++] = p->partner->next_state;
+			} else if(p->constant)
+				miters[nmiters++] = p->next_state;
+		}
+
+	sweeper_init(&s, model->aig, miters, nmiters);
+	sweep(&s);
+	failed = 0;
+	for(side=0;side<2;side++)
+		for(p=model->registers[side];p!=NULL;p=p->next) {
+			p->proof = 0;
+			if((p->partner != NULL)
+			  && (check_miter(&s, p->next_state, p->partner->next_state, conflict_limit) != SAT_UNSAT))
+				p->proof |= FAILED_PARTNER;
+			if(p->constant && (check_miter(&s, p->next_state, AIG_FALSE, conflict_limit) != SAT_UNSAT))
+				p->proof |= FAILED_CONSTANT;
+			if(p->proof & FAILED_PARTNER)
+				failed++;
+			if(p->proof & FAILED_CONSTANT)
+				failed++;
+		}
+	/* outputs only matter once the set of assumptions is final */
+	if(failed == 0)
+		for(p=model->outputs[SIDE_REF];p!=NULL;p=p->next) {
+			q = names_lookup(impl_outputs, p->name);
+			if(q != NULL)
+				p->proof = check_miter(&s, p->lit, q->lit, conflict_limit);
+		}
+	r->merged += s.merged;
+	r->sat_calls += s.sat_calls;
+	sweeper_free(&s);
+	free(miters);
+	names_free(impl_outputs);
+	return failed;
+}
+
+static struct equiv_model *build_model(struct llhdl_module *m, struct netlist_manager *netlist,
+	struct netlist_sym_store *symbols, struct pair *pairs, int npairs)
+{
+	struct equiv_model *model;
+	struct name_table *impl_pairs;
+	struct name_table *constants[2];
+	int i, side;
+
+	impl_pairs = names_new();
+	for(side=0;side<2;side++)
+		constants[side] = names_new();
+	for(i=0;i<npairs;i++) {
+		if(pairs[i].dropped)
+			continue;
+		if(pairs[i].ref == NULL)
+			names_add(constants[pairs[i].side], pairs[i].name, &pairs[i]);
+		else
+			names_add(impl_pairs, pairs[i].name, pairs[i].ref);
+	}
+	model = model_new();
+	model_build_llhdl(model, m, constants[SIDE_REF]);
+	model_build_netlist(model, netlist, symbols, impl_pairs, constants[SIDE_IMPL]);
+	names_free(impl_pairs);
+	for(side=0;side<2;side++)
+		names_free(constants[side]);
+	return model;
+}
+
+static void set_stats(struct equiv_model *model, struct equiv_result *r)
+{
+	struct aig *a = model->aig;
+	int i;
+
+	r->inputs = model->ninputs;
+	r->outputs = model->noutputs[SIDE_REF];
+	r->registers_ref = model->nregisters[SIDE_REF];
+	r->registers_impl = model->nregisters[SIDE_IMPL];
+	r->and_nodes = 0;
+	for(i=1;i<a->nnodes;i++)
+		if(!aig_is_input(a, i))
+			r->and_nodes++;
+}
+
+/* Ports that only exist on one side */
+static void check_ports(struct equiv_model *model, struct equiv_result *r)
+{
+	struct name_table *t[2];
+	struct equiv_point *p;
+	int side;
+
+	for(side=0;side<2;side++)
+		t[side] = index_points(model->outputs[side]);
+	for(side=0;side<2;side++)
+		for(p=model->outputs[side];p!=NULL;p=p->next)
+			if(names_lookup(t[!side], p->name) == NULL)
+				add_failure(r, EQUIV_POINT_OUTPUT, p->name, EQUIV_DIFFERENT, -1);
+	for(side=0;side<2;side++)
+		names_free(t[side]);
+}
+
+int equiv_check(struct llhdl_module *m, struct netlist_manager *netlist, struct netlist_sym_store *symbols,
+	long int conflict_limit, struct equiv_result *r)
+{
+	struct equiv_model *model0, *model;
+	struct equiv_point *p;
+	struct pair *pairs, *pair;
+	struct name_table *pair_index;
+	struct name_table *constant_index[2];
+	int npairs;
+	int i, side;
+
+	memset(r, 0, sizeof(struct equiv_result));
+	r->status = EQUIV_EQUIVALENT;
+
+	model0 = build_model(m, netlist, symbols, NULL, 0);
+	set_stats(model0, r);
+	check_ports(model0, r);
+	if(r->failures != NULL)
+		r->status = EQUIV_DIFFERENT;
+	simulate_sequential(model0);
+	for(p=model0->outputs[SIDE_REF];p!=NULL;p=p->next)
+		if(p->mismatch >= 0) {
+			add_failure(r, EQUIV_POINT_OUTPUT, p->name, EQUIV_DIFFERENT, p->mismatch);
+			r->status = EQUIV_DIFFERENT;
+		}
+	pairs = make_pairs(model0, &npairs);
+	pair_index = names_new();
+	for(side=0;side<2;side++)
+		constant_index[side] = names_new();
+	for(i=0;i<npairs;i++) {
+		if(pairs[i].ref == NULL)
+			names_add(constant_index[pairs[i].side], pairs[i].name, &pairs[i]);
+		else
+			names_add(pair_index, pairs[i].name, &pairs[i]);
+	}
+
+	if(r->status == EQUIV_EQUIVALENT) {
+		/* drop the assumptions that are not inductive until a fixed point is reached */
+		for(;;) {
+			model = build_model(m, netlist, symbols, pairs, npairs);
+			if(prove_model(model, conflict_limit, r) == 0)
+				break;
+			for(side=0;side<2;side++)
+				for(p=model->registers[side];p!=NULL;p=p->next) {
+					if(p->proof & FAILED_PARTNER) {
+						pair = names_lookup(pair_index, p->name);
+						pair->dropped = 1;
+					}
+					if(p->proof & FAILED_CONSTANT) {
+						pair = names_lookup(constant_index[side], p->name);
+						pair->dropped = 1;
+					}
+				}
+			model_free(model);
+		}
+		for(p=model->outputs[SIDE_REF];p!=NULL;p=p->next)
+			if(p->proof != SAT_UNSAT) {
+				add_failure(r, EQUIV_POINT_OUTPUT, p->name, EQUIV_UNDECIDED, -1);
+				r->status = EQUIV_UNDECIDED;
+			}
+		set_stats(model, r);
+		model_free(model);
+	}
+	for(i=0;i<npairs;i++)
+		if(!pairs[i].dropped && (pairs[i].ref != NULL))
+			r->register_pairs++;
+
+	/* registers named like a reference register that did not behave like it */
+	if(r->status != EQUIV_EQUIVALENT) {
+		for(p=model0->registers[SIDE_IMPL];p!=NULL;p=p->next) {
+			pair = names_lookup(pair_index, p->name);
+			if(p->mismatch >= 0)
+				add_failure(r, EQUIV_POINT_REGISTER, p->name, EQUIV_DIFFERENT, p->mismatch);
+			else if((pair != NULL) && pair->by_name && pair->dropped)
+				add_failure(r, EQUIV_POINT_REGISTER, p->name, EQUIV_UNDECIDED, -1);
+		}
+	}
+
+	names_free(pair_index);
+	for(side=0;side<2;side++)
+		names_free(constant_index[side]);
+	free(pairs);
+	model_free(model0);
+	return r->status;
+}
+
+void equiv_free_result(struct equiv_result *r)
+{
+	struct equiv_failure *f, *next;
+
+	for(f=r->failures;f!=NULL;f=next) {
+		next = f->next;
+		free(f->name);
+		free(f);
+	}
+	r->failures = NULL;
+}
@@ -0,0 +1,81 @@
+#ifndef __INTERNAL_H
+#define __INTERNAL_H
+
+#include <stdint.h>
+
+#include <llhdl/structure.h>
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/symbol.h>
+#include <equiv/equiv.h>
+
+#include "aig.h"
+
+/* Hash table from names to user pointers */
+
+struct name_entry {
+	char *name;
+	void *user;
+	struct name_entry *next;
+};
+
+struct name_table {
+	int size;
+	int count;
+	struct name_entry **buckets;
+};
+
+struct name_table *names_new();
+void names_free(struct name_table *t);
+void names_add(struct name_table *t, const char *name, void *user);
+void *names_lookup(struct name_table *t, const char *name);
+
+/* Both designs are modeled in a single AIG, so that identical logic is shared.
+ * Side 0 is the LLHDL module (reference), side 1 the netlist (implementation).
+ */
+
+enum {
+	SIDE_REF,
+	SIDE_IMPL
+};
+
+struct equiv_point {
+	char *name;
+	aig_lit lit;			/* < input, output function, or register state */
+	aig_lit next_state;		/* < registers only */
+	struct equiv_point *partner;	/* < reference register sharing the state of this one */
+	int constant;			/* < register assumed to stay 0 */
+	uint64_t value;			/* < current state in the simulation from reset */
+	uint64_t trace;			/* < signature of the values in that simulation */
+	int mismatch;			/* < first cycle at which the simulation told it apart, or -1 */
+	int proof;			/* < result of the proof on the last model */
+	struct equiv_point *next;
+};
+
+struct equiv_model {
+	struct aig *aig;
+	struct name_table *input_names;
+	struct equiv_point *inputs;
+	int ninputs;
+	struct equiv_point *outputs[2];
+	int noutputs[2];
+	struct equiv_point *registers[2];
+	int nregisters[2];
+	struct name_table *ref_registers;
+};
+
+struct equiv_model *model_new();
+void model_free(struct equiv_model *model);
+/* Returns the input with that name, creating it if needed */
+aig_lit model_input(struct equiv_model *model, const char *name);
+struct equiv_point *model_add_point(struct equiv_point **list, int *count, const char *name, aig_lit lit);
+
+/* <constants> holds the names of the registers assumed to stay 0. It may be NULL. */
+void model_build_llhdl(struct equiv_model *model, struct llhdl_module *m, struct name_table *constants);
+/* <pairs> maps implementation register names to the names of the reference registers
+ * whose state they share. It may be NULL.
+ */
+void model_build_netlist(struct equiv_model *model, struct netlist_manager *netlist,
+	struct netlist_sym_store *symbols, struct name_table *pairs, struct name_table *constants);
+
+#endif /* __INTERNAL_H */
@@ -0,0 +1,497 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <sim/blast.h>
+
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/xilprims.h>
+#include <netlist/symbol.h>
+
+#include "internal.h"
+
+struct equiv_model *model_new()
+{
+	struct equiv_model *model;
+
+	model = alloc_type0(struct equiv_model);
+	model->aig = aig_new();
+	model->input_names = names_new();
+	model->ref_registers = names_new();
+	return model;
+}
+
+static void free_points(struct equiv_point *p)
+{
+	struct equiv_point *next;
+
+	while(p != NULL) {
+		next = p->next;
+		free(p->name);
+		free(p);
+		p = next;
+	}
+}
+
+void model_free(struct equiv_model *model)
+{
+	int i;
+
+	aig_free(model->aig);
+	names_free(model->input_names);
+	names_free(model->ref_registers);
+	free_points(model->inputs);
+	for(i=0;i<2;i++) {
+		free_points(model->outputs[i]);
+		free_points(model->registers[i]);
+	}
+	free(model);
+}
+
+struct equiv_point *model_add_point(struct equiv_point **list, int *count, const char *name, aig_lit lit)
+{
+	struct equiv_point *p;
+
+	p = alloc_type0(struct equiv_point);
+	p->name = stralloc(name);
+	p->lit = lit;
+	p->mismatch = -1;
+	p->next = *list;
+	*list = p;
+	(*count)++;
+	return p;
+}
+
+/* Points are prepended as they are created, restore their order */
+static void reverse_points(struct equiv_point **list)
+{
+	struct equiv_point *p, *next, *r;
+
+	r = NULL;
+	for(p=*list;p!=NULL;p=next) {
+		next = p->next;
+		p->next = r;
+		r = p;
+	}
+	*list = r;
+}
+
+aig_lit model_input(struct equiv_model *model, const char *name)
+{
+	struct equiv_point *p;
+
+	p = names_lookup(model->input_names, name);
+	if(p == NULL) {
+		p = model_add_point(&model->inputs, &model->ninputs, name, aig_input(model->aig));
+		names_add(model->input_names, name, p);
+	}
+	return p->lit;
+}
+
+/* Same naming as the mapper, which puts it into the symbol store */
+static char *bit_name(const char *name, int vectorsize, int bit)
+{
+	char *r;
+
+	if(vectorsize == 1)
+		return stralloc(name);
+	if(asprintf(&r, "%s_%d", name, bit) == -1) abort();
+	return r;
+}
+
+/*
+ * Reference side: the LLHDL module is bit-blasted like the cycle simulator does it.
+ * A register is named after the signal it drives, bit by bit, which is
+ * how the mapper names the nets in the symbol store. The bits of the
+ * register past the width of the signal, and the registers that do not drive
+ * a signal directly, are anonymous and can only be matched by their trace.
+ */
+
+struct ref_compiler {
+	struct equiv_model *model;
+	struct aig *aig;
+	int fd_count;
+	struct name_table *constants;
+};
+
+static int cb_input(void *user, struct llhdl_node *signal, int bit)
+{
+	struct ref_compiler *c = user;
+	char *name;
+	aig_lit r;
+
+	name = bit_name(signal->p.signal.name, signal->p.signal.vectorsize, bit);
+	r = model_input(c->model, name);
+	free(name);
+	return r;
+}
+
+static int cb_gate(void *user, int op, int a, int b, int s)
+{
+	struct ref_compiler *c = user;
+
+	switch(op) {
+		case BLAST_NOT:
+			return aig_not(a);
+		case BLAST_AND:
+			return aig_and(c->aig, a, b);
+		case BLAST_OR:
+			return aig_or(c->aig, a, b);
+		case BLAST_XOR:
+			return aig_xor(c->aig, a, b);
+		case BLAST_MUX:
+			return aig_mux(c->aig, s, a, b);
+		default:
+			assert(0);
+			return AIG_FALSE;
+	}
+}
+
+static void *cb_fd(void *user, struct llhdl_node *fd, struct llhdl_node *signal, int vectorsize, int *state)
+{
+	struct ref_compiler *c = user;
+	struct equiv_point **points;
+	char *bitname;
+	int named;
+	int n;
+	int i;
+
+	points = alloc_size(vectorsize*sizeof(struct equiv_point *));
+	named = 0;
+	if(signal != NULL) {
+		named = signal->p.signal.vectorsize;
+		if(named > vectorsize)
+			named = vectorsize;
+	}
+	n = -1;
+	for(i=0;i<vectorsize;i++) {
+		if(i < named)
+			bitname = bit_name(signal->p.signal.name, signal->p.signal.vectorsize, i);
+		else {
+			if(n < 0)
+				n = c->fd_count++;
+			if(asprintf(&bitname, "$fd%d_%d", n, i) == -1) abort();
+		}
+		if((c->constants != NULL) && (names_lookup(c->constants, bitname) != NULL))
+			state[i] = AIG_FALSE;
+		else
+			state[i] = aig_input(c->aig);
+		points[i] = model_add_point(&c->model->registers[SIDE_REF], &c->model->nregisters[SIDE_REF],
+			bitname, state[i]);
+		points[i]->constant = state[i] == AIG_FALSE;
+		names_add(c->model->ref_registers, bitname, points[i]);
+		free(bitname);
+	}
+	return points;
+}
+
+static void cb_next_state(void *user, void *handle, struct llhdl_node *fd, int vectorsize, int *next_state)
+{
+	struct equiv_point **points = handle;
+	int i;
+
+	for(i=0;i<vectorsize;i++)
+		points[i]->next_state = next_state[i];
+	free(points);
+}
+
+static struct blast_ops ref_ops = {
+	.input = cb_input,
+	.gate = cb_gate,
+	.fd = cb_fd,
+	.next_state = cb_next_state
+};
+
+void model_build_llhdl(struct equiv_model *model, struct llhdl_module *m, struct name_table *constants)
+{
+	struct ref_compiler c;
+	struct llhdl_node *n;
+	char *name;
+	int i;
+
+	c.model = model;
+	c.aig = model->aig;
+	c.fd_count = 0;
+	c.constants = constants;
+
+	blast_module(m, &ref_ops, &c);
+	for(n=m->head;n!=NULL;n=n->p.signal.next) {
+		if(n->p.signal.type == LLHDL_SIGNAL_PORT_OUT)
+			for(i=0;i<n->p.signal.vectorsize;i++) {
+				name = bit_name(n->p.signal.name, n->p.signal.vectorsize, i);
+				model_add_point(&model->outputs[SIDE_REF], &model->noutputs[SIDE_REF],
+					name, ((int *)n->user)[i]);
+				free(name);
+			}
+	}
+	for(n=m->head;n!=NULL;n=n->p.signal.next) {
+		free(n->user);
+		n->user = NULL;
+	}
+	reverse_points(&model->outputs[SIDE_REF]);
+	reverse_points(&model->registers[SIDE_REF]);
+}
+
+/*
+ * Implementation side: the netlist is modeled primitive by primitive,
+ * from the nets that feed the output ports and the flip-flops.
+ */
+
+enum {
+	NET_UNKNOWN,
+	NET_BUSY,
+	NET_DONE
+};
+
+struct netlist_builder {
+	struct equiv_model *model;
+	struct aig *aig;
+	struct netlist_instance **drivers;	/* < per net uid */
+	struct netlist_net ***inputs;		/* < per instance uid, net on each input pin */
+	struct netlist_net **outputs;		/* < per instance uid */
+	struct equiv_point **registers;		/* < per instance uid */
+	const char **names;			/* < per net uid, name of the register driving it */
+	aig_lit *lits;				/* < per net uid */
+	char *state;				/* < per net uid */
+};
+
+#define IS_PRIM(inst, t) ((inst)->p == &netlist_xilprims[NETLIST_XIL_##t])
+
+static void index_netlist(struct netlist_builder *b, struct netlist_manager *netlist)
+{
+	struct netlist_net *net;
+	struct netlist_branch *branch;
+	struct netlist_instance *inst;
+
+	for(net=netlist->nhead;net!=NULL;net=net->next) {
+		if(net->joined != NULL)
+			continue;
+		for(branch=net->head;branch!=NULL;branch=branch->next) {
+			inst = branch->inst;
+			if(branch->output) {
+				b->drivers[net->uid] = inst;
+				b->outputs[inst->uid] = net;
+			} else {
+				if(b->inputs[inst->uid] == NULL)
+					b->inputs[inst->uid] = alloc_size0(inst->p->inputs*sizeof(struct netlist_net *));
+				b->inputs[inst->uid][branch->pin_index] = net;
+			}
+		}
+	}
+}
+
+/* Registers are named after the signals they drive. A name that is also a reference
+ * register is preferred, as nets may carry several names.
+ */
+static void index_names(struct netlist_builder *b, struct netlist_sym_store *symbols, const char **ref_names)
+{
+	struct netlist_sym *sym;
+	struct netlist_net *net;
+	char *stem;
+	size_t len;
+
+	for(sym=symbols->head;sym!=NULL;sym=sym->next) {
+		if((sym->type != 'N') || (sym->user == NULL))
+			continue;
+		net = netlist_resolve_joined(sym->user);
+		stem = stralloc(sym->name);
+		len = strlen(stem);
+		if((len > 3) && (strcmp(&stem[len-3], "$IO") == 0))
+			stem[len-3] = 0;
+		if(names_lookup(b->model->ref_registers, stem) != NULL)
+			ref_names[net->uid] = sym->name;
+		else if(b->names[net->uid] == NULL)
+			b->names[net->uid] = sym->name;
+		free(stem);
+	}
+}
+
+static aig_lit eval_net(struct netlist_builder *b, struct netlist_net *net);
+
+static aig_lit eval_pin(struct netlist_builder *b, struct netlist_instance *inst, int pin)
+{
+	if((b->inputs[inst->uid] == NULL) || (b->inputs[inst->uid][pin] == NULL))
+		/* unconnected */
+		return aig_input(b->aig);
+	return eval_net(b, b->inputs[inst->uid][pin]);
+}
+
+static aig_lit eval_lut(struct netlist_builder *b, aig_lit *x, uint64_t init, int k, int base)
+{
+	aig_lit x0, x1;
+
+	if(k == 0)
+		return (init >> base) & 1 ? AIG_TRUE : AIG_FALSE;
+	x0 = eval_lut(b, x, init, k-1, base);
+	x1 = eval_lut(b, x, init, k-1, base + (1 << (k-1)));
+	return aig_mux(b->aig, x[k-1], x0, x1);
+}
+
+static aig_lit eval_instance(struct netlist_builder *b, struct netlist_instance *inst)
+{
+	aig_lit x[6];
+	uint64_t init;
+	int i;
+
+	if(inst->p->type == NETLIST_PRIMITIVE_PORT_IN)
+		/* the port name is the name of its only pin */
+		return model_input(b->model, inst->p->output_names[0]);
+	if(b->registers[inst->uid] != NULL)
+		return b->registers[inst->uid]->lit;
+	if(IS_PRIM(inst, IBUF) || IS_PRIM(inst, OBUF) || IS_PRIM(inst, BUFGP))
+		return eval_pin(b, inst, 0);
+	if(IS_PRIM(inst, GND))
+		return AIG_FALSE;
+	if(IS_PRIM(inst, VCC))
+		return AIG_TRUE;
+	if((inst->p >= &netlist_xilprims[NETLIST_XIL_LUT1]) && (inst->p <= &netlist_xilprims[NETLIST_XIL_LUT6])) {
+		for(i=0;i<inst->p->inputs;i++)
+			x[i] = eval_pin(b, inst, i);
+		init = strtoull(inst->attributes[0], NULL, 16);
+		return eval_lut(b, x, init, inst->p->inputs, 0);
+	}
+	if(IS_PRIM(inst, MUXF7) || IS_PRIM(inst, MUXF8))
+		return aig_mux(b->aig, eval_pin(b, inst, NETLIST_XIL_MUXF7_S),
+			eval_pin(b, inst, NETLIST_XIL_MUXF7_I0), eval_pin(b, inst, NETLIST_XIL_MUXF7_I1));
+	if(IS_PRIM(inst, MUXCY))
+		return aig_mux(b->aig, eval_pin(b, inst, NETLIST_XIL_MUXCY_S),
+			eval_pin(b, inst, NETLIST_XIL_MUXCY_DI), eval_pin(b, inst, NETLIST_XIL_MUXCY_CI));
+	if(IS_PRIM(inst, XORCY))
+		return aig_xor(b->aig, eval_pin(b, inst, NETLIST_XIL_XORCY_LI), eval_pin(b, inst, NETLIST_XIL_XORCY_CI));
+	fprintf(stderr, "Unsupported primitive for equivalence checking: %s\n", inst->p->name);
+	exit(EXIT_FAILURE);
+	return AIG_FALSE;
+}
+
+static aig_lit eval_net(struct netlist_builder *b, struct netlist_net *net)
+{
+	struct netlist_instance *driver;
+
+	if(b->state[net->uid] == NET_DONE)
+		return b->lits[net->uid];
+	if(b->state[net->uid] == NET_BUSY) {
+		fprintf(stderr, "Combinational loop in netlist through net %u\n", net->uid);
+		exit(EXIT_FAILURE);
+	}
+	b->state[net->uid] = NET_BUSY;
+	driver = b->drivers[net->uid];
+	if(driver == NULL)
+		/* undriven nets are unconstrained */
+		b->lits[net->uid] = aig_input(b->aig);
+	else
+		b->lits[net->uid] = eval_instance(b, driver);
+	b->state[net->uid] = NET_DONE;
+	return b->lits[net->uid];
+}
+
+static struct equiv_point *create_register(struct netlist_builder *b, struct netlist_instance *inst,
+	const char **ref_names, struct name_table *pairs, struct name_table *constants)
+{
+	struct equiv_model *model = b->model;
+	struct netlist_net *q;
+	struct equiv_point *p;
+	struct equiv_point *ref;
+	const char *symname;
+	char *name;
+	char *partner;
+	size_t len;
+	int constant;
+	aig_lit lit;
+
+	q = b->outputs[inst->uid];
+	symname = NULL;
+	if(q != NULL) {
+		symname = ref_names[q->uid];
+		if(symname == NULL)
+			symname = b->names[q->uid];
+	}
+	if(symname == NULL) {
+		if(asprintf(&name, "$FD%u", inst->uid) == -1) abort();
+	} else {
+		name = stralloc(symname);
+		len = strlen(name);
+		if((len > 3) && (strcmp(&name[len-3], "$IO") == 0))
+			name[len-3] = 0;
+	}
+
+	ref = NULL;
+	if(pairs != NULL) {
+		partner = names_lookup(pairs, name);
+		if(partner != NULL)
+			ref = names_lookup(model->ref_registers, partner);
+	}
+	constant = (constants != NULL) && (names_lookup(constants, name) != NULL);
+	if(ref != NULL)
+		lit = ref->lit;
+	else if(constant)
+		lit = AIG_FALSE;
+	else
+		lit = aig_input(b->aig);
+	p = model_add_point(&model->registers[SIDE_IMPL], &model->nregisters[SIDE_IMPL], name, lit);
+	p->partner = ref;
+	p->constant = constant;
+	free(name);
+	return p;
+}
+
+void model_build_netlist(struct equiv_model *model, struct netlist_manager *netlist,
+	struct netlist_sym_store *symbols, struct name_table *pairs, struct name_table *constants)
+{
+	struct netlist_builder b;
+	struct netlist_instance *inst;
+	const char **ref_names;
+	struct equiv_point *p;
+	unsigned int n, i;
+	aig_lit d, ce;
+
+	n = netlist->next_uid;
+	b.model = model;
+	b.aig = model->aig;
+	b.drivers = alloc_size0(n*sizeof(struct netlist_instance *));
+	b.inputs = alloc_size0(n*sizeof(struct netlist_net **));
+	b.outputs = alloc_size0(n*sizeof(struct netlist_net *));
+	b.registers = alloc_size0(n*sizeof(struct equiv_point *));
+	b.names = alloc_size0(n*sizeof(char *));
+	b.lits = alloc_size(n*sizeof(aig_lit));
+	b.state = alloc_size0(n);
+	ref_names = alloc_size0(n*sizeof(char *));
+
+	index_netlist(&b, netlist);
+	index_names(&b, symbols, ref_names);
+
+	/* state variables first */
+	for(inst=netlist->ihead;inst!=NULL;inst=inst->next)
+		if(IS_PRIM(inst, FD) || IS_PRIM(inst, FDE))
+			b.registers[inst->uid] = create_register(&b, inst, ref_names, pairs, constants);
+	for(inst=netlist->ihead;inst!=NULL;inst=inst->next) {
+		p = b.registers[inst->uid];
+		if(p != NULL) {
+			if(IS_PRIM(inst, FDE)) {
+				ce = eval_pin(&b, inst, NETLIST_XIL_FDE_CE);
+				d = eval_pin(&b, inst, NETLIST_XIL_FDE_D);
+				p->next_state = aig_mux(b.aig, ce, p->lit, d);
+			} else
+				p->next_state = eval_pin(&b, inst, NETLIST_XIL_FD_D);
+		} else if(inst->p->type == NETLIST_PRIMITIVE_PORT_OUT)
+			model_add_point(&model->outputs[SIDE_IMPL], &model->noutputs[SIDE_IMPL],
+				inst->p->input_names[0], eval_pin(&b, inst, 0));
+	}
+
+	reverse_points(&model->outputs[SIDE_IMPL]);
+	reverse_points(&model->registers[SIDE_IMPL]);
+
+	for(i=0;i<n;i++)
+		free(b.inputs[i]);
+	free(b.drivers);
+	free(b.inputs);
+	free(b.outputs);
+	free(b.registers);
+	free(b.names);
+	free(b.lits);
+	free(b.state);
+	free(ref_names);
+}
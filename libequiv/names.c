@@ -0,0 +1,89 @@
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include "internal.h"
+
+static unsigned int hash_name(const char *name)
+{
+	unsigned int h;
+
+	h = 2166136261U;
+	while(*name)
+		h = (h ^ (unsigned char)*name++)*16777619U;
+	return h;
+}
+
+struct name_table *names_new()
+{
+	struct name_table *t;
+
+	t = alloc_type(struct name_table);
+	t->size = 256;
+	t->count = 0;
+	t->buckets = alloc_size0(t->size*sizeof(struct name_entry *));
+	return t;
+}
+
+void names_free(struct name_table *t)
+{
+	struct name_entry *e, *next;
+	int i;
+
+	for(i=0;i<t->size;i++)
+		for(e=t->buckets[i];e!=NULL;e=next) {
+			next = e->next;
+			free(e->name);
+			free(e);
+		}
+	free(t->buckets);
+	free(t);
+}
+
+static void grow(struct name_table *t)
+{
+	struct name_entry **buckets;
+	struct name_entry *e, *next;
+	int size;
+	int i;
+	unsigned int h;
+
+	size = 2*t->size;
+	buckets = alloc_size0(size*sizeof(struct name_entry *));
+	for(i=0;i<t->size;i++)
+		for(e=t->buckets[i];e!=NULL;e=next) {
+			next = e->next;
+			h = hash_name(e->name) & (size - 1);
+			e->next = buckets[h];
+			buckets[h] = e;
+		}
+	free(t->buckets);
+	t->buckets = buckets;
+	t->size = size;
+}
+
+void names_add(struct name_table *t, const char *name, void *user)
+{
+	struct name_entry *e;
+	unsigned int h;
+
+	if(t->count >= t->size)
+		grow(t);
+	h = hash_name(name) & (t->size - 1);
+	e = alloc_type(struct name_entry);
+	e->name = stralloc(name);
+	e->user = user;
+	e->next = t->buckets[h];
+	t->buckets[h] = e;
+	t->count++;
+}
+
+void *names_lookup(struct name_table *t, const char *name)
+{
+	struct name_entry *e;
+
+	for(e=t->buckets[hash_name(name) & (t->size - 1)];e!=NULL;e=e->next)
+		if(strcmp(e->name, name) == 0)
+			return e->user;
+	return NULL;
+}
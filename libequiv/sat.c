@@ -0,0 +1,719 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include "sat.h"
+
+/*
+ * Conflict-driven clause learning with two watched literals, first UIP
+ * learning, VSIDS decisions with phase saving, Luby restarts and
+ * LBD-based reduction of the learnt clause database.
+ */
+
+#define UNDEF 2
+
+#define VAR(l)	((l) >> 1)
+#define NEG(l)	((l) ^ 1)
+
+/* Clause layout in the arena: header, LBD, literals */
+#define C_SIZE(c)	((c)[0] >> 2)
+#define C_LEARNT(c)	((c)[0] & 2)
+#define C_DELETED(c)	((c)[0] & 1)
+#define C_LBD(c)	((c)[1])
+#define C_LITS(c)	(&(c)[2])
+#define C_HEADER	2
+
+struct vec {
+	int n;
+	int size;
+	int *data;
+};
+
+struct sat {
+	int ok;
+	int nvars;
+	int size;
+
+	/* per variable */
+	unsigned char *assign;
+	unsigned char *polarity;
+	unsigned char *seen;
+	unsigned char *model;
+	int *level;
+	int *reason;
+	double *activity;
+	int *heap_index;
+
+	/* per literal */
+	struct vec *watches;
+
+	int *trail;
+	int trail_n;
+	int qhead;
+	struct vec trail_lim;
+
+	int *heap;
+	int heap_n;
+	double var_inc;
+
+	int *arena;
+	int arena_n;
+	int arena_size;
+	int wasted;
+	struct vec clauses;
+	struct vec learnts;
+	int max_learnts;
+
+	struct vec learnt;
+	struct vec stack;
+	int *level_stamp;
+	int stamp;
+};
+
+static void *resize(void *p, size_t s)
+{
+	p = realloc(p, s);
+	if(p == NULL)
+		abort();
+	return p;
+}
+
+static void vec_push(struct vec *v, int x)
+{
+	if(v->n == v->size) {
+		v->size = v->size ? 2*v->size : 4;
+		v->data = resize(v->data, v->size*sizeof(int));
+	}
+	v->data[v->n++] = x;
+}
+
+static void vec_free(struct vec *v)
+{
+	free(v->data);
+	v->data = NULL;
+	v->n = v->size = 0;
+}
+
+/* Heap of unassigned variables ordered by activity */
+
+static void heap_up(struct sat *s, int i)
+{
+	int v = s->heap[i];
+	int p;
+
+	while(i > 0) {
+		p = (i - 1)/2;
+		if(s->activity[s->heap[p]] >= s->activity[v])
+			break;
+		s->heap[i] = s->heap[p];
+		s->heap_index[s->heap[i]] = i;
+		i = p;
+	}
+	s->heap[i] = v;
+	s->heap_index[v] = i;
+}
+
+static void heap_down(struct sat *s, int i)
+{
+	int v = s->heap[i];
+	int c;
+
+	for(;;) {
+		c = 2*i + 1;
+		if(c >= s->heap_n)
+			break;
+		if((c + 1 < s->heap_n) && (s->activity[s->heap[c+1]] > s->activity[s->heap[c]]))
+			c++;
+		if(s->activity[s->heap[c]] <= s->activity[v])
+			break;
+		s->heap[i] = s->heap[c];
+		s->heap_index[s->heap[i]] = i;
+		i = c;
+	}
+	s->heap[i] = v;
+	s->heap_index[v] = i;
+}
+
+static void heap_insert(struct sat *s, int v)
+{
+	if(s->heap_index[v] >= 0)
+		return;
+	s->heap[s->heap_n] = v;
+	s->heap_index[v] = s->heap_n;
+	heap_up(s, s->heap_n++);
+}
+
+static int heap_pop(struct sat *s)
+{
+	int v;
+
+	v = s->heap[0];
+	s->heap_index[v] = -1;
+	s->heap_n--;
+	if(s->heap_n > 0) {
+		s->heap[0] = s->heap[s->heap_n];
+		s->heap_index[s->heap[0]] = 0;
+		heap_down(s, 0);
+	}
+	return v;
+}
+
+static void bump(struct sat *s, int v)
+{
+	int i;
+
+	s->activity[v] += s->var_inc;
+	if(s->activity[v] > 1e100) {
+		for(i=0;i<s->nvars;i++)
+			s->activity[i] *= 1e-100;
+		s->var_inc *= 1e-100;
+	}
+	if(s->heap_index[v] >= 0)
+		heap_up(s, s->heap_index[v]);
+}
+
+struct sat *sat_new()
+{
+	struct sat *s;
+
+	s = alloc_type0(struct sat);
+	s->ok = 1;
+	s->var_inc = 1.0;
+	s->max_learnts = 10000;
+	return s;
+}
+
+void sat_free(struct sat *s)
+{
+	int i;
+
+	for(i=0;i<2*s->nvars;i++)
+		vec_free(&s->watches[i]);
+	free(s->watches);
+	free(s->assign);
+	free(s->polarity);
+	free(s->seen);
+	free(s->model);
+	free(s->level);
+	free(s->reason);
+	free(s->activity);
+	free(s->heap_index);
+	free(s->heap);
+	free(s->trail);
+	free(s->arena);
+	free(s->level_stamp);
+	vec_free(&s->trail_lim);
+	vec_free(&s->clauses);
+	vec_free(&s->learnts);
+	vec_free(&s->learnt);
+	vec_free(&s->stack);
+	free(s);
+}
+
+void sat_reserve(struct sat *s, int nvars)
+{
+	int i;
+	int size;
+
+	if(nvars <= s->nvars)
+		return;
+	if(nvars > s->size) {
+		size = s->size ? s->size : 1024;
+		while(size < nvars)
+			size *= 2;
+		s->assign = resize(s->assign, size);
+		s->polarity = resize(s->polarity, size);
+		s->seen = resize(s->seen, size);
+		s->model = resize(s->model, size);
+		s->level = resize(s->level, size*sizeof(int));
+		s->reason = resize(s->reason, size*sizeof(int));
+		s->activity = resize(s->activity, size*sizeof(double));
+		s->heap_index = resize(s->heap_index, size*sizeof(int));
+		s->heap = resize(s->heap, size*sizeof(int));
+		s->trail = resize(s->trail, size*sizeof(int));
+		s->level_stamp = resize(s->level_stamp, (size+1)*sizeof(int));
+		s->watches = resize(s->watches, 2*size*sizeof(struct vec));
+		s->size = size;
+	}
+	for(i=s->nvars;i<nvars;i++) {
+		s->assign[i] = UNDEF;
+		s->polarity[i] = 0;
+		s->seen[i] = 0;
+		s->model[i] = 0;
+		s->level[i] = 0;
+		s->reason[i] = -1;
+		s->activity[i] = 0.0;
+		s->heap_index[i] = -1;
+		s->level_stamp[i+1] = 0;
+		memset(&s->watches[2*i], 0, 2*sizeof(struct vec));
+		heap_insert(s, i);
+	}
+	s->level_stamp[0] = 0;
+	s->nvars = nvars;
+}
+
+static int value(struct sat *s, int lit)
+{
+	int a = s->assign[VAR(lit)];
+
+	if(a == UNDEF)
+		return UNDEF;
+	return a ^ (lit & 1);
+}
+
+static int decision_level(struct sat *s)
+{
+	return s->trail_lim.n;
+}
+
+static void enqueue(struct sat *s, int lit, int reason)
+{
+	int v = VAR(lit);
+
+	s->assign[v] = !(lit & 1);
+	s->level[v] = decision_level(s);
+	s->reason[v] = reason;
+	s->trail[s->trail_n++] = lit;
+}
+
+static void cancel_until(struct sat *s, int level)
+{
+	int i, v;
+
+	if(decision_level(s) <= level)
+		return;
+	for(i=s->trail_n-1;i>=s->trail_lim.data[level];i--) {
+		v = VAR(s->trail[i]);
+		s->polarity[v] = s->assign[v];
+		s->assign[v] = UNDEF;
+		s->reason[v] = -1;
+		heap_insert(s, v);
+	}
+	s->trail_n = s->trail_lim.data[level];
+	s->qhead = s->trail_n;
+	s->trail_lim.n = level;
+}
+
+static int alloc_clause(struct sat *s, const int *lits, int n, int learnt)
+{
+	int ref;
+	int *c;
+
+	if(s->arena_n + n + C_HEADER > s->arena_size) {
+		s->arena_size = s->arena_size ? 2*s->arena_size : 65536;
+		while(s->arena_n + n + C_HEADER > s->arena_size)
+			s->arena_size *= 2;
+		s->arena = resize(s->arena, s->arena_size*sizeof(int));
+	}
+	ref = s->arena_n;
+	c = &s->arena[ref];
+	c[0] = (n << 2) | (learnt ? 2 : 0);
+	c[1] = 0;
+	memcpy(C_LITS(c), lits, n*sizeof(int));
+	s->arena_n += n + C_HEADER;
+	return ref;
+}
+
+static void attach(struct sat *s, int ref)
+{
+	int *lits = C_LITS(&s->arena[ref]);
+
+	vec_push(&s->watches[lits[0]], ref);
+	vec_push(&s->watches[lits[1]], ref);
+}
+
+/* Returns the conflicting clause, or -1 */
+static int propagate(struct sat *s)
+{
+	struct vec *ws;
+	int p, falsel;
+	int i, j, k;
+	int ref;
+	int *c, *lits;
+	int size;
+	int t;
+
+	while(s->qhead < s->trail_n) {
+		p = s->trail[s->qhead++];
+		falsel = NEG(p);
+		ws = &s->watches[falsel];
+		i = j = 0;
+		while(i < ws->n) {
+			ref = ws->data[i++];
+			c = &s->arena[ref];
+			if(C_DELETED(c))
+				continue;
+			lits = C_LITS(c);
+			size = C_SIZE(c);
+			if(lits[0] == falsel) {
+				lits[0] = lits[1];
+				lits[1] = falsel;
+			}
+			if(value(s, lits[0]) == 1) {
+				ws->data[j++] = ref;
+				continue;
+			}
+			for(k=2;k<size;k++) {
+				if(value(s, lits[k]) != 0) {
+					t = lits[1];
+					lits[1] = lits[k];
+					lits[k] = t;
+					vec_push(&s->watches[lits[1]], ref);
+					break;
+				}
+			}
+			if(k < size)
+				continue;
+			ws->data[j++] = ref;
+			if(value(s, lits[0]) == 0) {
+				while(i < ws->n)
+					ws->data[j++] = ws->data[i++];
+				ws->n = j;
+				s->qhead = s->trail_n;
+				return ref;
+			}
+			enqueue(s, lits[0], ref);
+		}
+		ws->n = j;
+	}
+	return -1;
+}
+
+/* A literal is redundant in the learnt clause if its reason only contains
+ * literals that already are in the clause, or are set at level 0.
+ */
+static int redundant(struct sat *s, int lit)
+{
+	int ref;
+	int *c, *lits;
+	int i, v;
+
+	ref = s->reason[VAR(lit)];
+	if(ref < 0)
+		return 0;
+	c = &s->arena[ref];
+	lits = C_LITS(c);
+	for(i=1;i<C_SIZE(c);i++) {
+		v = VAR(lits[i]);
+		if(!s->seen[v] && (s->level[v] > 0))
+			return 0;
+	}
+	return 1;
+}
+
+/* First UIP conflict analysis. Leaves the learnt clause in s->learnt,
+ * with the asserting literal first, and returns the backtrack level.
+ */
+static int analyze(struct sat *s, int confl, int *lbd)
+{
+	int pathc;
+	int p;
+	int index;
+	int *c, *lits;
+	int i, j, v;
+	int bt, max_i;
+
+	s->learnt.n = 0;
+	vec_push(&s->learnt, 0);
+	pathc = 0;
+	p = -1;
+	index = s->trail_n - 1;
+	do {
+		c = &s->arena[confl];
+		lits = C_LITS(c);
+		for(i=(p == -1) ? 0 : 1;i<C_SIZE(c);i++) {
+			v = VAR(lits[i]);
+			if(!s->seen[v] && (s->level[v] > 0)) {
+				bump(s, v);
+				s->seen[v] = 1;
+				if(s->level[v] >= decision_level(s))
+					pathc++;
+				else
+					vec_push(&s->learnt, lits[i]);
+			}
+		}
+		while(!s->seen[VAR(s->trail[index])])
+			index--;
+		p = s->trail[index--];
+		confl = s->reason[VAR(p)];
+		s->seen[VAR(p)] = 0;
+		pathc--;
+	} while(pathc > 0);
+	s->learnt.data[0] = NEG(p);
+
+	/* minimize */
+	s->stack.n = 0;
+	for(i=1,j=1;i<s->learnt.n;i++) {
+		if(redundant(s, s->learnt.data[i]))
+			vec_push(&s->stack, s->learnt.data[i]);
+		else
+			s->learnt.data[j++] = s->learnt.data[i];
+	}
+	for(i=0;i<s->stack.n;i++)
+		s->seen[VAR(s->stack.data[i])] = 0;
+	s->learnt.n = j;
+
+	/* find the backtrack level and put its literal second */
+	bt = 0;
+	max_i = 1;
+	for(i=1;i<s->learnt.n;i++) {
+		if(s->level[VAR(s->learnt.data[i])] > bt) {
+			bt = s->level[VAR(s->learnt.data[i])];
+			max_i = i;
+		}
+	}
+	if(s->learnt.n > 1) {
+		p = s->learnt.data[1];
+		s->learnt.data[1] = s->learnt.data[max_i];
+		s->learnt.data[max_i] = p;
+	}
+
+	s->stamp++;
+	*lbd = 0;
+	for(i=0;i<s->learnt.n;i++) {
+		v = VAR(s->learnt.data[i]);
+		s->seen[v] = 0;
+		if(s->level_stamp[s->level[v]] != s->stamp) {
+			s->level_stamp[s->level[v]] = s->stamp;
+			(*lbd)++;
+		}
+	}
+	return bt;
+}
+
+static int locked(struct sat *s, int ref)
+{
+	int *lits = C_LITS(&s->arena[ref]);
+
+	return (s->reason[VAR(lits[0])] == ref) && (value(s, lits[0]) == 1);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/* Delete the half of the learnt clauses with the highest LBD */
+static void reduce(struct sat *s)
+{
+	int *keys;
+	int i, j;
+	int limit;
+	int *c;
+
+	keys = alloc_size(s->learnts.n*sizeof(int));
+	for(i=0;i<s->learnts.n;i++)
+		keys[i] = C_LBD(&s->arena[s->learnts.data[i]]);
+	qsort(keys, s->learnts.n, sizeof(int), cmp_int);
+	limit = keys[s->learnts.n/2];
+	free(keys);
+
+	for(i=0,j=0;i<s->learnts.n;i++) {
+		c = &s->arena[s->learnts.data[i]];
+		if((C_LBD(c) >= limit) && (C_LBD(c) > 2) && !locked(s, s->learnts.data[i])) {
+			c[0] |= 1;
+			s->wasted += C_SIZE(c) + C_HEADER;
+		} else
+			s->learnts.data[j++] = s->learnts.data[i];
+	}
+	s->learnts.n = j;
+	s->max_learnts += s->max_learnts/10;
+}
+
+static void relocate(struct sat *s, struct vec *v, int *arena, int *n)
+{
+	int i;
+	int *c;
+	int size;
+
+	for(i=0;i<v->n;i++) {
+		c = &s->arena[v->data[i]];
+		size = C_SIZE(c) + C_HEADER;
+		memcpy(&arena[*n], c, size*sizeof(int));
+		v->data[i] = *n;
+		*n += size;
+	}
+}
+
+/* Compact the arena. Only called at decision level 0. */
+static void collect_garbage(struct sat *s)
+{
+	int *arena;
+	int n;
+	int i;
+
+	arena = alloc_size(s->arena_size*sizeof(int));
+	n = 0;
+	relocate(s, &s->clauses, arena, &n);
+	relocate(s, &s->learnts, arena, &n);
+	free(s->arena);
+	s->arena = arena;
+	s->arena_n = n;
+	s->wasted = 0;
+	for(i=0;i<2*s->nvars;i++)
+		s->watches[i].n = 0;
+	for(i=0;i<s->clauses.n;i++)
+		attach(s, s->clauses.data[i]);
+	for(i=0;i<s->learnts.n;i++)
+		attach(s, s->learnts.data[i]);
+	/* reasons are not needed for level 0 assignments */
+	for(i=0;i<s->trail_n;i++)
+		s->reason[VAR(s->trail[i])] = -1;
+}
+
+int sat_add_clause(struct sat *s, const int *lits, int n)
+{
+	int *c;
+	int i, j, k;
+	int ref;
+
+	if(!s->ok)
+		return 0;
+	assert(decision_level(s) == 0);
+	c = alloc_size((n+1)*sizeof(int));
+	for(i=0,j=0;i<n;i++) {
+		sat_reserve(s, VAR(lits[i]) + 1);
+		if(value(s, lits[i]) == 1)
+			goto done;
+		if(value(s, lits[i]) == 0)
+			continue;
+		for(k=0;k<j;k++) {
+			if(c[k] == lits[i])
+				break;
+			if(c[k] == NEG(lits[i]))
+				goto done;
+		}
+		if(k == j)
+			c[j++] = lits[i];
+	}
+	if(j == 0)
+		s->ok = 0;
+	else if(j == 1) {
+		enqueue(s, c[0], -1);
+		if(propagate(s) >= 0)
+			s->ok = 0;
+	} else {
+		ref = alloc_clause(s, c, j, 0);
+		vec_push(&s->clauses, ref);
+		attach(s, ref);
+	}
+done:
+	free(c);
+	return s->ok;
+}
+
+/* Luby restart sequence: 1 1 2 1 1 2 4 1 1 2 ... */
+static long int luby(int x)
+{
+	int size, seq;
+
+	for(size=1,seq=0;size<x+1;seq++,size=2*size+1);
+	while(size-1 != x) {
+		size = (size-1) >> 1;
+		seq--;
+		x = x % size;
+	}
+	return 1L << seq;
+}
+
+int sat_solve(struct sat *s, const int *assumptions, int nassumptions, long int conflict_limit)
+{
+	long int conflicts;
+	long int restart_conflicts, restart_limit;
+	int restarts;
+	int confl;
+	int bt, lbd;
+	int next;
+	int ref;
+	int i;
+
+	if(!s->ok)
+		return SAT_UNSAT;
+	for(i=0;i<nassumptions;i++)
+		sat_reserve(s, VAR(assumptions[i]) + 1);
+	if(propagate(s) >= 0) {
+		s->ok = 0;
+		return SAT_UNSAT;
+	}
+	if(s->wasted > s->arena_n/2)
+		collect_garbage(s);
+
+	conflicts = 0;
+	restarts = 0;
+	restart_conflicts = 0;
+	restart_limit = 100*luby(restarts);
+	for(;;) {
+		confl = propagate(s);
+		if(confl >= 0) {
+			conflicts++;
+			restart_conflicts++;
+			if(decision_level(s) == 0) {
+				s->ok = 0;
+				return SAT_UNSAT;
+			}
+			bt = analyze(s, confl, &lbd);
+			cancel_until(s, bt);
+			if(s->learnt.n == 1)
+				enqueue(s, s->learnt.data[0], -1);
+			else {
+				ref = alloc_clause(s, s->learnt.data, s->learnt.n, 1);
+				C_LBD(&s->arena[ref]) = lbd;
+				vec_push(&s->learnts, ref);
+				attach(s, ref);
+				enqueue(s, s->learnt.data[0], ref);
+			}
+			s->var_inc *= 1.0/0.95;
+			continue;
+		}
+
+		if((conflict_limit > 0) && (conflicts >= conflict_limit)) {
+			cancel_until(s, 0);
+			return SAT_UNKNOWN;
+		}
+		if(restart_conflicts >= restart_limit) {
+			cancel_until(s, 0);
+			restarts++;
+			restart_conflicts = 0;
+			restart_limit = 100*luby(restarts);
+			continue;
+		}
+		if(s->learnts.n >= s->max_learnts)
+			reduce(s);
+
+		next = -1;
+		while(decision_level(s) < nassumptions) {
+			next = assumptions[decision_level(s)];
+			if(value(s, next) == 1) {
+				/* already satisfied, open a dummy level */
+				vec_push(&s->trail_lim, s->trail_n);
+				next = -1;
+			} else if(value(s, next) == 0) {
+				cancel_until(s, 0);
+				return SAT_UNSAT;
+			} else
+				break;
+		}
+		if(next == -1) {
+			while((s->heap_n > 0) && (s->assign[s->heap[0]] != UNDEF))
+				heap_pop(s);
+			if(s->heap_n == 0) {
+				for(i=0;i<s->nvars;i++)
+					s->model[i] = s->assign[i] == 1;
+				cancel_until(s, 0);
+				return SAT_SAT;
+			}
+			i = heap_pop(s);
+			next = 2*i + (s->polarity[i] ? 0 : 1);
+		}
+		vec_push(&s->trail_lim, s->trail_n);
+		enqueue(s, next, -1);
+	}
+}
+
+int sat_model_value(struct sat *s, int var)
+{
+	if(var >= s->nvars)
+		return 0;
+	return s->model[var];
+}
@@ -0,0 +1,32 @@
+#ifndef __SAT_H
+#define __SAT_H
+
+/*
+ * Incremental CDCL SAT solver.
+ * A literal is twice the variable index, plus one if negated, which
+ * makes AIG literals usable as-is.
+ */
+
+enum {
+	SAT_UNSAT = 0,
+	SAT_SAT,
+	SAT_UNKNOWN
+};
+
+struct sat;
+
+struct sat *sat_new();
+void sat_free(struct sat *s);
+
+/* Make variables 0 to <nvars>-1 available */
+void sat_reserve(struct sat *s, int nvars);
+/* Returns 0 if the clause set has become unsatisfiable */
+int sat_add_clause(struct sat *s, const int *lits, int n);
+/* Solve under the given assumptions. Gives up with SAT_UNKNOWN after
+ * <conflict_limit> conflicts, if positive.
+ */
+int sat_solve(struct sat *s, const int *assumptions, int nassumptions, long int conflict_limit);
+/* Value of a variable in the model found by the last successful call to sat_solve() */
+int sat_model_value(struct sat *s, int var);
+
+#endif /* __SAT_H */
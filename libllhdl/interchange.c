@@ -8,6 +8,7 @@
 
 #include <llhdl/structure.h>
 #include <llhdl/interchange.h>
+#include <llhdl/tools.h>
 
 enum {
 	CMD_NONE,
@@ -15,7 +16,8 @@ enum {
 	CMD_INPUT,
 	CMD_OUTPUT,
 	CMD_SIGNAL,
-	CMD_ASSIGN
+	CMD_ASSIGN,
+	CMD_INSTANCE
 };
 
 static int str_to_cmd(const char *str)
@@ -27,6 +29,7 @@ static int str_to_cmd(const char *str)
 	if(strcmp(str, "output") == 0) return CMD_OUTPUT;
 	if(strcmp(str, "signal") == 0) return CMD_SIGNAL;
 	if(strcmp(str, "assign") == 0) return CMD_ASSIGN;
+	if(strcmp(str, "instance") == 0) return CMD_INSTANCE;
 	fprintf(stderr, "Invalid command: %s\n", str);
 	exit(EXIT_FAILURE);
 	return 0;
@@ -93,16 +96,93 @@ static int str_to_int(const char *str)
 
 static const char delims[] = " \t\n";
 
-static void parse_module(struct llhdl_module *m, char **saveptr)
+/* Signals of the module being parsed, by name, in an open addressing hash table */
+struct parse_names {
+	struct llhdl_node **table;
+	unsigned int mask;
+	int count;
+};
+
+static unsigned int name_hash(const char *s)
+{
+	unsigned int h;
+
+	h = 2166136261U;
+	while(*s != 0) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void init_names(struct parse_names *names)
+{
+	names->mask = 255;
+	names->table = alloc_size0((names->mask+1)*sizeof(struct llhdl_node *));
+	names->count = 0;
+}
+
+static unsigned int name_slot(struct parse_names *names, const char *name)
+{
+	unsigned int h;
+
+	h = name_hash(name) & names->mask;
+	while((names->table[h] != NULL) && (strcmp(names->table[h]->p.signal.name, name) != 0))
+		h = (h + 1) & names->mask;
+	return h;
+}
+
+static struct llhdl_node *find_name(struct parse_names *names, const char *name)
+{
+	return names->table[name_slot(names, name)];
+}
+
+static void add_name(struct parse_names *names, struct llhdl_node *n)
+{
+	struct llhdl_node **old;
+	unsigned int i, old_mask;
+
+	if(2*(names->count+1) > names->mask) {
+		old = names->table;
+		old_mask = names->mask;
+		names->mask = 2*names->mask + 1;
+		names->table = alloc_size0((names->mask+1)*sizeof(struct llhdl_node *));
+		for(i=0;i<=old_mask;i++)
+			if(old[i] != NULL)
+				names->table[name_slot(names, old[i]->p.signal.name)] = old[i];
+		free(old);
+	}
+	names->table[name_slot(names, n->p.signal.name)] = n;
+	names->count++;
+}
+
+/* Each module but the last one is a definition, owned by the module that follows */
+static void parse_module(struct llhdl_module **m, char **saveptr)
 {
 	char *token;
+	struct llhdl_module *next;
 
 	token = strtok_r(NULL, delims, saveptr);
 	if(token == NULL) {
 		fprintf(stderr, "Unexpected end of line\n");
 		exit(EXIT_FAILURE);
 	}
-	llhdl_set_module_name(m, token);
+	if(((*m)->name != NULL) || ((*m)->head != NULL) || ((*m)->ihead != NULL)) {
+		if((*m)->name == NULL) {
+			fprintf(stderr, "Module definitions must be named\n");
+			exit(EXIT_FAILURE);
+		}
+		if((strcmp((*m)->name, token) == 0) || (llhdl_find_definition(*m, token) != NULL)) {
+			fprintf(stderr, "Module %s is defined twice\n", token);
+			exit(EXIT_FAILURE);
+		}
+		next = llhdl_new_module();
+		next->dhead = (*m)->dhead;
+		(*m)->dhead = NULL;
+		llhdl_add_definition(next, *m);
+		*m = next;
+	}
+	llhdl_set_module_name(*m, token);
 }
 
 static void parse_vectorsize_sign(int *vectorsize_affected, int *sign_affected, int *vectorsize, int *sign, char **saveptr)
@@ -135,7 +215,7 @@ static void parse_vectorsize_sign(int *vectorsize_affected, int *sign_affected,
 	}
 }
 
-static void parse_signal(struct llhdl_module *m, char **saveptr, int type)
+static void parse_signal(struct llhdl_module *m, struct parse_names *names, char **saveptr, int type)
 {
 	char *token;
 	int vectorsize_affected, sign_affected;
@@ -152,7 +232,7 @@ static void parse_signal(struct llhdl_module *m, char **saveptr, int type)
 	sign = 0;
 	parse_vectorsize_sign(&vectorsize_affected, &sign_affected, &vectorsize, &sign, saveptr);
 	parse_vectorsize_sign(&vectorsize_affected, &sign_affected, &vectorsize, &sign, saveptr);
-	llhdl_create_signal(m, type, token, sign, vectorsize);
+	add_name(names, llhdl_create_signal(m, type, token, sign, vectorsize));
 }
 
 static struct llhdl_node *parse_constant(char *t)
@@ -193,35 +273,26 @@ static struct llhdl_node *parse_constant(char *t)
 	return n;
 }
 
-static struct llhdl_node *parse_expr(struct llhdl_module *m, char **saveptr);
 static int parse_expr_i(struct llhdl_module *m, char **saveptr);
 static int parse_expr_s(struct llhdl_module *m, char **saveptr);
 
-static struct llhdl_node **parse_nexpr(struct llhdl_module *m, char **saveptr, int n)
-{
-	int i;
-	struct llhdl_node **branches;
-	
-	branches = alloc_size(n*sizeof(struct llhdl_node *));
-	for(i=0;i<n;i++)
-		branches[i] = parse_expr(m, saveptr);
-	
-	return branches;
-}
-
-static struct llhdl_node *parse_operator(struct llhdl_module *m, char *op, char **saveptr)
-{
+/* An operator whose operands are being parsed */
+struct parse_frame {
 	int opc;
-	struct llhdl_node **branches;
-	struct llhdl_node *n;
-	int i, count;
-	struct llhdl_node *select;
 	int sign;
+	int count;			/* < operands, or slices of a vector */
+	int parsed;
+	struct llhdl_node **operands;	/* < the select of a mux comes first */
 	struct llhdl_slice *slices;
+};
 
-	branches = NULL;
-	opc = str_to_op(op);
-	switch(opc) {
+static void parse_operator(struct llhdl_module *m, char *op, char **saveptr, struct parse_frame *f)
+{
+	f->opc = str_to_op(op);
+	f->parsed = 0;
+	f->operands = NULL;
+	f->slices = NULL;
+	switch(f->opc) {
 		case OP_NOT:
 		case OP_AND:
 		case OP_OR:
@@ -229,68 +300,108 @@ static struct llhdl_node *parse_operator(struct llhdl_module *m, char *op, char
 		case OP_ADD:
 		case OP_SUB:
 		case OP_MUL:
-			branches = parse_nexpr(m, saveptr, llhdl_get_logic_arity(op_to_llhdl(opc)));
-			n = llhdl_create_logic(op_to_llhdl(opc), branches);
+			f->count = llhdl_get_logic_arity(op_to_llhdl(f->opc));
 			break;
 		case OP_MUX:
-			count = parse_expr_i(m, saveptr);
-			select = parse_expr(m, saveptr);
-			branches = parse_nexpr(m, saveptr, count);
-			n = llhdl_create_mux(count, select, branches);
+			f->count = parse_expr_i(m, saveptr) + 1;
 			break;
 		case OP_FD:
-			branches = parse_nexpr(m, saveptr, 2);
-			n = llhdl_create_fd(branches[0], branches[1]);
+			f->count = 2;
 			break;
 		case OP_VECT:
-			sign = parse_expr_s(m, saveptr);
-			count = parse_expr_i(m, saveptr);
-			assert(count > 0);
-			slices = alloc_size(count*sizeof(struct llhdl_slice));
-			for(i=0;i<count;i++) {
-				slices[i].source = parse_expr(m, saveptr);
-				slices[i].start = parse_expr_i(m, saveptr);
-				slices[i].end = parse_expr_i(m, saveptr);
-			}
-			n = llhdl_create_vect(sign, count, slices);
-			free(slices);
-			break;
+			f->sign = parse_expr_s(m, saveptr);
+			f->count = parse_expr_i(m, saveptr);
+			assert(f->count > 0);
+			f->slices = alloc_size(f->count*sizeof(struct llhdl_slice));
+			return;
 		default:
 			assert(0);
-			return NULL;
+			return;
 	}
-	free(branches);
+	f->operands = alloc_size(f->count*sizeof(struct llhdl_node *));
+}
+
+/* Adds an operand to the frame, and returns 1 if the frame is complete */
+static int parse_operand(struct llhdl_module *m, char **saveptr, struct parse_frame *f, struct llhdl_node *n)
+{
+	if(f->opc == OP_VECT) {
+		f->slices[f->parsed].source = n;
+		f->slices[f->parsed].start = parse_expr_i(m, saveptr);
+		f->slices[f->parsed].end = parse_expr_i(m, saveptr);
+	} else
+		f->operands[f->parsed] = n;
+	f->parsed++;
+	return f->parsed == f->count;
+}
+
+static struct llhdl_node *parse_complete(struct parse_frame *f)
+{
+	struct llhdl_node *n;
+
+	switch(f->opc) {
+		case OP_MUX:
+			n = llhdl_create_mux(f->count-1, f->operands[0], &f->operands[1]);
+			break;
+		case OP_FD:
+			n = llhdl_create_fd(f->operands[0], f->operands[1]);
+			break;
+		case OP_VECT:
+			n = llhdl_create_vect(f->sign, f->count, f->slices);
+			break;
+		default:
+			n = llhdl_create_logic(op_to_llhdl(f->opc), f->operands);
+			break;
+	}
+	free(f->operands);
+	free(f->slices);
 	return n;
 }
 
-static struct llhdl_node *parse_expr(struct llhdl_module *m, char **saveptr)
+/* Expressions are in prefix notation, the pending operators are kept on an explicit stack */
+static struct llhdl_node *parse_expr(struct llhdl_module *m, struct parse_names *names, char **saveptr)
 {
+	struct parse_frame *stack;
+	int depth, size;
 	char *token;
-	char type;
+	struct llhdl_node *n;
 
-	token = strtok_r(NULL, delims, saveptr);
-	if(token == NULL) {
-		fprintf(stderr, "Unexpected end of expression\n");
-		exit(EXIT_FAILURE);
-	}
-	type = *token;
-	switch(type) {
-		case '0'...'9':
-			return parse_constant(token);
-		case '#':
-			token++;
-			return parse_operator(m, token, saveptr);
-		default: {
-			struct llhdl_node *n;
-
-			n = llhdl_find_signal(m, token);
-			if(n == NULL) {
-				fprintf(stderr, "Reference to unknown signal: %s\n", token);
-				exit(EXIT_FAILURE);
-			}
-			return n;
+	size = 16;
+	stack = alloc_size(size*sizeof(struct parse_frame));
+	depth = 0;
+	while(1) {
+		token = strtok_r(NULL, delims, saveptr);
+		if(token == NULL) {
+			fprintf(stderr, "Unexpected end of expression\n");
+			exit(EXIT_FAILURE);
 		}
+		switch(*token) {
+			case '0'...'9':
+				n = parse_constant(token);
+				break;
+			case '#':
+				if(depth == size) {
+					size *= 2;
+					stack = realloc(stack, size*sizeof(struct parse_frame));
+					assert(stack != NULL);
+				}
+				parse_operator(m, token+1, saveptr, &stack[depth++]);
+				continue;
+			default:
+				n = find_name(names, token);
+				if(n == NULL) {
+					fprintf(stderr, "Reference to unknown signal: %s\n", token);
+					exit(EXIT_FAILURE);
+				}
+				break;
+		}
+		/* Complete the operators that this node finishes */
+		while((depth > 0) && parse_operand(m, saveptr, &stack[depth-1], n))
+			n = parse_complete(&stack[--depth]);
+		if(depth == 0)
+			break;
 	}
+	free(stack);
+	return n;
 }
 
 static int parse_expr_i(struct llhdl_module *m, char **saveptr)
@@ -321,7 +432,7 @@ static int parse_expr_s(struct llhdl_module *m, char **saveptr)
 	return 0;
 }
 
-static void parse_assign(struct llhdl_module *m, char **saveptr)
+static void parse_assign(struct llhdl_module *m, struct parse_names *names, char **saveptr)
 {
 	char *token;
 	struct llhdl_node *target_signal;
@@ -331,20 +442,73 @@ static void parse_assign(struct llhdl_module *m, char **saveptr)
 		fprintf(stderr, "Unexpected end of line\n");
 		exit(EXIT_FAILURE);
 	}
-	target_signal = llhdl_find_signal(m, token);
+	target_signal = find_name(names, token);
 	if(target_signal == NULL) {
 		fprintf(stderr, "Assignment to unknown signal %s\n", token);
 		exit(EXIT_FAILURE);
 	}
-	if(target_signal->p.signal.source != NULL) {
+	if((target_signal->p.signal.source != NULL) || (target_signal->p.signal.driver != NULL)) {
 		fprintf(stderr, "Conflicting assignments on signal %s\n", token);
 		exit(EXIT_FAILURE);
 	}
-	target_signal->p.signal.source = parse_expr(m, saveptr);
+	target_signal->p.signal.source = parse_expr(m, names, saveptr);
 }
 
-static void parse_line(struct llhdl_module *m, char *line)
+static void parse_instance(struct llhdl_module *m, struct parse_names *names, char **saveptr)
 {
+	char *name, *token, *signal_name;
+	struct llhdl_module *definition;
+	struct llhdl_instance *inst;
+	struct llhdl_node *port, *signal;
+
+	name = strtok_r(NULL, delims, saveptr);
+	token = strtok_r(NULL, delims, saveptr);
+	if(token == NULL) {
+		fprintf(stderr, "Unexpected end of line\n");
+		exit(EXIT_FAILURE);
+	}
+	definition = llhdl_find_definition(m, token);
+	if(definition == NULL) {
+		fprintf(stderr, "Instance of unknown module: %s\n", token);
+		exit(EXIT_FAILURE);
+	}
+	for(inst=m->ihead;inst!=NULL;inst=inst->next) {
+		if(strcmp(inst->name, name) == 0) {
+			fprintf(stderr, "Instance %s is defined twice\n", name);
+			exit(EXIT_FAILURE);
+		}
+	}
+	inst = llhdl_create_instance(m, definition, name);
+	while((token = strtok_r(NULL, delims, saveptr)) != NULL) {
+		signal_name = strchr(token, '=');
+		if(signal_name == NULL) {
+			fprintf(stderr, "Invalid port connection: %s\n", token);
+			exit(EXIT_FAILURE);
+		}
+		*signal_name++ = 0;
+		port = llhdl_find_signal(definition, token);
+		if(port == NULL) {
+			fprintf(stderr, "Connection to unknown port: %s\n", token);
+			exit(EXIT_FAILURE);
+		}
+		signal = find_name(names, signal_name);
+		if(signal == NULL) {
+			fprintf(stderr, "Reference to unknown signal: %s\n", signal_name);
+			exit(EXIT_FAILURE);
+		}
+		llhdl_connect(inst, port, signal);
+	}
+	for(port=definition->head;port!=NULL;port=port->p.signal.next) {
+		if((port->p.signal.type == LLHDL_SIGNAL_PORT_IN) && (llhdl_find_connection(inst, port) == NULL)) {
+			fprintf(stderr, "Input port %s of instance %s is not connected\n", port->p.signal.name, name);
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+static void parse_line(struct llhdl_module **m2, struct parse_names *names, char *line)
+{
+	struct llhdl_module *m = *m2;
 	char *saveptr;
 	char *str;
 	int command;
@@ -355,19 +519,26 @@ static void parse_line(struct llhdl_module *m, char *line)
 		case CMD_NONE:
 			return;
 		case CMD_MODULE:
-			parse_module(m, &saveptr);
+			parse_module(m2, &saveptr);
+			if(*m2 != m) {
+				free(names->table);
+				init_names(names);
+			}
 			break;
 		case CMD_INPUT:
-			parse_signal(m, &saveptr, LLHDL_SIGNAL_PORT_IN);
+			parse_signal(m, names, &saveptr, LLHDL_SIGNAL_PORT_IN);
 			break;
 		case CMD_OUTPUT:
-			parse_signal(m, &saveptr, LLHDL_SIGNAL_PORT_OUT);
+			parse_signal(m, names, &saveptr, LLHDL_SIGNAL_PORT_OUT);
 			break;
 		case CMD_SIGNAL:
-			parse_signal(m, &saveptr, LLHDL_SIGNAL_INTERNAL);
+			parse_signal(m, names, &saveptr, LLHDL_SIGNAL_INTERNAL);
 			break;
 		case CMD_ASSIGN:
-			parse_assign(m, &saveptr);
+			parse_assign(m, names, &saveptr);
+			return;
+		case CMD_INSTANCE:
+			parse_instance(m, names, &saveptr);
 			return;
 		default:
 			fprintf(stderr, "Invalid command: %s\n", str);
@@ -384,11 +555,13 @@ static void parse_line(struct llhdl_module *m, char *line)
 struct llhdl_module *llhdl_parse_fd(FILE *fd)
 {
 	struct llhdl_module *m;
+	struct parse_names names;
 	int r;
 	char *line;
 	size_t linesize;
 
 	m = llhdl_new_module();
+	init_names(&names);
 	
 	line = NULL;
 	linesize = 0;
@@ -398,9 +571,10 @@ struct llhdl_module *llhdl_parse_fd(FILE *fd)
 			assert(feof(fd));
 			break;
 		}
-		parse_line(m, line);
+		parse_line(&m, &names, line);
 	}
 	free(line);
+	free(names.table);
 
 	return m;
 }
@@ -432,17 +606,25 @@ static void write_signals(struct llhdl_module *m, FILE *fd)
 	}
 }
 
-static void write_expr(FILE *fd, struct llhdl_node *n)
+/* A node to write, or the bounds that follow the source of a slice */
+struct write_item {
+	struct llhdl_node *n;
+	struct llhdl_slice *slice;
+};
+
+static void write_node(FILE *fd, struct llhdl_node *n)
 {
-	int arity;
-	int i;
+	mpz_t v;
 	
 	fprintf(fd, " ");
 	switch(n->type) {
 		case LLHDL_NODE_CONSTANT:
 			if(n->p.constant.sign || (n->p.constant.vectorsize != 1))
 				fprintf(fd, "%d%c", n->p.constant.vectorsize, n->p.constant.sign ? 's' : 'u');
-			mpz_out_str(fd, 10, n->p.constant.value);
+			mpz_init(v);
+			llhdl_get_constant_value(v, n);
+			mpz_out_str(fd, 10, v);
+			mpz_clear(v);
 			break;
 		case LLHDL_NODE_SIGNAL:
 			fprintf(fd, "%s", n->p.signal.name);
@@ -475,29 +657,17 @@ static void write_expr(FILE *fd, struct llhdl_node *n)
 					assert(0);
 					break;
 			}
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			for(i=0;i<arity;i++)
-				write_expr(fd, n->p.logic.operands[i]);
 			break;
 		case LLHDL_NODE_MUX:
 			fprintf(fd, "#mux %d", n->p.mux.nsources);
-			write_expr(fd, n->p.mux.select);
-			for(i=0;i<n->p.mux.nsources;i++)
-				write_expr(fd, n->p.mux.sources[i]);
 			break;
 		case LLHDL_NODE_FD:
 			fprintf(fd, "#fd");
-			write_expr(fd, n->p.fd.clock);
-			write_expr(fd, n->p.fd.data);
 			break;
 		case LLHDL_NODE_VECT:
 			fprintf(fd, "#vect %c %d",
 				n->p.vect.sign ? 's' : 'u',
 				n->p.vect.nslices);
-			for(i=0;i<n->p.vect.nslices;i++) {
-				write_expr(fd, n->p.vect.slices[i].source);
-				fprintf(fd, " %d %d", n->p.vect.slices[i].start, n->p.vect.slices[i].end);
-			}
 			break;
 		default:
 			assert(0);
@@ -505,6 +675,52 @@ static void write_expr(FILE *fd, struct llhdl_node *n)
 	}
 }
 
+static void write_expr(FILE *fd, struct llhdl_node *n)
+{
+	struct write_item *stack;
+	int depth, size;
+	struct llhdl_node **operand;
+	int i, count;
+
+	size = 16;
+	stack = alloc_size(size*sizeof(struct write_item));
+	stack[0].n = n;
+	stack[0].slice = NULL;
+	depth = 1;
+	while(depth > 0) {
+		depth--;
+		if(stack[depth].slice != NULL) {
+			fprintf(fd, " %d %d", stack[depth].slice->start, stack[depth].slice->end);
+			continue;
+		}
+		n = stack[depth].n;
+		write_node(fd, n);
+		if(n->type == LLHDL_NODE_SIGNAL)
+			continue;
+		count = 0;
+		while(llhdl_get_operand(n, count) != NULL)
+			count++;
+		if(depth + 2*count > size) {
+			size = 2*(depth + 2*count);
+			stack = realloc(stack, size*sizeof(struct write_item));
+			assert(stack != NULL);
+		}
+		/* Pushed in reverse, so that the operands are written in order */
+		for(i=count-1;i>=0;i--) {
+			operand = llhdl_get_operand(n, i);
+			if(n->type == LLHDL_NODE_VECT) {
+				stack[depth].n = NULL;
+				stack[depth].slice = &n->p.vect.slices[i];
+				depth++;
+			}
+			stack[depth].n = *operand;
+			stack[depth].slice = NULL;
+			depth++;
+		}
+	}
+	free(stack);
+}
+
 static void write_assignments(struct llhdl_module *m, FILE *fd)
 {
 	struct llhdl_node *n;
@@ -521,14 +737,45 @@ static void write_assignments(struct llhdl_module *m, FILE *fd)
 	}
 }
 
-void llhdl_write_fd(struct llhdl_module *m, FILE *fd)
+static void write_instances(struct llhdl_module *m, FILE *fd)
+{
+	struct llhdl_instance *inst;
+	int i;
+
+	inst = m->ihead;
+	while(inst != NULL) {
+		fprintf(fd, "instance %s %s", inst->name, inst->definition->name);
+		for(i=0;i<inst->nconnections;i++)
+			fprintf(fd, " %s=%s",
+				inst->connections[i].port->p.signal.name,
+				inst->connections[i].signal->p.signal.name);
+		fprintf(fd, "\n");
+		inst = inst->next;
+	}
+}
+
+static void write_module(struct llhdl_module *m, FILE *fd)
 {
 	if(m->name != NULL)
 		fprintf(fd, "module %s\n", m->name);
 	write_signals(m, fd);
+	write_instances(m, fd);
 	write_assignments(m, fd);
 }
 
+void llhdl_write_fd(struct llhdl_module *m, FILE *fd)
+{
+	struct llhdl_module *d;
+
+	d = m->dhead;
+	while(d != NULL) {
+		write_module(d, fd);
+		fprintf(fd, "\n");
+		d = d->next;
+	}
+	write_module(m, fd);
+}
+
 struct llhdl_module *llhdl_parse_file(const char *filename)
 {
 	FILE *fd;
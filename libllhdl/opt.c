@@ -0,0 +1,1210 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <util.h>
+#include <gmp.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/tools.h>
+#include <llhdl/opt.h>
+
+/*
+ * Values follow the conventions of the mapper: operands are extended to the width
+ * of the node that consumes them according to their own sign, and results are
+ * truncated to the node width.
+ */
+
+typedef int (*rewrite_c)(struct llhdl_module *m, struct llhdl_node **n);
+
+/* Bottom-up rewrite of a tree, the callback may replace the node it is passed */
+static int rewrite(struct llhdl_module *m, struct llhdl_node **n, rewrite_c c)
+{
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
+	int r;
+
+	r = 0;
+	llhdl_traversal_init(&t, LLHDL_ORDER_POST, 0);
+	llhdl_traversal_push(&t, n);
+	while((slot = llhdl_traversal_next(&t)) != NULL)
+		r += c(m, slot);
+	llhdl_traversal_free(&t);
+	return r;
+}
+
+static int rewrite_module(struct llhdl_module *m, rewrite_c c)
+{
+	struct llhdl_node *n;
+	int r;
+
+	r = 0;
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		r += rewrite(m, &n->p.signal.source, c);
+	return r;
+}
+
+static struct llhdl_node *new_constant(mpz_t v, int sign, int vectorsize)
+{
+	struct llhdl_node *n;
+	mpz_t r;
+
+	mpz_init(r);
+	mpz_fdiv_r_2exp(r, v, vectorsize);
+	n = llhdl_create_constant(r, sign, vectorsize);
+	mpz_clear(r);
+	return n;
+}
+
+static struct llhdl_node *new_constant_ui(unsigned long int v, int sign, int vectorsize)
+{
+	return llhdl_create_constant_ui(v, sign, vectorsize);
+}
+
+static void replace(struct llhdl_node **n, struct llhdl_node *r)
+{
+	llhdl_free_node(*n);
+	*n = r;
+}
+
+/* Returns 0 if the constant, extended to <vectorsize> bits, is all zeros,
+ * 1 if it is all ones, -1 otherwise.
+ */
+static int constant_pattern(struct llhdl_node *n, int vectorsize)
+{
+	mpz_t v;
+	int r;
+
+	mpz_init(v);
+	llhdl_get_constant_value(v, n);
+	mpz_fdiv_r_2exp(v, v, vectorsize);
+	if(mpz_sgn(v) == 0)
+		r = 0;
+	else if(mpz_popcount(v) == vectorsize)
+		r = 1;
+	else
+		r = -1;
+	mpz_clear(v);
+	return r;
+}
+
+static int constant_is_one(struct llhdl_node *n)
+{
+	mpz_t v;
+	int r;
+
+	mpz_init(v);
+	llhdl_get_constant_value(v, n);
+	r = mpz_cmp_ui(v, 1) == 0;
+	mpz_clear(v);
+	return r;
+}
+
+/* Give <n> the requested vector size and sign, preserving its value.
+ * Returns NULL if that cannot be done without duplicating <n>.
+ */
+static struct llhdl_node *adjust(struct llhdl_node *n, int vectorsize, int sign)
+{
+	int n_vectorsize, n_sign;
+	struct llhdl_slice *slices;
+	int nslices;
+	mpz_t v;
+	struct llhdl_node *r;
+
+	n_vectorsize = llhdl_get_vectorsize(n);
+	n_sign = llhdl_get_sign(n);
+	if((n_vectorsize == vectorsize) && (n_sign == sign))
+		return n;
+	if(n->type == LLHDL_NODE_CONSTANT) {
+		mpz_init(v);
+		llhdl_get_constant_value(v, n);
+		r = new_constant(v, sign, vectorsize);
+		mpz_clear(v);
+		llhdl_free_node(n);
+		return r;
+	}
+	if(n_vectorsize >= vectorsize) {
+		slices = alloc_type(struct llhdl_slice);
+		slices[0].source = n;
+		slices[0].start = 0;
+		slices[0].end = vectorsize-1;
+		nslices = 1;
+	} else if(!n_sign) {
+		slices = alloc_size(2*sizeof(struct llhdl_slice));
+		slices[0].source = n;
+		slices[0].start = 0;
+		slices[0].end = n_vectorsize-1;
+		slices[1].source = new_constant_ui(0, 0, vectorsize-n_vectorsize);
+		slices[1].start = 0;
+		slices[1].end = vectorsize-n_vectorsize-1;
+		nslices = 2;
+	} else if(n->type == LLHDL_NODE_SIGNAL) {
+		/* signals can be referenced several times to replicate the sign bit */
+		nslices = 1 + vectorsize - n_vectorsize;
+		slices = alloc_size(nslices*sizeof(struct llhdl_slice));
+		slices[0].source = n;
+		slices[0].start = 0;
+		slices[0].end = n_vectorsize-1;
+		for(nslices=1;nslices<=vectorsize-n_vectorsize;nslices++) {
+			slices[nslices].source = n;
+			slices[nslices].start = n_vectorsize-1;
+			slices[nslices].end = n_vectorsize-1;
+		}
+	} else
+		return NULL;
+	r = llhdl_create_vect(sign, nslices, slices);
+	free(slices);
+	return r;
+}
+
+/* Replace <n> by one of its operands, optionally inverted */
+static int replace_by_operand(struct llhdl_node **n, struct llhdl_node **operand, int invert)
+{
+	struct llhdl_node *x, *r;
+	int vectorsize, sign;
+
+	vectorsize = llhdl_get_vectorsize(*n);
+	sign = llhdl_get_sign(*n);
+	x = *operand;
+	*operand = NULL;
+	r = adjust(x, vectorsize, sign);
+	if(r == NULL) {
+		*operand = x;
+		return 0;
+	}
+	if(invert)
+		r = llhdl_create_logic(LLHDL_LOGIC_NOT, &r);
+	replace(n, r);
+	return 1;
+}
+
+static int replace_by_constant(struct llhdl_node **n, int ones)
+{
+	int vectorsize;
+	mpz_t v;
+
+	vectorsize = llhdl_get_vectorsize(*n);
+	mpz_init(v);
+	if(ones) {
+		mpz_setbit(v, vectorsize);
+		mpz_sub_ui(v, v, 1);
+	}
+	replace(n, new_constant(v, llhdl_get_sign(*n), vectorsize));
+	mpz_clear(v);
+	return 1;
+}
+
+static int all_operands_constant(struct llhdl_node *n)
+{
+	int i, arity;
+
+	switch(n->type) {
+		case LLHDL_NODE_LOGIC:
+		case LLHDL_NODE_EXTLOGIC:
+			arity = llhdl_get_logic_arity(n->p.logic.op);
+			for(i=0;i<arity;i++)
+				if(n->p.logic.operands[i]->type != LLHDL_NODE_CONSTANT)
+					return 0;
+			return 1;
+		case LLHDL_NODE_VECT:
+			for(i=0;i<n->p.vect.nslices;i++)
+				if(n->p.vect.slices[i].source->type != LLHDL_NODE_CONSTANT)
+					return 0;
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+/*
+ * Constant folding
+ */
+
+static int fold_signal(struct llhdl_node **n2)
+{
+	struct llhdl_node *n = *n2;
+	struct llhdl_node *source;
+	mpz_t v;
+
+	if(n->p.signal.type != LLHDL_SIGNAL_INTERNAL)
+		return 0;
+	source = n->p.signal.source;
+	if(source == NULL)
+		return 0;
+	if(source->type == LLHDL_NODE_CONSTANT) {
+		mpz_init(v);
+		llhdl_get_constant_value(v, source);
+		*n2 = new_constant(v, n->p.signal.sign, n->p.signal.vectorsize);
+		mpz_clear(v);
+		return 1;
+	}
+	if((source->type == LLHDL_NODE_SIGNAL) && (source != n)
+	  && (llhdl_get_vectorsize(source) == n->p.signal.vectorsize)
+	  && (llhdl_get_sign(source) == n->p.signal.sign)) {
+		/* alias */
+		*n2 = source;
+		return 1;
+	}
+	return 0;
+}
+
+static int fold_c(struct llhdl_module *m, struct llhdl_node **n2)
+{
+	struct llhdl_node *n = *n2;
+	mpz_t a, b, r;
+	int i, j, bitindex;
+
+	if(n->type == LLHDL_NODE_SIGNAL)
+		return fold_signal(n2);
+	if(!all_operands_constant(n))
+		return 0;
+
+	mpz_init(a);
+	mpz_init(b);
+	mpz_init(r);
+	if(n->type == LLHDL_NODE_VECT) {
+		bitindex = 0;
+		for(i=0;i<n->p.vect.nslices;i++) {
+			llhdl_get_constant_value(a, n->p.vect.slices[i].source);
+			for(j=n->p.vect.slices[i].start;j<=n->p.vect.slices[i].end;j++) {
+				if(mpz_tstbit(a, j))
+					mpz_setbit(r, bitindex);
+				bitindex++;
+			}
+		}
+	} else {
+		llhdl_get_constant_value(a, n->p.logic.operands[0]);
+		if(llhdl_get_logic_arity(n->p.logic.op) > 1)
+			llhdl_get_constant_value(b, n->p.logic.operands[1]);
+		switch(n->p.logic.op) {
+			case LLHDL_LOGIC_NOT:
+				mpz_com(r, a);
+				break;
+			case LLHDL_LOGIC_AND:
+				mpz_and(r, a, b);
+				break;
+			case LLHDL_LOGIC_OR:
+				mpz_ior(r, a, b);
+				break;
+			case LLHDL_LOGIC_XOR:
+				mpz_xor(r, a, b);
+				break;
+			case LLHDL_EXTLOGIC_ADD:
+				mpz_add(r, a, b);
+				break;
+			case LLHDL_EXTLOGIC_SUB:
+				mpz_sub(r, a, b);
+				break;
+			case LLHDL_EXTLOGIC_MUL:
+				mpz_mul(r, a, b);
+				break;
+			default:
+				assert(0);
+				break;
+		}
+	}
+	replace(n2, new_constant(r, llhdl_get_sign(n), llhdl_get_vectorsize(n)));
+	mpz_clear(a);
+	mpz_clear(b);
+	mpz_clear(r);
+	return 1;
+}
+
+static int opt_fold(struct llhdl_module *m)
+{
+	return rewrite_module(m, fold_c);
+}
+
+/*
+ * Algebraic simplifications
+ */
+
+static int simplify_logic(struct llhdl_node **n2)
+{
+	struct llhdl_node *n = *n2;
+	struct llhdl_node **operands = n->p.logic.operands;
+	int k, pattern;
+
+	if(n->p.logic.op == LLHDL_LOGIC_NOT) {
+		if((operands[0]->type == LLHDL_NODE_LOGIC) && (operands[0]->p.logic.op == LLHDL_LOGIC_NOT))
+			return replace_by_operand(n2, &operands[0]->p.logic.operands[0], 0);
+		return 0;
+	}
+
+	if(llhdl_equiv(operands[0], operands[1])) {
+		switch(n->p.logic.op) {
+			case LLHDL_LOGIC_AND:
+			case LLHDL_LOGIC_OR:
+				return replace_by_operand(n2, &operands[0], 0);
+			case LLHDL_LOGIC_XOR:
+			case LLHDL_EXTLOGIC_SUB:
+				return replace_by_constant(n2, 0);
+		}
+	}
+
+	for(k=0;k<2;k++) {
+		if(operands[k]->type != LLHDL_NODE_CONSTANT)
+			continue;
+		if((n->p.logic.op == LLHDL_EXTLOGIC_SUB) && (k == 0))
+			continue;
+		pattern = constant_pattern(operands[k], llhdl_get_vectorsize(n));
+		switch(n->p.logic.op) {
+			case LLHDL_LOGIC_AND:
+				if(pattern == 0)
+					return replace_by_constant(n2, 0);
+				if(pattern == 1)
+					return replace_by_operand(n2, &operands[!k], 0);
+				break;
+			case LLHDL_LOGIC_OR:
+				if(pattern == 0)
+					return replace_by_operand(n2, &operands[!k], 0);
+				if(pattern == 1)
+					return replace_by_constant(n2, 1);
+				break;
+			case LLHDL_LOGIC_XOR:
+				if(pattern != -1)
+					return replace_by_operand(n2, &operands[!k], pattern);
+				break;
+			case LLHDL_EXTLOGIC_ADD:
+			case LLHDL_EXTLOGIC_SUB:
+				if(pattern == 0)
+					return replace_by_operand(n2, &operands[!k], 0);
+				break;
+			case LLHDL_EXTLOGIC_MUL:
+				if(pattern == 0)
+					return replace_by_constant(n2, 0);
+				if(constant_is_one(operands[k]))
+					return replace_by_operand(n2, &operands[!k], 0);
+				break;
+		}
+	}
+	return 0;
+}
+
+static int simplify_vect(struct llhdl_node **n2)
+{
+	struct llhdl_node *n = *n2;
+	struct llhdl_slice *slices = n->p.vect.slices;
+	struct llhdl_slice *merged;
+	int i, nmerged;
+
+	if((n->p.vect.nslices == 1) && (slices[0].start == 0)
+	  && (slices[0].end == llhdl_get_vectorsize(slices[0].source)-1)
+	  && (llhdl_get_sign(slices[0].source) == n->p.vect.sign))
+		return replace_by_operand(n2, &slices[0].source, 0);
+
+	/* merge contiguous slices of the same signal */
+	for(i=1;i<n->p.vect.nslices;i++)
+		if((slices[i].source == slices[i-1].source)
+		  && (slices[i].source->type == LLHDL_NODE_SIGNAL)
+		  && (slices[i].start == slices[i-1].end+1))
+			break;
+	if(i == n->p.vect.nslices)
+		return 0;
+	merged = alloc_size(n->p.vect.nslices*sizeof(struct llhdl_slice));
+	nmerged = 0;
+	for(i=0;i<n->p.vect.nslices;i++) {
+		if((nmerged > 0)
+		  && (slices[i].source == merged[nmerged-1].source)
+		  && (slices[i].source->type == LLHDL_NODE_SIGNAL)
+		  && (slices[i].start == merged[nmerged-1].end+1))
+			merged[nmerged-1].end = slices[i].end;
+		else {
+			merged[nmerged++] = slices[i];
+			slices[i].source = NULL;
+		}
+	}
+	*n2 = llhdl_create_vect(n->p.vect.sign, nmerged, merged);
+	llhdl_free_node(n);
+	free(merged);
+	return 1;
+}
+
+static int simplify_c(struct llhdl_module *m, struct llhdl_node **n2)
+{
+	switch((*n2)->type) {
+		case LLHDL_NODE_LOGIC:
+		case LLHDL_NODE_EXTLOGIC:
+			return simplify_logic(n2);
+		case LLHDL_NODE_VECT:
+			return simplify_vect(n2);
+		default:
+			return 0;
+	}
+}
+
+static int opt_simplify(struct llhdl_module *m)
+{
+	return rewrite_module(m, simplify_c);
+}
+
+/*
+ * Multiplexer simplifications
+ */
+
+/* All the values of the select have a source */
+static int mux_is_full(struct llhdl_node *n)
+{
+	int nselect;
+
+	nselect = llhdl_get_vectorsize(n->p.mux.select);
+	return (nselect < 31) && (n->p.mux.nsources >= (1 << nselect));
+}
+
+static int mux_c(struct llhdl_module *m, struct llhdl_node **n2)
+{
+	struct llhdl_node *n = *n2;
+	struct llhdl_node *select;
+	mpz_t v;
+	int i;
+
+	if(n->type != LLHDL_NODE_MUX)
+		return 0;
+	select = n->p.mux.select;
+
+	if(select->type == LLHDL_NODE_CONSTANT) {
+		mpz_init(v);
+		llhdl_get_constant_bits(v, select);
+		if(mpz_cmp_ui(v, n->p.mux.nsources) < 0)
+			i = mpz_get_ui(v);
+		else
+			i = -1;
+		mpz_clear(v);
+		if(i < 0)
+			/* undefined, pick zero */
+			return replace_by_constant(n2, 0);
+		return replace_by_operand(n2, &n->p.mux.sources[i], 0);
+	}
+
+	for(i=1;i<n->p.mux.nsources;i++)
+		if(!llhdl_equiv(n->p.mux.sources[0], n->p.mux.sources[i]))
+			break;
+	/* select values past the last source read as 0 */
+	if((i == n->p.mux.nsources)
+	  && (mux_is_full(n) || ((n->p.mux.sources[0]->type == LLHDL_NODE_CONSTANT)
+	    && (constant_pattern(n->p.mux.sources[0], llhdl_get_vectorsize(n->p.mux.sources[0])) == 0))))
+		return replace_by_operand(n2, &n->p.mux.sources[0], 0);
+
+	if((n->p.mux.nsources != 2) || (llhdl_get_vectorsize(select) != 1))
+		return 0;
+
+	if((select->type == LLHDL_NODE_LOGIC) && (select->p.logic.op == LLHDL_LOGIC_NOT)) {
+		/* absorb the inversion of the select signal */
+		n->p.mux.select = select->p.logic.operands[0];
+		select->p.logic.operands[0] = NULL;
+		llhdl_free_node(select);
+		select = n->p.mux.sources[0];
+		n->p.mux.sources[0] = n->p.mux.sources[1];
+		n->p.mux.sources[1] = select;
+		return 1;
+	}
+
+	if((llhdl_get_vectorsize(n) == 1)
+	  && (n->p.mux.sources[0]->type == LLHDL_NODE_CONSTANT)
+	  && (n->p.mux.sources[1]->type == LLHDL_NODE_CONSTANT)) {
+		i = constant_pattern(n->p.mux.sources[0], 1);
+		if(i == constant_pattern(n->p.mux.sources[1], 1))
+			return replace_by_constant(n2, i);
+		return replace_by_operand(n2, &n->p.mux.select, i);
+	}
+
+	return 0;
+}
+
+static int opt_mux(struct llhdl_module *m)
+{
+	return rewrite_module(m, mux_c);
+}
+
+/*
+ * Common subexpression elimination.
+ * Identical subtrees are found by structural hashing, and replaced by
+ * references to an internal signal computing them once.
+ */
+
+struct cse_entry {
+	struct llhdl_node **slot;
+	struct llhdl_node *node;
+	struct llhdl_node *signal; /* < set if the subtree is the whole source of this signal */
+	unsigned int hash;
+	int size;
+	int dead;
+};
+
+struct cse_sc {
+	struct llhdl_module *m;
+	int nentries;
+	struct cse_entry *entries;
+	int next_id;
+};
+
+static unsigned int hash_mix(unsigned int h, unsigned int v)
+{
+	return (h ^ v)*16777619U;
+}
+
+static int walk_count(struct llhdl_node **n, void *user)
+{
+	(*(int *)user)++;
+	return 1;
+}
+
+struct cse_value {
+	unsigned int hash;
+	int size;
+};
+
+/* Mixes the hash of operand <i> into <h>. The values of the operands that are not
+ * NULL are the top of the stack, the first one deepest.
+ */
+static unsigned int cse_mix_operand(unsigned int h, struct llhdl_node *n, int i, struct cse_value *values, int *k, int *size)
+{
+	if(*llhdl_get_operand(n, i) == NULL)
+		return hash_mix(h, 0);
+	*size += values[*k].size;
+	return hash_mix(h, values[(*k)++].hash);
+}
+
+/* Hashes the subtrees of <root>, and records those that contain logic */
+static void cse_collect(struct cse_sc *sc, struct llhdl_node **root, struct llhdl_node *signal)
+{
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
+	struct llhdl_node *n;
+	struct cse_value *values;
+	int depth, size;
+	unsigned int h;
+	int i, k, count, arity;
+	int s;
+	struct cse_entry *e;
+
+	size = 16;
+	values = alloc_size(size*sizeof(struct cse_value));
+	depth = 0;
+	llhdl_traversal_init(&t, LLHDL_ORDER_POST, 0);
+	llhdl_traversal_push(&t, root);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		n = *slot;
+		count = 0;
+		for(i=0;llhdl_get_operand(n, i)!=NULL;i++)
+			if(*llhdl_get_operand(n, i) != NULL)
+				count++;
+		k = depth - count;
+		h = hash_mix(2166136261U, n->type);
+		s = 0;
+		switch(n->type) {
+			case LLHDL_NODE_CONSTANT:
+				h = hash_mix(h, n->p.constant.sign);
+				h = hash_mix(h, n->p.constant.vectorsize);
+				h = hash_mix(h, llhdl_get_constant_ui(n));
+				break;
+			case LLHDL_NODE_SIGNAL:
+				h = hash_mix(h, (unsigned long int)n);
+				break;
+			case LLHDL_NODE_LOGIC:
+			case LLHDL_NODE_EXTLOGIC:
+				h = hash_mix(h, n->p.logic.op);
+				arity = llhdl_get_logic_arity(n->p.logic.op);
+				for(i=0;i<arity;i++)
+					h = cse_mix_operand(h, n, i, values, &k, &s);
+				s += n->type == LLHDL_NODE_EXTLOGIC ? 3 : 1;
+				break;
+			case LLHDL_NODE_MUX:
+				h = hash_mix(h, n->p.mux.nsources);
+				for(i=0;i<=n->p.mux.nsources;i++)
+					h = cse_mix_operand(h, n, i, values, &k, &s);
+				s += 1;
+				break;
+			case LLHDL_NODE_FD:
+				h = cse_mix_operand(h, n, 0, values, &k, &s);
+				h = cse_mix_operand(h, n, 1, values, &k, &s);
+				s += 3;
+				break;
+			case LLHDL_NODE_VECT:
+				h = hash_mix(h, n->p.vect.sign);
+				for(i=0;i<n->p.vect.nslices;i++) {
+					h = hash_mix(h, n->p.vect.slices[i].start);
+					h = hash_mix(h, n->p.vect.slices[i].end);
+					h = cse_mix_operand(h, n, i, values, &k, &s);
+				}
+				break;
+			default:
+				assert(0);
+				break;
+		}
+		if(s > 0) {
+			e = &sc->entries[sc->nentries++];
+			e->slot = slot;
+			e->node = n;
+			e->signal = slot == root ? signal : NULL;
+			e->hash = h;
+			e->size = s;
+			e->dead = 0;
+			n->user = e;
+		}
+		depth -= count;
+		if(depth == size) {
+			size *= 2;
+			values = realloc(values, size*sizeof(struct cse_value));
+			assert(values != NULL);
+		}
+		values[depth].hash = h;
+		values[depth].size = s;
+		depth++;
+	}
+	llhdl_traversal_free(&t);
+	free(values);
+}
+
+static int cse_cmp(const void *a, const void *b)
+{
+	const struct cse_entry *ea = a, *eb = b;
+
+	if(ea->size != eb->size)
+		return eb->size - ea->size;
+	if(ea->hash != eb->hash)
+		return ea->hash < eb->hash ? -1 : 1;
+	return 0;
+}
+
+static int walk_mark_dead(struct llhdl_node **n, void *user)
+{
+	if(((*n)->type != LLHDL_NODE_SIGNAL) && ((*n)->user != NULL))
+		((struct cse_entry *)(*n)->user)->dead = 1;
+	return 1;
+}
+
+static int walk_clear_user(struct llhdl_node **n, void *user)
+{
+	if((*n)->type != LLHDL_NODE_SIGNAL)
+		(*n)->user = NULL;
+	return 1;
+}
+
+/* Numbers the new signals after those of the previous runs, so that their
+ * names are unique without searching the module for each of them.
+ */
+static int cse_first_id(struct llhdl_module *m)
+{
+	struct llhdl_node *n;
+	int id, len, first;
+
+	first = 0;
+	for(n=m->head;n!=NULL;n=n->p.signal.next) {
+		len = 0;
+		if((sscanf(n->p.signal.name, "$cse%d%n", &id, &len) == 1)
+		  && (n->p.signal.name[len] == 0) && (id >= first))
+			first = id + 1;
+	}
+	return first;
+}
+
+static struct llhdl_node *cse_signal(struct cse_sc *sc, struct llhdl_node *n)
+{
+	char name[32];
+
+	sprintf(name, "$cse%d", sc->next_id++);
+	return llhdl_create_signal(sc->m, LLHDL_SIGNAL_INTERNAL, name,
+		llhdl_get_sign(n), llhdl_get_vectorsize(n));
+}
+
+static int opt_cse(struct llhdl_module *m)
+{
+	struct cse_sc sc;
+	struct llhdl_node *n;
+	struct llhdl_node *signal;
+	struct cse_entry *e, *keep;
+	int nodes;
+	int i, j, end;
+	int count;
+	int r;
+
+	nodes = 0;
+	llhdl_walk_module(walk_count, &nodes, m);
+	sc.m = m;
+	sc.nentries = 0;
+	sc.entries = alloc_size(nodes*sizeof(struct cse_entry));
+	sc.next_id = cse_first_id(m);
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		cse_collect(&sc, &n->p.signal.source, n);
+	/* sorting breaks the user pointers */
+	for(i=0;i<sc.nentries;i++)
+		sc.entries[i].node->user = NULL;
+	qsort(sc.entries, sc.nentries, sizeof(struct cse_entry), cse_cmp);
+	for(i=0;i<sc.nentries;i++)
+		sc.entries[i].node->user = &sc.entries[i];
+
+	r = 0;
+	for(i=0;i<sc.nentries;i=end) {
+		for(end=i+1;end<sc.nentries;end++)
+			if((sc.entries[end].size != sc.entries[i].size) || (sc.entries[end].hash != sc.entries[i].hash))
+				break;
+		if((end - i) < 2)
+			continue;
+		/* extract groups of equivalent subtrees from the run of identical hashes */
+		for(j=i;j<end;j++) {
+			keep = &sc.entries[j];
+			if(keep->dead || (*keep->slot != keep->node))
+				continue;
+			count = 0;
+			signal = NULL;
+			for(e=keep;e<&sc.entries[end];e++) {
+				if(e->dead || (*e->slot != e->node) || !llhdl_equiv(keep->node, e->node))
+					continue;
+				count++;
+				if((signal == NULL) && (e->signal != NULL)
+				  && (e->signal->p.signal.vectorsize == llhdl_get_vectorsize(e->node))
+				  && (e->signal->p.signal.sign == llhdl_get_sign(e->node))) {
+					signal = e->signal;
+					keep = e;
+				}
+			}
+			if(count < 2)
+				continue;
+			if(signal == NULL) {
+				signal = cse_signal(&sc, keep->node);
+				signal->p.signal.source = keep->node;
+				*keep->slot = signal;
+			}
+			for(e=&sc.entries[j];e<&sc.entries[end];e++) {
+				if((e == keep) || e->dead || (*e->slot != e->node) || !llhdl_equiv(keep->node, e->node))
+					continue;
+				llhdl_walk(walk_mark_dead, NULL, e->slot);
+				llhdl_free_node(e->node);
+				*e->slot = signal;
+				r++;
+			}
+			keep->dead = 1;
+		}
+	}
+
+	llhdl_walk_module(walk_clear_user, NULL, m);
+	free(sc.entries);
+	return r;
+}
+
+/*
+ * Removal of internal signals that do not contribute to any output
+ */
+
+static int walk_mark_used(struct llhdl_node **n2, void *user)
+{
+	struct llhdl_node *n = *n2;
+
+	if((n->type == LLHDL_NODE_SIGNAL) && (n->user == NULL)) {
+		n->user = n;
+		llhdl_walk(walk_mark_used, NULL, &n->p.signal.source);
+	}
+	return 1;
+}
+
+static int opt_dead(struct llhdl_module *m)
+{
+	struct llhdl_node *n, *next, *dead;
+	struct llhdl_node **prev;
+	struct llhdl_instance *inst;
+	int i;
+	int r;
+
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		if(n->p.signal.type != LLHDL_SIGNAL_INTERNAL) {
+			n->user = n;
+			llhdl_walk(walk_mark_used, NULL, &n->p.signal.source);
+		}
+	/* signals connected to instances are kept, whether they are read or driven */
+	for(inst=m->ihead;inst!=NULL;inst=inst->next)
+		for(i=0;i<inst->nconnections;i++)
+			walk_mark_used(&inst->connections[i].signal, NULL);
+
+	/* Dead signals can read each other: unlink them all before freeing */
+	r = 0;
+	dead = NULL;
+	prev = &m->head;
+	for(n=m->head;n!=NULL;n=next) {
+		next = n->p.signal.next;
+		if(n->user == NULL) {
+			*prev = next;
+			n->p.signal.next = dead;
+			dead = n;
+			r++;
+		} else {
+			n->user = NULL;
+			prev = &n->p.signal.next;
+		}
+	}
+	for(n=dead;n!=NULL;n=n->p.signal.next) {
+		llhdl_free_node(n->p.signal.source);
+		n->p.signal.source = NULL;
+	}
+	for(n=dead;n!=NULL;n=next) {
+		next = n->p.signal.next;
+		llhdl_free_signal(n);
+	}
+	return r;
+}
+
+/*
+ * Bit-width narrowing.
+ * A backward analysis computes how many low bits of each node and internal signal
+ * are actually read, then operands, constants, slices and internal signals
+ * are truncated to that width.
+ */
+
+/* A node and the number of its low bits that are used */
+struct narrow_item {
+	struct llhdl_node *parent;	/* < set if the node is truncated with a slice when still too wide */
+	struct llhdl_node **slot;
+	int r;
+};
+
+struct narrow_stack {
+	int count;
+	int size;
+	struct narrow_item *items;
+};
+
+static void narrow_push(struct narrow_stack *st, struct llhdl_node *parent, struct llhdl_node **slot, int r)
+{
+	if(*slot == NULL)
+		return;
+	if(st->count == st->size) {
+		st->size = 2*st->size + 16;
+		st->items = realloc(st->items, st->size*sizeof(struct narrow_item));
+		assert(st->items != NULL);
+	}
+	st->items[st->count].parent = parent;
+	st->items[st->count].slot = slot;
+	st->items[st->count].r = r;
+	st->count++;
+}
+
+/* Records that the <r> low bits of <root> are used. Returns 1 if the requirement of a signal grew. */
+static int narrow_require(struct llhdl_size_cache *c, struct narrow_stack *st, struct llhdl_node **root, int r)
+{
+	struct llhdl_node *n;
+	int *required;
+	int i;
+	int changed;
+
+	changed = 0;
+	st->count = 0;
+	narrow_push(st, NULL, root, r);
+	while(st->count > 0) {
+		st->count--;
+		n = *st->items[st->count].slot;
+		r = st->items[st->count].r;
+		switch(n->type) {
+			case LLHDL_NODE_CONSTANT:
+				break;
+			case LLHDL_NODE_SIGNAL:
+				required = n->user;
+				if(r > *required) {
+					*required = r;
+					changed = 1;
+				}
+				break;
+			case LLHDL_NODE_LOGIC:
+			case LLHDL_NODE_EXTLOGIC:
+				for(i=0;i<llhdl_get_logic_arity(n->p.logic.op);i++)
+					narrow_push(st, NULL, &n->p.logic.operands[i],
+						min(r, llhdl_get_vectorsize_cached(c, n->p.logic.operands[i])));
+				break;
+			case LLHDL_NODE_MUX:
+				narrow_push(st, NULL, &n->p.mux.select, llhdl_get_vectorsize_cached(c, n->p.mux.select));
+				for(i=0;i<n->p.mux.nsources;i++)
+					narrow_push(st, NULL, &n->p.mux.sources[i],
+						min(r, llhdl_get_vectorsize_cached(c, n->p.mux.sources[i])));
+				break;
+			case LLHDL_NODE_FD:
+				narrow_push(st, NULL, &n->p.fd.clock, llhdl_get_vectorsize_cached(c, n->p.fd.clock));
+				narrow_push(st, NULL, &n->p.fd.data, r);
+				break;
+			case LLHDL_NODE_VECT:
+				for(i=0;i<n->p.vect.nslices;i++) {
+					if(r <= 0)
+						break;
+					narrow_push(st, NULL, &n->p.vect.slices[i].source,
+						min(r, n->p.vect.slices[i].end - n->p.vect.slices[i].start + 1) + n->p.vect.slices[i].start);
+					r -= n->p.vect.slices[i].end - n->p.vect.slices[i].start + 1;
+				}
+				break;
+			default:
+				assert(0);
+				break;
+		}
+	}
+	return changed;
+}
+
+/* Pushes an operand of <parent> that is narrowed to <r> bits, or kept at its width if it is narrower */
+static void narrow_push_operand(struct llhdl_size_cache *c, struct narrow_stack *st, struct llhdl_node *parent, struct llhdl_node **slot, int r)
+{
+	int width;
+
+	if(*slot == NULL)
+		return;
+	width = llhdl_get_vectorsize_cached(c, *slot);
+	if(width > r)
+		narrow_push(st, parent, slot, r);
+	else
+		narrow_push(st, NULL, slot, width);
+}
+
+/*
+ * Lists, in pre-order, the nodes of <root> with the number of bits they must compute,
+ * and drops the slices of vectors above the used bits.
+ * Only the nodes that are not yet visited change, so that the sizes of the nodes
+ * that remain to be visited can be cached.
+ */
+static int narrow_list(struct llhdl_size_cache *c, struct narrow_stack *pending, struct narrow_stack *list, struct llhdl_node **root, int r)
+{
+	struct narrow_item *item;
+	struct llhdl_node *n;
+	int vectorsize;
+	int i;
+	int nslices, width;
+	int changes;
+
+	changes = 0;
+	pending->count = 0;
+	list->count = 0;
+	narrow_push(pending, NULL, root, r);
+	while(pending->count > 0) {
+		pending->count--;
+		item = &pending->items[pending->count];
+		narrow_push(list, item->parent, item->slot, item->r);
+		n = *item->slot;
+		r = item->r;
+		switch(n->type) {
+			case LLHDL_NODE_CONSTANT:
+			case LLHDL_NODE_SIGNAL:
+				break;
+			case LLHDL_NODE_LOGIC:
+			case LLHDL_NODE_EXTLOGIC:
+				for(i=0;i<llhdl_get_logic_arity(n->p.logic.op);i++)
+					narrow_push_operand(c, pending, n, &n->p.logic.operands[i], r);
+				break;
+			case LLHDL_NODE_MUX:
+				narrow_push(pending, NULL, &n->p.mux.select, llhdl_get_vectorsize_cached(c, n->p.mux.select));
+				for(i=0;i<n->p.mux.nsources;i++)
+					narrow_push_operand(c, pending, n, &n->p.mux.sources[i], r);
+				break;
+			case LLHDL_NODE_FD:
+				narrow_push(pending, NULL, &n->p.fd.clock, llhdl_get_vectorsize_cached(c, n->p.fd.clock));
+				vectorsize = llhdl_get_vectorsize_cached(c, n);
+				if(vectorsize > r)
+					narrow_push(pending, n, &n->p.fd.data, r);
+				else
+					narrow_push(pending, NULL, &n->p.fd.data, vectorsize);
+				break;
+			case LLHDL_NODE_VECT:
+				/* drop the slices above the used bits */
+				width = 0;
+				for(nslices=0;nslices<n->p.vect.nslices;nslices++) {
+					if(width >= r) {
+						for(i=nslices;i<n->p.vect.nslices;i++)
+							llhdl_free_node(n->p.vect.slices[i].source);
+						n->p.vect.nslices = nslices;
+						changes++;
+						break;
+					}
+					width += n->p.vect.slices[nslices].end - n->p.vect.slices[nslices].start + 1;
+					if(width > r) {
+						n->p.vect.slices[nslices].end -= width - r;
+						width = r;
+						changes++;
+					}
+				}
+				for(i=0;i<n->p.vect.nslices;i++)
+					narrow_push(pending, NULL, &n->p.vect.slices[i].source, n->p.vect.slices[i].end + 1);
+				break;
+			default:
+				assert(0);
+				break;
+		}
+	}
+	return changes;
+}
+
+/*
+ * Rewrites the listed nodes, operands first, so that they compute no more than
+ * the low bits that are used: constants are truncated, and operands that are still
+ * too wide are truncated with a slice.
+ * Arithmetic feeding arithmetic is not sliced, so that sum trees stay visible to the mapper.
+ * The sizes cached in <c> are those of nodes whose operands are already rewritten.
+ */
+static int narrow_rewrite(struct llhdl_size_cache *c, struct narrow_stack *list)
+{
+	struct narrow_item *item;
+	struct llhdl_slice slice;
+	struct llhdl_node *n;
+	int i;
+	int changes;
+
+	changes = 0;
+	for(i=list->count-1;i>=0;i--) {
+		item = &list->items[i];
+		n = *item->slot;
+		if(n->type == LLHDL_NODE_CONSTANT) {
+			if(n->p.constant.vectorsize > item->r) {
+				*item->slot = adjust(n, item->r, n->p.constant.sign);
+				changes++;
+			}
+			continue;
+		}
+		if(item->parent == NULL)
+			continue;
+		if((n->type == LLHDL_NODE_EXTLOGIC) && (item->parent->type == LLHDL_NODE_EXTLOGIC))
+			continue;
+		if(llhdl_get_vectorsize_cached(c, n) > item->r) {
+			slice.source = n;
+			slice.start = 0;
+			slice.end = item->r-1;
+			*item->slot = llhdl_create_vect(llhdl_get_sign_cached(c, n), 1, &slice);
+			changes++;
+		}
+	}
+	return changes;
+}
+
+static int opt_narrow(struct llhdl_module *m)
+{
+	struct llhdl_node *n;
+	struct llhdl_instance *inst;
+	struct llhdl_size_cache c;
+	struct narrow_stack pending, list;
+	int nsignals;
+	int *required;
+	int i;
+	int changed;
+	int r;
+
+	nsignals = 0;
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		nsignals++;
+	required = alloc_size(nsignals*sizeof(int));
+	i = 0;
+	for(n=m->head;n!=NULL;n=n->p.signal.next) {
+		/* unused internal signals keep one bit so that their sources stay consistent */
+		if((n->p.signal.type != LLHDL_SIGNAL_INTERNAL) || llhdl_is_clock(n))
+			required[i] = n->p.signal.vectorsize;
+		else
+			required[i] = 1;
+		n->user = &required[i++];
+	}
+	/* the width of signals connected to instances is set by the ports */
+	for(inst=m->ihead;inst!=NULL;inst=inst->next)
+		for(i=0;i<inst->nconnections;i++) {
+			n = inst->connections[i].signal;
+			*(int *)n->user = n->p.signal.vectorsize;
+		}
+
+	pending.count = pending.size = 0;
+	pending.items = NULL;
+	list.count = list.size = 0;
+	list.items = NULL;
+
+	/* the expressions do not change until the signals are narrowed */
+	llhdl_size_cache_init(&c);
+	do {
+		changed = 0;
+		for(n=m->head;n!=NULL;n=n->p.signal.next) {
+			r = *(int *)n->user;
+			if((n->p.signal.source != NULL) && (r > 0))
+				changed |= narrow_require(&c, &pending, &n->p.signal.source,
+					min(r, llhdl_get_vectorsize_cached(&c, n->p.signal.source)));
+		}
+	} while(changed);
+	llhdl_size_cache_free(&c);
+
+	r = 0;
+	for(n=m->head;n!=NULL;n=n->p.signal.next) {
+		i = *(int *)n->user;
+		if((i > 0) && (i < n->p.signal.vectorsize)) {
+			n->p.signal.vectorsize = i;
+			r++;
+		}
+	}
+	for(n=m->head;n!=NULL;n=n->p.signal.next) {
+		i = *(int *)n->user;
+		if((n->p.signal.source == NULL) || (i <= 0))
+			continue;
+		llhdl_size_cache_init(&c);
+		r += narrow_list(&c, &pending, &list, &n->p.signal.source,
+			min(i, llhdl_get_vectorsize_cached(&c, n->p.signal.source)));
+		llhdl_size_cache_free(&c);
+		r += narrow_rewrite(&c, &list);
+		llhdl_size_cache_free(&c);
+	}
+
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		n->user = NULL;
+	free(pending.items);
+	free(list.items);
+	free(required);
+	return r;
+}
+
+struct llhdl_opt_desc llhdl_opt_passes[] = {
+	{
+		.handle = "fold",
+		.description = "Constant folding and propagation",
+		.run = opt_fold
+	},
+	{
+		.handle = "simplify",
+		.description = "Algebraic simplifications",
+		.run = opt_simplify
+	},
+	{
+		.handle = "mux",
+		.description = "Multiplexer simplifications",
+		.run = opt_mux
+	},
+	{
+		.handle = "narrow",
+		.description = "Bit-width narrowing",
+		.run = opt_narrow
+	},
+	{
+		.handle = "cse",
+		.description = "Common subexpression elimination",
+		.run = opt_cse
+	},
+	{
+		.handle = "dead",
+		.description = "Removal of unused internal signals",
+		.run = opt_dead
+	}
+};
+
+int llhdl_opt_get_pass_by_handle(const char *handle)
+{
+	int i;
+
+	for(i=0;i<LLHDL_OPT_COUNT;i++) {
+		if(strcmp(llhdl_opt_passes[i].handle, handle) == 0)
+			return i;
+	}
+	return -1;
+}
+
+int llhdl_optimize(struct llhdl_module *m, unsigned int passes)
+{
+	struct llhdl_module *d;
+	int i;
+	int changes, total;
+
+	total = 0;
+	/* definitions keep their ports, so they are optimized independently */
+	for(d=m->dhead;d!=NULL;d=d->next)
+		total += llhdl_optimize(d, passes);
+	do {
+		changes = 0;
+		for(i=0;i<LLHDL_OPT_COUNT;i++)
+			if(passes & (1 << i))
+				changes += llhdl_opt_passes[i].run(m);
+		total += changes;
+	} while(changes != 0);
+	return total;
+}
@@ -0,0 +1,1198 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <util.h>
+#include <gmp.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/tools.h>
+#include <llhdl/partition.h>
+
+/*
+ * Multilevel hypergraph partitioning.
+ * The vertices are the signals that have a source expression, weighted
+ * by the number of nodes of the expression. Each of these signals is also
+ * a hyperedge connecting its driver to the signals that read it, whose
+ * cost is the vector size.
+ * The hypergraph is bisected recursively. Each bisection coarsens the
+ * hypergraph by matching vertices along their heaviest edges, bisects the
+ * coarsest level by growing one side from a seed, and refines the cut
+ * with Fiduccia-Mattheyses passes at each level on the way back.
+ */
+
+#define BALANCE_PERCENT		5	/* < allowed deviation from the target weights */
+#define COARSEST		64	/* < coarsening stops below that many vertices */
+#define MATCH_MAX_PINS		32	/* < larger edges are ignored for matching */
+#define INITIAL_TRIES		4
+#define FM_MAX_PASSES		8
+#define FM_MAX_FUTILE		200	/* < moves without improvement before a pass gives up */
+
+struct hypergraph {
+	int nvertices;
+	int *weight;
+	int total;
+	int nedges;
+	int *cost;
+	int *pin_start;		/* < pins of edge e are pins[pin_start[e]] to pins[pin_start[e+1]-1] */
+	int *pins;
+	int *edge_start;	/* < edges of vertex v are edges[edge_start[v]] to edges[edge_start[v+1]-1] */
+	int *edges;
+};
+
+static struct hypergraph *hg_new(int nvertices, int maxedges, int maxpins)
+{
+	struct hypergraph *h;
+
+	h = alloc_type(struct hypergraph);
+	h->nvertices = nvertices;
+	h->weight = alloc_size0((nvertices+1)*sizeof(int));
+	h->total = 0;
+	h->nedges = 0;
+	h->cost = alloc_size((maxedges+1)*sizeof(int));
+	h->pin_start = alloc_size((maxedges+1)*sizeof(int));
+	h->pin_start[0] = 0;
+	h->pins = alloc_size((maxpins+1)*sizeof(int));
+	h->edge_start = NULL;
+	h->edges = NULL;
+	return h;
+}
+
+/* Pins are written at the end of the pin array before the edge is added */
+static int *hg_next_pins(struct hypergraph *h)
+{
+	return &h->pins[h->pin_start[h->nedges]];
+}
+
+/* Edges with fewer than 2 pins cannot be cut and are dropped */
+static void hg_add_edge(struct hypergraph *h, int cost, int npins)
+{
+	if(npins < 2)
+		return;
+	h->cost[h->nedges] = cost;
+	h->pin_start[h->nedges+1] = h->pin_start[h->nedges] + npins;
+	h->nedges++;
+}
+
+/* Computes the total weight and the edges of each vertex, once all edges are added */
+static void hg_index(struct hypergraph *h)
+{
+	int *fill;
+	int v, e, i;
+
+	h->total = 0;
+	for(v=0;v<h->nvertices;v++)
+		h->total += h->weight[v];
+	h->edge_start = alloc_size0((h->nvertices+1)*sizeof(int));
+	h->edges = alloc_size((h->pin_start[h->nedges]+1)*sizeof(int));
+	for(i=0;i<h->pin_start[h->nedges];i++)
+		h->edge_start[h->pins[i]+1]++;
+	for(v=0;v<h->nvertices;v++)
+		h->edge_start[v+1] += h->edge_start[v];
+	fill = alloc_size((h->nvertices+1)*sizeof(int));
+	memcpy(fill, h->edge_start, h->nvertices*sizeof(int));
+	for(e=0;e<h->nedges;e++)
+		for(i=h->pin_start[e];i<h->pin_start[e+1];i++)
+			h->edges[fill[h->pins[i]]++] = e;
+	free(fill);
+}
+
+static void hg_free(struct hypergraph *h)
+{
+	free(h->weight);
+	free(h->cost);
+	free(h->pin_start);
+	free(h->pins);
+	free(h->edge_start);
+	free(h->edges);
+	free(h);
+}
+
+/* Merges pairs of vertices into the vertices of a coarser hypergraph, given by <map>.
+ * Returns NULL if too few vertices could be merged.
+ */
+static struct hypergraph *coarsen(struct hypergraph *h, int *map, int maxweight)
+{
+	struct hypergraph *c;
+	int *score, *touched, *mark, *p;
+	int ntouched, nc, best, size, npins;
+	int v, u, e, i, j;
+
+	score = alloc_size0((h->nvertices+1)*sizeof(int));
+	touched = alloc_size((h->nvertices+1)*sizeof(int));
+	for(v=0;v<h->nvertices;v++)
+		map[v] = -1;
+	nc = 0;
+	for(v=0;v<h->nvertices;v++) {
+		if(map[v] != -1)
+			continue;
+		ntouched = 0;
+		for(i=h->edge_start[v];i<h->edge_start[v+1];i++) {
+			e = h->edges[i];
+			size = h->pin_start[e+1] - h->pin_start[e];
+			if(size > MATCH_MAX_PINS)
+				continue;
+			for(j=h->pin_start[e];j<h->pin_start[e+1];j++) {
+				u = h->pins[j];
+				if((u == v) || (map[u] != -1) || (h->weight[u] + h->weight[v] > maxweight))
+					continue;
+				if(score[u] == 0)
+					touched[ntouched++] = u;
+				score[u] += 1 + h->cost[e]*1024/(size-1);
+			}
+		}
+		best = -1;
+		for(i=0;i<ntouched;i++) {
+			u = touched[i];
+			if((best == -1) || (score[u] > score[best]))
+				best = u;
+		}
+		for(i=0;i<ntouched;i++)
+			score[touched[i]] = 0;
+		map[v] = nc;
+		if(best != -1)
+			map[best] = nc;
+		nc++;
+	}
+	free(touched);
+	free(score);
+	if(nc > h->nvertices*9/10)
+		return NULL;
+
+	c = hg_new(nc, h->nedges, h->pin_start[h->nedges]);
+	for(v=0;v<h->nvertices;v++)
+		c->weight[map[v]] += h->weight[v];
+	mark = alloc_size((nc+1)*sizeof(int));
+	for(v=0;v<nc;v++)
+		mark[v] = -1;
+	for(e=0;e<h->nedges;e++) {
+		p = hg_next_pins(c);
+		npins = 0;
+		for(i=h->pin_start[e];i<h->pin_start[e+1];i++) {
+			u = map[h->pins[i]];
+			if(mark[u] != e) {
+				mark[u] = e;
+				p[npins++] = u;
+			}
+		}
+		hg_add_edge(c, h->cost[e], npins);
+	}
+	free(mark);
+	hg_index(c);
+	return c;
+}
+
+/* Hypergraph induced by the vertices on side <s>, <map> receives their original indices */
+static struct hypergraph *subgraph(struct hypergraph *h, int *side, int s, int **map)
+{
+	struct hypergraph *sub;
+	int *index, *p;
+	int n, npins;
+	int v, e, i;
+
+	index = alloc_size((h->nvertices+1)*sizeof(int));
+	n = 0;
+	for(v=0;v<h->nvertices;v++)
+		index[v] = side[v] == s ? n++ : -1;
+	*map = alloc_size((n+1)*sizeof(int));
+	sub = hg_new(n, h->nedges, h->pin_start[h->nedges]);
+	for(v=0;v<h->nvertices;v++) {
+		if(index[v] != -1) {
+			(*map)[index[v]] = v;
+			sub->weight[index[v]] = h->weight[v];
+		}
+	}
+	for(e=0;e<h->nedges;e++) {
+		p = hg_next_pins(sub);
+		npins = 0;
+		for(i=h->pin_start[e];i<h->pin_start[e+1];i++)
+			if(index[h->pins[i]] != -1)
+				p[npins++] = index[h->pins[i]];
+		hg_add_edge(sub, h->cost[e], npins);
+	}
+	free(index);
+	hg_index(sub);
+	return sub;
+}
+
+/*
+ * Fiduccia-Mattheyses refinement of a bisection.
+ * The free vertices of each side are kept in a max-heap by gain,
+ * the gain being the decrease of the cut if the vertex changes sides.
+ */
+
+struct fm {
+	struct hypergraph *h;
+	int *side;
+	int *count;		/* < pins of edge e on side s: count[2*e+s] */
+	int *gain;
+	int *pos;		/* < position of each vertex in its heap, -1 if locked */
+	int *heap[2];
+	int nheap[2];
+	int weight[2];
+	int target[2];
+	int maxweight[2];
+	int *moves;
+};
+
+static void heap_swap(struct fm *f, int s, int i, int j)
+{
+	int t;
+
+	t = f->heap[s][i];
+	f->heap[s][i] = f->heap[s][j];
+	f->heap[s][j] = t;
+	f->pos[f->heap[s][i]] = i;
+	f->pos[f->heap[s][j]] = j;
+}
+
+static void heap_update(struct fm *f, int s, int i)
+{
+	int *hp = f->heap[s];
+	int parent, child;
+
+	while(i > 0) {
+		parent = (i - 1)/2;
+		if(f->gain[hp[parent]] >= f->gain[hp[i]])
+			break;
+		heap_swap(f, s, i, parent);
+		i = parent;
+	}
+	while(1) {
+		child = 2*i + 1;
+		if(child >= f->nheap[s])
+			break;
+		if((child + 1 < f->nheap[s]) && (f->gain[hp[child+1]] > f->gain[hp[child]]))
+			child++;
+		if(f->gain[hp[i]] >= f->gain[hp[child]])
+			break;
+		heap_swap(f, s, i, child);
+		i = child;
+	}
+}
+
+static void heap_insert(struct fm *f, int v)
+{
+	int s = f->side[v];
+
+	f->heap[s][f->nheap[s]] = v;
+	f->pos[v] = f->nheap[s]++;
+	heap_update(f, s, f->pos[v]);
+}
+
+static void heap_remove(struct fm *f, int v)
+{
+	int s = f->side[v];
+	int i;
+
+	i = f->pos[v];
+	f->nheap[s]--;
+	if(i != f->nheap[s]) {
+		heap_swap(f, s, i, f->nheap[s]);
+		heap_update(f, s, i);
+	}
+	f->pos[v] = -1;
+}
+
+static void add_gain(struct fm *f, int v, int delta)
+{
+	if(f->pos[v] == -1)
+		return;
+	f->gain[v] += delta;
+	heap_update(f, f->side[v], f->pos[v]);
+}
+
+static int compute_gain(struct fm *f, int v)
+{
+	struct hypergraph *h = f->h;
+	int s = f->side[v];
+	int g;
+	int e, i;
+
+	g = 0;
+	for(i=h->edge_start[v];i<h->edge_start[v+1];i++) {
+		e = h->edges[i];
+		if(f->count[2*e+s] == 1)
+			g += h->cost[e];
+		if(f->count[2*e+1-s] == 0)
+			g -= h->cost[e];
+	}
+	return g;
+}
+
+static void count_pins(struct fm *f)
+{
+	struct hypergraph *h = f->h;
+	int v, e, i;
+
+	memset(f->count, 0, 2*h->nedges*sizeof(int));
+	f->weight[0] = 0;
+	f->weight[1] = 0;
+	for(v=0;v<h->nvertices;v++) {
+		f->weight[f->side[v]] += h->weight[v];
+		for(i=h->edge_start[v];i<h->edge_start[v+1];i++) {
+			e = h->edges[i];
+			f->count[2*e+f->side[v]]++;
+		}
+	}
+}
+
+/* Moves a locked vertex to the other side, updating the gains of the free vertices */
+static void move(struct fm *f, int v)
+{
+	struct hypergraph *h = f->h;
+	int from, to;
+	int e, u, c;
+	int i, j;
+
+	from = f->side[v];
+	to = 1 - from;
+	f->side[v] = to;
+	f->weight[from] -= h->weight[v];
+	f->weight[to] += h->weight[v];
+	for(i=h->edge_start[v];i<h->edge_start[v+1];i++) {
+		e = h->edges[i];
+		c = h->cost[e];
+		if(f->count[2*e+to] == 0) {
+			for(j=h->pin_start[e];j<h->pin_start[e+1];j++)
+				add_gain(f, h->pins[j], c);
+		} else if(f->count[2*e+to] == 1) {
+			for(j=h->pin_start[e];j<h->pin_start[e+1];j++) {
+				u = h->pins[j];
+				if(f->side[u] == to)
+					add_gain(f, u, -c);
+			}
+		}
+		f->count[2*e+from]--;
+		f->count[2*e+to]++;
+		if(f->count[2*e+from] == 0) {
+			for(j=h->pin_start[e];j<h->pin_start[e+1];j++)
+				add_gain(f, h->pins[j], -c);
+		} else if(f->count[2*e+from] == 1) {
+			for(j=h->pin_start[e];j<h->pin_start[e+1];j++) {
+				u = h->pins[j];
+				if(f->side[u] == from)
+					add_gain(f, u, c);
+			}
+		}
+	}
+}
+
+static void fm_init(struct fm *f, struct hypergraph *h, int *side, int target0)
+{
+	int slack;
+
+	f->h = h;
+	f->side = side;
+	f->count = alloc_size((2*h->nedges+1)*sizeof(int));
+	f->gain = alloc_size((h->nvertices+1)*sizeof(int));
+	f->pos = alloc_size((h->nvertices+1)*sizeof(int));
+	f->heap[0] = alloc_size((h->nvertices+1)*sizeof(int));
+	f->heap[1] = alloc_size((h->nvertices+1)*sizeof(int));
+	f->nheap[0] = 0;
+	f->nheap[1] = 0;
+	f->moves = alloc_size((h->nvertices+1)*sizeof(int));
+	f->target[0] = target0;
+	f->target[1] = h->total - target0;
+	slack = (long long)h->total*BALANCE_PERCENT/100 + 1;
+	f->maxweight[0] = f->target[0] + slack;
+	f->maxweight[1] = f->target[1] + slack;
+}
+
+static void fm_free(struct fm *f)
+{
+	free(f->count);
+	free(f->gain);
+	free(f->pos);
+	free(f->heap[0]);
+	free(f->heap[1]);
+	free(f->moves);
+}
+
+static void fm_fill_heaps(struct fm *f)
+{
+	int v;
+
+	f->nheap[0] = 0;
+	f->nheap[1] = 0;
+	for(v=0;v<f->h->nvertices;v++) {
+		f->gain[v] = compute_gain(f, v);
+		heap_insert(f, v);
+	}
+}
+
+static void fm_clear_heaps(struct fm *f)
+{
+	int v;
+
+	for(v=0;v<f->h->nvertices;v++)
+		f->pos[v] = -1;
+	f->nheap[0] = 0;
+	f->nheap[1] = 0;
+}
+
+static int imbalance(struct fm *f)
+{
+	return abs(f->weight[0] - f->target[0]);
+}
+
+static int cut(struct fm *f)
+{
+	int e, r;
+
+	r = 0;
+	for(e=0;e<f->h->nedges;e++)
+		if((f->count[2*e] != 0) && (f->count[2*e+1] != 0))
+			r += f->h->cost[e];
+	return r;
+}
+
+/* Returns 1 if the pass reduced the cut or the imbalance */
+static int fm_pass(struct fm *f)
+{
+	int nmoves, best_moves;
+	int total, best, best_imbalance;
+	int v, s, w;
+
+	fm_fill_heaps(f);
+	nmoves = 0;
+	total = 0;
+	best = 0;
+	best_moves = 0;
+	best_imbalance = imbalance(f);
+	while(nmoves - best_moves <= FM_MAX_FUTILE) {
+		v = -1;
+		for(s=0;s<2;s++) {
+			if(f->nheap[s] == 0)
+				continue;
+			w = f->heap[s][0];
+			if(f->weight[1-s] + f->h->weight[w] > f->maxweight[1-s])
+				continue;
+			if((v == -1) || (f->gain[w] > f->gain[v])
+			  || ((f->gain[w] == f->gain[v]) && (f->weight[s] - f->target[s] > f->weight[1-s] - f->target[1-s])))
+				v = w;
+		}
+		if(v == -1)
+			break;
+		total += f->gain[v];
+		heap_remove(f, v);
+		move(f, v);
+		f->moves[nmoves++] = v;
+		if((total > best) || ((total == best) && (imbalance(f) < best_imbalance))) {
+			best = total;
+			best_moves = nmoves;
+			best_imbalance = imbalance(f);
+		}
+	}
+	fm_clear_heaps(f);
+	/* Undo the moves after the best point */
+	while(nmoves > best_moves)
+		move(f, f->moves[--nmoves]);
+	return best_moves > 0;
+}
+
+static void fm_refine(struct fm *f)
+{
+	int i;
+
+	count_pins(f);
+	for(i=0;i<FM_MAX_PASSES;i++)
+		if(!fm_pass(f))
+			break;
+}
+
+/* Grows side 0 from vertex <seed>, taking the vertices that cut the fewest edges first */
+static void grow(struct fm *f, int seed)
+{
+	int v;
+
+	for(v=0;v<f->h->nvertices;v++)
+		f->side[v] = 1;
+	count_pins(f);
+	fm_fill_heaps(f);
+	v = seed;
+	while(f->weight[0] < f->target[0]) {
+		heap_remove(f, v);
+		move(f, v);
+		if(f->nheap[1] == 0)
+			break;
+		v = f->heap[1][0];
+	}
+	fm_clear_heaps(f);
+}
+
+static void initial_bisect(struct hypergraph *h, int *side, int target0)
+{
+	struct fm f;
+	int *best_side;
+	int best_cut, best_imbalance, c;
+	unsigned int seed;
+	int i;
+
+	best_side = alloc_size((h->nvertices+1)*sizeof(int));
+	best_cut = -1;
+	best_imbalance = 0;
+	seed = 1;
+	fm_init(&f, h, side, target0);
+	for(i=0;i<INITIAL_TRIES;i++) {
+		grow(&f, seed % h->nvertices);
+		fm_refine(&f);
+		c = cut(&f);
+		if((best_cut == -1) || (c < best_cut) || ((c == best_cut) && (imbalance(&f) < best_imbalance))) {
+			best_cut = c;
+			best_imbalance = imbalance(&f);
+			memcpy(best_side, side, h->nvertices*sizeof(int));
+		}
+		seed = seed*1103515245 + 12345;
+	}
+	memcpy(side, best_side, h->nvertices*sizeof(int));
+	fm_free(&f);
+	free(best_side);
+}
+
+static void bisect(struct hypergraph *h, int *side, int target0)
+{
+	struct hypergraph *c;
+	struct fm f;
+	int *map, *cside;
+	int v;
+
+	c = NULL;
+	map = NULL;
+	if(h->nvertices > COARSEST) {
+		map = alloc_size((h->nvertices+1)*sizeof(int));
+		c = coarsen(h, map, (long long)h->total*BALANCE_PERCENT/200 + 1);
+	}
+	if(c == NULL) {
+		free(map);
+		initial_bisect(h, side, target0);
+		return;
+	}
+	cside = alloc_size((c->nvertices+1)*sizeof(int));
+	bisect(c, cside, target0);
+	for(v=0;v<h->nvertices;v++)
+		side[v] = cside[map[v]];
+	free(cside);
+	free(map);
+	hg_free(c);
+
+	fm_init(&f, h, side, target0);
+	fm_refine(&f);
+	fm_free(&f);
+}
+
+/* Assigns the vertices to the parts <first> to <first>+<k>-1 */
+static void partition_k(struct hypergraph *h, int *part, int first, int k)
+{
+	struct hypergraph *sub;
+	int *side, *map, *subpart;
+	int k0, s, v;
+
+	if((k == 1) || (h->nvertices < 2)) {
+		for(v=0;v<h->nvertices;v++)
+			part[v] = first;
+		return;
+	}
+	k0 = k/2;
+	side = alloc_size((h->nvertices+1)*sizeof(int));
+	bisect(h, side, (long long)h->total*k0/k);
+	for(s=0;s<2;s++) {
+		sub = subgraph(h, side, s, &map);
+		subpart = alloc_size((sub->nvertices+1)*sizeof(int));
+		if(s == 0)
+			partition_k(sub, subpart, first, k0);
+		else
+			partition_k(sub, subpart, first + k0, k - k0);
+		for(v=0;v<sub->nvertices;v++)
+			part[map[v]] = subpart[v];
+		free(subpart);
+		free(map);
+		hg_free(sub);
+	}
+	free(side);
+}
+
+/*
+ * Module level
+ */
+
+struct part_signal {
+	struct llhdl_node *signal;
+	int vertex;			/* < -1 if the signal has no source */
+	int part;			/* < partition of the source, -1 if none */
+	int external;			/* < read outside of its partition */
+	struct llhdl_node *port;	/* < port of the signal in its own partition */
+	int last_part;			/* < last other partition that read the signal, -1 if none */
+	struct llhdl_node *last_port;	/* < port of the signal in that partition */
+};
+
+struct part_sc {
+	struct llhdl_module *m;
+	int k;
+	int nsignals;
+	struct part_signal *signals;
+	struct llhdl_module **definitions;
+	struct llhdl_instance **instances;
+	struct llhdl_module *first;
+	struct llhdl_module *last_definition;
+	/* splitting */
+	int limit;
+	const char *base;
+	int next_id;
+	/* reads */
+	int nreads;
+	int *read_signal;
+	int *read_vertex;
+	int *last;
+	int current;
+};
+
+static struct llhdl_node **get_slot(struct llhdl_node *n, int i)
+{
+	switch(n->type) {
+		case LLHDL_NODE_LOGIC:
+		case LLHDL_NODE_EXTLOGIC:
+			return i < llhdl_get_logic_arity(n->p.logic.op) ? &n->p.logic.operands[i] : NULL;
+		case LLHDL_NODE_MUX:
+			if(i == 0)
+				return &n->p.mux.select;
+			return i <= n->p.mux.nsources ? &n->p.mux.sources[i-1] : NULL;
+		case LLHDL_NODE_FD:
+			if(i == 0)
+				return &n->p.fd.clock;
+			return i == 1 ? &n->p.fd.data : NULL;
+		case LLHDL_NODE_VECT:
+			return i < n->p.vect.nslices ? &n->p.vect.slices[i].source : NULL;
+		default:
+			return NULL;
+	}
+}
+
+static struct part_signal *get_signal(struct llhdl_node *n)
+{
+	return n->user;
+}
+
+static int walk_weight(struct llhdl_node **n2, void *user)
+{
+	int *w = user;
+
+	if(((*n2)->type != LLHDL_NODE_SIGNAL) && ((*n2)->type != LLHDL_NODE_CONSTANT))
+		(*w)++;
+	return 1;
+}
+
+static int expression_weight(struct llhdl_node **n)
+{
+	int w;
+
+	w = 0;
+	llhdl_walk(walk_weight, &w, n);
+	return w;
+}
+
+static char *part_name(const char *base, int i)
+{
+	int r;
+	char *ret;
+	r = asprintf(&ret, "%s$part%d", base, i);
+	if(r == -1) abort();
+	return ret;
+}
+
+/* Moves the expression in <slot> into a new internal signal */
+static void extract(struct part_sc *sc, struct llhdl_node **slot)
+{
+	struct llhdl_node *s;
+	char *name;
+
+	name = part_name(sc->base, sc->next_id++);
+	s = llhdl_create_signal(sc->m, LLHDL_SIGNAL_INTERNAL, name,
+		llhdl_get_sign(*slot), llhdl_get_vectorsize(*slot));
+	free(name);
+	s->p.signal.source = *slot;
+	*slot = s;
+}
+
+/* Extracts the heaviest subexpressions of each node until at most <limit> nodes are left.
+ * The operands come first, and leave the number of nodes they have left on a stack.
+ */
+static void split_expression(struct part_sc *sc, struct llhdl_node **root)
+{
+	struct llhdl_traversal t;
+	struct llhdl_node **slot, **operand, **best;
+	struct llhdl_node *n;
+	int *weights;
+	int depth, size;
+	int count, w, k, bk;
+	int i;
+
+	size = 16;
+	weights = alloc_size(size*sizeof(int));
+	depth = 0;
+	llhdl_traversal_init(&t, LLHDL_ORDER_POST, 0);
+	llhdl_traversal_push(&t, root);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		n = *slot;
+		/* missing operands have no weight on the stack */
+		count = 0;
+		for(i=0;(operand = get_slot(n, i)) != NULL;i++)
+			if(*operand != NULL)
+				count++;
+		depth -= count;
+		w = 0;
+		if((n->type != LLHDL_NODE_SIGNAL) && (n->type != LLHDL_NODE_CONSTANT)) {
+			w = 1;
+			for(k=depth;k<depth+count;k++)
+				w += weights[k];
+		}
+		while(w > sc->limit) {
+			best = NULL;
+			bk = -1;
+			k = depth;
+			for(i=0;(operand = get_slot(n, i)) != NULL;i++) {
+				if(*operand == NULL)
+					continue;
+				/* clocks stay signals */
+				if(((n->type != LLHDL_NODE_FD) || (i != 0)) && (weights[k] > 0)
+				  && ((best == NULL) || (weights[k] > weights[bk]))) {
+					best = operand;
+					bk = k;
+				}
+				k++;
+			}
+			if(best == NULL)
+				break;
+			extract(sc, best);
+			w -= weights[bk];
+			weights[bk] = 0;
+		}
+		if(depth == size) {
+			size *= 2;
+			weights = realloc(weights, size*sizeof(int));
+			assert(weights != NULL);
+		}
+		weights[depth++] = w;
+	}
+	llhdl_traversal_free(&t);
+	free(weights);
+}
+
+static void split_expressions(struct part_sc *sc)
+{
+	struct llhdl_node *n;
+	int total;
+
+	total = 0;
+	for(n=sc->m->head;n!=NULL;n=n->p.signal.next)
+		total += expression_weight(&n->p.signal.source);
+	sc->limit = total/(8*sc->k) + 1;
+	sc->next_id = 0;
+	/* new signals are inserted at the head of the list, and are small enough */
+	for(n=sc->m->head;n!=NULL;n=n->p.signal.next) {
+		sc->base = n->p.signal.name;
+		split_expression(sc, &n->p.signal.source);
+	}
+}
+
+static int walk_reads(struct llhdl_node **n2, void *user)
+{
+	struct part_sc *sc = user;
+	struct part_signal *s;
+	int i;
+
+	if((*n2)->type != LLHDL_NODE_SIGNAL)
+		return 1;
+	s = get_signal(*n2);
+	if((s->vertex == -1) || (s->vertex == sc->current))
+		return 1;
+	i = s - sc->signals;
+	if(sc->last[i] == sc->current)
+		return 1;
+	sc->last[i] = sc->current;
+	sc->read_signal[sc->nreads] = i;
+	sc->read_vertex[sc->nreads] = sc->current;
+	sc->nreads++;
+	return 1;
+}
+
+static int walk_count_reads(struct llhdl_node **n2, void *user)
+{
+	int *count = user;
+
+	if((*n2)->type == LLHDL_NODE_SIGNAL)
+		(*count)++;
+	return 1;
+}
+
+static struct hypergraph *build_hypergraph(struct part_sc *sc)
+{
+	struct hypergraph *h;
+	struct part_signal *s;
+	int *vertices, *edge, *p;
+	int nvertices, nedges, maxreads, npins;
+	int i, j;
+
+	nvertices = 0;
+	maxreads = 0;
+	for(i=0;i<sc->nsignals;i++) {
+		s = &sc->signals[i];
+		if(s->signal->p.signal.source != NULL) {
+			s->vertex = nvertices++;
+			llhdl_walk(walk_count_reads, &maxreads, &s->signal->p.signal.source);
+		}
+	}
+	vertices = alloc_size((nvertices+1)*sizeof(int));
+	for(i=0;i<sc->nsignals;i++)
+		if(sc->signals[i].vertex != -1)
+			vertices[sc->signals[i].vertex] = i;
+
+	/* each signal read by a vertex is a pin of the edge of that signal */
+	sc->nreads = 0;
+	sc->read_signal = alloc_size((maxreads+1)*sizeof(int));
+	sc->read_vertex = alloc_size((maxreads+1)*sizeof(int));
+	sc->last = alloc_size((sc->nsignals+1)*sizeof(int));
+	for(i=0;i<sc->nsignals;i++)
+		sc->last[i] = -1;
+	for(i=0;i<nvertices;i++) {
+		sc->current = i;
+		llhdl_walk(walk_reads, sc, &sc->signals[vertices[i]].signal->p.signal.source);
+	}
+	free(sc->last);
+
+	/* sort the reads by signal */
+	edge = alloc_size0((sc->nsignals+1)*sizeof(int));
+	for(i=0;i<sc->nreads;i++)
+		edge[sc->read_signal[i]+1]++;
+	for(i=0;i<sc->nsignals;i++)
+		edge[i+1] += edge[i];
+	p = alloc_size((sc->nreads+1)*sizeof(int));
+	for(i=0;i<sc->nreads;i++)
+		p[edge[sc->read_signal[i]]++] = sc->read_vertex[i];
+	/* edge[i] is now the end of the reads of signal i */
+
+	nedges = 0;
+	for(i=0;i<sc->nsignals;i++)
+		if(sc->signals[i].vertex != -1)
+			nedges++;
+	h = hg_new(nvertices, nedges, nvertices + sc->nreads);
+	for(i=0;i<nvertices;i++) {
+		s = &sc->signals[vertices[i]];
+		h->weight[i] = expression_weight(&s->signal->p.signal.source);
+		if(h->weight[i] == 0)
+			h->weight[i] = 1;
+	}
+	j = 0;
+	for(i=0;i<sc->nsignals;i++) {
+		s = &sc->signals[i];
+		if(s->vertex != -1) {
+			npins = 0;
+			hg_next_pins(h)[npins++] = s->vertex;
+			for(;j<edge[i];j++)
+				hg_next_pins(h)[npins++] = p[j];
+			hg_add_edge(h, s->signal->p.signal.vectorsize, npins);
+		}
+		j = edge[i];
+	}
+	hg_index(h);
+
+	free(p);
+	free(edge);
+	free(vertices);
+	return h;
+}
+
+static void create_partition(struct part_sc *sc, int i)
+{
+	struct llhdl_module *d;
+	char *name;
+
+	d = llhdl_new_module();
+	name = part_name(sc->m->name != NULL ? sc->m->name : "top", i);
+	llhdl_set_module_name(d, name);
+	free(name);
+	/* there can be one partition per signal */
+	if(sc->last_definition != NULL)
+		sc->last_definition->next = d;
+	else
+		llhdl_add_definition(sc->m, d);
+	sc->last_definition = d;
+	sc->instances[i] = llhdl_create_instance(sc->m, d, d->name);
+	sc->definitions[i] = d;
+	if(sc->first == NULL)
+		sc->first = d;
+}
+
+static struct llhdl_node *create_port(struct part_sc *sc, struct part_signal *s, int i)
+{
+	struct llhdl_node *port;
+
+	port = llhdl_create_signal(sc->definitions[i],
+		s->part == i ? LLHDL_SIGNAL_PORT_OUT : LLHDL_SIGNAL_PORT_IN,
+		s->signal->p.signal.name, s->signal->p.signal.sign, s->signal->p.signal.vectorsize);
+	if(s->part == i) {
+		/* the source must be moved before the connection */
+		port->p.signal.source = s->signal->p.signal.source;
+		s->signal->p.signal.source = NULL;
+	}
+	llhdl_connect(sc->instances[i], port, s->signal);
+	return port;
+}
+
+/* Port of partition <i> that gives access to signal <s> of the top-level module.
+ * The reads of each partition are mapped to ports one partition after the other,
+ * so that only the port of the last one needs to be remembered.
+ */
+static struct llhdl_node *get_port(struct part_sc *sc, struct part_signal *s, int i)
+{
+	if(s->part == i) {
+		if(s->port == NULL)
+			s->port = create_port(sc, s, i);
+		return s->port;
+	}
+	if(s->last_part != i) {
+		s->last_port = create_port(sc, s, i);
+		s->last_part = i;
+	}
+	return s->last_port;
+}
+
+static int walk_map_ports(struct llhdl_node **n2, void *user)
+{
+	struct part_sc *sc = user;
+	struct part_signal *s;
+
+	if((*n2)->type != LLHDL_NODE_SIGNAL)
+		return 1;
+	s = get_signal(*n2);
+	if((s->part != sc->current) || s->external)
+		*n2 = get_port(sc, s, sc->current);
+	return 1;
+}
+
+/* Signals that are internal to a partition are moved, the others become ports */
+static void build_partitions(struct part_sc *sc, int *part)
+{
+	struct llhdl_node **prev;
+	struct llhdl_node *n, *next;
+	struct llhdl_instance *inst;
+	struct part_signal *s;
+	int *member_start, *members;
+	int i, j;
+
+	for(i=0;i<sc->nsignals;i++) {
+		s = &sc->signals[i];
+		if(s->vertex != -1) {
+			s->part = part[s->vertex];
+			if(s->signal->p.signal.type != LLHDL_SIGNAL_INTERNAL)
+				s->external = 1;
+		}
+	}
+	for(i=0;i<sc->nreads;i++)
+		if(sc->signals[sc->read_signal[i]].part != part[sc->read_vertex[i]])
+			sc->signals[sc->read_signal[i]].external = 1;
+	for(inst=sc->m->ihead;inst!=NULL;inst=inst->next)
+		for(j=0;j<inst->nconnections;j++)
+			get_signal(inst->connections[j].signal)->external = 1;
+
+	for(i=0;i<sc->nsignals;i++) {
+		s = &sc->signals[i];
+		if((s->part != -1) && (sc->definitions[s->part] == NULL))
+			create_partition(sc, s->part);
+	}
+	for(i=0;i<sc->nsignals;i++) {
+		s = &sc->signals[i];
+		if((s->part != -1) && s->external)
+			get_port(sc, s, s->part);
+	}
+
+	prev = &sc->m->head;
+	for(n=sc->m->head;n!=NULL;n=next) {
+		next = n->p.signal.next;
+		s = get_signal(n);
+		if((s->part != -1) && !s->external) {
+			*prev = next;
+			n->p.signal.next = sc->definitions[s->part]->head;
+			sc->definitions[s->part]->head = n;
+		} else
+			prev = &n->p.signal.next;
+	}
+
+	/* the signals moved to partition i are members[member_start[i]] to members[member_start[i+1]-1] */
+	member_start = alloc_size0((sc->k+1)*sizeof(int));
+	for(i=0;i<sc->nsignals;i++)
+		if((sc->signals[i].part != -1) && !sc->signals[i].external)
+			member_start[sc->signals[i].part+1]++;
+	for(i=0;i<sc->k;i++)
+		member_start[i+1] += member_start[i];
+	members = alloc_size((member_start[sc->k]+1)*sizeof(int));
+	for(i=0;i<sc->nsignals;i++)
+		if((sc->signals[i].part != -1) && !sc->signals[i].external)
+			members[member_start[sc->signals[i].part]++] = i;
+	for(i=sc->k;i>0;i--)
+		member_start[i] = member_start[i-1];
+	member_start[0] = 0;
+
+	/* expressions read the ports instead of the top-level signals */
+	for(i=0;i<sc->k;i++) {
+		if(sc->definitions[i] == NULL)
+			continue;
+		sc->current = i;
+		for(n=sc->definitions[i]->head;n!=NULL;n=n->p.signal.next)
+			if(n->user == NULL)
+				llhdl_walk(walk_map_ports, sc, &n->p.signal.source);
+		for(j=member_start[i];j<member_start[i+1];j++)
+			llhdl_walk(walk_map_ports, sc, &sc->signals[members[j]].signal->p.signal.source);
+	}
+	free(members);
+	free(member_start);
+}
+
+static void init_signals(struct part_sc *sc)
+{
+	struct llhdl_node *n;
+	int i;
+
+	sc->nsignals = 0;
+	for(n=sc->m->head;n!=NULL;n=n->p.signal.next)
+		sc->nsignals++;
+	sc->signals = alloc_size((sc->nsignals+1)*sizeof(struct part_signal));
+	i = 0;
+	for(n=sc->m->head;n!=NULL;n=n->p.signal.next) {
+		sc->signals[i].signal = n;
+		sc->signals[i].vertex = -1;
+		sc->signals[i].part = -1;
+		sc->signals[i].external = 0;
+		sc->signals[i].port = NULL;
+		sc->signals[i].last_part = -1;
+		sc->signals[i].last_port = NULL;
+		n->user = &sc->signals[i];
+		i++;
+	}
+}
+
+static void free_signals(struct part_sc *sc)
+{
+	int i;
+
+	for(i=0;i<sc->nsignals;i++)
+		sc->signals[i].signal->user = NULL;
+	free(sc->read_signal);
+	free(sc->read_vertex);
+	free(sc->signals);
+}
+
+static void create_partitions(struct part_sc *sc, int *part)
+{
+	sc->definitions = alloc_size0(sc->k*sizeof(struct llhdl_module *));
+	sc->instances = alloc_size0(sc->k*sizeof(struct llhdl_instance *));
+	build_partitions(sc, part);
+	free(sc->definitions);
+	free(sc->instances);
+}
+
+struct llhdl_module *llhdl_partition(struct llhdl_module *m, int k)
+{
+	struct part_sc sc;
+	struct hypergraph *h;
+	int *part;
+
+	if(k < 2)
+		return NULL;
+	sc.m = m;
+	sc.k = k;
+	sc.first = NULL;
+	sc.last_definition = NULL;
+	split_expressions(&sc);
+
+	init_signals(&sc);
+	h = build_hypergraph(&sc);
+	if(h->nvertices > 0) {
+		part = alloc_size(h->nvertices*sizeof(int));
+		partition_k(h, part, 0, k);
+		create_partitions(&sc, part);
+		free(part);
+	}
+	hg_free(h);
+	free_signals(&sc);
+	return sc.first;
+}
+
+static int find_root(int *parent, int v)
+{
+	while(parent[v] != v) {
+		parent[v] = parent[parent[v]];
+		v = parent[v];
+	}
+	return v;
+}
+
+/* Gives each vertex the number of its cone, and returns the number of cones.
+ * Internal signals read by a single other vertex join the cone of that vertex.
+ */
+static int find_cones(struct part_sc *sc, int nvertices, int *part)
+{
+	struct llhdl_instance *inst;
+	struct part_signal *s;
+	int *readers, *reader, *parent, *cone;
+	int i, j, v, k;
+
+	readers = alloc_size0((sc->nsignals+1)*sizeof(int));
+	reader = alloc_size((sc->nsignals+1)*sizeof(int));
+	for(i=0;i<sc->nreads;i++) {
+		readers[sc->read_signal[i]]++;
+		reader[sc->read_signal[i]] = sc->read_vertex[i];
+	}
+	/* signals connected to instances are read outside of the cones */
+	for(inst=sc->m->ihead;inst!=NULL;inst=inst->next)
+		for(j=0;j<inst->nconnections;j++)
+			readers[get_signal(inst->connections[j].signal) - sc->signals] = -1;
+
+	parent = alloc_size((nvertices+1)*sizeof(int));
+	for(v=0;v<nvertices;v++)
+		parent[v] = v;
+	for(i=0;i<sc->nsignals;i++) {
+		s = &sc->signals[i];
+		if((s->vertex != -1) && (s->signal->p.signal.type == LLHDL_SIGNAL_INTERNAL) && (readers[i] == 1))
+			parent[find_root(parent, s->vertex)] = find_root(parent, reader[i]);
+	}
+
+	cone = alloc_size((nvertices+1)*sizeof(int));
+	for(v=0;v<nvertices;v++)
+		cone[v] = -1;
+	k = 0;
+	for(v=0;v<nvertices;v++) {
+		i = find_root(parent, v);
+		if(cone[i] == -1)
+			cone[i] = k++;
+		part[v] = cone[i];
+	}
+
+	free(cone);
+	free(parent);
+	free(reader);
+	free(readers);
+	return k;
+}
+
+struct llhdl_module *llhdl_partition_cones(struct llhdl_module *m)
+{
+	struct part_sc sc;
+	struct hypergraph *h;
+	int *part;
+
+	sc.m = m;
+	sc.first = NULL;
+	sc.last_definition = NULL;
+	init_signals(&sc);
+	h = build_hypergraph(&sc);
+	if(h->nvertices > 0) {
+		part = alloc_size(h->nvertices*sizeof(int));
+		sc.k = find_cones(&sc, h->nvertices, part);
+		create_partitions(&sc, part);
+		free(part);
+	}
+	hg_free(h);
+	free_signals(&sc);
+	return sc.first;
+}
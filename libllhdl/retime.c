@@ -0,0 +1,490 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <util.h>
+#include <gmp.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/tools.h>
+#include <llhdl/retime.h>
+
+/*
+ * Leiserson-Saxe retiming.
+ * Combinational nodes and signals are the vertices of the graph,
+ * and chains of FD nodes between them are the edge weights.
+ * The FEAS algorithm is used to test the feasibility of a clock period,
+ * and the minimum period is found by binary search.
+ *
+ * Registers are only moved backwards, from the outputs of vertices
+ * to their inputs. FD nodes are initialized to 0, so this preserves the
+ * initial state as long as the vertex outputs 0 when all its inputs are 0.
+ * Vertices which do not (NOT gates, constants) are fixed, like ports
+ * and clocks.
+ */
+
+struct retime_vertex {
+	struct llhdl_node *node;
+	int delay;
+	int fixed;
+	int lag;
+	int arrival;
+	int move;
+	int first_in, nin;
+	int first_out, nout;
+};
+
+struct retime_edge {
+	struct llhdl_node **slot;
+	int from, to;
+	int weight;
+	int foreign; /* < edge contains registers from other clock domains */
+};
+
+struct retime_graph {
+	struct llhdl_module *m;
+	struct llhdl_node *clock;
+	int nvertices;
+	struct retime_vertex *vertices;
+	int nedges;
+	struct retime_edge *edges;
+	int *in_edges;
+	int *out_edges;
+};
+
+struct retime_clock {
+	struct llhdl_node *clock;
+	int count;
+	struct retime_clock *next;
+};
+
+struct retime_count {
+	int nodes;
+	struct retime_clock *clocks;
+};
+
+static int walk_count(struct llhdl_node **n2, void *user)
+{
+	struct llhdl_node *n = *n2;
+	struct retime_count *rc = user;
+	struct retime_clock *c;
+
+	rc->nodes++;
+	if((n->type == LLHDL_NODE_FD) && (n->p.fd.clock->type == LLHDL_NODE_SIGNAL)) {
+		for(c=rc->clocks;c!=NULL;c=c->next)
+			if(c->clock == n->p.fd.clock)
+				break;
+		if(c == NULL) {
+			c = alloc_type(struct retime_clock);
+			c->clock = n->p.fd.clock;
+			c->count = 0;
+			c->next = rc->clocks;
+			rc->clocks = c;
+		}
+		c->count++;
+	}
+	return 1;
+}
+
+static int node_delay(struct llhdl_node *n)
+{
+	int k, levels;
+
+	switch(n->type) {
+		case LLHDL_NODE_LOGIC:
+			return 1;
+		case LLHDL_NODE_EXTLOGIC:
+			if(n->p.logic.op == LLHDL_EXTLOGIC_MUL)
+				return 2 + llhdl_get_vectorsize(n)/4;
+			return 1 + llhdl_get_vectorsize(n)/8;
+		case LLHDL_NODE_MUX:
+			levels = 1;
+			for(k=4;k<n->p.mux.nsources;k*=4)
+				levels++;
+			return levels;
+		default:
+			return 0;
+	}
+}
+
+static int is_fixed(struct llhdl_node *n)
+{
+	switch(n->type) {
+		case LLHDL_NODE_SIGNAL:
+			return (n->p.signal.type != LLHDL_SIGNAL_INTERNAL) || llhdl_is_clock(n);
+		case LLHDL_NODE_CONSTANT:
+			return 1;
+		case LLHDL_NODE_LOGIC:
+			return n->p.logic.op == LLHDL_LOGIC_NOT;
+		default:
+			return 0;
+	}
+}
+
+static struct llhdl_node **get_slot(struct llhdl_node *n, int i)
+{
+	switch(n->type) {
+		case LLHDL_NODE_SIGNAL:
+			return i == 0 ? &n->p.signal.source : NULL;
+		case LLHDL_NODE_LOGIC:
+		case LLHDL_NODE_EXTLOGIC:
+			return i < llhdl_get_logic_arity(n->p.logic.op) ? &n->p.logic.operands[i] : NULL;
+		case LLHDL_NODE_MUX:
+			if(i == 0)
+				return &n->p.mux.select;
+			return i <= n->p.mux.nsources ? &n->p.mux.sources[i-1] : NULL;
+		case LLHDL_NODE_VECT:
+			return i < n->p.vect.nslices ? &n->p.vect.slices[i].source : NULL;
+		default:
+			return NULL;
+	}
+}
+
+static int add_vertex(struct retime_graph *g, struct llhdl_node *n)
+{
+	struct retime_vertex *v;
+
+	v = &g->vertices[g->nvertices];
+	v->node = n;
+	v->delay = node_delay(n);
+	v->fixed = is_fixed(n);
+	v->lag = 0;
+	v->nin = 0;
+	v->nout = 0;
+	n->user = v;
+	return g->nvertices++;
+}
+
+static void add_edges(struct retime_graph *g, int to)
+{
+	struct llhdl_node **slot;
+	struct llhdl_node *n;
+	struct retime_edge *e;
+	int weight, foreign;
+	int from;
+	int i;
+
+	for(i=0;(slot = get_slot(g->vertices[to].node, i)) != NULL;i++) {
+		n = *slot;
+		weight = 0;
+		foreign = 0;
+		while((n != NULL) && (n->type == LLHDL_NODE_FD)) {
+			if(n->p.fd.clock != g->clock)
+				foreign = 1;
+			weight++;
+			n = n->p.fd.data;
+		}
+		if(n == NULL) {
+			g->vertices[to].fixed = 1;
+			continue;
+		}
+		if(n->user == NULL) {
+			from = add_vertex(g, n);
+			add_edges(g, from);
+		} else
+			from = (struct retime_vertex *)n->user - g->vertices;
+		e = &g->edges[g->nedges++];
+		e->slot = slot;
+		e->from = from;
+		e->to = to;
+		e->weight = weight;
+		e->foreign = foreign;
+		if(foreign) {
+			g->vertices[from].fixed = 1;
+			g->vertices[to].fixed = 1;
+		}
+		g->vertices[from].nout++;
+		g->vertices[to].nin++;
+	}
+}
+
+static void build_adjacency(struct retime_graph *g)
+{
+	int i;
+	int in, out;
+	struct retime_edge *e;
+
+	in = 0;
+	out = 0;
+	for(i=0;i<g->nvertices;i++) {
+		g->vertices[i].first_in = in;
+		g->vertices[i].first_out = out;
+		in += g->vertices[i].nin;
+		out += g->vertices[i].nout;
+		g->vertices[i].nin = 0;
+		g->vertices[i].nout = 0;
+	}
+	g->in_edges = alloc_size(g->nedges*sizeof(int));
+	g->out_edges = alloc_size(g->nedges*sizeof(int));
+	for(i=0;i<g->nedges;i++) {
+		e = &g->edges[i];
+		g->in_edges[g->vertices[e->to].first_in + g->vertices[e->to].nin++] = i;
+		g->out_edges[g->vertices[e->from].first_out + g->vertices[e->from].nout++] = i;
+	}
+}
+
+static int build_graph(struct retime_graph *g, struct llhdl_module *m)
+{
+	struct retime_count rc;
+	struct retime_clock *c, *next;
+	struct llhdl_node *n;
+	int nsignals;
+	int i, nsvertices;
+
+	g->m = m;
+	rc.nodes = 0;
+	rc.clocks = NULL;
+	llhdl_walk_module(walk_count, &rc, m);
+
+	/* retime the clock domain with the most registers */
+	g->clock = NULL;
+	i = 0;
+	for(c=rc.clocks;c!=NULL;c=next) {
+		next = c->next;
+		if(c->count > i) {
+			g->clock = c->clock;
+			i = c->count;
+		}
+		free(c);
+	}
+	if(g->clock == NULL)
+		return 0;
+
+	nsignals = 0;
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		nsignals++;
+	g->vertices = alloc_size((rc.nodes+nsignals)*sizeof(struct retime_vertex));
+	g->edges = alloc_size((rc.nodes+nsignals)*sizeof(struct retime_edge));
+	g->nvertices = 0;
+	g->nedges = 0;
+
+	llhdl_identify_clocks(m);
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		add_vertex(g, n);
+	nsvertices = g->nvertices;
+	for(i=0;i<nsvertices;i++)
+		add_edges(g, i);
+	build_adjacency(g);
+	return 1;
+}
+
+static void free_graph(struct retime_graph *g)
+{
+	int i;
+
+	for(i=0;i<g->nvertices;i++)
+		g->vertices[i].node->user = NULL;
+	free(g->vertices);
+	free(g->edges);
+	free(g->in_edges);
+	free(g->out_edges);
+}
+
+static int retimed_weight(struct retime_graph *g, struct retime_edge *e)
+{
+	return e->weight + g->vertices[e->to].lag - g->vertices[e->from].lag;
+}
+
+static int compute_arrival(struct retime_graph *g, int i)
+{
+	struct retime_vertex *v;
+	struct retime_edge *e;
+	int j;
+	int a, r;
+
+	v = &g->vertices[i];
+	if(v->arrival >= 0)
+		return v->arrival;
+	if(v->arrival == -2)
+		/* combinational loop */
+		return 0;
+	v->arrival = -2;
+	r = 0;
+	for(j=0;j<v->nin;j++) {
+		e = &g->edges[g->in_edges[v->first_in+j]];
+		if(retimed_weight(g, e) == 0) {
+			a = compute_arrival(g, e->from);
+			if(a > r)
+				r = a;
+		}
+	}
+	v->arrival = r + v->delay;
+	return v->arrival;
+}
+
+static int compute_period(struct retime_graph *g)
+{
+	int i;
+	int r;
+
+	for(i=0;i<g->nvertices;i++)
+		g->vertices[i].arrival = -1;
+	r = 0;
+	for(i=0;i<g->nvertices;i++)
+		r = max(r, compute_arrival(g, i));
+	return r;
+}
+
+/* FEAS: increment the lag of vertices whose arrival time exceeds the period.
+ * A vertex is only moved if all its outputs have a register, or lead to vertices
+ * that are moved too.
+ */
+static int feas(struct retime_graph *g, int period)
+{
+	struct retime_vertex *v;
+	struct retime_edge *e;
+	int iter;
+	int i, j;
+	int changed;
+
+	for(i=0;i<g->nvertices;i++)
+		g->vertices[i].lag = 0;
+	for(iter=0;iter<g->nvertices;iter++) {
+		if(compute_period(g) <= period)
+			return 1;
+		for(i=0;i<g->nvertices;i++) {
+			v = &g->vertices[i];
+			v->move = !v->fixed && (v->arrival > period);
+		}
+		do {
+			changed = 0;
+			for(i=0;i<g->nvertices;i++) {
+				v = &g->vertices[i];
+				if(!v->move)
+					continue;
+				for(j=0;j<v->nout;j++) {
+					e = &g->edges[g->out_edges[v->first_out+j]];
+					if((retimed_weight(g, e) == 0) && !g->vertices[e->to].move) {
+						v->move = 0;
+						changed = 1;
+						break;
+					}
+				}
+			}
+		} while(changed);
+		changed = 0;
+		for(i=0;i<g->nvertices;i++)
+			if(g->vertices[i].move) {
+				g->vertices[i].lag++;
+				changed = 1;
+			}
+		if(!changed)
+			break;
+	}
+	return compute_period(g) <= period;
+}
+
+static struct llhdl_node *register_chain(struct llhdl_node *clock, struct llhdl_node *n, int count)
+{
+	while(count-- > 0)
+		n = llhdl_create_fd(clock, n);
+	return n;
+}
+
+static char *chain_name(const char *base, int i)
+{
+	int r;
+	char *ret;
+	r = asprintf(&ret, "%s$retime%d", base, i);
+	if(r == -1) abort();
+	return ret;
+}
+
+static void rewrite(struct retime_graph *g)
+{
+	struct retime_vertex *v;
+	struct retime_edge *e;
+	struct llhdl_node *n, *next;
+	struct llhdl_node **chain;
+	int i, j;
+	int nregs, max_weight;
+	char *name;
+
+	for(i=0;i<g->nedges;i++) {
+		e = &g->edges[i];
+		if(e->foreign)
+			continue;
+		n = *e->slot;
+		while(n->type == LLHDL_NODE_FD) {
+			next = n->p.fd.data;
+			free(n);
+			n = next;
+		}
+		*e->slot = n;
+	}
+
+	for(i=0;i<g->nvertices;i++) {
+		v = &g->vertices[i];
+		nregs = 0;
+		max_weight = 0;
+		for(j=0;j<v->nout;j++) {
+			e = &g->edges[g->out_edges[v->first_out+j]];
+			if(e->foreign || (retimed_weight(g, e) == 0))
+				continue;
+			nregs++;
+			max_weight = max(max_weight, retimed_weight(g, e));
+		}
+		if(nregs == 0)
+			continue;
+		if((v->node->type == LLHDL_NODE_SIGNAL) && (nregs > 1)) {
+			/* share registers between fanouts through new internal signals */
+			chain = alloc_size((max_weight+1)*sizeof(struct llhdl_node *));
+			chain[0] = v->node;
+			for(j=1;j<=max_weight;j++) {
+				name = chain_name(v->node->p.signal.name, j);
+				chain[j] = llhdl_create_signal(g->m, LLHDL_SIGNAL_INTERNAL, name,
+					v->node->p.signal.sign, v->node->p.signal.vectorsize);
+				free(name);
+				chain[j]->p.signal.source = llhdl_create_fd(g->clock, chain[j-1]);
+			}
+			for(j=0;j<v->nout;j++) {
+				e = &g->edges[g->out_edges[v->first_out+j]];
+				if(!e->foreign)
+					*e->slot = chain[retimed_weight(g, e)];
+			}
+			free(chain);
+		} else {
+			for(j=0;j<v->nout;j++) {
+				e = &g->edges[g->out_edges[v->first_out+j]];
+				if(!e->foreign)
+					*e->slot = register_chain(g->clock, v->node, retimed_weight(g, e));
+			}
+		}
+	}
+}
+
+int llhdl_retime(struct llhdl_module *m, int *period_before)
+{
+	struct retime_graph g;
+	int lo, hi, mid;
+	int i;
+
+	if(!build_graph(&g, m)) {
+		if(period_before != NULL)
+			*period_before = -1;
+		return -1;
+	}
+
+	hi = compute_period(&g);
+	if(period_before != NULL)
+		*period_before = hi;
+	lo = 0;
+	for(i=0;i<g.nvertices;i++)
+		lo = max(lo, g.vertices[i].delay);
+	while(lo < hi) {
+		mid = (lo + hi)/2;
+		if(feas(&g, mid))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if(!feas(&g, hi))
+		/* should not happen, fall back to the original registers */
+		for(i=0;i<g.nvertices;i++)
+			g.vertices[i].lag = 0;
+	rewrite(&g);
+	hi = compute_period(&g);
+
+	free_graph(&g);
+	return hi;
+}
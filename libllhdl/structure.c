@@ -1,11 +1,13 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <string.h>
 #include <util.h>
 #include <gmp.h>
 
 #include <llhdl/structure.h>
+#include <llhdl/tools.h>
 
 int llhdl_get_logic_arity(int op)
 {
@@ -31,6 +33,9 @@ struct llhdl_module *llhdl_new_module()
 	m = alloc_type(struct llhdl_module);
 	m->name = NULL;
 	m->head = NULL;
+	m->ihead = NULL;
+	m->dhead = NULL;
+	m->next = NULL;
 
 	return m;
 }
@@ -38,9 +43,18 @@ struct llhdl_module *llhdl_new_module()
 void llhdl_free_module(struct llhdl_module *m)
 {
 	struct llhdl_node *n1, *n2;
+	struct llhdl_instance *i1, *i2;
+	struct llhdl_module *d1, *d2;
 	
 	free(m->name);
 
+	i1 = m->ihead;
+	while(i1 != NULL) {
+		i2 = i1->next;
+		llhdl_free_instance(i1);
+		i1 = i2;
+	}
+
 	/* We must traverse the list twice,
 	 * otherwise invalid signal references may appear in
 	 * llhdl_free_node().
@@ -58,6 +72,13 @@ void llhdl_free_module(struct llhdl_module *m)
 		free(n1);
 		n1 = n2;
 	}
+
+	d1 = m->dhead;
+	while(d1 != NULL) {
+		d2 = d1->next;
+		llhdl_free_module(d1);
+		d1 = d2;
+	}
 	free(m);
 }
 
@@ -70,28 +91,88 @@ void llhdl_set_module_name(struct llhdl_module *m, const char *name)
 		m->name = stralloc(name);
 }
 
+void llhdl_add_definition(struct llhdl_module *top, struct llhdl_module *d)
+{
+	struct llhdl_module **last;
+
+	assert(d->dhead == NULL);
+	last = &top->dhead;
+	while(*last != NULL)
+		last = &(*last)->next;
+	d->next = NULL;
+	*last = d;
+}
+
+struct llhdl_module *llhdl_find_definition(struct llhdl_module *top, const char *name)
+{
+	struct llhdl_module *d;
+
+	d = top->dhead;
+	while(d != NULL) {
+		if((d->name != NULL) && (strcmp(d->name, name) == 0))
+			return d;
+		d = d->next;
+	}
+	return NULL;
+}
+
 static struct llhdl_node *alloc_base_node(int payload_size, int type)
 {
 	struct llhdl_node *n;
 
-	n = alloc_size(sizeof(int)+sizeof(void *)+payload_size);
+	n = alloc_size(offsetof(struct llhdl_node, p)+payload_size);
 	n->type = type;
+	n->mark = 0;
 	n->user = NULL;
 	return n;
 }
 
+static uint64_t inline_mask(int vectorsize)
+{
+	if(vectorsize >= 64)
+		return ~(uint64_t)0;
+	return ((uint64_t)1 << vectorsize) - 1;
+}
+
 struct llhdl_node *llhdl_create_constant(mpz_t value, int sign, int vectorsize)
 {
 	struct llhdl_node *n;
+	uint64_t bits;
+	size_t i;
 
 	/* TODO: handle here sign/size mismatches with the MPZ type so libgmp nicely
 	 * takes care of sign extension for us later on.
 	 */
 
 	n = alloc_base_node(sizeof(struct llhdl_node_constant), LLHDL_NODE_CONSTANT);
-	mpz_init_set(n->p.constant.value, value);
 	n->p.constant.sign = sign;
 	n->p.constant.vectorsize = vectorsize;
+	if(LLHDL_CONSTANT_INLINE(n)) {
+		/* Low bits of the two's complement value, without allocating */
+		bits = 0;
+		for(i=0;(i*GMP_NUMB_BITS < 64) && (i < mpz_size(value));i++)
+			bits |= (uint64_t)mpz_getlimbn(value, i) << (i*GMP_NUMB_BITS);
+		if(mpz_sgn(value) < 0)
+			bits = -bits;
+		n->p.constant.v.bits = bits & inline_mask(vectorsize);
+	} else
+		mpz_init_set(n->p.constant.v.big, value);
+	return n;
+}
+
+struct llhdl_node *llhdl_create_constant_ui(uint64_t value, int sign, int vectorsize)
+{
+	struct llhdl_node *n;
+
+	n = alloc_base_node(sizeof(struct llhdl_node_constant), LLHDL_NODE_CONSTANT);
+	n->p.constant.sign = sign;
+	n->p.constant.vectorsize = vectorsize;
+	if(LLHDL_CONSTANT_INLINE(n))
+		n->p.constant.v.bits = value & inline_mask(vectorsize);
+	else {
+		mpz_init(n->p.constant.v.big);
+		mpz_import(n->p.constant.v.big, 1, -1, sizeof(uint64_t), 0, 0, &value);
+	}
 	return n;
 }
 
@@ -106,6 +187,7 @@ struct llhdl_node *llhdl_create_signal(struct llhdl_module *m, int type, const c
 	n->p.signal.sign = sign;
 	n->p.signal.vectorsize = vectorsize;
 	n->p.signal.source = NULL;
+	n->p.signal.driver = NULL;
 	n->p.signal.next = m->head;
 	n->p.signal.is_clock = 0;
 	memcpy(n->p.signal.name, name, len+1);
@@ -171,42 +253,20 @@ struct llhdl_node *llhdl_create_vect(int sign, int nslices, struct llhdl_slice *
 
 void llhdl_free_node(struct llhdl_node *n)
 {
-	int i;
-	int arity;
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
 
-	if(n == NULL)
-		return;
-	if(n->type == LLHDL_NODE_SIGNAL)
-		return;
-
-	switch(n->type) {
-		case LLHDL_NODE_CONSTANT:
-			mpz_clear(n->p.constant.value);
-			break;
-		case LLHDL_NODE_LOGIC:
-		case LLHDL_NODE_EXTLOGIC:
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			for(i=0;i<arity;i++)
-				llhdl_free_node(n->p.logic.operands[i]);
-			break;
-		case LLHDL_NODE_MUX:
-			llhdl_free_node(n->p.mux.select);
-			for(i=0;i<n->p.mux.nsources;i++)
-				llhdl_free_node(n->p.mux.sources[i]);
-			break;
-		case LLHDL_NODE_FD:
-			llhdl_free_node(n->p.fd.clock);
-			llhdl_free_node(n->p.fd.data);
-			break;
-		case LLHDL_NODE_VECT:
-			for(i=0;i<n->p.vect.nslices;i++)
-				llhdl_free_node(n->p.vect.slices[i].source);
-			break;
-		default:
-			assert(0);
-			break;
+	/* Operands are returned before the nodes that hold them */
+	llhdl_traversal_init(&t, LLHDL_ORDER_POST, 0);
+	llhdl_traversal_push(&t, &n);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		if((*slot)->type == LLHDL_NODE_SIGNAL)
+			continue;
+		if(((*slot)->type == LLHDL_NODE_CONSTANT) && !LLHDL_CONSTANT_INLINE(*slot))
+			mpz_clear((*slot)->p.constant.v.big);
+		free(*slot);
 	}
-	free(n);
+	llhdl_traversal_free(&t);
 }
 
 void llhdl_free_signal(struct llhdl_node *n)
@@ -229,3 +289,66 @@ struct llhdl_node *llhdl_find_signal(struct llhdl_module *m, const char *name)
 	}
 	return NULL;
 }
+
+struct llhdl_instance *llhdl_create_instance(struct llhdl_module *m, struct llhdl_module *definition, const char *name)
+{
+	struct llhdl_instance *inst;
+	int len;
+
+	len = strlen(name);
+	inst = alloc_size(sizeof(struct llhdl_instance)+len+1);
+	inst->definition = definition;
+	inst->nconnections = 0;
+	inst->connections = NULL;
+	memcpy(inst->name, name, len+1);
+	inst->next = m->ihead;
+	m->ihead = inst;
+	return inst;
+}
+
+void llhdl_connect(struct llhdl_instance *inst, struct llhdl_node *port, struct llhdl_node *signal)
+{
+	assert(port->type == LLHDL_NODE_SIGNAL);
+	assert(signal->type == LLHDL_NODE_SIGNAL);
+	if(port->p.signal.type == LLHDL_SIGNAL_INTERNAL) {
+		fprintf(stderr, "Signal %s is not a port of instance %s\n", port->p.signal.name, inst->name);
+		exit(EXIT_FAILURE);
+	}
+	if(llhdl_find_connection(inst, port) != NULL) {
+		fprintf(stderr, "Port %s of instance %s is connected twice\n", port->p.signal.name, inst->name);
+		exit(EXIT_FAILURE);
+	}
+	if((port->p.signal.vectorsize != signal->p.signal.vectorsize) || (port->p.signal.sign != signal->p.signal.sign)) {
+		fprintf(stderr, "Type mismatch on port %s of instance %s\n", port->p.signal.name, inst->name);
+		exit(EXIT_FAILURE);
+	}
+	if(port->p.signal.type == LLHDL_SIGNAL_PORT_OUT) {
+		if((signal->p.signal.type == LLHDL_SIGNAL_PORT_IN) || (signal->p.signal.source != NULL)
+		  || (signal->p.signal.driver != NULL)) {
+			fprintf(stderr, "Conflicting assignments on signal %s\n", signal->p.signal.name);
+			exit(EXIT_FAILURE);
+		}
+		signal->p.signal.driver = inst;
+	}
+	inst->connections = realloc(inst->connections, (inst->nconnections+1)*sizeof(struct llhdl_connection));
+	if(inst->connections == NULL) abort();
+	inst->connections[inst->nconnections].port = port;
+	inst->connections[inst->nconnections].signal = signal;
+	inst->nconnections++;
+}
+
+struct llhdl_node *llhdl_find_connection(struct llhdl_instance *inst, struct llhdl_node *port)
+{
+	int i;
+
+	for(i=0;i<inst->nconnections;i++)
+		if(inst->connections[i].port == port)
+			return inst->connections[i].signal;
+	return NULL;
+}
+
+void llhdl_free_instance(struct llhdl_instance *inst)
+{
+	free(inst->connections);
+	free(inst);
+}
@@ -1,4 +1,7 @@
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <gmp.h>
 
 #include <llhdl/structure.h>
@@ -36,73 +39,244 @@ const char *llhdl_strlogic(int op)
 	}
 }
 
-struct llhdl_node *llhdl_dup(struct llhdl_node *n)
+static unsigned int epoch_counter;
+
+unsigned int llhdl_new_epoch()
+{
+	unsigned int r;
+
+	/* Partitions are mapped on several threads. Epoch 0 is never used by a traversal. */
+	do
+		r = __sync_add_and_fetch(&epoch_counter, 1);
+	while(r == 0);
+	return r;
+}
+
+struct llhdl_node **llhdl_get_operand(struct llhdl_node *n, int i)
 {
-	struct llhdl_node *r;
-	int i, arity;
-	struct llhdl_node **operands;
-	struct llhdl_node *select;
-	struct llhdl_node **sources;
-	struct llhdl_slice *slices;
-	
-	if(n == NULL)
-		return NULL;
-	
-	r = NULL;
 	switch(n->type) {
 		case LLHDL_NODE_CONSTANT:
-			r = llhdl_create_constant(n->p.constant.value, n->p.constant.sign, n->p.constant.vectorsize);
-			break;
 		case LLHDL_NODE_SIGNAL:
-			r = n;
-			break;
+			return NULL;
 		case LLHDL_NODE_LOGIC:
 		case LLHDL_NODE_EXTLOGIC:
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			operands = alloc_size(arity*sizeof(struct llhdl_node *));
-			for(i=0;i<arity;i++)
-				operands[i] = llhdl_dup(n->p.logic.operands[i]);
-			r = llhdl_create_logic(n->p.logic.op, operands);
-			free(operands);
-			break;
+			if(i < llhdl_get_logic_arity(n->p.logic.op))
+				return &n->p.logic.operands[i];
+			return NULL;
 		case LLHDL_NODE_MUX:
-			select = llhdl_dup(n->p.mux.select);
-			sources = alloc_size(n->p.mux.nsources*sizeof(struct llhdl_node *));
-			for(i=0;i<n->p.mux.nsources;i++)
-				sources[i] = llhdl_dup(n->p.mux.sources[i]);
-			r = llhdl_create_mux(n->p.mux.nsources, select, sources);
-			free(sources);
-			break;
+			if(i == 0)
+				return &n->p.mux.select;
+			if(i <= n->p.mux.nsources)
+				return &n->p.mux.sources[i-1];
+			return NULL;
 		case LLHDL_NODE_FD:
-			r = llhdl_create_fd(llhdl_dup(n->p.fd.clock), llhdl_dup(n->p.fd.data));
-			break;
+			if(i == 0)
+				return &n->p.fd.clock;
+			if(i == 1)
+				return &n->p.fd.data;
+			return NULL;
 		case LLHDL_NODE_VECT:
-			slices = alloc_size(n->p.vect.nslices*sizeof(struct llhdl_slice));
-			for(i=0;i<n->p.vect.nslices;i++) {
-				slices[i].source = llhdl_dup(n->p.vect.slices[i].source);
-				slices[i].start = n->p.vect.slices[i].start;
-				slices[i].end = n->p.vect.slices[i].end;
+			if(i < n->p.vect.nslices)
+				return &n->p.vect.slices[i].source;
+			return NULL;
+		default:
+			assert(0);
+			return NULL;
+	}
+}
+
+enum {
+	FRAME_NEW = -2,
+	FRAME_DONE = -1
+};
+
+void llhdl_traversal_init(struct llhdl_traversal *t, int order, int flags)
+{
+	t->order = order;
+	t->flags = flags;
+	t->epoch = llhdl_new_epoch();
+	t->current = -1;
+	t->depth = 0;
+	t->size = LLHDL_TRAVERSAL_LOCAL;
+	t->stack = t->local;
+}
+
+void llhdl_traversal_push(struct llhdl_traversal *t, struct llhdl_node **slot)
+{
+	if(t->depth == t->size) {
+		t->size *= 2;
+		if(t->stack == t->local) {
+			t->stack = alloc_size(t->size*sizeof(struct llhdl_frame));
+			memcpy(t->stack, t->local, t->depth*sizeof(struct llhdl_frame));
+		} else {
+			t->stack = realloc(t->stack, t->size*sizeof(struct llhdl_frame));
+			assert(t->stack != NULL);
+		}
+	}
+	t->stack[t->depth].slot = slot;
+	t->stack[t->depth].next = FRAME_NEW;
+	t->depth++;
+}
+
+/* Marks <n> and returns 1 if it was not visited yet */
+static int traversal_mark(struct llhdl_traversal *t, struct llhdl_node *n)
+{
+	/* Only signals can be reached several times in a well-formed tree */
+	if((n->type == LLHDL_NODE_SIGNAL) && !(t->flags & LLHDL_TRAVERSE_SIGNALS))
+		return 1;
+	if(n->mark == t->epoch)
+		return 0;
+	n->mark = t->epoch;
+	return 1;
+}
+
+struct llhdl_node **llhdl_traversal_next(struct llhdl_traversal *t)
+{
+	struct llhdl_frame *f;
+	struct llhdl_node *n;
+	struct llhdl_node **slot;
+
+	while(t->depth > 0) {
+		f = &t->stack[t->depth-1];
+		n = *f->slot;
+		if((n == NULL) || (f->next == FRAME_DONE)) {
+			t->depth--;
+			continue;
+		}
+		if(f->next == FRAME_NEW) {
+			if(!traversal_mark(t, n)) {
+				t->depth--;
+				continue;
 			}
-			r = llhdl_create_vect(n->p.vect.sign, n->p.vect.nslices, slices);
-			free(slices);
-			break;
+			f->next = 0;
+			if(t->order == LLHDL_ORDER_PRE) {
+				t->current = t->depth-1;
+				return f->slot;
+			}
+		}
+		if(n->type == LLHDL_NODE_SIGNAL)
+			slot = (t->flags & LLHDL_TRAVERSE_SIGNALS) && (f->next == 0) ? &n->p.signal.source : NULL;
+		else
+			slot = llhdl_get_operand(n, f->next);
+		if(slot != NULL) {
+			f->next++;
+			llhdl_traversal_push(t, slot);
+			continue;
+		}
+		t->depth--;
+		if(t->order == LLHDL_ORDER_POST)
+			return t->stack[t->depth].slot;
+	}
+	return NULL;
+}
+
+void llhdl_traversal_skip(struct llhdl_traversal *t)
+{
+	assert(t->order == LLHDL_ORDER_PRE);
+	assert(t->current >= 0);
+	t->stack[t->current].next = FRAME_DONE;
+}
+
+int llhdl_traversal_level(struct llhdl_traversal *t)
+{
+	assert(t->order == LLHDL_ORDER_PRE);
+	assert(t->current >= 0);
+	return t->current;
+}
+
+void llhdl_traversal_free(struct llhdl_traversal *t)
+{
+	if(t->stack != t->local)
+		free(t->stack);
+}
+
+struct llhdl_node **llhdl_sort_signals(struct llhdl_module *m)
+{
+	struct llhdl_traversal t;
+	struct llhdl_node **signals;
+	struct llhdl_node **r;
+	struct llhdl_node **slot;
+	struct llhdl_node *n;
+	int count;
+	int i;
+
+	count = 0;
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		count++;
+	signals = alloc_size((count+1)*sizeof(struct llhdl_node *));
+	r = alloc_size((count+1)*sizeof(struct llhdl_node *));
+	i = 0;
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		signals[i++] = n;
+
+	llhdl_traversal_init(&t, LLHDL_ORDER_POST, LLHDL_TRAVERSE_SIGNALS);
+	for(i=count-1;i>=0;i--)
+		llhdl_traversal_push(&t, &signals[i]);
+	i = 0;
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		if((*slot)->type == LLHDL_NODE_SIGNAL)
+			r[i++] = *slot;
+	}
+	llhdl_traversal_free(&t);
+	r[i] = NULL;
+	free(signals);
+	return r;
+}
+
+/* Copies the node, keeping the operands of the original */
+static struct llhdl_node *dup_shallow(struct llhdl_node *n)
+{
+	switch(n->type) {
+		case LLHDL_NODE_CONSTANT:
+			if(LLHDL_CONSTANT_INLINE(n))
+				return llhdl_create_constant_ui(n->p.constant.v.bits, n->p.constant.sign, n->p.constant.vectorsize);
+			return llhdl_create_constant(n->p.constant.v.big, n->p.constant.sign, n->p.constant.vectorsize);
+		case LLHDL_NODE_SIGNAL:
+			return n;
+		case LLHDL_NODE_LOGIC:
+		case LLHDL_NODE_EXTLOGIC:
+			return llhdl_create_logic(n->p.logic.op, n->p.logic.operands);
+		case LLHDL_NODE_MUX:
+			return llhdl_create_mux(n->p.mux.nsources, n->p.mux.select, n->p.mux.sources);
+		case LLHDL_NODE_FD:
+			return llhdl_create_fd(n->p.fd.clock, n->p.fd.data);
+		case LLHDL_NODE_VECT:
+			return llhdl_create_vect(n->p.vect.sign, n->p.vect.nslices, n->p.vect.slices);
 		default:
 			assert(0);
-			break;
+			return NULL;
 	}
+}
+
+struct llhdl_node *llhdl_dup(struct llhdl_node *n)
+{
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
+	struct llhdl_node *r;
+
+	/* The operands of each copy are replaced when the traversal resumes */
+	r = n;
+	llhdl_traversal_init(&t, LLHDL_ORDER_PRE, 0);
+	llhdl_traversal_push(&t, &r);
+	while((slot = llhdl_traversal_next(&t)) != NULL)
+		*slot = dup_shallow(*slot);
+	llhdl_traversal_free(&t);
 	return r;
 }
 
-int llhdl_equiv(struct llhdl_node *a, struct llhdl_node *b)
+/* Compares the nodes without their operands */
+static int equiv_shallow(struct llhdl_node *a, struct llhdl_node *b)
 {
-	int i, arity;
-	
+	int i;
+
 	if(a->type != b->type) return 0;
 	switch(a->type) {
 		case LLHDL_NODE_CONSTANT:
 			if(a->p.constant.sign != b->p.constant.sign) return 0;
 			if(a->p.constant.vectorsize != b->p.constant.vectorsize) return 0;
-			if(mpz_cmp(a->p.constant.value, b->p.constant.value) != 0) return 0;
+			if(LLHDL_CONSTANT_INLINE(a)) {
+				if(a->p.constant.v.bits != b->p.constant.v.bits) return 0;
+			} else if(mpz_cmp(a->p.constant.v.big, b->p.constant.v.big) != 0) return 0;
 			break;
 		case LLHDL_NODE_SIGNAL:
 			if(a != b) return 0;
@@ -110,19 +284,11 @@ int llhdl_equiv(struct llhdl_node *a, struct llhdl_node *b)
 		case LLHDL_NODE_LOGIC:
 		case LLHDL_NODE_EXTLOGIC:
 			if(a->p.logic.op != b->p.logic.op) return 0;
-			arity = llhdl_get_logic_arity(a->p.logic.op);
-			for(i=0;i<arity;i++)
-				if(!llhdl_equiv(a->p.logic.operands[i], b->p.logic.operands[i])) return 0;
 			break;
 		case LLHDL_NODE_MUX:
 			if(a->p.mux.nsources != b->p.mux.nsources) return 0;
-			if(!llhdl_equiv(a->p.mux.select, b->p.mux.select)) return 0;
-			for(i=0;i<a->p.mux.nsources;i++)
-				if(!llhdl_equiv(a->p.mux.sources[i], b->p.mux.sources[i])) return 0;
 			break;
 		case LLHDL_NODE_FD:
-			if(!llhdl_equiv(a->p.fd.clock, b->p.fd.clock)) return 0;
-			if(!llhdl_equiv(a->p.fd.data, b->p.fd.data)) return 0;
 			break;
 		case LLHDL_NODE_VECT:
 			if(a->p.vect.sign != b->p.vect.sign) return 0;
@@ -130,7 +296,6 @@ int llhdl_equiv(struct llhdl_node *a, struct llhdl_node *b)
 			for(i=0;i<a->p.vect.nslices;i++) {
 				if(a->p.vect.slices[i].start != b->p.vect.slices[i].start) return 0;
 				if(a->p.vect.slices[i].end != b->p.vect.slices[i].end) return 0;
-				if(!llhdl_equiv(a->p.vect.slices[i].source, b->p.vect.slices[i].source)) return 0;
 			}
 			break;
 		default:
@@ -140,148 +305,424 @@ int llhdl_equiv(struct llhdl_node *a, struct llhdl_node *b)
 	return 1;
 }
 
-int llhdl_get_sign(struct llhdl_node *n)
+int llhdl_equiv(struct llhdl_node *a, struct llhdl_node *b)
 {
-	int arity;
+	struct llhdl_node *local[2*LLHDL_TRAVERSAL_LOCAL];
+	struct llhdl_node **stack;
+	struct llhdl_node **sa;
+	int depth, size;
 	int i;
+	int r;
+
+	/* Pairs of nodes still to compare */
+	stack = local;
+	size = LLHDL_TRAVERSAL_LOCAL;
+	stack[0] = a;
+	stack[1] = b;
+	depth = 1;
+	r = 1;
+	while(depth > 0) {
+		depth--;
+		a = stack[2*depth];
+		b = stack[2*depth+1];
+		if((a == NULL) || (b == NULL)) {
+			if(a != b) {
+				r = 0;
+				break;
+			}
+			continue;
+		}
+		if(!equiv_shallow(a, b)) {
+			r = 0;
+			break;
+		}
+		for(i=0;(sa = llhdl_get_operand(a, i)) != NULL;i++) {
+			if(depth == size) {
+				size *= 2;
+				if(stack == local) {
+					stack = alloc_size(2*size*sizeof(struct llhdl_node *));
+					memcpy(stack, local, 2*depth*sizeof(struct llhdl_node *));
+				} else {
+					stack = realloc(stack, 2*size*sizeof(struct llhdl_node *));
+					assert(stack != NULL);
+				}
+			}
+			stack[2*depth] = *sa;
+			stack[2*depth+1] = *llhdl_get_operand(b, i);
+			depth++;
+		}
+	}
+	if(stack != local)
+		free(stack);
+	return r;
+}
+
+#define DATA_CONE_LOCAL 32
+
+struct size_sign {
+	int vectorsize;
 	int sign;
-	
-	if(n == NULL) return 0;
+};
+
+static unsigned int size_hash(struct llhdl_node *n)
+{
+	unsigned long int v;
+
+	v = (unsigned long int)n;
+	return (unsigned int)(v >> 4) ^ (unsigned int)(v >> 16);
+}
+
+static struct llhdl_size_entry *size_lookup(struct llhdl_size_cache *c, struct llhdl_node *n)
+{
+	unsigned int i;
+
+	if(c->entries == NULL)
+		return NULL;
+	for(i=size_hash(n) & c->mask;c->entries[i].n!=NULL;i=(i+1) & c->mask)
+		if(c->entries[i].n == n)
+			return &c->entries[i];
+	return NULL;
+}
+
+static void size_insert(struct llhdl_size_entry *entries, unsigned int mask, struct llhdl_node *n, int vectorsize, int sign)
+{
+	unsigned int i;
+
+	for(i=size_hash(n) & mask;entries[i].n!=NULL;i=(i+1) & mask);
+	entries[i].n = n;
+	entries[i].vectorsize = vectorsize;
+	entries[i].sign = sign;
+}
+
+static void size_record(struct llhdl_size_cache *c, struct llhdl_node *n, int vectorsize, int sign)
+{
+	struct llhdl_size_entry *old;
+	unsigned int old_size;
+	unsigned int i;
+
+	/* keep the table at most half full */
+	if(2*(c->count+1) > c->mask+1) {
+		old = c->entries;
+		old_size = old == NULL ? 0 : c->mask+1;
+		c->mask = old == NULL ? 255 : 2*c->mask+1;
+		c->entries = alloc_size0((c->mask+1)*sizeof(struct llhdl_size_entry));
+		for(i=0;i<old_size;i++)
+			if(old[i].n != NULL)
+				size_insert(c->entries, c->mask, old[i].n, old[i].vectorsize, old[i].sign);
+		free(old);
+	}
+	size_insert(c->entries, c->mask, n, vectorsize, sign);
+	c->count++;
+}
+
+void llhdl_size_cache_init(struct llhdl_size_cache *c)
+{
+	c->mask = 0;
+	c->count = 0;
+	c->entries = NULL;
+}
+
+void llhdl_size_cache_free(struct llhdl_size_cache *c)
+{
+	free(c->entries);
+	llhdl_size_cache_init(c);
+}
+
+/* Size and sign of the nodes that define their own, and of the nodes recorded in <c>.
+ * Returns 0 when they follow from the operands.
+ */
+static int own_size_sign(struct llhdl_size_cache *c, struct llhdl_node *n, struct size_sign *r)
+{
+	struct llhdl_size_entry *e;
+	int i;
+
 	switch(n->type) {
 		case LLHDL_NODE_CONSTANT:
-			return n->p.constant.sign;
+			r->vectorsize = n->p.constant.vectorsize;
+			r->sign = n->p.constant.sign;
+			return 1;
 		case LLHDL_NODE_SIGNAL:
-			return n->p.signal.sign;
-		case LLHDL_NODE_LOGIC:
-		case LLHDL_NODE_EXTLOGIC:
-			sign = 1;
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			for(i=0;i<arity;i++)
-				if(!llhdl_get_sign(n->p.logic.operands[i]))
-					sign = 0;
-			return sign;
-		case LLHDL_NODE_MUX:
-			sign = 1;
-			for(i=0;i<n->p.mux.nsources;i++)
-				if(!llhdl_get_sign(n->p.mux.sources[i]))
-					sign = 0;
-			return sign;
-		case LLHDL_NODE_FD:
-			return llhdl_get_sign(n->p.fd.data);
+			r->vectorsize = n->p.signal.vectorsize;
+			r->sign = n->p.signal.sign;
+			return 1;
 		case LLHDL_NODE_VECT:
-			return n->p.vect.sign;
+			r->vectorsize = 0;
+			for(i=0;i<n->p.vect.nslices;i++)
+				r->vectorsize += n->p.vect.slices[i].end - n->p.vect.slices[i].start + 1;
+			r->sign = n->p.vect.sign;
+			return 1;
 		default:
-			assert(0);
 			break;
 	}
+	if(c != NULL) {
+		e = size_lookup(c, n);
+		if(e != NULL) {
+			r->vectorsize = e->vectorsize;
+			r->sign = e->sign;
+			return 1;
+		}
+	}
+	return 0;
 }
 
-int llhdl_get_vectorsize(struct llhdl_node *n)
+/*
+ * Collects, in pre-order, the nodes whose vector size and sign follow
+ * from their operands, down to the nodes that define their own or
+ * are recorded in <c>.
+ * Mux selects, clocks and vector slices are not followed.
+ * Evaluating the nodes in reverse order sees the operands first.
+ */
+static int data_cone(struct llhdl_size_cache *c, struct llhdl_node *n, struct llhdl_node **local, struct llhdl_node ***nodes)
 {
-	int arity;
-	int v, count;
-	int i;
-	
-	if(n == NULL) return 0;
-	switch(n->type) {
-		case LLHDL_NODE_CONSTANT:
-			return n->p.constant.vectorsize;
-		case LLHDL_NODE_SIGNAL:
-			return n->p.signal.vectorsize;
-		case LLHDL_NODE_LOGIC:
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			count = 0;
-			for(i=0;i<arity;i++) {
-				v = llhdl_get_vectorsize(n->p.logic.operands[i]);
-				if(v > count)
-					count = v;
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
+	struct size_sign r;
+	int size, count;
+	int i, arity;
+
+	size = DATA_CONE_LOCAL;
+	count = 0;
+	*nodes = local;
+	llhdl_traversal_init(&t, LLHDL_ORDER_PRE, 0);
+	llhdl_traversal_push(&t, &n);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		if(count == size) {
+			size *= 2;
+			if(*nodes == local) {
+				*nodes = alloc_size(size*sizeof(struct llhdl_node *));
+				memcpy(*nodes, local, count*sizeof(struct llhdl_node *));
+			} else {
+				*nodes = realloc(*nodes, size*sizeof(struct llhdl_node *));
+				assert(*nodes != NULL);
 			}
-			return count;
-		case LLHDL_NODE_EXTLOGIC:
-			switch(n->p.logic.op) {
-				case LLHDL_EXTLOGIC_ADD:
-				case LLHDL_EXTLOGIC_SUB:
-					return max(llhdl_get_vectorsize(n->p.logic.operands[0]),
-						llhdl_get_vectorsize(n->p.logic.operands[1])) + 1;
-				case LLHDL_EXTLOGIC_MUL:
-					return llhdl_get_vectorsize(n->p.logic.operands[0]) + llhdl_get_vectorsize(n->p.logic.operands[1]);
+		}
+		(*nodes)[count++] = *slot;
+		llhdl_traversal_skip(&t);
+		if((*slot != n) && own_size_sign(c, *slot, &r))
+			continue;
+		switch((*slot)->type) {
+			case LLHDL_NODE_LOGIC:
+			case LLHDL_NODE_EXTLOGIC:
+				arity = llhdl_get_logic_arity((*slot)->p.logic.op);
+				for(i=0;i<arity;i++)
+					llhdl_traversal_push(&t, &(*slot)->p.logic.operands[i]);
+				break;
+			case LLHDL_NODE_MUX:
+				for(i=0;i<(*slot)->p.mux.nsources;i++)
+					llhdl_traversal_push(&t, &(*slot)->p.mux.sources[i]);
+				break;
+			case LLHDL_NODE_FD:
+				llhdl_traversal_push(&t, &(*slot)->p.fd.data);
+				break;
+			default:
+				break;
+		}
+	}
+	llhdl_traversal_free(&t);
+	return count;
+}
+
+/* Operands that are NULL are not in the cone, and have no value on the stack */
+static struct size_sign pop_operand(struct size_sign *stack, int *depth, struct llhdl_node *operand)
+{
+	struct size_sign null_value;
+
+	if(operand == NULL) {
+		null_value.vectorsize = 0;
+		null_value.sign = 0;
+		return null_value;
+	}
+	assert(*depth > 0);
+	return stack[--(*depth)];
+}
+
+static void get_size_sign(struct llhdl_size_cache *c, struct llhdl_node *n, struct size_sign *r)
+{
+	struct llhdl_node *local[DATA_CONE_LOCAL];
+	struct llhdl_node **nodes;
+	struct size_sign local_stack[DATA_CONE_LOCAL];
+	struct size_sign *stack;
+	struct size_sign a, b;
+	int count, depth;
+	int arity;
+	int i, j;
+
+	if(n == NULL) {
+		r->vectorsize = 0;
+		r->sign = 0;
+		return;
+	}
+	if(own_size_sign(c, n, r))
+		return;
+
+	count = data_cone(c, n, local, &nodes);
+	stack = nodes == local ? local_stack : alloc_size(count*sizeof(struct size_sign));
+	depth = 0;
+	for(i=count-1;i>=0;i--) {
+		n = nodes[i];
+		if((i == 0) || !own_size_sign(c, n, r)) {
+			switch(n->type) {
+				case LLHDL_NODE_LOGIC:
+					arity = llhdl_get_logic_arity(n->p.logic.op);
+					r->vectorsize = 0;
+					r->sign = 1;
+					for(j=0;j<arity;j++) {
+						a = pop_operand(stack, &depth, n->p.logic.operands[j]);
+						if(a.vectorsize > r->vectorsize)
+							r->vectorsize = a.vectorsize;
+						if(!a.sign)
+							r->sign = 0;
+					}
+					break;
+				case LLHDL_NODE_EXTLOGIC:
+					/* The last operand in the cone is evaluated first, and is the deepest on the stack */
+					a = pop_operand(stack, &depth, n->p.logic.operands[0]);
+					b = pop_operand(stack, &depth, n->p.logic.operands[1]);
+					switch(n->p.logic.op) {
+						case LLHDL_EXTLOGIC_ADD:
+						case LLHDL_EXTLOGIC_SUB:
+							r->vectorsize = max(a.vectorsize, b.vectorsize) + 1;
+							break;
+						case LLHDL_EXTLOGIC_MUL:
+							r->vectorsize = a.vectorsize + b.vectorsize;
+							break;
+						default:
+							assert(0);
+							r->vectorsize = 0;
+							break;
+					}
+					r->sign = a.sign && b.sign;
+					break;
+				case LLHDL_NODE_MUX:
+					r->vectorsize = 0;
+					r->sign = 1;
+					for(j=0;j<n->p.mux.nsources;j++) {
+						a = pop_operand(stack, &depth, n->p.mux.sources[j]);
+						if(a.vectorsize > r->vectorsize)
+							r->vectorsize = a.vectorsize;
+						if(!a.sign)
+							r->sign = 0;
+					}
+					break;
+				case LLHDL_NODE_FD:
+					*r = pop_operand(stack, &depth, n->p.fd.data);
+					break;
 				default:
 					assert(0);
+					r->vectorsize = 0;
+					r->sign = 0;
 					break;
 			}
-			break;
-		case LLHDL_NODE_MUX:
-			count = 0;
-			for(i=0;i<n->p.mux.nsources;i++) {
-				v = llhdl_get_vectorsize(n->p.mux.sources[i]);
-				if(v > count)
-					count = v;
-			}
-			return count;
-		case LLHDL_NODE_FD:
-			return llhdl_get_vectorsize(n->p.fd.data);
-		case LLHDL_NODE_VECT:
-			count = 0;
-			for(i=0;i<n->p.vect.nslices;i++)
-				count += n->p.vect.slices[i].end - n->p.vect.slices[i].start + 1;
-			return count;
-		default:
-			assert(0);
-			break;
+			if(c != NULL)
+				size_record(c, n, r->vectorsize, r->sign);
+		}
+		stack[depth++] = *r;
+	}
+	assert(depth == 1);
+	*r = stack[0];
+	if(nodes != local) {
+		free(stack);
+		free(nodes);
 	}
 }
 
-struct llhdl_walk_param {
-	llhdl_walk_c walk_c;
-	void *user;
-};
+int llhdl_get_sign(struct llhdl_node *n)
+{
+	struct size_sign r;
+
+	get_size_sign(NULL, n, &r);
+	return r.sign;
+}
 
-static int llhdl_walk_s(struct llhdl_walk_param *p, struct llhdl_node **n2)
+int llhdl_get_vectorsize(struct llhdl_node *n)
 {
-	struct llhdl_node *n;
-	int arity;
-	int i;
+	struct size_sign r;
+
+	get_size_sign(NULL, n, &r);
+	return r.vectorsize;
+}
+
+int llhdl_get_sign_cached(struct llhdl_size_cache *c, struct llhdl_node *n)
+{
+	struct size_sign r;
+
+	get_size_sign(c, n, &r);
+	return r.sign;
+}
+
+int llhdl_get_vectorsize_cached(struct llhdl_size_cache *c, struct llhdl_node *n)
+{
+	struct size_sign r;
+
+	get_size_sign(c, n, &r);
+	return r.vectorsize;
+}
+
+void llhdl_get_constant_bits(mpz_t r, struct llhdl_node *n)
+{
+	assert(n->type == LLHDL_NODE_CONSTANT);
+	if(LLHDL_CONSTANT_INLINE(n))
+		mpz_import(r, 1, -1, sizeof(uint64_t), 0, 0, &n->p.constant.v.bits);
+	else
+		mpz_fdiv_r_2exp(r, n->p.constant.v.big, n->p.constant.vectorsize);
+}
+
+int llhdl_get_constant_bit(struct llhdl_node *n, int bit)
+{
+	assert(n->type == LLHDL_NODE_CONSTANT);
+	if(LLHDL_CONSTANT_INLINE(n))
+		return (n->p.constant.v.bits >> bit) & 1;
+	return mpz_tstbit(n->p.constant.v.big, bit);
+}
+
+uint64_t llhdl_get_constant_ui(struct llhdl_node *n)
+{
+	uint64_t r;
+	size_t i;
+
+	assert(n->type == LLHDL_NODE_CONSTANT);
+	if(LLHDL_CONSTANT_INLINE(n))
+		return n->p.constant.v.bits;
+	r = 0;
+	for(i=0;i<64;i++)
+		if(mpz_tstbit(n->p.constant.v.big, i))
+			r |= (uint64_t)1 << i;
+	return r;
+}
+
+void llhdl_get_constant_value(mpz_t r, struct llhdl_node *n)
+{
+	int vectorsize;
 	
-	if(*n2 == NULL) return 1;
-	if(!p->walk_c(n2, p->user)) return 0;
-	n = *n2;
-	switch(n->type) {
-		case LLHDL_NODE_SIGNAL:
-		case LLHDL_NODE_CONSTANT:
-			break;
-		case LLHDL_NODE_LOGIC:
-		case LLHDL_NODE_EXTLOGIC:
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			for(i=0;i<arity;i++)
-				if(!llhdl_walk_s(p, &n->p.logic.operands[i])) return 0;
-			return 1;
-		case LLHDL_NODE_MUX:
-			if(!llhdl_walk_s(p, &n->p.mux.select)) return 0;
-			for(i=0;i<n->p.mux.nsources;i++)
-				if(!llhdl_walk_s(p, &n->p.mux.sources[i])) return 0;
-			return 1;
-		case LLHDL_NODE_FD:
-			if(!llhdl_walk_s(p, &n->p.fd.clock)) return 0;
-			if(!llhdl_walk_s(p, &n->p.fd.data)) return 0;
-			return 1;
-		case LLHDL_NODE_VECT:
-			for(i=0;i<n->p.vect.nslices;i++)
-				if(!llhdl_walk_s(p, &n->p.vect.slices[i].source)) return 0;
-			return 1;
-		default:
-			assert(0);
-			break;
+	vectorsize = n->p.constant.vectorsize;
+	llhdl_get_constant_bits(r, n);
+	if(n->p.constant.sign && mpz_tstbit(r, vectorsize-1)) {
+		mpz_t h;
+		
+		mpz_init(h);
+		mpz_setbit(h, vectorsize);
+		mpz_sub(r, r, h);
+		mpz_clear(h);
 	}
-	return 1;
 }
 
 int llhdl_walk(llhdl_walk_c walk_c, void *user, struct llhdl_node **n)
 {
-	struct llhdl_walk_param p;
-	
-	p.walk_c = walk_c;
-	p.user = user;
-	return llhdl_walk_s(&p, n);
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
+	int r;
+
+	r = 1;
+	llhdl_traversal_init(&t, LLHDL_ORDER_PRE, 0);
+	llhdl_traversal_push(&t, n);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		if(!walk_c(slot, user)) {
+			r = 0;
+			break;
+		}
+	}
+	llhdl_traversal_free(&t);
+	return r;
 }
 
 int llhdl_walk_module(llhdl_walk_c walk_c, void *user, struct llhdl_module *m)
@@ -297,7 +738,89 @@ int llhdl_walk_module(llhdl_walk_c walk_c, void *user, struct llhdl_module *m)
 	return 1;
 }
 
-void llhdl_clear_clocks(struct llhdl_module *m)
+static int walk_map_signal(struct llhdl_node **n2, void *user)
+{
+	if((*n2)->type == LLHDL_NODE_SIGNAL)
+		*n2 = (*n2)->user;
+	return 1;
+}
+
+static char *hierarchical_name(const char *prefix, const char *name)
+{
+	int r;
+	char *ret;
+	r = asprintf(&ret, "%s/%s", prefix, name);
+	if(r == -1) abort();
+	return ret;
+}
+
+/* Copies the contents of <d> into <m>, with the ports replaced by the connected signals */
+static void flatten_instance(struct llhdl_module *m, struct llhdl_module *d,
+	struct llhdl_connection *connections, int nconnections, const char *prefix)
+{
+	struct llhdl_node *n, *s;
+	struct llhdl_instance *inst;
+	struct llhdl_connection *sub;
+	char *name;
+	int i;
+
+	for(n=d->head;n!=NULL;n=n->p.signal.next)
+		n->user = NULL;
+	for(i=0;i<nconnections;i++)
+		connections[i].port->user = connections[i].signal;
+	for(n=d->head;n!=NULL;n=n->p.signal.next) {
+		if(n->user == NULL) {
+			name = hierarchical_name(prefix, n->p.signal.name);
+			n->user = llhdl_create_signal(m, LLHDL_SIGNAL_INTERNAL, name,
+				n->p.signal.sign, n->p.signal.vectorsize);
+			free(name);
+		}
+	}
+	for(n=d->head;n!=NULL;n=n->p.signal.next) {
+		if(n->p.signal.source != NULL) {
+			s = n->user;
+			assert(s->p.signal.source == NULL);
+			s->p.signal.source = llhdl_dup(n->p.signal.source);
+			llhdl_walk(walk_map_signal, NULL, &s->p.signal.source);
+		}
+	}
+	for(inst=d->ihead;inst!=NULL;inst=inst->next) {
+		sub = alloc_size(inst->nconnections*sizeof(struct llhdl_connection));
+		for(i=0;i<inst->nconnections;i++) {
+			sub[i].port = inst->connections[i].port;
+			sub[i].signal = inst->connections[i].signal->user;
+		}
+		name = hierarchical_name(prefix, inst->name);
+		flatten_instance(m, inst->definition, sub, inst->nconnections, name);
+		free(name);
+		free(sub);
+	}
+	for(n=d->head;n!=NULL;n=n->p.signal.next)
+		n->user = NULL;
+}
+
+void llhdl_flatten(struct llhdl_module *m)
+{
+	struct llhdl_instance *inst;
+	struct llhdl_module *d;
+	int i;
+
+	while(m->ihead != NULL) {
+		inst = m->ihead;
+		m->ihead = inst->next;
+		for(i=0;i<inst->nconnections;i++)
+			inst->connections[i].signal->p.signal.driver = NULL;
+		flatten_instance(m, inst->definition, inst->connections, inst->nconnections, inst->name);
+		llhdl_free_instance(inst);
+	}
+	while(m->dhead != NULL) {
+		d = m->dhead;
+		m->dhead = d->next;
+		llhdl_free_module(d);
+	}
+}
+
+static void clear_clocks(struct llhdl_module *m)
 {
 	struct llhdl_node *n;
 	
@@ -309,6 +832,15 @@ void llhdl_clear_clocks(struct llhdl_module *m)
 	}
 }
 
+void llhdl_clear_clocks(struct llhdl_module *m)
+{
+	struct llhdl_module *d;
+
+	for(d=m->dhead;d!=NULL;d=d->next)
+		clear_clocks(d);
+	clear_clocks(m);
+}
+
 static int walk_identify_clocks(struct llhdl_node **n2, void *user)
 {
 	struct llhdl_node *n = *n2;
@@ -323,9 +855,26 @@ static int walk_identify_clocks(struct llhdl_node **n2, void *user)
 	return 1;
 }
 
-void llhdl_identify_clocks(struct llhdl_module *m)
+static void identify_clocks(struct llhdl_module *m)
 {
+	struct llhdl_instance *inst;
+	int i;
+
 	llhdl_walk_module(walk_identify_clocks, NULL, m);
+	for(inst=m->ihead;inst!=NULL;inst=inst->next)
+		for(i=0;i<inst->nconnections;i++)
+			if(llhdl_is_clock(inst->connections[i].port))
+				llhdl_mark_clock(inst->connections[i].signal, 1);
+}
+
+/* Definitions are processed first, so that clock ports propagate to the instantiating modules */
+void llhdl_identify_clocks(struct llhdl_module *m)
+{
+	struct llhdl_module *d;
+
+	for(d=m->dhead;d!=NULL;d=d->next)
+		identify_clocks(d);
+	identify_clocks(m);
 }
 
 int llhdl_is_clock(struct llhdl_node *n)
@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <gmp.h>
 
 #include <util.h>
@@ -10,32 +11,22 @@
 
 #include <mapkit/mapkit.h>
 
-static void mapkit_interconnect_down(struct mapkit_sc *sc, int target_vectorsize, void **target_nets, struct llhdl_node *source)
+/* Connects the nets of <source> to <target_nets>, cutting or expanding to fit the target vectorsize */
+static void connect_source(struct mapkit_sc *sc, int target_vectorsize, void **target_nets, struct llhdl_node *source)
 {
 	int source_vectorsize, source_sign;
 	void **source_nets;
 	struct mapkit_result *mapr;
-	int vectorsize;
-	struct llhdl_node *n;
-	int i, offset;
-	
-	if(source == NULL) return;
+	int i;
 	
 	/* Retrieve the source nets in their original size */
-	source_vectorsize = llhdl_get_vectorsize(source);
-	source_sign = llhdl_get_sign(source);
+	source_vectorsize = mapkit_get_vectorsize(sc, source);
+	source_sign = mapkit_get_sign(sc, source);
 	source_nets = alloc_size(source_vectorsize*sizeof(void *));
 	mapr = source->user;
-	if(mapr != NULL) {
+	if(mapr != NULL)
 		memcpy(source_nets, mapr->output_nets, source_vectorsize*sizeof(void *));
-		offset = 0;
-		for(i=0;i<mapr->ninput_nodes;i++) {
-			n = *(mapr->input_nodes[i]);
-			vectorsize = llhdl_get_vectorsize(n);
-			mapkit_interconnect_down(sc, vectorsize, &mapr->input_nets[offset], n);
-			offset += vectorsize;
-		}
-	} else {
+	else {
 		if(source->type == LLHDL_NODE_SIGNAL) {
 			for(i=0;i<source_vectorsize;i++)
 				source_nets[i] = MAPKIT_CALL_SIGNAL(sc, source, i);
@@ -45,8 +36,10 @@ static void mapkit_interconnect_down(struct mapkit_sc *sc, int target_vectorsize
 		}
 	}
 	
-	/* Make the connection, cutting or expanding to fit the target vectorsize */
 	for(i=0;i<target_vectorsize;i++) {
+		if(target_nets[i] == NULL)
+			/* The bit is not read */
+			continue;
 		if(i < source_vectorsize)
 			MAPKIT_CALL_JOIN(sc, target_nets[i], source_nets[i]);
 		else {
@@ -60,6 +53,67 @@ static void mapkit_interconnect_down(struct mapkit_sc *sc, int target_vectorsize
 	free(source_nets);
 }
 
+struct interconnect_item {
+	int target_vectorsize;
+	void **target_nets;
+	struct llhdl_node *source;
+	int expanded; /* < the inputs of the mapped source are connected */
+};
+
+/* Connects the inputs of mapped results first, down to the cut lines, with an explicit stack */
+static void mapkit_interconnect_down(struct mapkit_sc *sc, int target_vectorsize, void **target_nets, struct llhdl_node *source)
+{
+	struct interconnect_item *stack;
+	int depth, size;
+	struct interconnect_item *it;
+	struct mapkit_result *mapr;
+	int vectorsize;
+	struct llhdl_node *n;
+	int i, offset;
+	
+	if(source == NULL) return;
+	
+	size = 16;
+	stack = alloc_size(size*sizeof(struct interconnect_item));
+	stack[0].target_vectorsize = target_vectorsize;
+	stack[0].target_nets = target_nets;
+	stack[0].source = source;
+	stack[0].expanded = 0;
+	depth = 1;
+	while(depth > 0) {
+		it = &stack[depth-1];
+		mapr = it->source->user;
+		if((mapr == NULL) || it->expanded) {
+			connect_source(sc, it->target_vectorsize, it->target_nets, it->source);
+			depth--;
+			continue;
+		}
+		it->expanded = 1;
+		if(depth + mapr->ninput_nodes > size) {
+			size = 2*(depth + mapr->ninput_nodes);
+			stack = realloc(stack, size*sizeof(struct interconnect_item));
+			assert(stack != NULL);
+		}
+		/* Pushed in reverse, so that the inputs are connected in order */
+		offset = 0;
+		for(i=0;i<mapr->ninput_nodes;i++)
+			offset += mapkit_get_vectorsize(sc, *(mapr->input_nodes[i]));
+		for(i=mapr->ninput_nodes-1;i>=0;i--) {
+			n = *(mapr->input_nodes[i]);
+			vectorsize = mapkit_get_vectorsize(sc, n);
+			offset -= vectorsize;
+			if(n == NULL)
+				continue;
+			stack[depth].target_vectorsize = vectorsize;
+			stack[depth].target_nets = &mapr->input_nets[offset];
+			stack[depth].source = n;
+			stack[depth].expanded = 0;
+			depth++;
+		}
+	}
+	free(stack);
+}
+
 void mapkit_interconnect_arc(struct mapkit_sc *sc, struct llhdl_node *n)
 {
 	void **target_nets;
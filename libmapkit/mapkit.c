@@ -19,6 +19,7 @@ struct mapkit_sc *mapkit_new(struct llhdl_module *module, mapkit_constant_c cons
 	sc->signal_c = signal_c;
 	sc->join_c = join_c;
 	sc->user = user;
+	llhdl_size_cache_init(&sc->sizes);
 	
 	return sc;
 }
@@ -65,9 +66,20 @@ void mapkit_free(struct mapkit_sc *sc)
 		free(pd1);
 		pd1 = pd2;
 	}
+	llhdl_size_cache_free(&sc->sizes);
 	free(sc);
 }
 
+int mapkit_get_vectorsize(struct mapkit_sc *sc, struct llhdl_node *n)
+{
+	return llhdl_get_vectorsize_cached(&sc->sizes, n);
+}
+
+int mapkit_get_sign(struct mapkit_sc *sc, struct llhdl_node *n)
+{
+	return llhdl_get_sign_cached(&sc->sizes, n);
+}
+
 struct mapkit_result *mapkit_create_result(int ninput_nodes, int ninput_nets, int noutput_nets)
 {
 	struct mapkit_result *r;
@@ -110,66 +122,29 @@ void mapkit_consume(struct mapkit_sc *sc, struct llhdl_node *n, struct mapkit_re
 	n->user = r;
 }
 
-static void run_process(struct llhdl_node **n, struct mapkit_process_desc *pd);
-
-static void run_process_mapped(struct mapkit_result *r, struct mapkit_process_desc *pd)
-{
-	int i;
-	for(i=0;i<r->ninput_nodes;i++)
-		run_process(r->input_nodes[i], pd);
-}
-
-static void run_process_unmapped(struct llhdl_node *n, struct mapkit_process_desc *pd)
+static void run_process(struct llhdl_node **n, struct mapkit_process_desc *pd)
 {
-	int arity;
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
+	struct mapkit_result *r;
 	int i;
-	
-	switch(n->type) {
-		case LLHDL_NODE_SIGNAL:
-		case LLHDL_NODE_CONSTANT:
-			break;
-		case LLHDL_NODE_LOGIC:
-		case LLHDL_NODE_EXTLOGIC:
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			for(i=0;i<arity;i++)
-				run_process(&n->p.logic.operands[i], pd);
-			break;
-		case LLHDL_NODE_MUX:
-			run_process(&n->p.mux.select, pd);
-			for(i=0;i<n->p.mux.nsources;i++)
-				run_process(&n->p.mux.sources[i], pd);
-			break;
-		case LLHDL_NODE_FD:
-			run_process(&n->p.fd.clock, pd);
-			run_process(&n->p.fd.data, pd);
-			break;
-		case LLHDL_NODE_VECT:
-			for(i=0;i<n->p.vect.nslices;i++)
-				run_process(&n->p.vect.slices[i].source, pd);
-			break;
-		default:
-			assert(0);
-			break;
-	}
-}
 
-static void run_process(struct llhdl_node **n, struct mapkit_process_desc *pd)
-{
-	if(*n == NULL) return;
-	if((*n)->user != NULL)
-		/* Node is already mapped, carry on to the cut line */
-		run_process_mapped((*n)->user, pd);
-	else {
-		/* Attempt mapping */
-		pd->process_c(n, pd->user);
-		/* Was mapping successful? */
-		if((*n)->user != NULL)
-			/* Yes, continue to the cut line */
-			run_process_mapped((*n)->user, pd);
-		else
-			/* No, try mapping the children */
-			run_process_unmapped(*n, pd);
+	llhdl_traversal_init(&t, LLHDL_ORDER_PRE, 0);
+	llhdl_traversal_push(&t, n);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		/* Attempt mapping, unless the node is already mapped */
+		if((*slot)->user == NULL)
+			pd->process_c(slot, pd->user);
+		r = (*slot)->user;
+		if(r != NULL) {
+			/* Mapped: continue to the cut line, in order */
+			llhdl_traversal_skip(&t);
+			for(i=r->ninput_nodes-1;i>=0;i--)
+				llhdl_traversal_push(&t, r->input_nodes[i]);
+		}
+		/* Otherwise, the traversal tries mapping the operands */
 	}
+	llhdl_traversal_free(&t);
 }
 
 void mapkit_metamap(struct mapkit_sc *sc)
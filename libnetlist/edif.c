@@ -1,110 +1,221 @@
 #include <assert.h>
+#include <stdarg.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <zlib.h>
 #include <util.h>
 
 #include <netlist/net.h>
 #include <netlist/manager.h>
 #include <netlist/edif.h>
 
-struct primitive_list {
-	struct netlist_primitive *p;
-	struct primitive_list *next;
+/*
+ * Output is formatted into a large buffer, written to a stdio stream
+ * or to a gzip stream when it is full.
+ */
+
+#define EDIF_BUFFER_SIZE (1024*1024)
+
+struct edif_out {
+	FILE *fd;
+	gzFile gz;
+	int len;
+	char buf[EDIF_BUFFER_SIZE];
 };
 
-static int in_primitive_list(struct primitive_list *l, struct netlist_primitive *p)
+static void out_flush(struct edif_out *o)
 {
-	while(l != NULL) {
-		if(l->p == p)
-			return 1;
-		l = l->next;
+	int r;
+
+	if(o->len == 0)
+		return;
+	if(o->gz != NULL)
+		r = gzwrite(o->gz, o->buf, o->len) == o->len;
+	else
+		r = fwrite(o->buf, 1, o->len, o->fd) == o->len;
+	if(!r) {
+		perror("EDIF output");
+		exit(EXIT_FAILURE);
 	}
-	return 0;
+	o->len = 0;
 }
 
-static struct primitive_list *build_primitive_list(struct netlist_instance *inst)
+static void out_data(struct edif_out *o, const char *s, int len)
 {
-	struct primitive_list *l;
-	struct primitive_list *new;
+	int n;
 
-	l = NULL;
-	while(inst != NULL) {
-		if(!in_primitive_list(l, inst->p)) {
-			new = alloc_type(struct primitive_list);
-			new->p = inst->p;
-			new->next = l;
-			l = new;
-		}
-		inst = inst->next;
+	while(len > 0) {
+		if(o->len == EDIF_BUFFER_SIZE)
+			out_flush(o);
+		n = EDIF_BUFFER_SIZE - o->len;
+		if(n > len)
+			n = len;
+		memcpy(&o->buf[o->len], s, n);
+		o->len += n;
+		s += n;
+		len -= n;
 	}
-	return l;
 }
 
-static void free_primitive_list(struct primitive_list *l)
+static void out_str(struct edif_out *o, const char *s)
 {
-	struct primitive_list *l2;
+	out_data(o, s, strlen(s));
+}
+
+/* <prefix> followed by <uid> in 8 hex digits, the identifiers of instances and nets */
+static void out_uid(struct edif_out *o, char prefix, unsigned int uid)
+{
+	static const char hex[] = "0123456789abcdef";
+	char s[9];
+	int i;
 
-	while(l != NULL) {
-		l2 = l->next;
-		free(l);
-		l = l2;
+	s[0] = prefix;
+	for(i=8;i>0;i--) {
+		s[i] = hex[uid & 0xf];
+		uid >>= 4;
 	}
+	out_data(o, s, 9);
 }
 
-static void write_imports(struct netlist_manager *m, FILE *fd, struct edif_param *param, struct primitive_list *l)
+static void out_printf(struct edif_out *o, const char *fmt, ...)
+{
+	va_list ap;
+	char *s;
+	int r;
+
+	va_start(ap, fmt);
+	r = vasprintf(&s, fmt, ap);
+	va_end(ap);
+	if(r == -1) abort();
+	out_data(o, s, r);
+	free(s);
+}
+
+/* Primitives used by the instances, in order of first use */
+struct primitive_set {
+	int size;			/* < power of 2 */
+	int count;
+	struct netlist_primitive **table;
+	struct netlist_primitive **order;
+};
+
+static unsigned int primitive_hash(struct netlist_primitive *p)
+{
+	return ((unsigned long int)p >> 4)*2654435761U;
+}
+
+/* Slot of <p> in the table, or the empty slot where it belongs */
+static struct netlist_primitive **primitive_slot(struct primitive_set *s, struct netlist_primitive *p)
+{
+	unsigned int h;
+
+	h = primitive_hash(p) & (s->size - 1);
+	while((s->table[h] != NULL) && (s->table[h] != p))
+		h = (h + 1) & (s->size - 1);
+	return &s->table[h];
+}
+
+static void primitive_grow(struct primitive_set *s)
 {
 	int i;
 
-	while(l != NULL) {
-		if(l->p->type == NETLIST_PRIMITIVE_INTERNAL) {
-			fprintf(fd, "(cell %s\n"
+	free(s->table);
+	s->size *= 2;
+	s->table = alloc_size0(s->size*sizeof(struct netlist_primitive *));
+	for(i=0;i<s->count;i++)
+		*primitive_slot(s, s->order[i]) = s->order[i];
+	s->order = realloc(s->order, s->size/2*sizeof(struct netlist_primitive *));
+	assert(s->order != NULL);
+}
+
+static void build_primitive_set(struct primitive_set *s, struct netlist_instance *inst)
+{
+	struct netlist_primitive **slot;
+
+	s->size = 64;
+	s->count = 0;
+	s->table = alloc_size0(s->size*sizeof(struct netlist_primitive *));
+	s->order = alloc_size(s->size/2*sizeof(struct netlist_primitive *));
+	while(inst != NULL) {
+		if(2*s->count == s->size)
+			primitive_grow(s);
+		slot = primitive_slot(s, inst->p);
+		if(*slot == NULL) {
+			*slot = inst->p;
+			s->order[s->count++] = inst->p;
+		}
+		inst = inst->next;
+	}
+}
+
+static void free_primitive_set(struct primitive_set *s)
+{
+	free(s->table);
+	free(s->order);
+}
+
+/* Primitives are listed from the last used to the first */
+
+static void write_imports(struct netlist_manager *m, struct edif_out *o, struct edif_param *param, struct primitive_set *l)
+{
+	struct netlist_primitive *p;
+	int i, j;
+
+	for(j=l->count-1;j>=0;j--) {
+		p = l->order[j];
+		if(p->type == NETLIST_PRIMITIVE_INTERNAL) {
+			out_printf(o, "(cell %s\n"
 				"(cellType GENERIC)\n",
-				l->p->name);
-			fprintf(fd, "(view view_1\n"
+				p->name);
+			out_str(o, "(view view_1\n"
 				"(viewType NETLIST)\n");
-			fprintf(fd, "(interface\n");
-			for(i=0;i<l->p->inputs;i++)
-				fprintf(fd, "(port %s (direction INPUT))\n",
-					l->p->input_names[i]);
-			for(i=0;i<l->p->outputs;i++)
-				fprintf(fd, "(port %s (direction OUTPUT))\n",
-					l->p->output_names[i]);
-			fprintf(fd, ")\n");
-			fprintf(fd, ")\n");
-			fprintf(fd, ")\n");
+			out_str(o, "(interface\n");
+			for(i=0;i<p->inputs;i++)
+				out_printf(o, "(port %s (direction INPUT))\n",
+					p->input_names[i]);
+			for(i=0;i<p->outputs;i++)
+				out_printf(o, "(port %s (direction OUTPUT))\n",
+					p->output_names[i]);
+			out_str(o, ")\n");
+			out_str(o, ")\n");
+			out_str(o, ")\n");
 		}
-		l = l->next;
 	}
 }
 
-static void write_io(struct netlist_manager *m, FILE *fd, struct edif_param *param, struct primitive_list *l)
+static void write_io(struct netlist_manager *m, struct edif_out *o, struct edif_param *param, struct primitive_set *l)
 {
-	while(l != NULL) {
-		switch(l->p->type) {
+	struct netlist_primitive *p;
+	int j;
+
+	for(j=l->count-1;j>=0;j--) {
+		p = l->order[j];
+		switch(p->type) {
 			case NETLIST_PRIMITIVE_INTERNAL:
 				break;
 			case NETLIST_PRIMITIVE_PORT_OUT:
-				assert(l->p->inputs == 1);
-				assert(l->p->outputs == 0);
-				fprintf(fd, "(port %s (direction OUTPUT))\n",
-					l->p->input_names[0]);
+				assert(p->inputs == 1);
+				assert(p->outputs == 0);
+				out_printf(o, "(port %s (direction OUTPUT))\n",
+					p->input_names[0]);
 				break;
 			case NETLIST_PRIMITIVE_PORT_IN:
-				assert(l->p->inputs == 0);
-				assert(l->p->outputs == 1);
-				fprintf(fd, "(port %s (direction INPUT))\n",
-					l->p->output_names[0]);
+				assert(p->inputs == 0);
+				assert(p->outputs == 1);
+				out_printf(o, "(port %s (direction INPUT))\n",
+					p->output_names[0]);
 				break;
 			default:
 				assert(0);
 				break;
 		}
-		l = l->next;
 	}
 }
 
-static void write_instantiations(struct netlist_manager *m, FILE *fd, struct edif_param *param)
+/* The records below are written once per instance or branch, without printf */
+
+static void write_instantiations(struct netlist_manager *m, struct edif_out *o, struct edif_param *param)
 {
 	struct netlist_instance *inst;
 	int i;
@@ -112,32 +223,33 @@ static void write_instantiations(struct netlist_manager *m, FILE *fd, struct edi
 	inst = m->ihead;
 	while(inst != NULL) {
 		if(inst->p->type == NETLIST_PRIMITIVE_INTERNAL) {
-			fprintf(fd,
-				"(instance I%08x\n"
-				"(viewRef view_1 (cellRef %s (libraryRef %s)))\n",
-				inst->uid,
-				inst->p->name,
-				param->cell_library);
+			out_str(o, "(instance ");
+			out_uid(o, 'I', inst->uid);
+			out_str(o, "\n(viewRef view_1 (cellRef ");
+			out_str(o, inst->p->name);
+			out_str(o, " (libraryRef ");
+			out_str(o, param->cell_library);
+			out_str(o, ")))\n");
 			if(param->flavor == EDIF_FLAVOR_XILINX)
-				fprintf(fd, "(property XSTLIB (boolean (true)) (owner \"Xilinx\"))\n");
+				out_str(o, "(property XSTLIB (boolean (true)) (owner \"Xilinx\"))\n");
 			for(i=0;i<inst->p->attribute_count;i++) {
+				out_str(o, "(property ");
+				out_str(o, inst->p->attribute_names[i]);
+				out_str(o, " (string \"");
+				out_str(o, inst->attributes[i]);
 				if(param->flavor == EDIF_FLAVOR_XILINX)
-					fprintf(fd, "(property %s (string \"%s\") (owner \"Xilinx\"))",
-						inst->p->attribute_names[i],
-						inst->attributes[i]);
+					out_str(o, "\") (owner \"Xilinx\"))");
 				else
-					fprintf(fd, "(property %s (string \"%s\"))",
-						inst->p->attribute_names[i],
-						inst->attributes[i]);
+					out_str(o, "\"))");
 			}
-			fprintf(fd, ")\n");
+			out_str(o, ")\n");
 		}
 
 		inst = inst->next;
 	}
 }
 
-static void write_connections(struct netlist_manager *m, FILE *fd, struct edif_param *param)
+static void write_connections(struct netlist_manager *m, struct edif_out *o, struct edif_param *param)
 {
 	struct netlist_net *net;
 	struct netlist_branch *branch;
@@ -148,85 +260,88 @@ static void write_connections(struct netlist_manager *m, FILE *fd, struct edif_p
 		branch = net->head;
 		if(branch != NULL) {
 			assert(net->joined == NULL);
-			fprintf(fd, "(net N%08x\n", net->uid);
-			fprintf(fd, "(joined\n");
+			out_str(o, "(net ");
+			out_uid(o, 'N', net->uid);
+			out_str(o, "\n(joined\n");
 			while(branch != NULL) {
 				if(branch->output)
 					portname = branch->inst->p->output_names[branch->pin_index];
 				else
 					portname = branch->inst->p->input_names[branch->pin_index];
-				if(branch->inst->p->type == NETLIST_PRIMITIVE_INTERNAL)
-					fprintf(fd, "(portRef %s (instanceRef I%08x))\n",
-						portname,
-						branch->inst->uid);
-				else
-					fprintf(fd, "(portRef %s)\n", portname);
+				out_str(o, "(portRef ");
+				out_str(o, portname);
+				if(branch->inst->p->type == NETLIST_PRIMITIVE_INTERNAL) {
+					out_str(o, " (instanceRef ");
+					out_uid(o, 'I', branch->inst->uid);
+					out_str(o, "))\n");
+				} else
+					out_str(o, ")\n");
 				branch = branch->next;
 			}
-			fprintf(fd, ")\n");
-			fprintf(fd, ")\n");
+			out_str(o, ")\n");
+			out_str(o, ")\n");
 		}
 		net = net->next;
 	}
 }
 
-void netlist_m_edif_fd(struct netlist_manager *m, FILE *fd, struct edif_param *param)
+static void write_edif(struct netlist_manager *m, struct edif_out *o, struct edif_param *param)
 {
-	struct primitive_list *prim_list;
+	struct primitive_set prim_set;
 
 	/* start EDIF */
-	fprintf(fd,
+	out_printf(o,
 		"(edif %s\n"
 		"(edifVersion 2 0 0)\n"
 		"(edifLevel 0)\n"
 		"(keywordMap (keywordLevel 0))\n", param->design_name);
 
-	prim_list = build_primitive_list(m->ihead);
+	build_primitive_set(&prim_set, m->ihead);
 
 	/* write imports */
-	fprintf(fd,
+	out_printf(o,
 		"(external %s\n"
 		"(edifLevel 0)\n"
 		"(technology (numberDefinition))\n",
 		param->cell_library);
-	write_imports(m, fd, param, prim_list);
-	fprintf(fd, ")\n");
+	write_imports(m, o, param, &prim_set);
+	out_str(o, ")\n");
 
 	/* start design library, top level cell, and netlist view */
-	fprintf(fd,
+	out_printf(o,
 		"(library %s_lib\n"
 		"(edifLevel 0)\n"
 		"(technology (numberDefinition))\n",
 		param->design_name);
-	fprintf(fd,
+	out_printf(o,
 		"(cell %s\n"
 		"(cellType GENERIC)\n",
 		param->design_name);
-	fprintf(fd,
+	out_str(o,
 		"(view view_1\n"
 		"(viewType NETLIST)\n");
 
 	/* write I/O ports */
-	fprintf(fd, "(interface\n");
-	write_io(m, fd, param, prim_list);
-	fprintf(fd, "(designator \"%s\")\n", param->part);
-	fprintf(fd, ")\n");
+	out_str(o, "(interface\n");
+	write_io(m, o, param, &prim_set);
+	out_printf(o, "(designator \"%s\")\n", param->part);
+	out_str(o, ")\n");
 
-	free_primitive_list(prim_list);
+	free_primitive_set(&prim_set);
 
 	/* write instantiations and connections */
-	fprintf(fd, "(contents\n");
-	write_instantiations(m, fd, param);
-	write_connections(m, fd, param);
-	fprintf(fd, ")\n");
+	out_str(o, "(contents\n");
+	write_instantiations(m, o, param);
+	write_connections(m, o, param);
+	out_str(o, ")\n");
 
 	/* end view, top level cell and design library */
-	fprintf(fd, ")\n");
-	fprintf(fd, ")\n");
-	fprintf(fd, ")\n");
+	out_str(o, ")\n");
+	out_str(o, ")\n");
+	out_str(o, ")\n");
 
 	/* write design */
-	fprintf(fd, 
+	out_printf(o, 
 		"(design %s\n"
 		"(cellRef %s (libraryRef %s_lib))\n"
 		"(property PART (string \"%s\") (owner \"%s\"))\n"
@@ -238,7 +353,49 @@ void netlist_m_edif_fd(struct netlist_manager *m, FILE *fd, struct edif_param *p
 		param->manufacturer);
 	
 	/* end EDIF */
-	fprintf(fd, ")\n");
+	out_str(o, ")\n");
+	out_flush(o);
+}
+
+void netlist_m_edif_fd(struct netlist_manager *m, FILE *fd, struct edif_param *param)
+{
+	struct edif_out *o;
+
+	o = alloc_type(struct edif_out);
+	o->fd = fd;
+	o->gz = NULL;
+	o->len = 0;
+	write_edif(m, o, param);
+	free(o);
+}
+
+static int has_suffix(const char *s, const char *suffix)
+{
+	int l, ls;
+
+	l = strlen(s);
+	ls = strlen(suffix);
+	return (l >= ls) && (strcmp(s + l - ls, suffix) == 0);
+}
+
+static void edif_gz_file(struct netlist_manager *m, const char *filename, struct edif_param *param)
+{
+	struct edif_out *o;
+
+	o = alloc_type(struct edif_out);
+	o->fd = NULL;
+	o->gz = gzopen(filename, "wb");
+	if(o->gz == NULL) {
+		perror("netlist_m_edif_file");
+		exit(EXIT_FAILURE);
+	}
+	o->len = 0;
+	write_edif(m, o, param);
+	if(gzclose(o->gz) != Z_OK) {
+		fprintf(stderr, "netlist_m_edif_file: failed to write %s\n", filename);
+		exit(EXIT_FAILURE);
+	}
+	free(o);
 }
 
 void netlist_m_edif_file(struct netlist_manager *m, const char *filename, struct edif_param *param)
@@ -246,6 +403,10 @@ void netlist_m_edif_file(struct netlist_manager *m, const char *filename, struct
 	FILE *fd;
 	int r;
 
+	if(has_suffix(filename, ".gz")) {
+		edif_gz_file(m, filename, param);
+		return;
+	}
 	fd = fopen(filename, "w");
 	if(fd == NULL) {
 		perror("netlist_m_edif_file");
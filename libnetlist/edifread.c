@@ -0,0 +1,1240 @@
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <util.h>
+
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/io.h>
+#include <netlist/symbol.h>
+#include <netlist/edif.h>
+
+/*
+ * EDIF reader.
+ * The file is mapped in memory and split into tokens in place: tokens and
+ * names are references into the file, nothing is allocated per token.
+ * All the cells are parsed into compact arrays first, as a cell can be
+ * instantiated before the design designates the top-level cell. Then the
+ * top-level cell is elaborated into the netlist manager, flattening the
+ * hierarchy.
+ */
+
+enum {
+	TOKEN_END,
+	TOKEN_OPEN,
+	TOKEN_CLOSE,
+	TOKEN_SYMBOL,
+	TOKEN_STRING
+};
+
+struct token {
+	const char *s;
+	int len;
+};
+
+enum {
+	DIRECTION_NONE,
+	DIRECTION_INPUT,
+	DIRECTION_OUTPUT,
+	DIRECTION_INOUT
+};
+
+struct edif_port {
+	int name;			/* < interned identifier */
+	struct token display;		/* < name in the original design */
+	int direction;
+	int width;			/* < 0 for a scalar port, size of an array otherwise */
+	int first_pin;			/* < pins are numbered across the ports of a cell */
+};
+
+struct edif_property {
+	int name;
+	struct token value;
+};
+
+struct edif_instance {
+	int name;
+	struct token display;
+	int cell;
+	int first_property;
+	int nproperties;
+};
+
+struct edif_ref {
+	int instance;			/* < in the cell, -1 for a port of the cell */
+	int pin;			/* < name of the port until resolved */
+	int member;			/* < index in an array port, -1 for a scalar */
+};
+
+struct edif_net {
+	struct token display;
+	int first_ref;
+	int nrefs;
+};
+
+struct edif_cell {
+	int library;
+	int name;
+	struct token display;
+	int first_port;
+	int nports;
+	int npins;
+	int has_contents;
+	int first_instance;
+	int ninstances;
+	int first_net;
+	int nnets;
+	struct netlist_primitive *p;	/* < leaf cells only */
+	int *pins;			/* < leaf cells: (pin index << 1) | output */
+};
+
+/* Maps (scope, interned name) to indexes */
+struct map_entry {
+	uint64_t key;
+	int value;			/* < -1 if the entry is free */
+};
+
+struct map {
+	unsigned int mask;
+	unsigned int count;
+	struct map_entry *table;
+};
+
+struct buffer {
+	char *s;
+	int len;
+	int size;
+};
+
+struct reader {
+	struct edif_read_param *param;
+	const char *filename;
+	const char *start;
+	const char *end;
+	const char *p;
+
+	int type;			/* < current token */
+	struct token t;
+
+	int nnames, names_size;
+	struct token *names;
+	unsigned int name_mask;
+	int *name_table;		/* < open addressing, -1 if free */
+
+	struct map cell_map;		/* < (library, name) */
+	struct map port_map;		/* < (cell, name) */
+	struct map instance_map;	/* < (cell, name) */
+
+	int ncells, cells_size;
+	struct edif_cell *cells;
+	int nports, ports_size;
+	struct edif_port *port_list;
+	int nproperties, properties_size;
+	struct edif_property *properties;
+	int ninstances, instances_size;
+	struct edif_instance *instance_list;
+	int nnets, nets_size;
+	struct edif_net *nets;
+	int nrefs, refs_size;
+	struct edif_ref *refs;
+
+	int top;
+	struct buffer path;		/* < hierarchical prefix */
+	struct buffer scratch;
+};
+
+static void parse_error(struct reader *r, const char *fmt, ...)
+{
+	va_list ap;
+	const char *p;
+	int line;
+
+	line = 1;
+	for(p=r->start;p<r->t.s;p++)
+		if(*p == '\n')
+			line++;
+	fprintf(stderr, "%s:%d: ", r->filename, line);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(EXIT_FAILURE);
+}
+
+static void elaboration_error(struct reader *r, const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(stderr, "%s: ", r->filename);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fprintf(stderr, "\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Makes room for element <n> of a growable array */
+static void *reserve(void *a, int *size, int n, int elem_size)
+{
+	if(n < *size)
+		return a;
+	if(*size == 0)
+		*size = 256;
+	while(*size <= n)
+		*size *= 2;
+	a = realloc(a, (size_t)*size*elem_size);
+	if(a == NULL)
+		abort();
+	return a;
+}
+
+static void buffer_reset(struct buffer *b, int len)
+{
+	b->len = len;
+}
+
+static void buffer_append(struct buffer *b, const char *s, int len)
+{
+	b->s = reserve(b->s, &b->size, b->len + len, 1);
+	if(len > 0)
+		memcpy(&b->s[b->len], s, len);
+	b->len += len;
+	b->s[b->len] = 0;
+}
+
+/* The value of the token as a string, valid until the next call */
+static const char *token_str(struct reader *r, struct token *t)
+{
+	buffer_reset(&r->scratch, 0);
+	buffer_append(&r->scratch, t->s, t->len);
+	return r->scratch.s;
+}
+
+/* The hierarchical name of an object of the cell being elaborated */
+static const char *path_str(struct reader *r, struct token *t)
+{
+	buffer_reset(&r->scratch, 0);
+	buffer_append(&r->scratch, r->path.s, r->path.len);
+	buffer_append(&r->scratch, t->s, t->len);
+	return r->scratch.s;
+}
+
+/*
+ * Tokenizer
+ */
+
+enum {
+	CHAR_DELIMITER = 1,
+	CHAR_SPACE = 2
+};
+
+static const unsigned char char_class[256] = {
+	['('] = CHAR_DELIMITER,
+	[')'] = CHAR_DELIMITER,
+	['"'] = CHAR_DELIMITER,
+	[' '] = CHAR_DELIMITER|CHAR_SPACE,
+	['\t'] = CHAR_DELIMITER|CHAR_SPACE,
+	['\n'] = CHAR_DELIMITER|CHAR_SPACE,
+	['\r'] = CHAR_DELIMITER|CHAR_SPACE,
+	['\f'] = CHAR_DELIMITER|CHAR_SPACE
+};
+
+static void next_token(struct reader *r)
+{
+	const char *p;
+
+	p = r->p;
+	while((p < r->end) && (char_class[(unsigned char)*p] & CHAR_SPACE))
+		p++;
+	r->t.s = p;
+	if(p == r->end)
+		r->type = TOKEN_END;
+	else if(*p == '(') {
+		r->type = TOKEN_OPEN;
+		p++;
+	} else if(*p == ')') {
+		r->type = TOKEN_CLOSE;
+		p++;
+	} else if(*p == '"') {
+		p++;
+		r->t.s = p;
+		while((p < r->end) && (*p != '"'))
+			p++;
+		if(p == r->end)
+			parse_error(r, "Unterminated string");
+		r->type = TOKEN_STRING;
+		r->t.len = p - r->t.s;
+		r->p = p + 1;
+		return;
+	} else {
+		while((p < r->end) && !(char_class[(unsigned char)*p] & CHAR_DELIMITER))
+			p++;
+		r->type = TOKEN_SYMBOL;
+	}
+	r->t.len = p - r->t.s;
+	r->p = p;
+}
+
+/* Keywords are case insensitive, and only made of letters */
+static int is_keyword(struct reader *r, const char *keyword)
+{
+	int i;
+
+	if(r->type != TOKEN_SYMBOL)
+		return 0;
+	for(i=0;i<r->t.len;i++)
+		if((keyword[i] == 0) || ((r->t.s[i] | 0x20) != (keyword[i] | 0x20)))
+			return 0;
+	return keyword[i] == 0;
+}
+
+static void expect(struct reader *r, int type, const char *what)
+{
+	next_token(r);
+	if(r->type != type)
+		parse_error(r, "%s expected", what);
+}
+
+/* Skips the rest of the current form, including its closing parenthesis */
+static void skip_form(struct reader *r)
+{
+	int depth;
+
+	depth = 1;
+	while(depth > 0) {
+		next_token(r);
+		switch(r->type) {
+			case TOKEN_OPEN:
+				depth++;
+				break;
+			case TOKEN_CLOSE:
+				depth--;
+				break;
+			case TOKEN_END:
+				parse_error(r, "Unexpected end of file");
+				break;
+		}
+	}
+}
+
+/* Reads the keyword of the next form of a list.
+ * Returns 0 at the end of the list, after consuming its closing parenthesis.
+ */
+static int next_form(struct reader *r)
+{
+	while(1) {
+		next_token(r);
+		switch(r->type) {
+			case TOKEN_CLOSE:
+				return 0;
+			case TOKEN_OPEN:
+				expect(r, TOKEN_SYMBOL, "Keyword");
+				return 1;
+			case TOKEN_END:
+				parse_error(r, "Unexpected end of file");
+				break;
+			default:
+				/* Stray atoms are ignored */
+				break;
+		}
+	}
+}
+
+static int token_int(struct reader *r)
+{
+	int i, v, sign;
+
+	if(r->type != TOKEN_SYMBOL)
+		parse_error(r, "Integer expected");
+	i = 0;
+	sign = 1;
+	if((r->t.len > 0) && (r->t.s[0] == '-')) {
+		sign = -1;
+		i++;
+	}
+	if(i == r->t.len)
+		parse_error(r, "Integer expected");
+	v = 0;
+	for(;i<r->t.len;i++) {
+		if((r->t.s[i] < '0') || (r->t.s[i] > '9'))
+			parse_error(r, "Integer expected");
+		v = 10*v + r->t.s[i] - '0';
+	}
+	return sign*v;
+}
+
+/*
+ * Names and maps
+ */
+
+static unsigned int token_hash(const char *s, int len)
+{
+	unsigned int h;
+	int i;
+
+	h = 2166136261U;
+	for(i=0;i<len;i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static void grow_names(struct reader *r)
+{
+	unsigned int h;
+	int i;
+
+	free(r->name_table);
+	r->name_mask = r->name_mask == 0 ? 1023 : 2*r->name_mask + 1;
+	r->name_table = alloc_size((r->name_mask+1)*sizeof(int));
+	memset(r->name_table, 0xff, (r->name_mask+1)*sizeof(int));
+	for(i=0;i<r->nnames;i++) {
+		h = token_hash(r->names[i].s, r->names[i].len) & r->name_mask;
+		while(r->name_table[h] != -1)
+			h = (h + 1) & r->name_mask;
+		r->name_table[h] = i;
+	}
+}
+
+/* Identifiers of EDIF can be escaped with '&' */
+static int intern(struct reader *r, struct token *t)
+{
+	const char *s;
+	int len;
+	unsigned int h;
+	int i;
+
+	s = t->s;
+	len = t->len;
+	if((len > 1) && (s[0] == '&')) {
+		s++;
+		len--;
+	}
+	if(2*r->nnames >= r->name_mask)
+		grow_names(r);
+	h = token_hash(s, len) & r->name_mask;
+	while((i = r->name_table[h]) != -1) {
+		if((r->names[i].len == len) && (memcmp(r->names[i].s, s, len) == 0))
+			return i;
+		h = (h + 1) & r->name_mask;
+	}
+	r->names = reserve(r->names, &r->names_size, r->nnames, sizeof(struct token));
+	r->names[r->nnames].s = s;
+	r->names[r->nnames].len = len;
+	r->name_table[h] = r->nnames;
+	return r->nnames++;
+}
+
+static uint64_t map_key(int scope, int name)
+{
+	return ((uint64_t)(unsigned int)scope << 32) | (unsigned int)name;
+}
+
+static unsigned int map_hash(uint64_t key)
+{
+	return (key*0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+static void map_init(struct map *m)
+{
+	m->mask = 0;
+	m->count = 0;
+	m->table = NULL;
+}
+
+static void map_free(struct map *m)
+{
+	free(m->table);
+}
+
+static struct map_entry *map_slot(struct map *m, uint64_t key)
+{
+	unsigned int h;
+
+	h = map_hash(key) & m->mask;
+	while((m->table[h].value != -1) && (m->table[h].key != key))
+		h = (h + 1) & m->mask;
+	return &m->table[h];
+}
+
+static int map_get(struct map *m, int scope, int name)
+{
+	if(m->table == NULL)
+		return -1;
+	return map_slot(m, map_key(scope, name))->value;
+}
+
+static void map_put(struct map *m, int scope, int name, int value)
+{
+	struct map_entry *old;
+	unsigned int i, old_mask;
+
+	if(2*(m->count + 1) > m->mask) {
+		old = m->table;
+		old_mask = m->mask;
+		m->mask = m->mask == 0 ? 1023 : 2*m->mask + 1;
+		m->table = alloc_size((m->mask+1)*sizeof(struct map_entry));
+		for(i=0;i<=m->mask;i++)
+			m->table[i].value = -1;
+		if(old != NULL) {
+			for(i=0;i<=old_mask;i++)
+				if(old[i].value != -1)
+					*map_slot(m, old[i].key) = old[i];
+			free(old);
+		}
+	}
+	*map_slot(m, map_key(scope, name)) = (struct map_entry){ map_key(scope, name), value };
+	m->count++;
+}
+
+/*
+ * Parser
+ */
+
+/* nameDef: an identifier, (rename identifier "name") or,
+ * if <width> is not NULL, (array nameDef size).
+ */
+static int parse_name_def(struct reader *r, struct token *display, int *width)
+{
+	int name;
+
+	if(width != NULL)
+		*width = 0;
+	next_token(r);
+	if(r->type == TOKEN_SYMBOL) {
+		*display = r->t;
+		return intern(r, &r->t);
+	}
+	if(r->type != TOKEN_OPEN)
+		parse_error(r, "Name expected");
+	expect(r, TOKEN_SYMBOL, "Keyword");
+	if(is_keyword(r, "rename")) {
+		expect(r, TOKEN_SYMBOL, "Identifier");
+		name = intern(r, &r->t);
+		*display = r->t;
+		next_token(r);
+		if(r->type == TOKEN_STRING) {
+			*display = r->t;
+			skip_form(r);
+		} else if(r->type == TOKEN_OPEN) {
+			/* stringDisplay */
+			skip_form(r);
+			skip_form(r);
+		} else if(r->type != TOKEN_CLOSE)
+			skip_form(r);
+		return name;
+	}
+	if((width != NULL) && is_keyword(r, "array")) {
+		name = parse_name_def(r, display, NULL);
+		next_token(r);
+		*width = token_int(r);
+		if(*width <= 0)
+			parse_error(r, "Invalid array size");
+		skip_form(r);
+		return name;
+	}
+	parse_error(r, "Name expected");
+	return -1;
+}
+
+/* nameRef: an identifier, or (member identifier index) if <member> is not NULL */
+static int parse_name_ref(struct reader *r, int *member)
+{
+	int name;
+
+	if(member != NULL)
+		*member = -1;
+	next_token(r);
+	if(r->type == TOKEN_SYMBOL)
+		return intern(r, &r->t);
+	if((member == NULL) || (r->type != TOKEN_OPEN))
+		parse_error(r, "Name expected");
+	expect(r, TOKEN_SYMBOL, "Keyword");
+	if(!is_keyword(r, "member"))
+		parse_error(r, "Name expected");
+	expect(r, TOKEN_SYMBOL, "Identifier");
+	name = intern(r, &r->t);
+	next_token(r);
+	*member = token_int(r);
+	skip_form(r);
+	return name;
+}
+
+static void parse_port(struct reader *r, int cell)
+{
+	struct edif_cell *c;
+	struct edif_port *port;
+	int i;
+
+	r->port_list = reserve(r->port_list, &r->ports_size, r->nports, sizeof(struct edif_port));
+	i = r->nports++;
+	port = &r->port_list[i];
+	c = &r->cells[cell];
+	port->name = parse_name_def(r, &port->display, &port->width);
+	port->direction = DIRECTION_NONE;
+	port->first_pin = c->npins;
+	if(map_get(&r->port_map, cell, port->name) != -1)
+		parse_error(r, "Port defined twice");
+	map_put(&r->port_map, cell, port->name, i);
+	c->npins += port->width > 0 ? port->width : 1;
+	c->nports++;
+
+	while(next_form(r)) {
+		if(is_keyword(r, "direction")) {
+			next_token(r);
+			if(is_keyword(r, "INPUT"))
+				port->direction = DIRECTION_INPUT;
+			else if(is_keyword(r, "OUTPUT"))
+				port->direction = DIRECTION_OUTPUT;
+			else if(is_keyword(r, "INOUT"))
+				port->direction = DIRECTION_INOUT;
+			else
+				parse_error(r, "Invalid port direction");
+			skip_form(r);
+		} else
+			skip_form(r);
+	}
+}
+
+static void parse_interface(struct reader *r, int cell)
+{
+	r->cells[cell].first_port = r->nports - r->cells[cell].nports;
+	while(next_form(r)) {
+		if(is_keyword(r, "port"))
+			parse_port(r, cell);
+		else
+			skip_form(r);
+	}
+}
+
+static void parse_property(struct reader *r)
+{
+	struct edif_property *prop;
+	struct token display;
+
+	r->properties = reserve(r->properties, &r->properties_size, r->nproperties, sizeof(struct edif_property));
+	prop = &r->properties[r->nproperties++];
+	prop->name = parse_name_def(r, &display, NULL);
+	prop->value.s = NULL;
+	prop->value.len = 0;
+	while(next_form(r)) {
+		if(is_keyword(r, "string") || is_keyword(r, "integer")) {
+			next_token(r);
+			if((r->type == TOKEN_STRING) || (r->type == TOKEN_SYMBOL)) {
+				prop->value = r->t;
+				skip_form(r);
+			} else if(r->type == TOKEN_OPEN) {
+				skip_form(r);
+				skip_form(r);
+			}
+		} else if(is_keyword(r, "boolean")) {
+			next_token(r);
+			if(r->type == TOKEN_OPEN) {
+				expect(r, TOKEN_SYMBOL, "Keyword");
+				prop->value = r->t;
+				skip_form(r);
+				skip_form(r);
+			} else if(r->type != TOKEN_CLOSE)
+				skip_form(r);
+		} else
+			skip_form(r);
+	}
+}
+
+static void parse_cell_ref(struct reader *r, int library, int *cell)
+{
+	int name;
+
+	name = parse_name_ref(r, NULL);
+	while(next_form(r)) {
+		if(is_keyword(r, "libraryRef")) {
+			library = parse_name_ref(r, NULL);
+			skip_form(r);
+		} else
+			skip_form(r);
+	}
+	*cell = map_get(&r->cell_map, library, name);
+	if(*cell == -1)
+		parse_error(r, "Reference to the undefined cell %.*s", r->names[name].len, r->names[name].s);
+}
+
+static void parse_instance(struct reader *r, int cell)
+{
+	struct edif_instance *inst;
+	struct edif_cell *c;
+	int i;
+
+	c = &r->cells[cell];
+	r->instance_list = reserve(r->instance_list, &r->instances_size, r->ninstances, sizeof(struct edif_instance));
+	i = r->ninstances++;
+	inst = &r->instance_list[i];
+	inst->name = parse_name_def(r, &inst->display, NULL);
+	inst->cell = -1;
+	inst->first_property = r->nproperties;
+	inst->nproperties = 0;
+	if(map_get(&r->instance_map, cell, inst->name) != -1)
+		parse_error(r, "Instance defined twice");
+	map_put(&r->instance_map, cell, inst->name, i - c->first_instance);
+	c->ninstances++;
+
+	while(next_form(r)) {
+		if(is_keyword(r, "viewRef")) {
+			parse_name_ref(r, NULL);
+			while(next_form(r)) {
+				if(is_keyword(r, "cellRef"))
+					parse_cell_ref(r, c->library, &inst->cell);
+				else
+					skip_form(r);
+			}
+		} else if(is_keyword(r, "cellRef"))
+			parse_cell_ref(r, c->library, &inst->cell);
+		else if(is_keyword(r, "property")) {
+			parse_property(r);
+			inst->nproperties++;
+		} else
+			skip_form(r);
+	}
+	if(inst->cell == -1)
+		parse_error(r, "Instance without a cell");
+}
+
+static void parse_port_ref(struct reader *r)
+{
+	struct edif_ref *ref;
+
+	r->refs = reserve(r->refs, &r->refs_size, r->nrefs, sizeof(struct edif_ref));
+	ref = &r->refs[r->nrefs++];
+	ref->pin = parse_name_ref(r, &ref->member);
+	ref->instance = -1;
+	while(next_form(r)) {
+		if(is_keyword(r, "instanceRef")) {
+			ref->instance = parse_name_ref(r, NULL);
+			skip_form(r);
+		} else
+			skip_form(r);
+	}
+}
+
+static void parse_net(struct reader *r, int cell)
+{
+	struct edif_net *net;
+	int i;
+
+	r->nets = reserve(r->nets, &r->nets_size, r->nnets, sizeof(struct edif_net));
+	i = r->nnets++;
+	parse_name_def(r, &r->nets[i].display, NULL);
+	r->nets[i].first_ref = r->nrefs;
+	r->cells[cell].nnets++;
+	while(next_form(r)) {
+		if(is_keyword(r, "joined")) {
+			while(next_form(r)) {
+				if(is_keyword(r, "portRef"))
+					parse_port_ref(r);
+				else
+					skip_form(r);
+			}
+		} else
+			skip_form(r);
+	}
+	net = &r->nets[i];
+	net->nrefs = r->nrefs - net->first_ref;
+}
+
+static void parse_contents(struct reader *r, int cell)
+{
+	struct edif_cell *c;
+
+	c = &r->cells[cell];
+	if(!c->has_contents) {
+		c->has_contents = 1;
+		c->first_instance = r->ninstances;
+		c->first_net = r->nnets;
+	}
+	while(next_form(r)) {
+		if(is_keyword(r, "instance"))
+			parse_instance(r, cell);
+		else if(is_keyword(r, "net"))
+			parse_net(r, cell);
+		else
+			skip_form(r);
+	}
+}
+
+static void parse_view(struct reader *r, int cell)
+{
+	struct token display;
+
+	parse_name_def(r, &display, NULL);
+	while(next_form(r)) {
+		if(is_keyword(r, "interface"))
+			parse_interface(r, cell);
+		else if(is_keyword(r, "contents"))
+			parse_contents(r, cell);
+		else
+			skip_form(r);
+	}
+}
+
+/* Pin of a port of <cell>, given by name and array index */
+static int resolve_pin(struct reader *r, int cell, int name, int member)
+{
+	struct edif_cell *c;
+	struct edif_port *port;
+	int i;
+
+	c = &r->cells[cell];
+	i = map_get(&r->port_map, cell, name);
+	if(i == -1)
+		parse_error(r, "Cell %.*s has no port %.*s",
+			c->display.len, c->display.s, r->names[name].len, r->names[name].s);
+	port = &r->port_list[i];
+	if((port->width == 0) != (member == -1))
+		parse_error(r, "Invalid reference to port %.*s of cell %.*s",
+			port->display.len, port->display.s, c->display.len, c->display.s);
+	if(member >= port->width)
+		parse_error(r, "Index %d out of array port %.*s of cell %.*s",
+			member, port->display.len, port->display.s, c->display.len, c->display.s);
+	return port->first_pin + (member == -1 ? 0 : member);
+}
+
+static void resolve_contents(struct reader *r, int cell)
+{
+	struct edif_cell *c;
+	struct edif_net *net;
+	struct edif_ref *ref;
+	int i, j;
+
+	c = &r->cells[cell];
+	for(i=0;i<c->nnets;i++) {
+		net = &r->nets[c->first_net + i];
+		for(j=0;j<net->nrefs;j++) {
+			ref = &r->refs[net->first_ref + j];
+			if(ref->instance == -1)
+				ref->pin = resolve_pin(r, cell, ref->pin, ref->member);
+			else {
+				ref->instance = map_get(&r->instance_map, cell, ref->instance);
+				if(ref->instance == -1)
+					parse_error(r, "Net %.*s of cell %.*s refers to an undefined instance",
+						net->display.len, net->display.s, c->display.len, c->display.s);
+				ref->pin = resolve_pin(r, r->instance_list[c->first_instance + ref->instance].cell, ref->pin, ref->member);
+			}
+		}
+	}
+}
+
+static int find_name(char **names, int n, struct token *t)
+{
+	int i;
+
+	for(i=0;i<n;i++)
+		if((strlen(names[i]) == t->len) && (strncasecmp(names[i], t->s, t->len) == 0))
+			return i;
+	return -1;
+}
+
+/* Cells without contents are primitives, matched by name.
+ * Unknown primitives are only an error if they are instantiated.
+ */
+static void resolve_primitive(struct reader *r, int cell)
+{
+	struct edif_cell *c;
+	struct edif_port *port;
+	struct netlist_primitive *p;
+	struct token name;
+	int i, pin;
+
+	c = &r->cells[cell];
+	name = r->names[c->name];
+	c->p = NULL;
+	for(i=0;i<r->param->nprimitives;i++) {
+		p = &r->param->primitives[i];
+		if((p->type == NETLIST_PRIMITIVE_INTERNAL)
+		  && (strlen(p->name) == name.len) && (strncasecmp(p->name, name.s, name.len) == 0)) {
+			c->p = p;
+			break;
+		}
+	}
+	if(c->p == NULL)
+		return;
+	p = c->p;
+	c->pins = alloc_size((c->npins+1)*sizeof(int));
+	for(i=0;i<c->nports;i++) {
+		port = &r->port_list[c->first_port + i];
+		if(port->width != 0)
+			parse_error(r, "Array port %.*s of primitive %s is not supported",
+				port->display.len, port->display.s, p->name);
+		name = r->names[port->name];
+		if((pin = find_name(p->input_names, p->inputs, &name)) != -1)
+			c->pins[port->first_pin] = pin << 1;
+		else if((pin = find_name(p->output_names, p->outputs, &name)) != -1)
+			c->pins[port->first_pin] = (pin << 1) | 1;
+		else
+			parse_error(r, "Primitive %s has no pin %.*s", p->name, name.len, name.s);
+	}
+}
+
+static void parse_cell(struct reader *r, int library)
+{
+	struct edif_cell *c;
+	int i;
+
+	r->cells = reserve(r->cells, &r->cells_size, r->ncells, sizeof(struct edif_cell));
+	i = r->ncells++;
+	c = &r->cells[i];
+	memset(c, 0, sizeof(struct edif_cell));
+	c->library = library;
+	c->name = parse_name_def(r, &c->display, NULL);
+	c->first_port = r->nports;
+	if(map_get(&r->cell_map, library, c->name) != -1)
+		parse_error(r, "Cell %.*s defined twice", c->display.len, c->display.s);
+
+	while(next_form(r)) {
+		if(is_keyword(r, "view"))
+			parse_view(r, i);
+		else
+			skip_form(r);
+	}
+
+	if(r->cells[i].has_contents)
+		resolve_contents(r, i);
+	else
+		resolve_primitive(r, i);
+	/* Registered last, so that a cell cannot instantiate itself */
+	map_put(&r->cell_map, library, r->cells[i].name, i);
+}
+
+static void parse_library(struct reader *r)
+{
+	struct token display;
+	int library;
+
+	library = parse_name_def(r, &display, NULL);
+	while(next_form(r)) {
+		if(is_keyword(r, "cell"))
+			parse_cell(r, library);
+		else
+			skip_form(r);
+	}
+}
+
+static void parse_design(struct reader *r)
+{
+	struct token display;
+
+	parse_name_def(r, &display, NULL);
+	while(next_form(r)) {
+		if(is_keyword(r, "cellRef"))
+			parse_cell_ref(r, -1, &r->top);
+		else
+			skip_form(r);
+	}
+}
+
+static void parse_edif(struct reader *r)
+{
+	struct token display;
+
+	expect(r, TOKEN_OPEN, "EDIF file");
+	expect(r, TOKEN_SYMBOL, "EDIF file");
+	if(!is_keyword(r, "edif"))
+		parse_error(r, "EDIF file expected");
+	parse_name_def(r, &display, NULL);
+	while(next_form(r)) {
+		if(is_keyword(r, "edifVersion")) {
+			next_token(r);
+			if(token_int(r) != 2)
+				parse_error(r, "Only EDIF 2 is supported");
+			skip_form(r);
+		} else if(is_keyword(r, "library") || is_keyword(r, "external"))
+			parse_library(r);
+		else if(is_keyword(r, "design"))
+			parse_design(r);
+		else
+			skip_form(r);
+	}
+	if(r->top == -1)
+		parse_error(r, "No design");
+}
+
+/*
+ * Elaboration
+ */
+
+static void set_properties(struct reader *r, struct netlist_instance *ni, struct edif_instance *inst)
+{
+	struct edif_property *prop;
+	int i, a;
+
+	for(i=0;i<inst->nproperties;i++) {
+		prop = &r->properties[inst->first_property + i];
+		if(prop->value.s == NULL)
+			continue;
+		a = find_name(ni->p->attribute_names, ni->p->attribute_count, &r->names[prop->name]);
+		if(a != -1)
+			netlist_set_attribute(ni, ni->p->attribute_names[a], token_str(r, &prop->value));
+	}
+}
+
+/* <pins> are the nets connected to the ports of <cell>, NULL if unconnected */
+static void elaborate(struct reader *r, struct netlist_manager *m, int cell, struct netlist_net **pins)
+{
+	struct edif_cell *c, *ic;
+	struct edif_instance *inst;
+	struct edif_net *n;
+	struct edif_ref *ref;
+	struct netlist_net *net;
+	struct netlist_net **child;
+	struct netlist_instance *ni;
+	struct netlist_sym *sym;
+	void **objects;
+	int i, j, code;
+	int path_len;
+
+	c = &r->cells[cell];
+	objects = alloc_size((c->ninstances+1)*sizeof(void *));
+	for(i=0;i<c->ninstances;i++) {
+		inst = &r->instance_list[c->first_instance + i];
+		ic = &r->cells[inst->cell];
+		if(ic->has_contents) {
+			objects[i] = alloc_size0((ic->npins+1)*sizeof(struct netlist_net *));
+			continue;
+		}
+		if(ic->p == NULL)
+			elaboration_error(r, "Cell %.*s is not a known primitive", ic->display.len, ic->display.s);
+		ni = netlist_m_instantiate(m, ic->p);
+		set_properties(r, ni, inst);
+		if(r->param->symbols != NULL) {
+			sym = netlist_sym_add(r->param->symbols, ni->uid, 'I', path_str(r, &inst->display));
+			sym->user = ni;
+		}
+		objects[i] = ni;
+	}
+
+	for(i=0;i<c->nnets;i++) {
+		n = &r->nets[c->first_net + i];
+		net = NULL;
+		for(j=0;j<n->nrefs;j++) {
+			ref = &r->refs[n->first_ref + j];
+			if((ref->instance == -1) && (pins[ref->pin] != NULL)) {
+				if(net == NULL)
+					net = pins[ref->pin];
+				else
+					netlist_join(net, pins[ref->pin]);
+			}
+		}
+		if(net == NULL)
+			net = netlist_m_create_net(m);
+		for(j=0;j<n->nrefs;j++) {
+			ref = &r->refs[n->first_ref + j];
+			if(ref->instance == -1)
+				continue;
+			ic = &r->cells[r->instance_list[c->first_instance + ref->instance].cell];
+			if(ic->has_contents) {
+				child = objects[ref->instance];
+				if(child[ref->pin] == NULL)
+					child[ref->pin] = net;
+				else
+					netlist_join(child[ref->pin], net);
+			} else {
+				code = ic->pins[ref->pin];
+				netlist_add_branch(net, objects[ref->instance], code & 1, code >> 1);
+			}
+		}
+		if(r->param->symbols != NULL) {
+			sym = netlist_sym_add(r->param->symbols, netlist_resolve_joined(net)->uid, 'N', path_str(r, &n->display));
+			sym->user = net;
+		}
+	}
+
+	for(i=0;i<c->ninstances;i++) {
+		inst = &r->instance_list[c->first_instance + i];
+		ic = &r->cells[inst->cell];
+		if(!ic->has_contents)
+			continue;
+		path_len = r->path.len;
+		buffer_append(&r->path, inst->display.s, inst->display.len);
+		buffer_append(&r->path, "/", 1);
+		elaborate(r, m, inst->cell, objects[i]);
+		buffer_reset(&r->path, path_len);
+		free(objects[i]);
+	}
+	free(objects);
+}
+
+static void elaborate_top(struct reader *r, struct netlist_manager *m)
+{
+	struct edif_cell *c;
+	struct edif_port *port;
+	struct netlist_net **pins;
+	struct netlist_primitive *p;
+	struct netlist_instance *inst;
+	struct token *id;
+	int i, j, n, ret;
+	char *name;
+
+	c = &r->cells[r->top];
+	if(!c->has_contents)
+		elaboration_error(r, "The top-level cell %.*s has no contents", c->display.len, c->display.s);
+	pins = alloc_size0((c->npins+1)*sizeof(struct netlist_net *));
+	for(i=0;i<c->nports;i++) {
+		port = &r->port_list[c->first_port + i];
+		/* Named like the ports of the mapper, as display names need not be valid identifiers */
+		id = &r->names[port->name];
+		n = port->width > 0 ? port->width : 1;
+		for(j=0;j<n;j++) {
+			if(port->width > 0) {
+				ret = asprintf(&name, "%.*s_%d", id->len, id->s, j);
+				if(ret == -1) abort();
+			} else
+				name = stralloc(token_str(r, id));
+			switch(port->direction) {
+				case DIRECTION_INPUT:
+					p = netlist_create_io_primitive(r->param->iops, NETLIST_PRIMITIVE_PORT_IN, name);
+					inst = netlist_m_instantiate(m, p);
+					pins[port->first_pin + j] = netlist_m_create_net_with_branch(m, inst, 1, 0);
+					break;
+				case DIRECTION_OUTPUT:
+					p = netlist_create_io_primitive(r->param->iops, NETLIST_PRIMITIVE_PORT_OUT, name);
+					inst = netlist_m_instantiate(m, p);
+					pins[port->first_pin + j] = netlist_m_create_net_with_branch(m, inst, 0, 0);
+					break;
+				default:
+					elaboration_error(r, "Top-level port %s is not an input or an output", name);
+					break;
+			}
+			free(name);
+		}
+	}
+	elaborate(r, m, r->top, pins);
+	free(pins);
+}
+
+/*
+ * Files
+ */
+
+/* Decompresses the whole file */
+static char *read_gz(const char *filename, size_t *len)
+{
+	gzFile gz;
+	char *buf;
+	size_t size;
+	int r;
+
+	gz = gzopen(filename, "rb");
+	if(gz == NULL) {
+		perror("netlist_m_edif_read_file");
+		exit(EXIT_FAILURE);
+	}
+	size = 1024*1024;
+	buf = alloc_size(size);
+	*len = 0;
+	while(1) {
+		if(*len == size) {
+			size *= 2;
+			buf = realloc(buf, size);
+			if(buf == NULL)
+				abort();
+		}
+		r = gzread(gz, buf + *len, size - *len > 0x40000000 ? 0x40000000 : size - *len);
+		if(r < 0) {
+			fprintf(stderr, "netlist_m_edif_read_file: failed to decompress %s\n", filename);
+			exit(EXIT_FAILURE);
+		}
+		if(r == 0)
+			break;
+		*len += r;
+	}
+	gzclose(gz);
+	return buf;
+}
+
+static char *map_file(const char *filename, size_t *len)
+{
+	int fd;
+	struct stat st;
+	void *p;
+
+	fd = open(filename, O_RDONLY);
+	if(fd == -1) {
+		perror("netlist_m_edif_read_file");
+		exit(EXIT_FAILURE);
+	}
+	if(fstat(fd, &st) == -1) {
+		perror("netlist_m_edif_read_file");
+		exit(EXIT_FAILURE);
+	}
+	*len = st.st_size;
+	if(*len == 0) {
+		close(fd);
+		return NULL;
+	}
+	p = mmap(NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(p == MAP_FAILED) {
+		perror("netlist_m_edif_read_file");
+		exit(EXIT_FAILURE);
+	}
+	madvise(p, *len, MADV_SEQUENTIAL);
+	close(fd);
+	return p;
+}
+
+void netlist_m_edif_read_file(struct netlist_manager *m, const char *filename, struct edif_read_param *param)
+{
+	struct reader r;
+	size_t len, flen;
+	char *data;
+	int gz;
+	int i;
+
+	flen = strlen(filename);
+	gz = (flen > 3) && (strcmp(filename + flen - 3, ".gz") == 0);
+	if(gz)
+		data = read_gz(filename, &len);
+	else
+		data = map_file(filename, &len);
+
+	memset(&r, 0, sizeof(r));
+	r.param = param;
+	r.filename = filename;
+	r.start = data;
+	r.end = data + len;
+	r.p = data;
+	r.t.s = data;
+	r.top = -1;
+	map_init(&r.cell_map);
+	map_init(&r.port_map);
+	map_init(&r.instance_map);
+
+	parse_edif(&r);
+	elaborate_top(&r, m);
+
+	map_free(&r.cell_map);
+	map_free(&r.port_map);
+	map_free(&r.instance_map);
+	for(i=0;i<r.ncells;i++)
+		free(r.cells[i].pins);
+	free(r.cells);
+	free(r.port_list);
+	free(r.properties);
+	free(r.instance_list);
+	free(r.nets);
+	free(r.refs);
+	free(r.names);
+	free(r.name_table);
+	free(r.path.s);
+	free(r.scratch.s);
+	if(gz)
+		free(data);
+	else if(data != NULL)
+		munmap(data, r.end - r.start);
+}
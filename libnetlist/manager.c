@@ -136,11 +136,144 @@ int netlist_m_prune_pass(struct netlist_manager *m)
 	return count;
 }
 
+/*
+ * Pruning gives the same result as repeating netlist_m_prune_pass() until it
+ * deletes nothing, without scanning all the nets for each instance.
+ * Deleting an instance can only stop the drivers of its nets from driving,
+ * so those are the only instances checked again.
+ */
+
+struct prune_pin {
+	struct netlist_net *net;
+	int output;
+};
+
+static int can_prune(struct netlist_instance *inst)
+{
+	return !inst->dont_touch && (inst->p->type == NETLIST_PRIMITIVE_INTERNAL);
+}
+
+/* <branches> counts the remaining branches of each net */
+static int pins_driving(struct prune_pin *pins, int npins, int *branches)
+{
+	int i, j, own;
+
+	for(i=0;i<npins;i++) {
+		if(!pins[i].output)
+			continue;
+		own = 0;
+		for(j=0;j<npins;j++)
+			if(pins[j].net == pins[i].net)
+				own++;
+		if(branches[pins[i].net->uid] > own)
+			return 1;
+	}
+	return 0;
+}
+
 void netlist_m_prune(struct netlist_manager *m)
 {
-	int count;
-	
-	do {
-		count = netlist_m_prune_pass(m);
-	} while(count > 0);
+	struct netlist_instance *inst, *d, **iprev;
+	struct netlist_net *net;
+	struct netlist_branch *b, **bprev;
+	struct prune_pin *pins;
+	struct netlist_instance **drivers;
+	int *pin_start, *driver_start, *fill;
+	int *branches;
+	int *queue;
+	char *deleted;
+	unsigned int n, u;
+	int i, j, qhead, qtail;
+
+	/* pins of the instance with uid u are pins[pin_start[u]] to pins[pin_start[u+1]-1],
+	 * instances with an output on the net with uid u are drivers[driver_start[u]] to drivers[driver_start[u+1]-1]
+	 */
+	n = m->next_uid;
+	pin_start = alloc_size0((n+1)*sizeof(int));
+	driver_start = alloc_size0((n+1)*sizeof(int));
+	branches = alloc_size0((n+1)*sizeof(int));
+	for(net=m->nhead;net!=NULL;net=net->next)
+		for(b=net->head;b!=NULL;b=b->next) {
+			pin_start[b->inst->uid+1]++;
+			if(b->output)
+				driver_start[net->uid+1]++;
+			branches[net->uid]++;
+		}
+	for(u=0;u<n;u++) {
+		pin_start[u+1] += pin_start[u];
+		driver_start[u+1] += driver_start[u];
+	}
+	pins = alloc_size((pin_start[n]+1)*sizeof(struct prune_pin));
+	drivers = alloc_size((driver_start[n]+1)*sizeof(struct netlist_instance *));
+	fill = alloc_size((n+1)*sizeof(int));
+	memcpy(fill, pin_start, (n+1)*sizeof(int));
+	for(net=m->nhead;net!=NULL;net=net->next)
+		for(b=net->head;b!=NULL;b=b->next) {
+			pins[fill[b->inst->uid]].net = net;
+			pins[fill[b->inst->uid]].output = b->output;
+			fill[b->inst->uid]++;
+		}
+	memcpy(fill, driver_start, (n+1)*sizeof(int));
+	for(net=m->nhead;net!=NULL;net=net->next)
+		for(b=net->head;b!=NULL;b=b->next)
+			if(b->output)
+				drivers[fill[net->uid]++] = b->inst;
+	free(fill);
+
+	/* each instance is queued at most once, and deleted when it leaves the queue */
+	deleted = alloc_size0(n+1);
+	queue = alloc_size((n+1)*sizeof(int));
+	qhead = qtail = 0;
+	for(inst=m->ihead;inst!=NULL;inst=inst->next)
+		if(can_prune(inst) && !pins_driving(&pins[pin_start[inst->uid]], pin_start[inst->uid+1] - pin_start[inst->uid], branches)) {
+			deleted[inst->uid] = 1;
+			queue[qtail++] = inst->uid;
+		}
+	while(qhead < qtail) {
+		u = queue[qhead++];
+		for(i=pin_start[u];i<pin_start[u+1];i++) {
+			net = pins[i].net;
+			branches[net->uid]--;
+			for(j=driver_start[net->uid];j<driver_start[net->uid+1];j++) {
+				d = drivers[j];
+				if(!deleted[d->uid] && can_prune(d)
+				  && !pins_driving(&pins[pin_start[d->uid]], pin_start[d->uid+1] - pin_start[d->uid], branches)) {
+					deleted[d->uid] = 1;
+					queue[qtail++] = d->uid;
+				}
+			}
+		}
+	}
+
+	for(net=m->nhead;net!=NULL;net=net->next) {
+		bprev = &net->head;
+		net->tail = NULL;
+		while(*bprev != NULL) {
+			b = *bprev;
+			if(deleted[b->inst->uid]) {
+				*bprev = b->next;
+				free(b);
+			} else {
+				net->tail = b;
+				bprev = &b->next;
+			}
+		}
+	}
+	iprev = &m->ihead;
+	while(*iprev != NULL) {
+		inst = *iprev;
+		if(deleted[inst->uid]) {
+			*iprev = inst->next;
+			netlist_free_instance(inst);
+		} else
+			iprev = &inst->next;
+	}
+
+	free(queue);
+	free(deleted);
+	free(drivers);
+	free(pins);
+	free(branches);
+	free(driver_start);
+	free(pin_start);
 }
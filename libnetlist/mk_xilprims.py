@@ -195,6 +195,7 @@ def generate_h():
 	for p in primitives:
 		print "\tNETLIST_XIL_%s = %d," % (p.name, i)
 		i += 1
+	print "\tNETLIST_XIL_COUNT = %d" % i
 	print "};"
 
 	for p in primitives:
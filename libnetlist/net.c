@@ -1,10 +1,76 @@
 #include <assert.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include <util.h>
 
 #include <netlist/net.h>
 
+/*
+ * Attribute values are interned: instances with the same value
+ * (e.g. the INIT of identical LUTs) share one string.
+ * Interned strings live until the program exits.
+ * The table is shared by the netlists mapped on different threads.
+ */
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int intern_mask;
+static unsigned int intern_count;
+static char **intern_table;
+
+static unsigned int intern_hash(const char *s)
+{
+	unsigned int h;
+
+	h = 2166136261U;
+	while(*s)
+		h = (h ^ (unsigned char)*s++)*16777619U;
+	return h;
+}
+
+static void intern_grow(void)
+{
+	char **table;
+	unsigned int mask, h, i;
+
+	mask = intern_table == NULL ? 255 : 2*intern_mask + 1;
+	table = alloc_size0((mask+1)*sizeof(char *));
+	if(intern_table != NULL) {
+		for(i=0;i<=intern_mask;i++) {
+			if(intern_table[i] == NULL)
+				continue;
+			h = intern_hash(intern_table[i]) & mask;
+			while(table[h] != NULL)
+				h = (h + 1) & mask;
+			table[h] = intern_table[i];
+		}
+		free(intern_table);
+	}
+	intern_table = table;
+	intern_mask = mask;
+}
+
+static char *intern(const char *s)
+{
+	unsigned int h;
+	char *r;
+
+	if(s == NULL)
+		return NULL;
+	pthread_mutex_lock(&intern_lock);
+	if((intern_table == NULL) || (2*intern_count > intern_mask))
+		intern_grow();
+	h = intern_hash(s) & intern_mask;
+	while((intern_table[h] != NULL) && (strcmp(intern_table[h], s) != 0))
+		h = (h + 1) & intern_mask;
+	if(intern_table[h] == NULL) {
+		intern_table[h] = stralloc(s);
+		intern_count++;
+	}
+	r = intern_table[h];
+	pthread_mutex_unlock(&intern_lock);
+	return r;
+}
+
 struct netlist_instance *netlist_instantiate(unsigned int uid, struct netlist_primitive *p)
 {
 	struct netlist_instance *new;
@@ -19,7 +85,7 @@ struct netlist_instance *netlist_instantiate(unsigned int uid, struct netlist_pr
 	if(p->attribute_count > 0) {
 		new->attributes = alloc_size(p->attribute_count*sizeof(void *));
 		for(i=0;i<p->attribute_count;i++)
-			new->attributes[i] = stralloc(p->default_attributes[i]);
+			new->attributes[i] = intern(p->default_attributes[i]);
 	} else
 		new->attributes = NULL;
 
@@ -30,10 +96,6 @@ struct netlist_instance *netlist_instantiate(unsigned int uid, struct netlist_pr
 
 void netlist_free_instance(struct netlist_instance *inst)
 {
-	int i;
-
-	for(i=0;i<inst->p->attribute_count;i++)
-		free(inst->attributes[i]);
 	free(inst->attributes);
 	
 	free(inst);
@@ -55,11 +117,10 @@ void netlist_set_attribute(struct netlist_instance *inst, const char *attr, cons
 	a = find_attribute(inst, attr);
 	assert(a != -1);
 	
-	free(inst->attributes[a]);
 	if(value == NULL)
-		inst->attributes[a] = stralloc(inst->p->default_attributes[a]);
+		inst->attributes[a] = intern(inst->p->default_attributes[a]);
 	else
-		inst->attributes[a] = stralloc(value);
+		inst->attributes[a] = intern(value);
 }
 
 struct netlist_net *netlist_create_net(unsigned int uid)
@@ -69,36 +130,40 @@ struct netlist_net *netlist_create_net(unsigned int uid)
 	net = alloc_type(struct netlist_net);
 	net->uid = uid;
 	net->head = NULL;
+	net->tail = NULL;
 	net->joined = NULL;
 	net->next = NULL;
 	return net;
 }
 
+/* Halves the chains of nets joined one after the other, as the mappers do */
 struct netlist_net *netlist_resolve_joined(struct netlist_net *net)
 {
-	while(net->joined != NULL)
+	while(net->joined != NULL) {
+		if(net->joined->joined != NULL)
+			net->joined = net->joined->joined;
 		net = net->joined;
+	}
 	return net;
 }
 
 void netlist_join(struct netlist_net *resulting, struct netlist_net *tomerge)
 {
-	struct netlist_branch *last;
-	
 	if((resulting == NULL) || (tomerge == NULL)) return;
 	resulting = netlist_resolve_joined(resulting);
 	tomerge = netlist_resolve_joined(tomerge);
 	if(resulting == tomerge) return;
 	
-	if(resulting->head != NULL) {
-		last = resulting->head;
-		while(last->next != NULL)
-			last = last->next;
-		last->next = tomerge->head;
-	} else
-		resulting->head = tomerge->head;
+	if(tomerge->head != NULL) {
+		if(resulting->head != NULL)
+			resulting->tail->next = tomerge->head;
+		else
+			resulting->head = tomerge->head;
+		resulting->tail = tomerge->tail;
+	}
 	
 	tomerge->head = NULL;
+	tomerge->tail = NULL;
 	tomerge->joined = resulting;
 }
 
@@ -118,6 +183,8 @@ void netlist_add_branch(struct netlist_net *net, struct netlist_instance *inst,
 	branch->output = output;
 	branch->pin_index = pin_index;
 	branch->next = net->head;
+	if(net->head == NULL)
+		net->tail = branch;
 	net->head = branch;
 }
 
@@ -142,6 +209,7 @@ void netlist_disconnect_instance(struct netlist_net *net, struct netlist_instanc
 			b1 = b1->next;
 		}
 	}
+	net->tail = prev;
 }
 
 void netlist_free_net(struct netlist_net *net)
@@ -6,12 +6,33 @@
 
 #include <netlist/symbol.h>
 
+static unsigned int name_hash(const char *s)
+{
+	unsigned int h;
+
+	h = 2166136261U;
+	while(*s != 0) {
+		h ^= (unsigned char)*s++;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static unsigned int uid_hash(unsigned int uid)
+{
+	return uid*2654435761U;
+}
+
 struct netlist_sym_store *netlist_sym_newstore()
 {
 	struct netlist_sym_store *store;
 
 	store = alloc_type(struct netlist_sym_store);
 	store->head = NULL;
+	store->count = 0;
+	store->mask = 255;
+	store->names = alloc_size0((store->mask+1)*sizeof(struct netlist_sym *));
+	store->uids = alloc_size0((store->mask+1)*sizeof(struct netlist_sym *));
 	return store;
 }
 
@@ -25,13 +46,51 @@ void netlist_sym_freestore(struct netlist_sym_store *store)
 		free(s);
 		s = s2;
 	}
+	free(store->names);
+	free(store->uids);
 	free(store);
 }
 
+/* Rebuilds the indexes with twice as many buckets, keeping the order of the chains */
+static void grow_store(struct netlist_sym_store *store)
+{
+	struct netlist_sym **name_tails, **uid_tails;
+	struct netlist_sym *s;
+	unsigned int h;
+
+	free(store->names);
+	free(store->uids);
+	store->mask = 2*store->mask + 1;
+	store->names = alloc_size0((store->mask+1)*sizeof(struct netlist_sym *));
+	store->uids = alloc_size0((store->mask+1)*sizeof(struct netlist_sym *));
+	name_tails = alloc_size0((store->mask+1)*sizeof(struct netlist_sym *));
+	uid_tails = alloc_size0((store->mask+1)*sizeof(struct netlist_sym *));
+	for(s=store->head;s!=NULL;s=s->next) {
+		s->name_next = NULL;
+		h = name_hash(s->name) & store->mask;
+		if(name_tails[h] == NULL)
+			store->names[h] = s;
+		else
+			name_tails[h]->name_next = s;
+		name_tails[h] = s;
+
+		s->uid_next = NULL;
+		h = uid_hash(s->uid) & store->mask;
+		if(uid_tails[h] == NULL)
+			store->uids[h] = s;
+		else
+			uid_tails[h]->uid_next = s;
+		uid_tails[h] = s;
+	}
+	free(name_tails);
+	free(uid_tails);
+}
+
 struct netlist_sym *netlist_sym_add(struct netlist_sym_store *store, unsigned int uid, char type, const char *name)
 {
 	int len;
 	struct netlist_sym *s;
+	unsigned int h;
 
 	len = strlen(name);
 	s = alloc_size(sizeof(struct netlist_sym)+len+1);
@@ -41,6 +100,15 @@ struct netlist_sym *netlist_sym_add(struct netlist_sym_store *store, unsigned in
 	s->type = type;
 	memcpy(s->name, name, len+1);
 	store->head = s;
+
+	h = name_hash(name) & store->mask;
+	s->name_next = store->names[h];
+	store->names[h] = s;
+	h = uid_hash(uid) & store->mask;
+	s->uid_next = store->uids[h];
+	store->uids[h] = s;
+	if(++store->count > store->mask)
+		grow_store(store);
 	return s;
 }
 
@@ -48,11 +116,11 @@ struct netlist_sym *netlist_sym_lookup(struct netlist_sym_store *store, const ch
 {
 	struct netlist_sym *it;
 
-	it = store->head;
+	it = store->names[name_hash(name) & store->mask];
 	while(it != NULL) {
 		if(((type == 0x00) || (it->type == type)) && (strcmp(name, it->name) == 0))
 			return it;
-		it = it->next;
+		it = it->name_next;
 	}
 	return NULL;
 }
@@ -61,11 +129,11 @@ struct netlist_sym *netlist_sym_revlookup(struct netlist_sym_store *store, unsig
 {
 	struct netlist_sym *it;
 
-	it = store->head;
+	it = store->uids[uid_hash(uid) & store->mask];
 	while(it != NULL) {
 		if(it->uid == uid)
 			return it;
-		it = it->next;
+		it = it->uid_next;
 	}
 	return 0;
 }
@@ -107,7 +175,7 @@ void netlist_sym_from_fd(struct netlist_sym_store *store, FILE *fd)
 	int n;
 	
 	while(1) {
-		n = fscanf(fd, "%x %c %as", &uid, &type, &name);
+		n = fscanf(fd, "%x %c %ms", &uid, &type, &name);
 		if(n != 3) {
 			if(!feof(fd)) {
 				perror("netlist_sym_from_fd");
@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include <llhdl/structure.h>
+
+#include "internal.h"
+
+struct sim_sc *sim_new(struct llhdl_module *m)
+{
+	struct sim_sc *sc;
+
+	sc = alloc_type(struct sim_sc);
+	sc->module = m;
+	sc->signals = NULL;
+	sim_compile(sc);
+	sc->values = alloc_size(sc->nslots*sizeof(sim_word));
+	sim_reset(sc);
+	return sc;
+}
+
+void sim_free(struct sim_sc *sc)
+{
+	struct sim_signal *s, *next;
+
+	for(s=sc->signals;s!=NULL;s=next) {
+		next = s->next;
+		free(s->slots);
+		free(s);
+	}
+	free(sc->values);
+	free(sc->insns);
+	free(sc->latches);
+	free(sc->latch_buffer);
+	free(sc);
+}
+
+struct sim_signal *sim_get_signals(struct sim_sc *sc)
+{
+	return sc->signals;
+}
+
+struct sim_signal *sim_find_signal(struct sim_sc *sc, const char *name)
+{
+	struct sim_signal *s;
+
+	for(s=sc->signals;s!=NULL;s=s->next)
+		if(strcmp(s->signal->p.signal.name, name) == 0)
+			return s;
+	return NULL;
+}
+
+int sim_get_instruction_count(struct sim_sc *sc)
+{
+	return sc->ninsns;
+}
+
+void sim_set(struct sim_sc *sc, struct sim_signal *s, int bit, sim_word v)
+{
+	assert(s->signal->p.signal.type == LLHDL_SIGNAL_PORT_IN);
+	sc->values[s->slots[bit]] = v;
+}
+
+sim_word sim_get(struct sim_sc *sc, struct sim_signal *s, int bit)
+{
+	return sc->values[s->slots[bit]];
+}
+
+void sim_set_lane(struct sim_sc *sc, struct sim_signal *s, int lane, mpz_t v)
+{
+	sim_word mask;
+	int i;
+
+	assert(s->signal->p.signal.type == LLHDL_SIGNAL_PORT_IN);
+	mask = (sim_word)1 << lane;
+	for(i=0;i<s->vectorsize;i++) {
+		if(mpz_tstbit(v, i))
+			sc->values[s->slots[i]] |= mask;
+		else
+			sc->values[s->slots[i]] &= ~mask;
+	}
+}
+
+void sim_get_lane(struct sim_sc *sc, struct sim_signal *s, int lane, mpz_t r)
+{
+	int i;
+
+	mpz_set_ui(r, 0);
+	for(i=0;i<s->vectorsize;i++)
+		if((sc->values[s->slots[i]] >> lane) & 1)
+			mpz_setbit(r, i);
+}
+
+void sim_reset(struct sim_sc *sc)
+{
+	memset(sc->values, 0, sc->nslots*sizeof(sim_word));
+	sc->values[SIM_SLOT_ONE] = ~(sim_word)0;
+}
+
+void sim_eval(struct sim_sc *sc)
+{
+	sim_word *v = sc->values;
+	struct sim_insn *insn, *end;
+
+	end = &sc->insns[sc->ninsns];
+	for(insn=sc->insns;insn<end;insn++) {
+		switch(insn->op) {
+			case SIM_OP_NOT:
+				v[insn->dst] = ~v[insn->a];
+				break;
+			case SIM_OP_AND:
+				v[insn->dst] = v[insn->a] & v[insn->b];
+				break;
+			case SIM_OP_OR:
+				v[insn->dst] = v[insn->a] | v[insn->b];
+				break;
+			case SIM_OP_XOR:
+				v[insn->dst] = v[insn->a] ^ v[insn->b];
+				break;
+			case SIM_OP_MUX:
+				v[insn->dst] = v[insn->a] ^ ((v[insn->a] ^ v[insn->b]) & v[insn->c]);
+				break;
+		}
+	}
+}
+
+void sim_clock(struct sim_sc *sc, struct llhdl_node *clock)
+{
+	int i;
+
+	/* sample all registers before updating any, as they may feed each other */
+	for(i=0;i<sc->nlatches;i++)
+		sc->latch_buffer[i] = sc->values[sc->latches[i].next];
+	for(i=0;i<sc->nlatches;i++)
+		if((clock == NULL) || (sc->latches[i].clock == clock))
+			sc->values[sc->latches[i].state] = sc->latch_buffer[i];
+}
@@ -0,0 +1,471 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/tools.h>
+#include <sim/blast.h>
+
+/*
+ * The module is levelized by compiling each signal after the signals it reads.
+ * Registers break the dependency cycles: their outputs are state bits, and their
+ * data inputs are compiled once all signals are done.
+ * Every node is compiled to an array of bits. Extensions, truncations and slices
+ * only rearrange the array and cost no gates.
+ */
+
+struct pending_fd {
+	struct llhdl_node *fd;
+	int vectorsize;
+	void *handle;
+	struct pending_fd *next;
+};
+
+struct blaster {
+	struct blast_ops *ops;
+	void *user;
+	struct pending_fd *pending;
+	struct llhdl_size_cache sizes;	/* < the nodes are not modified */
+	/* pre-order list of the expression being compiled */
+	int nnodes, nodes_size;
+	struct llhdl_node **nodes;
+	/* bits of the operands not consumed yet */
+	int nvalues, values_size;
+	int **values;
+	/* signals waiting for the signals they read */
+	int nsignals, signals_size;
+	struct llhdl_node **signals;
+};
+
+static int in_progress;
+
+/* Gates, with constant folding */
+
+static int g_not(struct blaster *c, int a)
+{
+	if(a == BLAST_ZERO) return BLAST_ONE;
+	if(a == BLAST_ONE) return BLAST_ZERO;
+	return c->ops->gate(c->user, BLAST_NOT, a, 0, 0);
+}
+
+static int g_and(struct blaster *c, int a, int b)
+{
+	if((a == BLAST_ZERO) || (b == BLAST_ZERO)) return BLAST_ZERO;
+	if((a == BLAST_ONE) || (a == b)) return b;
+	if(b == BLAST_ONE) return a;
+	return c->ops->gate(c->user, BLAST_AND, a, b, 0);
+}
+
+static int g_or(struct blaster *c, int a, int b)
+{
+	if((a == BLAST_ONE) || (b == BLAST_ONE)) return BLAST_ONE;
+	if((a == BLAST_ZERO) || (a == b)) return b;
+	if(b == BLAST_ZERO) return a;
+	return c->ops->gate(c->user, BLAST_OR, a, b, 0);
+}
+
+static int g_xor(struct blaster *c, int a, int b)
+{
+	if(a == BLAST_ZERO) return b;
+	if(b == BLAST_ZERO) return a;
+	if(a == BLAST_ONE) return g_not(c, b);
+	if(b == BLAST_ONE) return g_not(c, a);
+	if(a == b) return BLAST_ZERO;
+	return c->ops->gate(c->user, BLAST_XOR, a, b, 0);
+}
+
+static int g_mux(struct blaster *c, int a, int b, int s)
+{
+	if((s == BLAST_ZERO) || (a == b)) return a;
+	if(s == BLAST_ONE) return b;
+	return c->ops->gate(c->user, BLAST_MUX, a, b, s);
+}
+
+/* Sign or zero extension, or truncation, to <vectorsize> bits */
+static int *extend(int *bits, int n_vectorsize, int sign, int vectorsize)
+{
+	int *r;
+	int i;
+
+	r = alloc_size(vectorsize*sizeof(int));
+	for(i=0;i<vectorsize;i++) {
+		if(i < n_vectorsize)
+			r[i] = bits[i];
+		else if(sign)
+			r[i] = bits[n_vectorsize-1];
+		else
+			r[i] = BLAST_ZERO;
+	}
+	return r;
+}
+
+static void push_value(struct blaster *c, int *bits)
+{
+	if(c->nvalues == c->values_size) {
+		c->values_size = 2*c->values_size + 16;
+		c->values = realloc(c->values, c->values_size*sizeof(int *));
+		assert(c->values != NULL);
+	}
+	c->values[c->nvalues++] = bits;
+}
+
+/* Takes the bits of the operand <n> off the stack, extended to <vectorsize> bits */
+static int *pop_operand(struct blaster *c, struct llhdl_node *n, int vectorsize)
+{
+	int *bits, *r;
+
+	assert(c->nvalues > 0);
+	bits = c->values[--c->nvalues];
+	r = extend(bits, llhdl_get_vectorsize_cached(&c->sizes, n), llhdl_get_sign_cached(&c->sizes, n), vectorsize);
+	free(bits);
+	return r;
+}
+
+static int *compile_fd(struct blaster *c, struct llhdl_node *n, struct llhdl_node *signal)
+{
+	struct pending_fd *p;
+	int *r;
+
+	p = alloc_type(struct pending_fd);
+	p->fd = n;
+	p->vectorsize = llhdl_get_vectorsize_cached(&c->sizes, n);
+	r = alloc_size(p->vectorsize*sizeof(int));
+	p->handle = c->ops->fd(c->user, n, signal, p->vectorsize, r);
+	p->next = c->pending;
+	c->pending = p;
+	return r;
+}
+
+static int *compile_add(struct blaster *c, int *a, int *b, int vectorsize, int sub)
+{
+	int *r;
+	int carry;
+	int i;
+	int bi, t;
+
+	r = alloc_size(vectorsize*sizeof(int));
+	carry = sub ? BLAST_ONE : BLAST_ZERO;
+	for(i=0;i<vectorsize;i++) {
+		bi = sub ? g_not(c, b[i]) : b[i];
+		t = g_xor(c, a[i], bi);
+		r[i] = g_xor(c, t, carry);
+		if(i != (vectorsize-1))
+			carry = g_or(c, g_and(c, a[i], bi), g_and(c, carry, t));
+	}
+	return r;
+}
+
+static int *compile_mul(struct blaster *c, int *a, int *b, int vectorsize)
+{
+	int *acc, *row, *sum;
+	int i, j;
+
+	acc = alloc_size0(vectorsize*sizeof(int));
+	row = alloc_size(vectorsize*sizeof(int));
+	for(i=0;i<vectorsize;i++) {
+		if(b[i] == BLAST_ZERO)
+			continue;
+		for(j=0;j<vectorsize;j++)
+			row[j] = j < i ? BLAST_ZERO : g_and(c, a[j-i], b[i]);
+		sum = compile_add(c, acc, row, vectorsize, 0);
+		free(acc);
+		acc = sum;
+	}
+	free(row);
+	return acc;
+}
+
+static int *compile_logic(struct blaster *c, struct llhdl_node *n, int vectorsize)
+{
+	int *a, *b, *r;
+	int i;
+
+	a = pop_operand(c, n->p.logic.operands[0], vectorsize);
+	if(n->p.logic.op == LLHDL_LOGIC_NOT) {
+		for(i=0;i<vectorsize;i++)
+			a[i] = g_not(c, a[i]);
+		return a;
+	}
+	b = pop_operand(c, n->p.logic.operands[1], vectorsize);
+	switch(n->p.logic.op) {
+		case LLHDL_LOGIC_AND:
+			for(i=0;i<vectorsize;i++)
+				a[i] = g_and(c, a[i], b[i]);
+			r = a;
+			break;
+		case LLHDL_LOGIC_OR:
+			for(i=0;i<vectorsize;i++)
+				a[i] = g_or(c, a[i], b[i]);
+			r = a;
+			break;
+		case LLHDL_LOGIC_XOR:
+			for(i=0;i<vectorsize;i++)
+				a[i] = g_xor(c, a[i], b[i]);
+			r = a;
+			break;
+		case LLHDL_EXTLOGIC_ADD:
+		case LLHDL_EXTLOGIC_SUB:
+			r = compile_add(c, a, b, vectorsize, n->p.logic.op == LLHDL_EXTLOGIC_SUB);
+			free(a);
+			break;
+		case LLHDL_EXTLOGIC_MUL:
+			r = compile_mul(c, a, b, vectorsize);
+			free(a);
+			break;
+		default:
+			assert(0);
+			r = NULL;
+			break;
+	}
+	free(b);
+	return r;
+}
+
+/* Selects bit <bit> among the sources <base> to <base>+2^<level>-1.
+ * Sources past the end read as 0.
+ */
+static int mux_tree(struct blaster *c, int **sources, int nsources, int *select, int bit, long long int base, int level)
+{
+	long long int half;
+	int a, b;
+
+	if(base >= nsources)
+		return BLAST_ZERO;
+	if(level == 0)
+		return sources[base][bit];
+	half = 1LL << (level-1);
+	a = mux_tree(c, sources, nsources, select, bit, base, level-1);
+	b = mux_tree(c, sources, nsources, select, bit, base+half, level-1);
+	return g_mux(c, a, b, select[level-1]);
+}
+
+static int *compile_mux(struct blaster *c, struct llhdl_node *n, int vectorsize)
+{
+	int **sources;
+	int *select;
+	int select_size;
+	int *r;
+	int i;
+
+	select_size = llhdl_get_vectorsize_cached(&c->sizes, n->p.mux.select);
+	select = c->values[--c->nvalues];
+	sources = alloc_size(n->p.mux.nsources*sizeof(int *));
+	for(i=0;i<n->p.mux.nsources;i++)
+		sources[i] = pop_operand(c, n->p.mux.sources[i], vectorsize);
+	/* select bits past 62 can only address missing sources */
+	while((select_size > 62) && (select[select_size-1] == BLAST_ZERO))
+		select_size--;
+	if(select_size > 62) {
+		fprintf(stderr, "Multiplexer select too wide\n");
+		exit(EXIT_FAILURE);
+	}
+	r = alloc_size(vectorsize*sizeof(int));
+	for(i=0;i<vectorsize;i++)
+		r[i] = mux_tree(c, sources, n->p.mux.nsources, select, i, 0, select_size);
+	for(i=0;i<n->p.mux.nsources;i++)
+		free(sources[i]);
+	free(sources);
+	free(select);
+	return r;
+}
+
+static int *compile_vect(struct blaster *c, struct llhdl_node *n, int vectorsize)
+{
+	int *r, *bits;
+	int i, j, k;
+
+	r = alloc_size(vectorsize*sizeof(int));
+	k = 0;
+	for(i=0;i<n->p.vect.nslices;i++) {
+		bits = c->values[--c->nvalues];
+		for(j=n->p.vect.slices[i].start;j<=n->p.vect.slices[i].end;j++)
+			r[k++] = bits[j];
+		free(bits);
+	}
+	return r;
+}
+
+/* Lists the nodes of the expression in <slot> in pre-order. Registers take
+ * no operand: their data inputs are compiled once all signals are done.
+ */
+static void list_expression(struct blaster *c, struct llhdl_node **slot)
+{
+	struct llhdl_traversal t;
+
+	c->nnodes = 0;
+	llhdl_traversal_init(&t, LLHDL_ORDER_PRE, 0);
+	llhdl_traversal_push(&t, slot);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		if(c->nnodes == c->nodes_size) {
+			c->nodes_size = 2*c->nodes_size + 16;
+			c->nodes = realloc(c->nodes, c->nodes_size*sizeof(struct llhdl_node *));
+			assert(c->nodes != NULL);
+		}
+		c->nodes[c->nnodes++] = *slot;
+		if((*slot)->type == LLHDL_NODE_FD)
+			llhdl_traversal_skip(&t);
+	}
+	llhdl_traversal_free(&t);
+}
+
+/* Compiles the expression in <slot> to <vectorsize> bits, once the signals it reads are done.
+ * The list is evaluated backwards, so that the operands of a node are on the stack
+ * with the first one on top.
+ */
+static int *compile_expression(struct blaster *c, struct llhdl_node **slot, int vectorsize)
+{
+	struct llhdl_node *n;
+	int n_vectorsize;
+	int *r;
+	int i, j;
+
+	list_expression(c, slot);
+	for(i=c->nnodes-1;i>=0;i--) {
+		n = c->nodes[i];
+		n_vectorsize = llhdl_get_vectorsize_cached(&c->sizes, n);
+		switch(n->type) {
+			case LLHDL_NODE_CONSTANT:
+				r = alloc_size(n_vectorsize*sizeof(int));
+				for(j=0;j<n_vectorsize;j++)
+					r[j] = llhdl_get_constant_bit(n, j) ? BLAST_ONE : BLAST_ZERO;
+				break;
+			case LLHDL_NODE_SIGNAL:
+				assert((n->user != NULL) && (n->user != &in_progress));
+				r = alloc_size(n_vectorsize*sizeof(int));
+				memcpy(r, n->user, n_vectorsize*sizeof(int));
+				break;
+			case LLHDL_NODE_LOGIC:
+			case LLHDL_NODE_EXTLOGIC:
+				r = compile_logic(c, n, n_vectorsize);
+				break;
+			case LLHDL_NODE_MUX:
+				r = compile_mux(c, n, n_vectorsize);
+				break;
+			case LLHDL_NODE_FD:
+				r = compile_fd(c, n, NULL);
+				break;
+			case LLHDL_NODE_VECT:
+				r = compile_vect(c, n, n_vectorsize);
+				break;
+			default:
+				assert(0);
+				r = NULL;
+				break;
+		}
+		push_value(c, r);
+	}
+	r = pop_operand(c, *slot, vectorsize);
+	assert(c->nvalues == 0);
+	return r;
+}
+
+static void push_signal(struct blaster *c, struct llhdl_node *n)
+{
+	if(c->nsignals == c->signals_size) {
+		c->signals_size = 2*c->signals_size + 16;
+		c->signals = realloc(c->signals, c->signals_size*sizeof(struct llhdl_node *));
+		assert(c->signals != NULL);
+	}
+	c->signals[c->nsignals++] = n;
+}
+
+/* Compiles the signals without an expression to evaluate. The others are marked
+ * in progress, and the signals their expression reads are scheduled before them.
+ */
+static void start_signal(struct blaster *c, struct llhdl_node *n)
+{
+	struct llhdl_node *source, *s;
+	int vectorsize;
+	int *bits;
+	int i;
+
+	vectorsize = n->p.signal.vectorsize;
+	source = n->p.signal.source;
+	if(n->p.signal.type == LLHDL_SIGNAL_PORT_IN) {
+		bits = alloc_size(vectorsize*sizeof(int));
+		for(i=0;i<vectorsize;i++)
+			bits[i] = c->ops->input(c->user, n, i);
+		n->user = bits;
+	} else if(source == NULL)
+		n->user = alloc_size0(vectorsize*sizeof(int));
+	else if(source->type == LLHDL_NODE_FD) {
+		/* the register is known by the name of the signal */
+		bits = compile_fd(c, source, n);
+		n->user = extend(bits, llhdl_get_vectorsize_cached(&c->sizes, source), llhdl_get_sign_cached(&c->sizes, source), vectorsize);
+		free(bits);
+	} else {
+		n->user = &in_progress;
+		list_expression(c, &n->p.signal.source);
+		for(i=0;i<c->nnodes;i++) {
+			s = c->nodes[i];
+			if(s->type != LLHDL_NODE_SIGNAL)
+				continue;
+			if(s->user == &in_progress) {
+				fprintf(stderr, "Combinational loop through signal '%s'\n", s->p.signal.name);
+				exit(EXIT_FAILURE);
+			}
+			if(s->user == NULL)
+				push_signal(c, s);
+		}
+	}
+}
+
+/* Compiles <n> and the signals it depends on, depth first.
+ * The signals in progress are those on the path from <n>.
+ */
+static void compile_signal(struct blaster *c, struct llhdl_node *n)
+{
+	push_signal(c, n);
+	while(c->nsignals > 0) {
+		n = c->signals[c->nsignals-1];
+		if(n->user == NULL)
+			start_signal(c, n);
+		else {
+			c->nsignals--;
+			if(n->user == &in_progress)
+				n->user = compile_expression(c, &n->p.signal.source, n->p.signal.vectorsize);
+		}
+	}
+}
+
+void blast_module(struct llhdl_module *m, struct blast_ops *ops, void *user)
+{
+	struct blaster c;
+	struct llhdl_node *n;
+	struct pending_fd *p;
+	int *bits;
+
+	c.ops = ops;
+	c.user = user;
+	c.pending = NULL;
+	llhdl_size_cache_init(&c.sizes);
+	c.nnodes = 0;
+	c.nodes_size = 0;
+	c.nodes = NULL;
+	c.nvalues = 0;
+	c.values_size = 0;
+	c.values = NULL;
+	c.nsignals = 0;
+	c.signals_size = 0;
+	c.signals = NULL;
+
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		n->user = NULL;
+	for(n=m->head;n!=NULL;n=n->p.signal.next)
+		compile_signal(&c, n);
+	/* next states, which may create more registers */
+	while(c.pending != NULL) {
+		p = c.pending;
+		c.pending = p->next;
+		bits = compile_expression(&c, &p->fd->p.fd.data, p->vectorsize);
+		ops->next_state(user, p->handle, p->fd, p->vectorsize, bits);
+		free(bits);
+		free(p);
+	}
+	llhdl_size_cache_free(&c.sizes);
+	free(c.nodes);
+	free(c.values);
+	free(c.signals);
+}
@@ -0,0 +1,173 @@
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <sim/blast.h>
+
+#include "internal.h"
+
+/*
+ * The module is bit-blasted with a slot index for each bit,
+ * and every gate becomes an instruction.
+ */
+
+#define INSN_BLOCK 1024
+
+struct insn_block {
+	int n;
+	struct sim_insn insns[INSN_BLOCK];
+	struct insn_block *next;
+};
+
+struct register_bits {
+	struct llhdl_node *clock;
+	int vectorsize;
+	int *state;
+	int *next_state;
+	struct register_bits *next;
+};
+
+struct compiler {
+	struct sim_sc *sc;
+	struct insn_block *head;
+	struct insn_block *tail;
+	struct register_bits *registers;
+};
+
+static int new_slot(struct compiler *c)
+{
+	return c->sc->nslots++;
+}
+
+static int emit(struct compiler *c, int op, int a, int b, int s)
+{
+	struct insn_block *block;
+	struct sim_insn *insn;
+
+	if((c->tail == NULL) || (c->tail->n == INSN_BLOCK)) {
+		block = alloc_type(struct insn_block);
+		block->n = 0;
+		block->next = NULL;
+		if(c->tail == NULL)
+			c->head = block;
+		else
+			c->tail->next = block;
+		c->tail = block;
+	}
+	insn = &c->tail->insns[c->tail->n++];
+	insn->op = op;
+	insn->dst = new_slot(c);
+	insn->a = a;
+	insn->b = b;
+	insn->c = s;
+	c->sc->ninsns++;
+	return insn->dst;
+}
+
+static int cb_input(void *user, struct llhdl_node *signal, int bit)
+{
+	return new_slot(user);
+}
+
+static int cb_gate(void *user, int op, int a, int b, int c)
+{
+	return emit(user, op, a, b, c);
+}
+
+static void *cb_fd(void *user, struct llhdl_node *fd, struct llhdl_node *signal, int vectorsize, int *state)
+{
+	struct compiler *c = user;
+	struct register_bits *reg;
+	int i;
+
+	reg = alloc_type(struct register_bits);
+	reg->clock = fd->p.fd.clock;
+	reg->vectorsize = vectorsize;
+	reg->state = alloc_size(vectorsize*sizeof(int));
+	for(i=0;i<vectorsize;i++)
+		reg->state[i] = state[i] = new_slot(c);
+	reg->next_state = NULL;
+	reg->next = c->registers;
+	c->registers = reg;
+	c->sc->nlatches += vectorsize;
+	return reg;
+}
+
+static void cb_next_state(void *user, void *handle, struct llhdl_node *fd, int vectorsize, int *next_state)
+{
+	struct register_bits *reg = handle;
+
+	reg->next_state = alloc_size(vectorsize*sizeof(int));
+	memcpy(reg->next_state, next_state, vectorsize*sizeof(int));
+}
+
+static struct blast_ops ops = {
+	.input = cb_input,
+	.gate = cb_gate,
+	.fd = cb_fd,
+	.next_state = cb_next_state
+};
+
+static void flatten(struct compiler *c)
+{
+	struct sim_sc *sc = c->sc;
+	struct insn_block *block, *next;
+	struct register_bits *reg, *rnext;
+	int i, j;
+
+	sc->insns = alloc_size((sc->ninsns+1)*sizeof(struct sim_insn));
+	i = 0;
+	for(block=c->head;block!=NULL;block=next) {
+		next = block->next;
+		memcpy(&sc->insns[i], block->insns, block->n*sizeof(struct sim_insn));
+		i += block->n;
+		free(block);
+	}
+
+	sc->latches = alloc_size((sc->nlatches+1)*sizeof(struct sim_latch));
+	sc->latch_buffer = alloc_size((sc->nlatches+1)*sizeof(sim_word));
+	i = 0;
+	for(reg=c->registers;reg!=NULL;reg=rnext) {
+		rnext = reg->next;
+		for(j=0;j<reg->vectorsize;j++) {
+			sc->latches[i].clock = reg->clock;
+			sc->latches[i].state = reg->state[j];
+			sc->latches[i].next = reg->next_state[j];
+			i++;
+		}
+		free(reg->state);
+		free(reg->next_state);
+		free(reg);
+	}
+}
+
+void sim_compile(struct sim_sc *sc)
+{
+	struct compiler c;
+	struct llhdl_node *n;
+	struct sim_signal *s, **last;
+
+	c.sc = sc;
+	c.head = NULL;
+	c.tail = NULL;
+	c.registers = NULL;
+
+	sc->nslots = 2;
+	sc->ninsns = 0;
+	sc->nlatches = 0;
+	blast_module(sc->module, &ops, &c);
+	last = &sc->signals;
+	for(n=sc->module->head;n!=NULL;n=n->p.signal.next) {
+		s = alloc_type(struct sim_signal);
+		s->signal = n;
+		s->vectorsize = n->p.signal.vectorsize;
+		s->slots = n->user;
+		s->next = NULL;
+		*last = s;
+		last = &s->next;
+		n->user = NULL;
+	}
+
+	flatten(&c);
+}
@@ -0,0 +1,48 @@
+#ifndef __INTERNAL_H
+#define __INTERNAL_H
+
+#include <sim/sim.h>
+#include <sim/blast.h>
+
+/* Slots holding constant words */
+#define SIM_SLOT_ZERO	BLAST_ZERO
+#define SIM_SLOT_ONE	BLAST_ONE
+
+enum {
+	SIM_OP_NOT = BLAST_NOT,
+	SIM_OP_AND = BLAST_AND,
+	SIM_OP_OR = BLAST_OR,
+	SIM_OP_XOR = BLAST_XOR,
+	SIM_OP_MUX = BLAST_MUX	/* < dst = c ? b : a */
+};
+
+struct sim_insn {
+	int op;
+	int dst;
+	int a;
+	int b;
+	int c;
+};
+
+/* One bit of a register */
+struct sim_latch {
+	struct llhdl_node *clock;
+	int state;
+	int next;
+};
+
+struct sim_sc {
+	struct llhdl_module *module;
+	int nslots;
+	sim_word *values;
+	int ninsns;
+	struct sim_insn *insns;
+	int nlatches;
+	struct sim_latch *latches;
+	sim_word *latch_buffer;
+	struct sim_signal *signals;
+};
+
+void sim_compile(struct sim_sc *sc);
+
+#endif /* __INTERNAL_H */
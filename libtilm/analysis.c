@@ -0,0 +1,353 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/tools.h>
+
+#include <mapkit/mapkit.h>
+
+#include "variables.h"
+#include "truthtable.h"
+#include "analysis.h"
+
+/*
+ * The truth table of each output bit is computed in a single sweep
+ * over the cone of that bit, with all the minterms processed in parallel
+ * as the bits of the tables.
+ * The cone is first listed in pre-order, with the bit each node contributes,
+ * then evaluated in reverse order on a stack of tables, operands first.
+ */
+
+enum {
+	TT_ZERO,	/* < bit past the vector size of an unsigned node */
+	TT_CONSTANT,
+	TT_LEAF,
+	TT_LOGIC,
+	TT_MUX
+};
+
+struct tt_task {
+	int type;
+	struct llhdl_node *n;
+	int bit;
+};
+
+struct sweep {
+	struct tilm_variables *var;
+	int *position;		/* < input of each variable in the current truth tables, -1 if none */
+	struct tilm_tt_masks *masks;
+	int ntasks, tasks_size;
+	struct tt_task *tasks;	/* < cone of the current bit, in pre-order */
+	int npending, pending_size;
+	struct tt_task *pending;	/* < bits of nodes left to list */
+	int nvalues, values_size;
+	mpz_t *values;		/* < truth tables of the evaluated operands */
+};
+
+static void push_task(struct tt_task **tasks, int *count, int *size, int type, struct llhdl_node *n, int bit)
+{
+	if(*count == *size) {
+		*size = 2*(*size) + 16;
+		*tasks = realloc(*tasks, (*size)*sizeof(struct tt_task));
+		assert(*tasks != NULL);
+	}
+	(*tasks)[*count].type = type;
+	(*tasks)[*count].n = n;
+	(*tasks)[*count].bit = bit;
+	(*count)++;
+}
+
+static void add_task(struct sweep *s, int type, struct llhdl_node *n, int bit)
+{
+	push_task(&s->tasks, &s->ntasks, &s->tasks_size, type, n, bit);
+}
+
+static void add_pending(struct sweep *s, struct llhdl_node *n, int bit)
+{
+	push_task(&s->pending, &s->npending, &s->pending_size, TT_LEAF, n, bit);
+}
+
+static int mux_reachable(struct llhdl_node *n, int nselect)
+{
+	/* Select values past the last source give 0 */
+	if((nselect < 30) && (n->p.mux.nsources > (1 << nselect)))
+		return 1 << nselect;
+	return n->p.mux.nsources;
+}
+
+static int is_terminal(struct sweep *s, struct llhdl_node *n)
+{
+	return (n->type == LLHDL_NODE_CONSTANT) || (n->type == LLHDL_NODE_SIGNAL)
+		|| (tilm_find_leaf(s->var, n) != NULL);
+}
+
+static void list_cone(struct sweep *s, struct llhdl_node *n, int bit)
+{
+	struct mapkit_sc *mapkit = s->var->mapkit;
+	int vectorsize, nselect, nreachable;
+	int i, b, len;
+
+	s->ntasks = 0;
+	add_pending(s, n, bit);
+	while(s->npending > 0) {
+		s->npending--;
+		n = s->pending[s->npending].n;
+		bit = s->pending[s->npending].bit;
+		/* Bits past the vector size are extended according to the sign of the node, like the enumeration does */
+		if(bit > 0) {
+			vectorsize = mapkit_get_vectorsize(mapkit, n);
+			if(bit >= vectorsize) {
+				if(!mapkit_get_sign(mapkit, n)) {
+					add_task(s, TT_ZERO, n, bit);
+					continue;
+				}
+				bit = vectorsize - 1;
+			}
+		}
+		if(tilm_find_leaf(s->var, n) != NULL) {
+			/* Already mapped, or left to another partition */
+			add_task(s, TT_LEAF, n, bit);
+			continue;
+		}
+		switch(n->type) {
+			case LLHDL_NODE_CONSTANT:
+				add_task(s, TT_CONSTANT, n, bit);
+				break;
+			case LLHDL_NODE_LOGIC:
+				add_task(s, TT_LOGIC, n, bit);
+				if(n->p.logic.op == LLHDL_LOGIC_NOT)
+					add_pending(s, n->p.logic.operands[0], bit);
+				else if(is_terminal(s, n->p.logic.operands[0])) {
+					/* The operations are commutative: listing the simple operand
+					 * first evaluates the other one first, so that chains take
+					 * a constant number of tables on the stack.
+					 */
+					add_pending(s, n->p.logic.operands[1], bit);
+					add_pending(s, n->p.logic.operands[0], bit);
+				} else {
+					add_pending(s, n->p.logic.operands[0], bit);
+					add_pending(s, n->p.logic.operands[1], bit);
+				}
+				break;
+			case LLHDL_NODE_MUX:
+				add_task(s, TT_MUX, n, bit);
+				nselect = mapkit_get_vectorsize(mapkit, n->p.mux.select);
+				nreachable = mux_reachable(n, nselect);
+				for(i=nreachable-1;i>=0;i--)
+					add_pending(s, n->p.mux.sources[i], bit);
+				for(b=nselect-1;b>=0;b--)
+					add_pending(s, n->p.mux.select, b);
+				break;
+			case LLHDL_NODE_VECT:
+				for(i=0;i<n->p.vect.nslices;i++) {
+					len = n->p.vect.slices[i].end - n->p.vect.slices[i].start + 1;
+					if(bit < len) {
+						add_pending(s, n->p.vect.slices[i].source, n->p.vect.slices[i].start + bit);
+						break;
+					}
+					bit -= len;
+				}
+				assert(i < n->p.vect.nslices);
+				break;
+			default:
+				add_task(s, TT_LEAF, n, bit);
+				break;
+		}
+	}
+}
+
+static mpz_t *push_value(struct sweep *s)
+{
+	int i;
+
+	if(s->nvalues == s->values_size) {
+		s->values_size = 2*s->values_size + 16;
+		s->values = realloc(s->values, s->values_size*sizeof(mpz_t));
+		assert(s->values != NULL);
+		for(i=s->nvalues;i<s->values_size;i++)
+			mpz_init(s->values[i]);
+	}
+	return &s->values[s->nvalues++];
+}
+
+static void eval_leaf(struct sweep *s, mpz_t r, struct llhdl_node *n, int bit)
+{
+	struct tilm_leaf *l;
+	int index;
+
+	l = tilm_find_leaf(s->var, n);
+	index = l->index[bit];
+	assert(index != -1);
+	assert(s->position[index] != -1);
+	mpz_set(r, s->masks->positive[s->position[index]]);
+}
+
+/* The operands are on top of the stack, in any order as the operations are commutative */
+static void eval_logic(struct sweep *s, struct llhdl_node *n)
+{
+	mpz_t *a, *b;
+
+	a = &s->values[s->nvalues-1];
+	if(n->p.logic.op == LLHDL_LOGIC_NOT) {
+		mpz_xor(*a, *a, s->masks->ones);
+		return;
+	}
+	b = &s->values[s->nvalues-2];
+	switch(n->p.logic.op) {
+		case LLHDL_LOGIC_AND:
+			mpz_and(*b, *a, *b);
+			break;
+		case LLHDL_LOGIC_OR:
+			mpz_ior(*b, *a, *b);
+			break;
+		case LLHDL_LOGIC_XOR:
+			mpz_xor(*b, *a, *b);
+			break;
+		default:
+			assert(0);
+			break;
+	}
+	s->nvalues--;
+}
+
+/* The select bits are on top of the stack, bit 0 last, followed by the sources */
+static void eval_mux(struct sweep *s, struct llhdl_node *n)
+{
+	int nselect, nreachable;
+	int i, b;
+	mpz_t *select;
+	mpz_t *inverted;
+	mpz_t r, term;
+
+	nselect = mapkit_get_vectorsize(s->var->mapkit, n->p.mux.select);
+	nreachable = mux_reachable(n, nselect);
+	select = &s->values[s->nvalues-1];
+	inverted = alloc_size(nselect*sizeof(mpz_t));
+	for(b=0;b<nselect;b++) {
+		mpz_init(inverted[b]);
+		mpz_xor(inverted[b], select[-b], s->masks->ones);
+	}
+	mpz_init(r);
+	mpz_init(term);
+	for(i=0;i<nreachable;i++) {
+		mpz_set(term, select[-nselect-i]);
+		for(b=0;(b<nselect) && (mpz_sgn(term) != 0);b++)
+			mpz_and(term, term, (b < 30) && (i & (1 << b)) ? select[-b] : inverted[b]);
+		mpz_ior(r, r, term);
+	}
+	mpz_clear(term);
+	for(b=0;b<nselect;b++)
+		mpz_clear(inverted[b]);
+	free(inverted);
+	s->nvalues -= nselect + nreachable;
+	mpz_swap(*push_value(s), r);
+	mpz_clear(r);
+}
+
+static void tt_bit(struct sweep *s, mpz_t r, struct llhdl_node *n, int bit)
+{
+	struct tt_task *t;
+	int i;
+
+	list_cone(s, n, bit);
+	s->nvalues = 0;
+	for(i=s->ntasks-1;i>=0;i--) {
+		t = &s->tasks[i];
+		switch(t->type) {
+			case TT_ZERO:
+				mpz_set_ui(*push_value(s), 0);
+				break;
+			case TT_CONSTANT:
+				if(llhdl_get_constant_bit(t->n, t->bit))
+					mpz_set(*push_value(s), s->masks->ones);
+				else
+					mpz_set_ui(*push_value(s), 0);
+				break;
+			case TT_LEAF:
+				eval_leaf(s, *push_value(s), t->n, t->bit);
+				break;
+			case TT_LOGIC:
+				eval_logic(s, t->n);
+				break;
+			case TT_MUX:
+				eval_mux(s, t->n);
+				break;
+		}
+	}
+	assert(s->nvalues == 1);
+	mpz_set(r, s->values[0]);
+}
+
+struct tilm_analysis *tilm_analyze(struct tilm_tt_cache *tc, struct tilm_variables *var, struct llhdl_node *n)
+{
+	struct tilm_analysis *a;
+	struct tilm_function *f;
+	struct tilm_variable *v;
+	struct sweep s;
+	int i, j;
+
+	a = alloc_type(struct tilm_analysis);
+	a->vectorsize = var->vectorsize;
+	a->functions = alloc_size(a->vectorsize*sizeof(struct tilm_function));
+
+	s.var = var;
+	s.ntasks = 0;
+	s.tasks_size = 0;
+	s.tasks = NULL;
+	s.npending = 0;
+	s.pending_size = 0;
+	s.pending = NULL;
+	s.nvalues = 0;
+	s.values_size = 0;
+	s.values = NULL;
+	s.position = alloc_size((var->nvars+1)*sizeof(int));
+	for(i=0;i<var->nvars;i++)
+		s.position[i] = -1;
+
+	for(i=0;i<a->vectorsize;i++) {
+		f = &a->functions[i];
+		f->nvars = tilm_variables_remaining(var->heads[i]);
+		if(f->nvars > TILM_MAX_SUPPORT) {
+			fprintf(stderr, "Function of %d variables is too large for LUT mapping\n", f->nvars);
+			exit(EXIT_FAILURE);
+		}
+		f->vars = alloc_size((f->nvars+1)*sizeof(int));
+		j = f->nvars;
+		for(v=var->heads[i];v!=NULL;v=v->next)
+			f->vars[--j] = v->index;
+		mpz_init(f->tt);
+		if((var->observed != NULL) && !var->observed[i])
+			/* Not read, any value will do */
+			continue;
+		for(j=0;j<f->nvars;j++)
+			s.position[f->vars[j]] = j;
+		s.masks = tilm_tt_get_masks(tc, f->nvars);
+		tt_bit(&s, f->tt, n, i);
+		for(j=0;j<f->nvars;j++)
+			s.position[f->vars[j]] = -1;
+	}
+
+	for(i=0;i<s.values_size;i++)
+		mpz_clear(s.values[i]);
+	free(s.values);
+	free(s.pending);
+	free(s.tasks);
+	free(s.position);
+	return a;
+}
+
+void tilm_analysis_free(struct tilm_analysis *a)
+{
+	int i;
+
+	for(i=0;i<a->vectorsize;i++) {
+		mpz_clear(a->functions[i].tt);
+		free(a->functions[i].vars);
+	}
+	free(a->functions);
+	free(a);
+}
@@ -0,0 +1,31 @@
+#ifndef __ANALYSIS_H
+#define __ANALYSIS_H
+
+#include <gmp.h>
+
+#include <llhdl/structure.h>
+
+#include "variables.h"
+#include "truthtable.h"
+
+/*
+ * Function of an output bit.
+ * Variable j of the truth table is vars[j].
+ * The variables are ordered like the support list, with the head
+ * as the most significant variable.
+ */
+struct tilm_function {
+	int nvars;
+	int *vars;
+	mpz_t tt;
+};
+
+struct tilm_analysis {
+	int vectorsize;
+	struct tilm_function *functions;
+};
+
+struct tilm_analysis *tilm_analyze(struct tilm_tt_cache *tc, struct tilm_variables *var, struct llhdl_node *n);
+void tilm_analysis_free(struct tilm_analysis *a);
+
+#endif
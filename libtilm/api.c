@@ -8,6 +8,8 @@
 #include <tilm/tilm.h>
 
 #include "internal.h"
+#include "partition.h"
+#include "library.h"
 
 struct tilm_desc tilm_mappers[] = {
 	{
@@ -49,7 +51,11 @@ static void tilm_process_c(struct llhdl_node **n, void *user)
 
 static void tilm_free_c(void *user)
 {
-	free(user);
+	struct tilm_sc *sc = user;
+
+	tilm_library_free(sc->library);
+	tilm_free_observed(sc);
+	free(sc);
 }
 
 void tilm_register(struct mapkit_sc *mapkit,
@@ -75,6 +81,10 @@ void tilm_register(struct mapkit_sc *mapkit,
 	sc->create_lut_c = create_lut_c;
 	sc->create_mux_c = create_mux_c;
 	sc->user = user;
+	sc->library = tilm_library_new(max_inputs, create_mux_c != NULL);
+	sc->observed_mask = 0;
+	sc->nobserved = 0;
+	sc->observed = NULL;
 	
 	mapkit_register_process(mapkit, tilm_process_c, tilm_free_c, sc);
 }
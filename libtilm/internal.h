@@ -3,6 +3,9 @@
 
 #include <tilm/tilm.h>
 
+struct tilm_library;
+struct tilm_observed;
+
 struct tilm_sc {
 	struct mapkit_sc *mapkit;
 	int mapper_id;
@@ -13,6 +16,10 @@ struct tilm_sc {
 	tilm_create_lut_c create_lut_c;
 	tilm_create_mux_c create_mux_c;
 	void *user;
+	struct tilm_library *library;	/* < plans of the functions that need several LUTs */
+	unsigned int observed_mask;
+	int nobserved;
+	struct tilm_observed *observed;	/* < bits of partition inputs read by their parent */
 };
 
 #define TILM_CALL_CREATE_NET(_sc)			((_sc)->create_net_c((_sc)->user))
@@ -0,0 +1,416 @@
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include <util.h>
+
+#include "npn.h"
+#include "library.h"
+
+struct tilm_library *tilm_library_new(int max_inputs, int dedicated_muxes)
+{
+	struct tilm_library *l;
+
+	l = alloc_type(struct tilm_library);
+	l->max_inputs = max_inputs;
+	l->dedicated_muxes = dedicated_muxes;
+	l->mask = 63;
+	l->nplans = 0;
+	l->table = alloc_size0((l->mask+1)*sizeof(struct tilm_plan *));
+	return l;
+}
+
+/*
+ * Plans are searched in the space of 6 variables, where subfunctions
+ * keep the numbering of the variables of the function.
+ */
+
+struct subfunction {
+	uint64_t tt;
+	int cost;		/* < number of LUTs */
+	int depth;		/* < number of dedicated muxes after the LUTs */
+	int split;
+	int complemented;	/* < the cofactors on <split> are complements */
+	int mux;		/* < the cofactors are combined with a dedicated mux */
+	int ref;		/* < reference once emitted, -1 before */
+};
+
+struct search {
+	int max_inputs;
+	int dedicated_muxes;
+	unsigned int mask;
+	int nsubfunctions;
+	struct subfunction *table;
+	int nelements;
+	struct tilm_plan_element *elements;
+};
+
+static unsigned int word_hash(uint64_t tt)
+{
+	return ((unsigned int)(tt ^ (tt >> 32)))*2654435761U;
+}
+
+static struct subfunction *lookup(struct search *s, uint64_t tt);
+
+static void grow(struct search *s)
+{
+	struct subfunction *old;
+	struct subfunction *sf;
+	unsigned int i, oldmask;
+
+	old = s->table;
+	oldmask = s->mask;
+	s->mask = 2*s->mask + 1;
+	s->table = alloc_size((s->mask+1)*sizeof(struct subfunction));
+	for(i=0;i<=s->mask;i++)
+		s->table[i].cost = -1;
+	s->nsubfunctions = 0;
+	for(i=0;i<=oldmask;i++) {
+		if(old[i].cost != -1) {
+			sf = lookup(s, old[i].tt);
+			*sf = old[i];
+		}
+	}
+	free(old);
+}
+
+/* Returns the slot of <tt>, with a cost of -1 if it is new */
+static struct subfunction *lookup(struct search *s, uint64_t tt)
+{
+	unsigned int h;
+
+	if(2*s->nsubfunctions > s->mask)
+		grow(s);
+	h = word_hash(tt) & s->mask;
+	while((s->table[h].cost != -1) && (s->table[h].tt != tt))
+		h = (h + 1) & s->mask;
+	if(s->table[h].cost == -1) {
+		s->table[h].tt = tt;
+		s->nsubfunctions++;
+	}
+	return &s->table[h];
+}
+
+static int support(uint64_t tt)
+{
+	int i, r;
+
+	r = 0;
+	for(i=0;i<TILM_NPN_MAX_INPUTS;i++)
+		if(((tt >> (1 << i)) ^ tt) & ~tilm_word_positive[i])
+			r |= 1 << i;
+	return r;
+}
+
+static uint64_t cofactor(uint64_t tt, int var, int value)
+{
+	int shift;
+
+	shift = 1 << var;
+	if(value) {
+		tt &= tilm_word_positive[var];
+		return tt | (tt >> shift);
+	} else {
+		tt &= ~tilm_word_positive[var];
+		return tt | (tt << shift);
+	}
+}
+
+/*
+ * Number of LUTs of the best decomposition of <tt>.
+ * Cofactors that are LUTs or muxes of the same level can be combined
+ * with a dedicated mux instead of a LUT.
+ */
+static int cost(struct search *s, uint64_t tt)
+{
+	struct subfunction *sf;
+	int supp, k;
+	int i, c, c0, c1, d, d0, d1;
+	int best, best_depth, split, complemented, mux;
+	uint64_t f0, f1;
+
+	sf = lookup(s, tt);
+	if(sf->cost != -1)
+		return sf->cost;
+	supp = support(tt);
+	k = __builtin_popcount(supp);
+	best_depth = 0;
+	split = -1;
+	complemented = 0;
+	mux = 0;
+	if(k == 0)
+		best = 0;
+	else if(k == 1)
+		/* Identity or inverter */
+		best = tt == tilm_word_positive[__builtin_ctz(supp)] ? 0 : 1;
+	else if(k <= s->max_inputs)
+		best = 1;
+	else {
+		best = -1;
+		for(i=TILM_NPN_MAX_INPUTS-1;i>=0;i--) {
+			if(!(supp & (1 << i)))
+				continue;
+			f0 = cofactor(tt, i, 0);
+			f1 = cofactor(tt, i, 1);
+			if(f0 == ~f1) {
+				c = cost(s, f0) + 1;
+				d = 0;
+			} else {
+				c0 = cost(s, f0);
+				c1 = cost(s, f1);
+				d0 = lookup(s, f0)->depth;
+				d1 = lookup(s, f1)->depth;
+				if(s->dedicated_muxes && (c0 > 0) && (c1 > 0) && (d0 == d1) && (d0 < TILM_PLAN_MUX_LEVELS)) {
+					c = c0 + c1;
+					d = d0 + 1;
+				} else {
+					c = c0 + c1 + 1;
+					d = 0;
+				}
+			}
+			if((best == -1) || (c < best) || ((c == best) && (d < best_depth))) {
+				best = c;
+				best_depth = d;
+				split = i;
+				complemented = f0 == ~f1;
+				mux = d > 0;
+			}
+		}
+	}
+	/* The recursion may have moved the slot */
+	sf = lookup(s, tt);
+	sf->cost = best;
+	sf->depth = best_depth;
+	sf->split = split;
+	sf->complemented = complemented;
+	sf->mux = mux;
+	sf->ref = -1;
+	return best;
+}
+
+static int add_element(struct search *s, int type, int ninputs, int *inputs, uint64_t init)
+{
+	struct tilm_plan_element *e;
+	int i;
+
+	s->elements = realloc(s->elements, (s->nelements+1)*sizeof(struct tilm_plan_element));
+	if(s->elements == NULL) abort();
+	e = &s->elements[s->nelements];
+	e->type = type;
+	e->ninputs = ninputs;
+	for(i=0;i<ninputs;i++)
+		e->inputs[i] = inputs[i];
+	e->init = init;
+	return TILM_PLAN_ELEMENT + s->nelements++;
+}
+
+/* LUT over the support of <tt> */
+static int emit_lut(struct search *s, uint64_t tt, int supp)
+{
+	int inputs[TILM_NPN_MAX_INPUTS];
+	int ninputs;
+	int i, m, x;
+	uint64_t init;
+
+	ninputs = 0;
+	for(i=0;i<TILM_NPN_MAX_INPUTS;i++)
+		if(supp & (1 << i))
+			inputs[ninputs++] = i;
+	init = 0;
+	for(m=0;m<(1 << ninputs);m++) {
+		x = 0;
+		for(i=0;i<ninputs;i++)
+			if(m & (1 << i))
+				x |= 1 << inputs[i];
+		if((tt >> x) & 1)
+			init |= 1ULL << m;
+	}
+	return add_element(s, TILM_PLAN_LUT, ninputs, inputs, init);
+}
+
+/* Mux or XOR of the cofactors, constant cofactors are folded into the LUT */
+static int emit_combine(struct search *s, int split, int complemented, int ref0, int ref1)
+{
+	int inputs[3];
+	int value[3];
+	int pin0, pin1;
+	int ninputs;
+	int m, sel, v0, v1, out;
+	uint64_t init;
+
+	ninputs = 0;
+	inputs[ninputs++] = split;
+	pin0 = pin1 = -1;
+	if(ref0 >= TILM_PLAN_ELEMENT || ref0 < TILM_NPN_MAX_INPUTS) {
+		pin0 = ninputs;
+		inputs[ninputs++] = ref0;
+	}
+	if(!complemented && (ref1 >= TILM_PLAN_ELEMENT || ref1 < TILM_NPN_MAX_INPUTS)) {
+		pin1 = ninputs;
+		inputs[ninputs++] = ref1;
+	}
+	init = 0;
+	for(m=0;m<(1 << ninputs);m++) {
+		for(sel=0;sel<ninputs;sel++)
+			value[sel] = (m >> sel) & 1;
+		sel = value[0];
+		v0 = pin0 != -1 ? value[pin0] : ref0 == TILM_PLAN_CONST1;
+		v1 = pin1 != -1 ? value[pin1] : ref1 == TILM_PLAN_CONST1;
+		if(complemented)
+			out = sel ^ v0;
+		else
+			out = sel ? v1 : v0;
+		if(out)
+			init |= 1ULL << m;
+	}
+	return add_element(s, TILM_PLAN_LUT, ninputs, inputs, init);
+}
+
+static int emit(struct search *s, uint64_t tt)
+{
+	struct subfunction *sf;
+	int supp, k;
+	int split, complemented, mux;
+	int first0, first1;
+	int inputs[3];
+	int ref0, ref1, ref;
+
+	sf = lookup(s, tt);
+	assert(sf->cost != -1);
+	if(sf->ref != -1)
+		return sf->ref;
+	supp = support(tt);
+	k = __builtin_popcount(supp);
+	split = sf->split;
+	complemented = sf->complemented;
+	mux = sf->mux;
+	if(k == 0)
+		ref = tt == 0 ? TILM_PLAN_CONST0 : TILM_PLAN_CONST1;
+	else if((k == 1) && (tt == tilm_word_positive[__builtin_ctz(supp)]))
+		ref = __builtin_ctz(supp);
+	else if(k <= s->max_inputs)
+		ref = emit_lut(s, tt, supp);
+	else if(complemented) {
+		ref0 = emit(s, cofactor(tt, split, 0));
+		ref = emit_combine(s, split, 1, ref0, -1);
+	} else {
+		/* Dedicated muxes need cofactors that feed nothing else */
+		first0 = TILM_PLAN_ELEMENT + s->nelements;
+		ref0 = emit(s, cofactor(tt, split, 0));
+		if(mux && (ref0 >= first0))
+			lookup(s, cofactor(tt, split, 0))->ref = -1;
+		first1 = TILM_PLAN_ELEMENT + s->nelements;
+		ref1 = emit(s, cofactor(tt, split, 1));
+		if(mux && (ref0 >= first0) && (ref1 >= first1)) {
+			lookup(s, cofactor(tt, split, 1))->ref = -1;
+			inputs[0] = split;
+			inputs[1] = ref0;
+			inputs[2] = ref1;
+			ref = add_element(s, TILM_PLAN_MUX, 3, inputs, 0);
+		} else
+			ref = emit_combine(s, split, 0, ref0, ref1);
+	}
+	sf = lookup(s, tt);
+	sf->ref = ref;
+	return ref;
+}
+
+static struct tilm_plan *create_plan(struct tilm_library *l, uint64_t tt, int nvars)
+{
+	struct tilm_plan *p;
+	struct search s;
+	uint64_t full;
+	unsigned int i;
+	int v;
+
+	/* Replicate the table over the unused variables */
+	full = tt;
+	for(v=nvars;v<TILM_NPN_MAX_INPUTS;v++)
+		full |= full << (1 << v);
+
+	s.max_inputs = l->max_inputs;
+	s.dedicated_muxes = l->dedicated_muxes;
+	s.mask = 255;
+	s.nsubfunctions = 0;
+	s.table = alloc_size((s.mask+1)*sizeof(struct subfunction));
+	for(i=0;i<=s.mask;i++)
+		s.table[i].cost = -1;
+	s.nelements = 0;
+	s.elements = NULL;
+	cost(&s, full);
+	emit(&s, full);
+	free(s.table);
+	assert(s.nelements > 0);
+
+	p = alloc_type(struct tilm_plan);
+	p->nvars = nvars;
+	p->tt = tt;
+	p->nelements = s.nelements;
+	p->elements = s.elements;
+	return p;
+}
+
+static unsigned int plan_hash(uint64_t tt, int nvars)
+{
+	return word_hash(tt ^ nvars);
+}
+
+static void library_grow(struct tilm_library *l)
+{
+	struct tilm_plan **table;
+	struct tilm_plan *p, *next;
+	unsigned int mask, h, i;
+
+	mask = 2*l->mask + 1;
+	table = alloc_size0((mask+1)*sizeof(struct tilm_plan *));
+	for(i=0;i<=l->mask;i++) {
+		for(p=l->table[i];p!=NULL;p=next) {
+			next = p->next;
+			h = plan_hash(p->tt, p->nvars) & mask;
+			p->next = table[h];
+			table[h] = p;
+		}
+	}
+	free(l->table);
+	l->table = table;
+	l->mask = mask;
+}
+
+/* <tt> must be canonical, and not fit in a single LUT */
+struct tilm_plan *tilm_library_get(struct tilm_library *l, uint64_t tt, int nvars)
+{
+	struct tilm_plan *p;
+	unsigned int h;
+
+	assert(nvars > l->max_inputs);
+	assert(nvars <= TILM_NPN_MAX_INPUTS);
+	h = plan_hash(tt, nvars) & l->mask;
+	for(p=l->table[h];p!=NULL;p=p->next)
+		if((p->tt == tt) && (p->nvars == nvars))
+			return p;
+	if(l->nplans > l->mask) {
+		library_grow(l);
+		h = plan_hash(tt, nvars) & l->mask;
+	}
+	p = create_plan(l, tt, nvars);
+	p->next = l->table[h];
+	l->table[h] = p;
+	l->nplans++;
+	return p;
+}
+
+void tilm_library_free(struct tilm_library *l)
+{
+	struct tilm_plan *p, *next;
+	unsigned int i;
+
+	for(i=0;i<=l->mask;i++) {
+		for(p=l->table[i];p!=NULL;p=next) {
+			next = p->next;
+			free(p->elements);
+			free(p);
+		}
+	}
+	free(l->table);
+	free(l);
+}
@@ -0,0 +1,56 @@
+#ifndef __LIBRARY_H
+#define __LIBRARY_H
+
+#include <stdint.h>
+
+#include "npn.h"
+
+/* References to the inputs of a plan element */
+enum {
+	TILM_PLAN_CONST0 = TILM_NPN_MAX_INPUTS,
+	TILM_PLAN_CONST1,
+	TILM_PLAN_ELEMENT	/* < then the index of an earlier element */
+};
+
+/* Dedicated muxes are assumed to be available for that many levels */
+#define TILM_PLAN_MUX_LEVELS 2
+
+enum {
+	TILM_PLAN_LUT,
+	TILM_PLAN_MUX		/* < inputs are the select variable, then the elements for 0 and 1 */
+};
+
+/* Inputs below TILM_NPN_MAX_INPUTS are variables */
+struct tilm_plan_element {
+	int type;
+	int ninputs;
+	int inputs[TILM_NPN_MAX_INPUTS];
+	uint64_t init;
+};
+
+/* Implementation of a canonical function, the output is that of the last element */
+struct tilm_plan {
+	int nvars;
+	uint64_t tt;
+	int nelements;
+	struct tilm_plan_element *elements;
+	struct tilm_plan *next;
+};
+
+/*
+ * Plans are built the first time a function class is met,
+ * by choosing the decomposition with the fewest LUTs.
+ */
+struct tilm_library {
+	int max_inputs;
+	int dedicated_muxes;
+	unsigned int mask;
+	int nplans;
+	struct tilm_plan **table;
+};
+
+struct tilm_library *tilm_library_new(int max_inputs, int dedicated_muxes);
+struct tilm_plan *tilm_library_get(struct tilm_library *l, uint64_t tt, int nvars);
+void tilm_library_free(struct tilm_library *l);
+
+#endif /* __LIBRARY_H */
@@ -0,0 +1,87 @@
+#include <stdint.h>
+
+#include "npn.h"
+
+const uint64_t tilm_word_positive[TILM_NPN_MAX_INPUTS] = {
+	0xaaaaaaaaaaaaaaaaULL,
+	0xccccccccccccccccULL,
+	0xf0f0f0f0f0f0f0f0ULL,
+	0xff00ff00ff00ff00ULL,
+	0xffff0000ffff0000ULL,
+	0xffffffff00000000ULL
+};
+
+uint64_t tilm_word_ones(int nvars)
+{
+	if(nvars == TILM_NPN_MAX_INPUTS)
+		return ~0ULL;
+	return (1ULL << (1 << nvars)) - 1;
+}
+
+uint64_t tilm_word_flip(uint64_t tt, int var)
+{
+	int shift;
+
+	shift = 1 << var;
+	return ((tt & tilm_word_positive[var]) >> shift)
+		| ((tt & ~tilm_word_positive[var]) << shift);
+}
+
+uint64_t tilm_word_swap(uint64_t tt, int var)
+{
+	uint64_t t;
+	int shift;
+
+	shift = 1 << var;
+	t = ((tt >> shift) ^ tt) & tilm_word_positive[var] & ~tilm_word_positive[var+1];
+	return tt ^ t ^ (t << shift);
+}
+
+static int ones(uint64_t x)
+{
+	return __builtin_popcountll(x);
+}
+
+/*
+ * The output is complemented so that at most half the minterms are 1,
+ * each input so that its positive cofactor has at least as many 1s as
+ * its negative cofactor, and the inputs are sorted by positive cofactor
+ * weight.
+ */
+uint64_t tilm_npn_canonicalize(uint64_t tt, int nvars, struct tilm_npn_transform *t)
+{
+	uint64_t all;
+	int weight[TILM_NPN_MAX_INPUTS];
+	int i, j, sorted, x;
+
+	all = tilm_word_ones(nvars);
+	t->output_negated = 0;
+	if(2*ones(tt) > (1 << nvars)) {
+		tt ^= all;
+		t->output_negated = 1;
+	}
+	for(i=0;i<nvars;i++) {
+		t->perm[i] = i;
+		t->negated[i] = 0;
+		weight[i] = ones(tt & tilm_word_positive[i]);
+		if(2*weight[i] < ones(tt)) {
+			tt = tilm_word_flip(tt, i) & all;
+			t->negated[i] = 1;
+			weight[i] = ones(tt) - weight[i];
+		}
+	}
+	/* Bubble sort with adjacent swaps */
+	do {
+		sorted = 1;
+		for(j=0;j<nvars-1;j++) {
+			if(weight[j] > weight[j+1]) {
+				tt = tilm_word_swap(tt, j);
+				x = weight[j]; weight[j] = weight[j+1]; weight[j+1] = x;
+				x = t->perm[j]; t->perm[j] = t->perm[j+1]; t->perm[j+1] = x;
+				x = t->negated[j]; t->negated[j] = t->negated[j+1]; t->negated[j+1] = x;
+				sorted = 0;
+			}
+		}
+	} while(!sorted);
+	return tt;
+}
@@ -0,0 +1,36 @@
+#ifndef __NPN_H
+#define __NPN_H
+
+#include <stdint.h>
+
+/*
+ * Functions of up to 6 variables fit in a 64-bit truth table,
+ * bit m being the value when variable i takes the value of bit i of m.
+ */
+#define TILM_NPN_MAX_INPUTS 6
+
+extern const uint64_t tilm_word_positive[TILM_NPN_MAX_INPUTS];
+
+uint64_t tilm_word_ones(int nvars);
+/* Function with variable <var> complemented */
+uint64_t tilm_word_flip(uint64_t tt, int var);
+/* Function with variables <var> and <var>+1 exchanged */
+uint64_t tilm_word_swap(uint64_t tt, int var);
+
+/*
+ * The original function f and the canonical function g are related by
+ * f(x) = g(y) ^ output_negated, with y[j] = x[perm[j]] ^ negated[j].
+ */
+struct tilm_npn_transform {
+	int perm[TILM_NPN_MAX_INPUTS];
+	int negated[TILM_NPN_MAX_INPUTS];
+	int output_negated;
+};
+
+/*
+ * Semi-canonical form: most functions of an NPN class have the same form,
+ * the rest are spread over a few representatives.
+ */
+uint64_t tilm_npn_canonicalize(uint64_t tt, int nvars, struct tilm_npn_transform *t);
+
+#endif /* __NPN_H */
@@ -23,12 +23,12 @@ struct part_node_list {
 	int nnodes;
 	int nbits;
 	struct part_node *head;
+	struct part_node *tail;
 };
 
-static void part_node_list_add(struct part_node_list *nl, struct llhdl_node **n)
+static void part_node_list_add(struct tilm_sc *sc, struct part_node_list *nl, struct llhdl_node **n)
 {
 	struct part_node *new;
-	struct part_node *last;
 	
 	new = alloc_type(struct part_node);
 	new->n = n;
@@ -36,15 +36,12 @@ static void part_node_list_add(struct part_node_list *nl, struct llhdl_node **n)
 	
 	if(nl->head == NULL)
 		nl->head = new;
-	else {
-		last = nl->head;
-		while(last->next != NULL)
-			last = last->next;
-		last->next = new;
-	}
+	else
+		nl->tail->next = new;
+	nl->tail = new;
 	
 	nl->nnodes++;
-	nl->nbits += llhdl_get_vectorsize(*n);
+	nl->nbits += mapkit_get_vectorsize(sc->mapkit, *n);
 }
 
 static void part_node_list_free(struct part_node_list *nl)
@@ -59,41 +56,104 @@ static void part_node_list_free(struct part_node_list *nl)
 	}
 }
 
-static void find_partition_boundary(struct part_node_list *nl, struct llhdl_node **n)
+/* Makes room for the value of <level> in a table indexed by traversal level */
+static int *level_table(int *table, int *size, int level)
 {
-	int i, arity;
+	if(level < *size)
+		return table;
+	*size = 2*level + 16;
+	table = realloc(table, *size*sizeof(int));
+	assert(table != NULL);
+	return table;
+}
 
-	if((*n)->user != NULL) {
-		/* Already mapped */
-		part_node_list_add(nl, n);
-		return;
+/* Logic and mux nodes at <depth> 0 are left to other partitions */
+static void find_partition_boundary(struct tilm_sc *sc, struct part_node_list *nl, struct llhdl_node **n, int depth)
+{
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
+	int *depths;	/* < depth of the operands of the node at each level */
+	int size, level, d;
+
+	depths = NULL;
+	size = 0;
+	llhdl_traversal_init(&t, LLHDL_ORDER_PRE, 0);
+	llhdl_traversal_push(&t, n);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		level = llhdl_traversal_level(&t);
+		d = level == 0 ? depth : depths[level-1];
+		depths = level_table(depths, &size, level);
+		if((*slot)->user != NULL) {
+			/* Already mapped */
+			part_node_list_add(sc, nl, slot);
+			llhdl_traversal_skip(&t);
+			continue;
+		}
+		switch((*slot)->type) {
+			case LLHDL_NODE_CONSTANT:
+				/* nothing to do */
+				break;
+			case LLHDL_NODE_LOGIC:
+			case LLHDL_NODE_MUX:
+				if(d == 0) {
+					part_node_list_add(sc, nl, slot);
+					llhdl_traversal_skip(&t);
+				} else
+					depths[level] = d-1;
+				break;
+			case LLHDL_NODE_VECT:
+				depths[level] = d;
+				break;
+			default:
+				part_node_list_add(sc, nl, slot);
+				llhdl_traversal_skip(&t);
+				break;
+		}
 	}
+	llhdl_traversal_free(&t);
+	free(depths);
+}
+
+int tilm_partition_depth(struct llhdl_node *n)
+{
+	struct llhdl_traversal t;
+	struct llhdl_node **slot;
+	int *depths;	/* < logic and mux nodes from the root down to the node at each level */
+	int size, level, d, r;
 
-	switch((*n)->type) {
-		case LLHDL_NODE_CONSTANT:
-			/* nothing to do */
-			break;
-		case LLHDL_NODE_LOGIC:
-			arity = llhdl_get_logic_arity((*n)->p.logic.op);
-			for(i=0;i<arity;i++)
-				find_partition_boundary(nl, &(*n)->p.logic.operands[i]);
-			break;
-		case LLHDL_NODE_MUX:
-			find_partition_boundary(nl, &(*n)->p.mux.select);
-			for(i=0;i<(*n)->p.mux.nsources;i++)
-				find_partition_boundary(nl, &(*n)->p.mux.sources[i]);
-			break;
-		case LLHDL_NODE_VECT:
-			for(i=0;i<(*n)->p.vect.nslices;i++)
-				find_partition_boundary(nl, &(*n)->p.vect.slices[i].source);
-			break;
-		default:
-			part_node_list_add(nl, n);
-			break;
+	depths = NULL;
+	size = 0;
+	r = 0;
+	llhdl_traversal_init(&t, LLHDL_ORDER_PRE, 0);
+	llhdl_traversal_push(&t, &n);
+	while((slot = llhdl_traversal_next(&t)) != NULL) {
+		level = llhdl_traversal_level(&t);
+		d = level == 0 ? 0 : depths[level-1];
+		depths = level_table(depths, &size, level);
+		if((*slot)->user != NULL) {
+			llhdl_traversal_skip(&t);
+			continue;
+		}
+		switch((*slot)->type) {
+			case LLHDL_NODE_LOGIC:
+			case LLHDL_NODE_MUX:
+				depths[level] = d+1;
+				if(d+1 > r) r = d+1;
+				break;
+			case LLHDL_NODE_VECT:
+				depths[level] = d;
+				break;
+			default:
+				llhdl_traversal_skip(&t);
+				break;
+		}
 	}
+	llhdl_traversal_free(&t);
+	free(depths);
+	return r;
 }
 
-struct mapkit_result *tilm_try_partition(struct tilm_sc *sc, struct llhdl_node **n)
+struct mapkit_result *tilm_try_partition(struct tilm_sc *sc, struct llhdl_node **n, int depth)
 {
 	struct part_node_list nl;
 	int noutputs;
@@ -110,12 +170,14 @@ struct mapkit_result *tilm_try_partition(struct tilm_sc *sc, struct llhdl_node *
 	   ((*n)->type != LLHDL_NODE_VECT))
 	   	return NULL;
 
+	assert(depth != 0);
 	/* OK - we map the current node. Find the boundaries of the partition. */
 	nl.nnodes = 0;
 	nl.nbits = 0;
 	nl.head = NULL;
-	find_partition_boundary(&nl, n);
-	noutputs = llhdl_get_vectorsize(*n);
+	nl.tail = NULL;
+	find_partition_boundary(sc, &nl, n, depth);
+	noutputs = mapkit_get_vectorsize(sc->mapkit, *n);
 	
 	/* Generate the Mapkit result structure */
 	r = mapkit_create_result(nl.nnodes, nl.nbits, noutputs);
@@ -126,11 +188,78 @@ struct mapkit_result *tilm_try_partition(struct tilm_sc *sc, struct llhdl_node *
 		pn = pn->next;
 		i++;
 	}
-	for(i=0;i<nl.nbits;i++)
-		r->input_nets[i] = TILM_CALL_CREATE_NET(sc);
 	
 	/* Clean up */
 	part_node_list_free(&nl);
 	
 	return r;
 }
+
+struct tilm_observed {
+	struct llhdl_node *n;
+	char *bits;
+};
+
+static unsigned int observed_slot(struct tilm_sc *sc, struct llhdl_node *n)
+{
+	unsigned int h;
+
+	h = (((unsigned long)n) >> 4)*2654435761U;
+	h &= sc->observed_mask;
+	while((sc->observed[h].n != NULL) && (sc->observed[h].n != n))
+		h = (h + 1) & sc->observed_mask;
+	return h;
+}
+
+static void observed_grow(struct tilm_sc *sc)
+{
+	struct tilm_observed *old;
+	unsigned int oldmask, i, h;
+
+	old = sc->observed;
+	oldmask = sc->observed_mask;
+	sc->observed_mask = old == NULL ? 63 : 2*oldmask + 1;
+	sc->observed = alloc_size0((sc->observed_mask+1)*sizeof(struct tilm_observed));
+	if(old != NULL) {
+		for(i=0;i<=oldmask;i++) {
+			if(old[i].n != NULL) {
+				h = observed_slot(sc, old[i].n);
+				sc->observed[h] = old[i];
+			}
+		}
+		free(old);
+	}
+}
+
+void tilm_set_observed(struct tilm_sc *sc, struct llhdl_node *n, char *bits)
+{
+	unsigned int h;
+
+	if((sc->observed == NULL) || (2*sc->nobserved > sc->observed_mask))
+		observed_grow(sc);
+	h = observed_slot(sc, n);
+	if(sc->observed[h].n == NULL)
+		sc->nobserved++;
+	else
+		free(sc->observed[h].bits);
+	sc->observed[h].n = n;
+	sc->observed[h].bits = bits;
+}
+
+char *tilm_get_observed(struct tilm_sc *sc, struct llhdl_node *n)
+{
+	if(sc->observed == NULL)
+		return NULL;
+	return sc->observed[observed_slot(sc, n)].bits;
+}
+
+void tilm_free_observed(struct tilm_sc *sc)
+{
+	unsigned int i;
+
+	if(sc->observed == NULL)
+		return;
+	for(i=0;i<=sc->observed_mask;i++)
+		free(sc->observed[i].bits);
+	free(sc->observed);
+}
@@ -11,9 +11,22 @@
  * Otherwise, the returned mapkit_result has the following filed in:
  *   <ninput_nodes> is number of nodes at the partition boundary
  *   <input_nodes> point to the nodes at the partition boundary
- *   <input_nets> contains empty nets
- *   <output_nets> is a table of NULL
+ *   <input_nets> and <output_nets> are tables of NULL
+ * Logic and mux nodes <depth> levels below the root become inputs of the
+ * partition, and are left to other partitions (-1 for no limit, 0 is invalid).
  */
-struct mapkit_result *tilm_try_partition(struct tilm_sc *sc, struct llhdl_node **n);
+struct mapkit_result *tilm_try_partition(struct tilm_sc *sc, struct llhdl_node **n, int depth);
+/* Levels of logic and mux nodes in the partition without limit */
+int tilm_partition_depth(struct llhdl_node *n);
+
+/*
+ * A partition whose root is an input of another partition only needs
+ * the bits that the parent reads. <bits> has one flag per bit of <n>,
+ * and belongs to the table once set.
+ * tilm_get_observed returns NULL if all the bits are read.
+ */
+void tilm_set_observed(struct tilm_sc *sc, struct llhdl_node *n, char *bits);
+char *tilm_get_observed(struct tilm_sc *sc, struct llhdl_node *n);
+void tilm_free_observed(struct tilm_sc *sc);
 
 #endif /* __PARTITION_H */
@@ -1,6 +1,6 @@
 #include <assert.h>
 #include <stdlib.h>
-#include <limits.h>
+#include <string.h>
 #include <gmp.h>
 
 #include <util.h>
@@ -12,231 +12,176 @@
 
 #include "partition.h"
 #include "variables.h"
+#include "truthtable.h"
+#include "npn.h"
+#include "library.h"
+#include "analysis.h"
 #include "internal.h"
 
-struct llhdl_node *get_node_value(struct tilm_variables *var, int obit, struct llhdl_node *n)
+/*
+ * Subfunctions that have already been mapped, with their support.
+ * Tables are stored with bit 0 cleared, so that complemented
+ * functions share an entry.
+ */
+struct memo_entry {
+	int nvars;
+	int *vars;
+	mpz_t tt;
+	int inverted;		/* < the net implements the complement of <tt> */
+	void *net;
+	struct memo_entry *next;
+};
+
+struct map_level_param {
+	struct tilm_sc *sc;
+	struct mapkit_result *r;
+	struct tilm_variables *var;
+	struct tilm_tt_cache tc;
+	unsigned int mask;
+	int nentries;
+	struct memo_entry **memo;
+};
+
+/* Levels of the returned nets, that tell if they can feed a dedicated mux */
+enum {
+	LEVEL_SHARED = -1,	/* < constant, input or already used net */
+	LEVEL_LUT = 0		/* < then the number of dedicated muxes after the LUT */
+};
+
+static unsigned int memo_hash(int nvars, int *vars, mpz_t canonical)
 {
-	int vectorsize;
-	int sign;
-	int i;
-	mpz_t v;
-	struct llhdl_node *on;
-	
-	vectorsize = llhdl_get_vectorsize(n);
-	sign = llhdl_get_sign(n);
-	mpz_init2(v, vectorsize);
-	for(i=0;i<vectorsize;i++) {
-		if(tilm_variable_value(var, obit, n, i))
-			mpz_setbit(v, i);
+	unsigned int h;
+	size_t i, n;
+	mp_limb_t l;
+	int j;
+
+	h = nvars;
+	for(j=0;j<nvars;j++)
+		h = h*31 + vars[j];
+	n = mpz_size(canonical);
+	for(i=0;i<n;i++) {
+		l = mpz_getlimbn(canonical, i);
+		h = h*31 + (unsigned int)(l ^ (l >> 32));
 	}
-	on = llhdl_create_constant(v, sign, vectorsize);
-	mpz_clear(v);
-	return on;
+	return h*2654435761U;
 }
 
-static void compose_from_slices(mpz_t v, struct llhdl_slice *slices, struct llhdl_node **values, int n)
+/* Returns the entry with the same support and function or complement */
+static struct memo_entry *memo_find(struct map_level_param *mlp, int nvars, int *vars, mpz_t canonical)
 {
-	int i, j;
-	int bitindex;
-	
-	bitindex = 0;
-	for(i=0;i<n;i++) {
-		for(j=slices[i].start;j<=slices[i].end;j++) {
-			if(mpz_tstbit(values[i]->p.constant.value, j))
-				mpz_setbit(v, bitindex);
-			bitindex++;
-		}
+	struct memo_entry *e;
+
+	e = mlp->memo[memo_hash(nvars, vars, canonical) & mlp->mask];
+	while(e != NULL) {
+		if((e->nvars == nvars)
+		  && (memcmp(e->vars, vars, nvars*sizeof(int)) == 0)
+		  && (mpz_cmp(e->tt, canonical) == 0))
+			return e;
+		e = e->next;
 	}
+	return NULL;
 }
 
-static struct llhdl_node *eval(struct tilm_variables *var, int obit, struct llhdl_node *n)
+static void memo_grow(struct map_level_param *mlp)
 {
-	mpz_t v;
-	int i, arity;
-	struct llhdl_node *value;
-	struct llhdl_node **values;
-	struct llhdl_node *r; /* returned constant */
+	struct memo_entry **table;
+	struct memo_entry *e, *next;
+	unsigned int mask, h;
+	unsigned int i;
 
-	r = NULL;
-	switch(n->type) {
-		case LLHDL_NODE_CONSTANT:
-			r = llhdl_create_constant(n->p.constant.value, n->p.constant.sign, n->p.constant.vectorsize);
-			break;
-		case LLHDL_NODE_VECT:
-			values = alloc_size(n->p.vect.nslices*sizeof(struct llhdl_node *));
-			for(i=0;i<n->p.vect.nslices;i++)
-				values[i] = eval(var, obit, n->p.vect.slices[i].source);
-			mpz_init(v);
-			compose_from_slices(v, n->p.vect.slices, values, n->p.vect.nslices);
-			for(i=0;i<n->p.vect.nslices;i++)
-				llhdl_free_node(values[i]);
-			free(values);
-			r = llhdl_create_constant(v, llhdl_get_sign(n), llhdl_get_vectorsize(n));
-			mpz_clear(v);
-			break;
-		case LLHDL_NODE_LOGIC:
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			values = alloc_size(arity*sizeof(struct llhdl_node *));
-			for(i=0;i<arity;i++)
-				values[i] = eval(var, obit, n->p.logic.operands[i]);
-			mpz_init(v);
-			switch(n->p.logic.op) {
-				case LLHDL_LOGIC_NOT: {
-					mpz_t h;
-					int count;
-					
-					count = llhdl_get_vectorsize(values[0]);
-					mpz_init2(h, count);
-					for(i=0;i<count;i++)
-						mpz_setbit(h, i);
-					mpz_xor(v, h, values[0]->p.constant.value);
-					mpz_clear(h);
-					break;
-				}
-				case LLHDL_LOGIC_AND:
-					mpz_and(v, values[0]->p.constant.value, values[1]->p.constant.value);
-					break;
-				case LLHDL_LOGIC_OR:
-					mpz_ior(v, values[0]->p.constant.value, values[1]->p.constant.value);
-					break;
-				case LLHDL_LOGIC_XOR:
-					mpz_xor(v, values[0]->p.constant.value, values[1]->p.constant.value);
-					break;
-				default:
-					assert(0);
-					break;
-			}
-			r = llhdl_create_constant(v, llhdl_get_sign(n), llhdl_get_vectorsize(n));
-			mpz_clear(v);
-			for(i=0;i<arity;i++)
-				llhdl_free_node(values[i]);
-			free(values);
-			break;
-		case LLHDL_NODE_MUX:
-			value = eval(var, obit, n->p.mux.select);
-			i = mpz_get_si(value->p.constant.value);
-			llhdl_free_node(value);
-			assert(i >= 0);
-			if(i < n->p.mux.nsources) {
-				r = eval(var, obit, n->p.mux.sources[i]);
-				r->p.constant.sign = llhdl_get_sign(n);
-				r->p.constant.vectorsize = llhdl_get_vectorsize(n);
-			} /* otherwise, result is undefined and caught below */
-			break;
-		default:
-			r = get_node_value(var, obit, n);
-			break;
-	}
-	
-	/* Catch undefined values */
-	if(r == NULL) {
-		mpz_init(v);
-		r = llhdl_create_constant(v, llhdl_get_sign(n), llhdl_get_vectorsize(n));
-		mpz_clear(v);
+	mask = 2*mlp->mask + 1;
+	table = alloc_size0((mask+1)*sizeof(struct memo_entry *));
+	for(i=0;i<=mlp->mask;i++) {
+		for(e=mlp->memo[i];e!=NULL;e=next) {
+			next = e->next;
+			h = memo_hash(e->nvars, e->vars, e->tt) & mask;
+			e->next = table[h];
+			table[h] = e;
+		}
 	}
-	
-	return r;
+	free(mlp->memo);
+	mlp->memo = table;
+	mlp->mask = mask;
 }
 
-struct map_level_param {
-	struct tilm_sc *sc;
-	struct llhdl_node *top;
-	struct mapkit_result *r;
-	struct tilm_variables *var;
-	int obit;
-};
-
-static void eval_and_set(struct map_level_param *mlp, mpz_t result)
+static void memo_add(struct map_level_param *mlp, int nvars, int *vars, mpz_t canonical, int inverted, void *net)
 {
-	struct llhdl_node *evn;
+	struct memo_entry *e;
+	unsigned int h;
 
-	mpz_mul_2exp(result, result, 1);
-	evn = eval(mlp->var, mlp->obit, mlp->top);
-	if(mpz_tstbit(evn->p.constant.value, mlp->obit))
-		mpz_setbit(result, 0);
-	llhdl_free_node(evn);
+	if(mlp->nentries > mlp->mask)
+		memo_grow(mlp);
+	e = alloc_type(struct memo_entry);
+	e->nvars = nvars;
+	e->vars = alloc_size((nvars+1)*sizeof(int));
+	memcpy(e->vars, vars, nvars*sizeof(int));
+	mpz_init_set(e->tt, canonical);
+	e->inverted = inverted;
+	e->net = net;
+	h = memo_hash(nvars, vars, canonical) & mlp->mask;
+	e->next = mlp->memo[h];
+	mlp->memo[h] = e;
+	mlp->nentries++;
 }
 
-static void eval_multi(struct map_level_param *mlp, struct tilm_variable *v, mpz_t result)
+static void memo_free(struct map_level_param *mlp)
 {
-	if(v == NULL) {
-		eval_and_set(mlp, result);
-		return;
-	}
-	if(v->next == NULL) {
-		v->value = 1;
-		eval_and_set(mlp, result);
-		v->value = 0;
-		eval_and_set(mlp, result);
-	} else {
-		v->value = 1;
-		eval_multi(mlp, v->next, result);
-		v->value = 0;
-		eval_multi(mlp, v->next, result);
+	struct memo_entry *e, *next;
+	unsigned int i;
+
+	for(i=0;i<=mlp->mask;i++) {
+		for(e=mlp->memo[i];e!=NULL;e=next) {
+			next = e->next;
+			mpz_clear(e->tt);
+			free(e->vars);
+			free(e);
+		}
 	}
+	free(mlp->memo);
 }
 
-static int is_n_ones(mpz_t v, int n)
+static void *create_lut_net(struct map_level_param *mlp, int varcount, mpz_t contents, void **inputs)
 {
+	void *lut;
+	void *lut_net;
 	int i;
-	mpz_t c;
-	int r;
-	
-	mpz_init2(c, n);
-	for(i=0;i<n;i++)
-		mpz_setbit(c, i);
-	r = mpz_cmp(v, c) == 0;
-	mpz_clear(c);
-	return r;
+
+	lut = TILM_CALL_CREATE_LUT(mlp->sc, varcount, contents);
+	for(i=0;i<varcount;i++)
+		TILM_CALL_BRANCH(mlp->sc, inputs[i], lut, 0, i);
+	lut_net = TILM_CALL_CREATE_NET(mlp->sc);
+	TILM_CALL_BRANCH(mlp->sc, lut_net, lut, 1, 0);
+	return lut_net;
 }
 
-static void *fit_into_lut(struct map_level_param *mlp, struct tilm_variable *v)
+static void *fit_into_lut(struct map_level_param *mlp, mpz_t contents, int *vars, int varcount, int *level)
 {
-	int varcount;
-	mpz_t contents;
-	void *lut;
-	int i;
-	struct tilm_variable *v2;
-	void *in_net;
+	struct tilm_tt_masks *m;
+	void **inputs;
 	void *lut_net;
+	int i;
 
-	varcount = tilm_variables_remaining(v);
-	
-	mpz_init2(contents, 1 << varcount);
-	eval_multi(mlp, v, contents);
-	
+	m = tilm_tt_get_masks(&mlp->tc, varcount);
+	*level = LEVEL_SHARED;
 	if(mpz_sgn(contents) == 0)
 		/* LUT output does not depend on inputs and is always 0 */
 		lut_net = TILM_CALL_CONSTANT(mlp->sc, 0);
-	else if(is_n_ones(contents, 1 << varcount))
+	else if(mpz_cmp(contents, m->ones) == 0)
 		/* LUT output does not depend on inputs and is always 1 */
 		lut_net = TILM_CALL_CONSTANT(mlp->sc, 1);
-	else if(varcount == 0)
-		/* Constant */
-		lut_net = TILM_CALL_CONSTANT(mlp->sc, mpz_get_ui(contents));
 	else if((varcount == 1) && (mpz_get_ui(contents) == 2))
 		/* Identity */
-		lut_net = mapkit_find_input_net(mlp->r, v->n, v->bit);
+		lut_net = mlp->var->nets[vars[0]];
 	else {
 		/* Arbitrary function */
-		lut = TILM_CALL_CREATE_LUT(mlp->sc, varcount, contents);
-	
-		i = varcount;
-		v2 = v;
-		while(v2 != NULL) {
-			i--;
-			in_net = mapkit_find_input_net(mlp->r, v2->n, v2->bit);
-			TILM_CALL_BRANCH(mlp->sc, in_net, lut, 0, i);
-			v2 = v2->next;
-		}
-		assert(i == 0);
-		
-		lut_net = TILM_CALL_CREATE_NET(mlp->sc);
-		TILM_CALL_BRANCH(mlp->sc, lut_net, lut, 1, 0);
+		inputs = alloc_size(varcount*sizeof(void *));
+		for(i=0;i<varcount;i++)
+			inputs[i] = mlp->var->nets[vars[i]];
+		lut_net = create_lut_net(mlp, varcount, contents, inputs);
+		free(inputs);
+		*level = LEVEL_LUT;
 	}
 	
-	mpz_clear(contents);
-	
 	return lut_net;
 }
 
@@ -251,39 +196,150 @@ static void *create_mux_lut(struct tilm_sc *sc)
 	return lut;
 }
 
-static void *create_mux(struct tilm_sc *sc, int muxlevel)
+/* Dedicated muxes can only be fed by the LUTs or muxes of the previous level */
+static void *create_mux(struct tilm_sc *sc, int level0, int level1, int *level)
 {
 	void *r;
 
-	if(sc->create_mux_c == NULL)
+	*level = LEVEL_LUT;
+	if((sc->create_mux_c == NULL) || (level0 != level1) || (level0 == LEVEL_SHARED))
 		return create_mux_lut(sc);
-	r = TILM_CALL_CREATE_MUX(sc, muxlevel);
+	r = TILM_CALL_CREATE_MUX(sc, level0);
 	if(r == NULL)
 		return create_mux_lut(sc);
+	*level = level0 + 1;
 	return r;
 }
 
-static void *map_level(struct map_level_param *mlp, struct tilm_variable *v);
+/* Removes the variables the function does not depend on */
+static int reduce_support(struct map_level_param *mlp, mpz_t f, int *vars, int varcount)
+{
+	struct tilm_tt_masks *m;
+	mpz_t d;
+	int i;
 
-static void *decompose(struct map_level_param *mlp, struct tilm_variable *v, int muxlevel)
+	mpz_init(d);
+	for(i=varcount-1;i>=0;i--) {
+		m = tilm_tt_get_masks(&mlp->tc, varcount);
+		tilm_tt_difference(m, d, f, i);
+		if(mpz_sgn(d) == 0) {
+			tilm_tt_move_top(m, f, varcount, i);
+			mpz_fdiv_r_2exp(f, f, 1UL << (varcount-1));
+			memmove(&vars[i], &vars[i+1], (varcount-i-1)*sizeof(int));
+			varcount--;
+		}
+	}
+	mpz_clear(d);
+	return varcount;
+}
+
+/*
+ * Chooses the variable to decompose on.
+ * A variable whose cofactors are complements of each other is taken first,
+ * as only one of them needs to be mapped. Otherwise, the variable that leaves
+ * the smallest cofactor supports is taken.
+ * Ties go to the most significant variable.
+ */
+static int choose_split(struct map_level_param *mlp, mpz_t f, int varcount, int *complemented)
+{
+	struct tilm_tt_masks *m;
+	mpz_t *d;
+	int i, j;
+	int cost, best_cost, best;
+
+	m = tilm_tt_get_masks(&mlp->tc, varcount);
+	d = alloc_size(varcount*sizeof(mpz_t));
+	for(i=0;i<varcount;i++) {
+		mpz_init(d[i]);
+		tilm_tt_difference(m, d[i], f, i);
+	}
+
+	*complemented = 0;
+	best = varcount-1;
+	best_cost = 2*varcount;
+	for(j=varcount-1;j>=0;j--) {
+		if(mpz_cmp(d[j], m->negative[j]) == 0) {
+			*complemented = 1;
+			best = j;
+			break;
+		}
+		cost = 0;
+		for(i=0;i<varcount;i++) {
+			if(i == j)
+				continue;
+			cost += tilm_tt_intersects(d[i], m->negative[j]);
+			cost += tilm_tt_intersects(d[i], m->positive[j]);
+		}
+		if(cost < best_cost) {
+			best_cost = cost;
+			best = j;
+		}
+	}
+
+	for(i=0;i<varcount;i++)
+		mpz_clear(d[i]);
+	free(d);
+	return best;
+}
+
+static void *map_level(struct map_level_param *mlp, mpz_t contents, int *vars, int varcount, int *level);
+
+static void *create_xor(struct map_level_param *mlp, void *select_net, void *net)
+{
+	void *inputs[2];
+	void *r;
+	mpz_t contents;
+
+	inputs[0] = select_net;
+	inputs[1] = net;
+	mpz_init_set_ui(contents, 0x6);
+	r = create_lut_net(mlp, 2, contents, inputs);
+	mpz_clear(contents);
+	return r;
+}
+
+/* Moves the split variable to the top, so that the cofactors are the halves of the truth table */
+static void *decompose(struct map_level_param *mlp, mpz_t contents, int *vars, int varcount, int *level)
 {
 	void *negative_net;
 	void *positive_net;
 	void *select_net;
 	void *mux;
 	void *mux_net;
+	mpz_t cofactor;
+	int *split_vars;
+	int split, select;
+	int complemented;
+	int level0, level1;
 	
-	v->value = 0;
-	negative_net = map_level(mlp, v->next);
-	v->value = 1;
-	positive_net = map_level(mlp, v->next);
+	split = choose_split(mlp, contents, varcount, &complemented);
+	select = vars[split];
+	tilm_tt_move_top(tilm_tt_get_masks(&mlp->tc, varcount), contents, varcount, split);
+	split_vars = alloc_size(varcount*sizeof(int));
+	memcpy(split_vars, vars, split*sizeof(int));
+	memcpy(&split_vars[split], &vars[split+1], (varcount-split-1)*sizeof(int));
+	select_net = mlp->var->nets[select];
+
+	mpz_init(cofactor);
+	mpz_fdiv_r_2exp(cofactor, contents, 1UL << (varcount-1));
+	negative_net = map_level(mlp, cofactor, split_vars, varcount-1, &level0);
+	if(complemented) {
+		mpz_clear(cofactor);
+		free(split_vars);
+		*level = LEVEL_LUT;
+		return create_xor(mlp, select_net, negative_net);
+	}
+	mpz_fdiv_q_2exp(cofactor, contents, 1UL << (varcount-1));
+	positive_net = map_level(mlp, cofactor, split_vars, varcount-1, &level1);
+	mpz_clear(cofactor);
+	free(split_vars);
 	
-	if(negative_net == positive_net)
+	if(negative_net == positive_net) {
+		*level = LEVEL_SHARED;
 		return negative_net;
+	}
 	
-	select_net = mapkit_find_input_net(mlp->r, v->n, v->bit);
-	
-	mux = create_mux(mlp->sc, muxlevel);
+	mux = create_mux(mlp->sc, level0, level1, level);
 	TILM_CALL_BRANCH(mlp->sc, select_net, mux, 0, 0);
 	TILM_CALL_BRANCH(mlp->sc, negative_net, mux, 0, 1);
 	TILM_CALL_BRANCH(mlp->sc, positive_net, mux, 0, 2);
@@ -294,33 +350,276 @@ static void *decompose(struct map_level_param *mlp, struct tilm_variable *v, int
 	return mux_net;
 }
 
-static void *map_level(struct map_level_param *mlp, struct tilm_variable *v)
+static void *create_inverter(struct map_level_param *mlp, void *net)
 {
-	int varcount;
+	mpz_t contents;
+	void *r;
 	
-	varcount = tilm_variables_remaining(v);
-	if(varcount <= mlp->sc->max_inputs)
-		return fit_into_lut(mlp, v);
+	mpz_init_set_ui(contents, 1);
+	r = create_lut_net(mlp, 1, contents, &net);
+	mpz_clear(contents);
+	return r;
+}
+
+/*
+ * Small functions that need several LUTs are implemented from the library.
+ * Complemented inputs and outputs are folded into the LUT contents,
+ * the complement of a mux being pushed to its inputs.
+ */
+static void *map_from_library(struct map_level_param *mlp, mpz_t contents, int *vars, int varcount, int *level)
+{
+	struct tilm_npn_transform t;
+	struct tilm_plan *p;
+	struct tilm_plan_element *e;
+	void **element_nets;
+	int *levels;
+	char *complement;
+	void *inputs[TILM_NPN_MAX_INPUTS];
+	void *mux;
+	uint64_t canonical, init;
+	mpz_t c;
+	void *r;
+	int i, j, swap;
+
+	canonical = tilm_npn_canonicalize(tilm_tt_to_word(contents), varcount, &t);
+	p = tilm_library_get(mlp->sc->library, canonical, varcount);
+	element_nets = alloc_size(p->nelements*sizeof(void *));
+	levels = alloc_size(p->nelements*sizeof(int));
+	complement = alloc_size0(p->nelements);
+	complement[p->nelements-1] = t.output_negated;
+	for(i=p->nelements-1;i>=0;i--) {
+		e = &p->elements[i];
+		if((e->type == TILM_PLAN_MUX) && complement[i]) {
+			complement[e->inputs[1] - TILM_PLAN_ELEMENT] = 1;
+			complement[e->inputs[2] - TILM_PLAN_ELEMENT] = 1;
+		}
+	}
+	mpz_init(c);
+	for(i=0;i<p->nelements;i++) {
+		e = &p->elements[i];
+		for(j=0;j<e->ninputs;j++) {
+			if(e->inputs[j] >= TILM_PLAN_ELEMENT)
+				inputs[j] = element_nets[e->inputs[j] - TILM_PLAN_ELEMENT];
+			else {
+				assert(e->inputs[j] < TILM_NPN_MAX_INPUTS);
+				inputs[j] = mlp->var->nets[vars[t.perm[e->inputs[j]]]];
+			}
+		}
+		if(e->type == TILM_PLAN_MUX) {
+			swap = t.negated[e->inputs[0]];
+			mux = create_mux(mlp->sc,
+				levels[e->inputs[1] - TILM_PLAN_ELEMENT],
+				levels[e->inputs[2] - TILM_PLAN_ELEMENT],
+				&levels[i]);
+			TILM_CALL_BRANCH(mlp->sc, inputs[0], mux, 0, 0);
+			TILM_CALL_BRANCH(mlp->sc, inputs[1], mux, 0, swap ? 2 : 1);
+			TILM_CALL_BRANCH(mlp->sc, inputs[2], mux, 0, swap ? 1 : 2);
+			element_nets[i] = TILM_CALL_CREATE_NET(mlp->sc);
+			TILM_CALL_BRANCH(mlp->sc, element_nets[i], mux, 1, 0);
+		} else {
+			init = e->init;
+			for(j=0;j<e->ninputs;j++)
+				if((e->inputs[j] < TILM_NPN_MAX_INPUTS) && t.negated[e->inputs[j]])
+					init = tilm_word_flip(init, j);
+			if(complement[i])
+				init ^= tilm_word_ones(e->ninputs);
+			tilm_tt_from_word(c, init);
+			element_nets[i] = create_lut_net(mlp, e->ninputs, c, inputs);
+			levels[i] = LEVEL_LUT;
+		}
+	}
+	mpz_clear(c);
+	r = element_nets[p->nelements-1];
+	*level = levels[p->nelements-1];
+	free(complement);
+	free(levels);
+	free(element_nets);
+	return r;
+}
+
+/* <contents> is modified */
+static void *map_level(struct map_level_param *mlp, mpz_t contents, int *vars, int varcount, int *level)
+{
+	struct memo_entry *e;
+	int *own_vars;
+	mpz_t canonical;
+	int inverted;
+	void *r;
+
+	own_vars = alloc_size((varcount+1)*sizeof(int));
+	memcpy(own_vars, vars, varcount*sizeof(int));
+	varcount = reduce_support(mlp, contents, own_vars, varcount);
+
+	inverted = mpz_tstbit(contents, 0);
+	mpz_init(canonical);
+	if(inverted)
+		mpz_xor(canonical, contents, tilm_tt_get_masks(&mlp->tc, varcount)->ones);
+	else
+		mpz_set(canonical, contents);
+	e = memo_find(mlp, varcount, own_vars, canonical);
+	if((e != NULL) && (e->inverted == inverted)) {
+		*level = LEVEL_SHARED;
+		r = e->net;
+	} else if(varcount <= mlp->sc->max_inputs)
+		r = fit_into_lut(mlp, contents, own_vars, varcount, level);
+	else if(e != NULL) {
+		/* Inverting the shared net is cheaper than a second tree */
+		*level = LEVEL_LUT;
+		r = create_inverter(mlp, e->net);
+	} else if(varcount <= TILM_NPN_MAX_INPUTS)
+		r = map_from_library(mlp, contents, own_vars, varcount, level);
+	else
+		r = decompose(mlp, contents, own_vars, varcount, level);
+	if(e == NULL)
+		memo_add(mlp, varcount, own_vars, canonical, inverted, r);
+
+	mpz_clear(canonical);
+	free(own_vars);
+	return r;
+}
+
+/* Tells the partitions left below this one which of their bits are read */
+static void record_observed(struct tilm_sc *sc, struct tilm_variables *var)
+{
+	struct tilm_leaf *l;
+	char *bits;
+	int i, j;
+
+	for(i=0;i<var->nleaves;i++) {
+		l = &var->leaves[i];
+		if((l->n->user != NULL) ||
+		   ((l->n->type != LLHDL_NODE_LOGIC) && (l->n->type != LLHDL_NODE_MUX)))
+			continue;
+		for(j=0;j<l->vectorsize;j++)
+			if(l->index[j] == -1)
+				break;
+		if(j == l->vectorsize)
+			continue;
+		bits = alloc_size(l->vectorsize);
+		for(j=0;j<l->vectorsize;j++)
+			bits[j] = l->index[j] != -1;
+		tilm_set_observed(sc, l->n, bits);
+	}
+}
+
+static struct llhdl_node *select_slice(struct llhdl_node *select, int start, int end)
+{
+	struct llhdl_slice slice;
+
+	slice.source = select;
+	slice.start = start;
+	slice.end = end;
+	return llhdl_create_vect(0, 1, &slice);
+}
+
+/*
+ * Shannon decomposition on the top select bit: the mux becomes a two-way
+ * mux between the sources with that bit cleared and those with it set.
+ * The node is modified in place, as the mapper has already visited it
+ * and may have recorded its observed bits. The select is duplicated,
+ * but it usually is a signal.
+ */
+static void split_mux(struct llhdl_node *n)
+{
+	struct llhdl_node *select;
+	struct llhdl_node *low, *high;
+	int nselect, nlow;
+
+	select = n->p.mux.select;
+	nselect = llhdl_get_vectorsize(select);
+	nlow = n->p.mux.nsources;
+	if((nselect < 31) && (nlow > (1 << (nselect-1))))
+		nlow = 1 << (nselect-1);
+	low = llhdl_create_mux(nlow, select_slice(llhdl_dup(select), 0, nselect-2), n->p.mux.sources);
+	if(nlow < n->p.mux.nsources)
+		high = llhdl_create_mux(n->p.mux.nsources-nlow, select_slice(llhdl_dup(select), 0, nselect-2), &n->p.mux.sources[nlow]);
 	else
-		return decompose(mlp, v, varcount - mlp->sc->max_inputs - 1);
+		high = llhdl_create_constant_ui(0, llhdl_get_sign(n), llhdl_get_vectorsize(n));
+	n->p.mux.nsources = 2;
+	n->p.mux.select = select_slice(select, nselect-1, nselect-1);
+	n->p.mux.sources[0] = low;
+	n->p.mux.sources[1] = high;
+}
+
+/*
+ * Only muxes can have too many variables in a partition of depth 1.
+ * Splits those at the top of the partition, and returns 0 if there
+ * was none that could be split.
+ */
+static int split_wide_muxes(struct llhdl_node *n)
+{
+	int i, r;
+
+	switch(n->type) {
+		case LLHDL_NODE_MUX:
+			if((llhdl_get_vectorsize(n->p.mux.select) < 2) || (n->p.mux.nsources < 2))
+				return 0;
+			split_mux(n);
+			return 1;
+		case LLHDL_NODE_VECT:
+			r = 0;
+			for(i=0;i<n->p.vect.nslices;i++)
+				if(n->p.vect.slices[i].source->user == NULL)
+					r |= split_wide_muxes(n->p.vect.slices[i].source);
+			return r;
+		default:
+			return 0;
+	}
 }
 
 void tilm_process_shannon(struct tilm_sc *sc, struct llhdl_node **n)
 {
 	struct map_level_param mlp;
-	int vectorsize;
+	struct tilm_analysis *a;
+	struct tilm_function *f;
+	char *observed;
+	int depth;
+	int level;
+	int i;
 	
 	mlp.sc = sc;
-	mlp.top = *n;
+	observed = tilm_get_observed(sc, *n);
 	
-	mlp.r = tilm_try_partition(sc, n);
-	if(mlp.r == NULL) return;
-	mlp.var = tilm_variables_enumerate(*n);
+	/* Shrink the partition until the truth tables are small enough */
+	depth = -1;
+	while(1) {
+		mlp.r = tilm_try_partition(sc, n, depth);
+		if(mlp.r == NULL) return;
+		mlp.var = tilm_variables_enumerate(sc, mlp.r, *n, observed);
+		if(tilm_variables_max_support(mlp.var) <= TILM_MAX_SUPPORT)
+			break;
+		if((depth == 1) && !split_wide_muxes(*n))
+			break;
+		tilm_variables_free(mlp.var);
+		mapkit_free_result(mlp.r);
+		/* Once at depth 1, split muxes until the partition fits */
+		if(depth == -1)
+			depth = tilm_partition_depth(*n);
+		/* Long chains would take one try per level */
+		if(depth > 2*TILM_MAX_SUPPORT)
+			depth /= 2;
+		else
+			depth--;
+		if(depth < 1)
+			depth = 1;
+	}
+	tilm_variables_create_nets(sc, mlp.var);
+	record_observed(sc, mlp.var);
+	tilm_tt_init(&mlp.tc);
+	a = tilm_analyze(&mlp.tc, mlp.var, *n);
+	mlp.mask = 63;
+	mlp.nentries = 0;
+	mlp.memo = alloc_size0((mlp.mask+1)*sizeof(struct memo_entry *));
 	
-	vectorsize = llhdl_get_vectorsize(*n);
-	for(mlp.obit=0;mlp.obit<vectorsize;mlp.obit++)
-		mlp.r->output_nets[mlp.obit] = map_level(&mlp, mlp.var->heads[mlp.obit]);
+	/* Bits share the memo, so that identical bits get the same net */
+	for(i=0;i<a->vectorsize;i++) {
+		f = &a->functions[i];
+		mlp.r->output_nets[i] = map_level(&mlp, f->tt, f->vars, f->nvars, &level);
+	}
 
+	memo_free(&mlp);
+	tilm_analysis_free(a);
+	tilm_tt_free(&mlp.tc);
 	tilm_variables_free(mlp.var);
 	mapkit_consume(sc->mapkit, *n, mlp.r);
 }
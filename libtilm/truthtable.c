@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <gmp.h>
+
+#include <util.h>
+
+#include "truthtable.h"
+
+void tilm_tt_init(struct tilm_tt_cache *c)
+{
+	int i;
+
+	for(i=0;i<=TILM_MAX_SUPPORT;i++)
+		c->masks[i] = NULL;
+}
+
+static struct tilm_tt_masks *create_masks(int nvars)
+{
+	struct tilm_tt_masks *m;
+	mpz_t t;
+	unsigned long int w;
+	int i;
+
+	m = alloc_type(struct tilm_tt_masks);
+	mpz_init(m->ones);
+	tilm_tt_ones(m->ones, nvars);
+	m->positive = alloc_size((nvars+1)*sizeof(mpz_t));
+	m->negative = alloc_size((nvars+1)*sizeof(mpz_t));
+	m->swap = alloc_size((nvars+1)*sizeof(mpz_t));
+	mpz_init(t);
+	for(i=0;i<nvars;i++) {
+		/* 2^i zeros, 2^i ones, repeated */
+		w = 1UL << i;
+		tilm_tt_ones(t, i);
+		mpz_init(m->positive[i]);
+		mpz_mul_2exp(m->positive[i], t, w);
+		for(w=2*w;w<(1UL << nvars);w*=2) {
+			mpz_mul_2exp(t, m->positive[i], w);
+			mpz_ior(m->positive[i], m->positive[i], t);
+		}
+		mpz_init(m->negative[i]);
+		mpz_xor(m->negative[i], m->ones, m->positive[i]);
+	}
+	for(i=0;i<nvars-1;i++) {
+		mpz_init(m->swap[i]);
+		mpz_and(m->swap[i], m->positive[i], m->negative[i+1]);
+	}
+	mpz_clear(t);
+	return m;
+}
+
+struct tilm_tt_masks *tilm_tt_get_masks(struct tilm_tt_cache *c, int nvars)
+{
+	if(c->masks[nvars] == NULL)
+		c->masks[nvars] = create_masks(nvars);
+	return c->masks[nvars];
+}
+
+void tilm_tt_free(struct tilm_tt_cache *c)
+{
+	struct tilm_tt_masks *m;
+	int i, j;
+
+	for(i=0;i<=TILM_MAX_SUPPORT;i++) {
+		m = c->masks[i];
+		if(m == NULL)
+			continue;
+		for(j=0;j<i;j++) {
+			mpz_clear(m->positive[j]);
+			mpz_clear(m->negative[j]);
+		}
+		for(j=0;j<i-1;j++)
+			mpz_clear(m->swap[j]);
+		mpz_clear(m->ones);
+		free(m->positive);
+		free(m->negative);
+		free(m->swap);
+		free(m);
+	}
+}
+
+void tilm_tt_ones(mpz_t r, int nvars)
+{
+	mpz_set_ui(r, 0);
+	mpz_setbit(r, 1UL << nvars);
+	mpz_sub_ui(r, r, 1);
+}
+
+uint64_t tilm_tt_to_word(mpz_t tt)
+{
+	uint64_t r;
+
+	r = 0;
+	mpz_export(&r, NULL, -1, sizeof(r), 0, 0, tt);
+	return r;
+}
+
+void tilm_tt_from_word(mpz_t r, uint64_t tt)
+{
+	mpz_import(r, 1, -1, sizeof(tt), 0, 0, &tt);
+}
+
+/* Stops at the first common bit, without building the intersection */
+int tilm_tt_intersects(mpz_t a, mpz_t b)
+{
+	size_t i, n;
+
+	n = mpz_size(a);
+	if(mpz_size(b) < n)
+		n = mpz_size(b);
+	for(i=0;i<n;i++)
+		if(mpz_getlimbn(a, i) & mpz_getlimbn(b, i))
+			return 1;
+	return 0;
+}
+
+void tilm_tt_difference(struct tilm_tt_masks *m, mpz_t r, mpz_t f, int var)
+{
+	mpz_fdiv_q_2exp(r, f, 1UL << var);
+	mpz_xor(r, r, f);
+	mpz_and(r, r, m->negative[var]);
+}
+
+/* Delta swaps of adjacent variables */
+void tilm_tt_move_top(struct tilm_tt_masks *m, mpz_t f, int nvars, int var)
+{
+	mpz_t t;
+	int i;
+
+	mpz_init(t);
+	for(i=var;i<nvars-1;i++) {
+		mpz_fdiv_q_2exp(t, f, 1UL << i);
+		mpz_xor(t, t, f);
+		mpz_and(t, t, m->swap[i]);
+		mpz_xor(f, f, t);
+		mpz_mul_2exp(t, t, 1UL << i);
+		mpz_xor(f, f, t);
+	}
+	mpz_clear(t);
+}
@@ -0,0 +1,40 @@
+#ifndef __TRUTHTABLE_H
+#define __TRUTHTABLE_H
+
+#include <stdint.h>
+#include <gmp.h>
+
+/* Beyond this support size, truth tables become too large */
+#define TILM_MAX_SUPPORT 24
+
+/*
+ * Bit m of a truth table of n variables is the value of the function
+ * when each variable i takes the value of bit i of m.
+ */
+struct tilm_tt_masks {
+	mpz_t ones;
+	mpz_t *positive;	/* < minterms where variable i is 1 */
+	mpz_t *negative;	/* < minterms where variable i is 0 */
+	mpz_t *swap;		/* < minterms where variable i is 1 and variable i+1 is 0 */
+};
+
+/* Masks are computed once for each number of variables */
+struct tilm_tt_cache {
+	struct tilm_tt_masks *masks[TILM_MAX_SUPPORT+1];
+};
+
+void tilm_tt_init(struct tilm_tt_cache *c);
+struct tilm_tt_masks *tilm_tt_get_masks(struct tilm_tt_cache *c, int nvars);
+void tilm_tt_free(struct tilm_tt_cache *c);
+
+void tilm_tt_ones(mpz_t r, int nvars);
+/* For tables of up to 6 variables */
+uint64_t tilm_tt_to_word(mpz_t tt);
+void tilm_tt_from_word(mpz_t r, uint64_t tt);
+int tilm_tt_intersects(mpz_t a, mpz_t b);
+/* Marks the minterms, with variable <var> at 0, that change when <var> is flipped */
+void tilm_tt_difference(struct tilm_tt_masks *m, mpz_t r, mpz_t f, int var);
+/* Makes variable <var> the most significant one, the variables above it move down */
+void tilm_tt_move_top(struct tilm_tt_masks *m, mpz_t f, int nvars, int var);
+
+#endif /* __TRUTHTABLE_H */
@@ -7,104 +7,214 @@
 #include <llhdl/structure.h>
 #include <llhdl/tools.h>
 
+#include <mapkit/mapkit.h>
+
 #include <tilm/tilm.h>
 
 #include "internal.h"
 #include "variables.h"
 
-static void add_single_variable(struct tilm_variable **head, struct llhdl_node *n, int bit)
+static unsigned int leaf_slot(struct tilm_variables *r, struct llhdl_node *n)
+{
+	unsigned int h;
+
+	h = (((unsigned long)n) >> 4)*2654435761U;
+	h &= r->mask;
+	while((r->table[h] != NULL) && (r->table[h]->n != n))
+		h = (h + 1) & r->mask;
+	return h;
+}
+
+struct tilm_leaf *tilm_find_leaf(struct tilm_variables *r, struct llhdl_node *n)
+{
+	return r->table[leaf_slot(r, n)];
+}
+
+/* The leaves are the input nodes of the partition, a node can appear more than once */
+static void index_leaves(struct tilm_variables *r, struct mapkit_result *mr)
+{
+	struct tilm_leaf *l;
+	struct llhdl_node *n;
+	unsigned int h;
+	int i, j, offset;
+
+	r->mask = 15;
+	while(r->mask+1 < 2*mr->ninput_nodes)
+		r->mask = 2*r->mask + 1;
+	r->table = alloc_size0((r->mask+1)*sizeof(struct tilm_leaf *));
+	r->leaves = alloc_size(mr->ninput_nodes*sizeof(struct tilm_leaf));
+	r->nleaves = 0;
+	offset = 0;
+	for(i=0;i<mr->ninput_nodes;i++) {
+		n = *mr->input_nodes[i];
+		h = leaf_slot(r, n);
+		if(r->table[h] == NULL) {
+			l = &r->leaves[r->nleaves++];
+			l->n = n;
+			l->vectorsize = mapkit_get_vectorsize(r->mapkit, n);
+			l->sign = mapkit_get_sign(r->mapkit, n);
+			l->index = alloc_size(l->vectorsize*sizeof(int));
+			for(j=0;j<l->vectorsize;j++)
+				l->index[j] = -1;
+			l->nets = &mr->input_nets[offset];
+			r->table[h] = l;
+		}
+		offset += mapkit_get_vectorsize(r->mapkit, n);
+	}
+}
+
+static void add_single_variable(struct tilm_variables *r, int obit, struct tilm_leaf *l, int bit)
 {
 	struct tilm_variable *v;
-	
-	v = *head;
-	while(v != NULL) {
-		if((v->n == n) && (v->bit == bit))
-			return;
-		v = v->next;
+	int index;
+
+	index = l->index[bit];
+	if(index == -1) {
+		index = r->nvars++;
+		l->index[bit] = index;
+		r->marks[index] = -1;
 	}
-	
+	if(r->marks[index] == obit)
+		return;
+	r->marks[index] = obit;
+
 	v = alloc_type(struct tilm_variable);
-	v->n = n;
+	v->index = index;
+	v->n = l->n;
 	v->bit = bit;
-	v->value = 0;
-	v->next = *head;
-	*head = v;
+	v->next = r->heads[obit];
+	r->heads[obit] = v;
 }
 
-static void add_variable(struct tilm_variable **head, struct llhdl_node *n, int bit)
+static void add_variable(struct tilm_variables *r, int obit, struct llhdl_node *n, int bit)
 {
-	int i, count;
+	struct tilm_leaf *l;
+	int i;
 	
-	count = llhdl_get_vectorsize(n);
+	l = tilm_find_leaf(r, n);
+	assert(l != NULL);
 	if(bit == -1) {
-		for(i=0;i<count;i++)
-			add_single_variable(head, n, i);
-	} else {
-		if(bit < count)
-			add_single_variable(head, n, bit);
-		else if(llhdl_get_sign(n))
-			add_single_variable(head, n, count-1);
+		for(i=0;i<l->vectorsize;i++)
+			add_single_variable(r, obit, l, i);
+	} else
+		add_single_variable(r, obit, l, bit);
+}
+
+struct pending_bit {
+	struct llhdl_node *n;
+	int bit;
+};
+
+static void push_pending(struct tilm_variables *r, struct llhdl_node *n, int bit)
+{
+	if(r->npending == r->pending_size) {
+		r->pending_size = 2*r->pending_size + 16;
+		r->pending = realloc(r->pending, r->pending_size*sizeof(struct pending_bit));
+		assert(r->pending != NULL);
 	}
+	r->pending[r->npending].n = n;
+	r->pending[r->npending].bit = bit;
+	r->npending++;
 }
 
-static void enumerate_bit(struct tilm_variable **head, struct llhdl_node *n, int bit)
+/*
+ * <bit> is -1 for all bits. Bits past the vector size are extended according to the sign of the node.
+ * Operands are pushed in reverse, so that variables are numbered in the order of a depth-first walk.
+ */
+static void enumerate_bit(struct tilm_variables *r, int obit, struct llhdl_node *n, int bit)
 {
 	int i, arity;
 	int j, len;
-	
-	if(n->user != NULL) {
-		/* Already mapped */
-		add_variable(head, n, bit);
-		return;
-	}
-	
-	switch(n->type) {
-		case LLHDL_NODE_CONSTANT:
-			/* nothing to do */
-			break;
-		case LLHDL_NODE_LOGIC:
-			arity = llhdl_get_logic_arity(n->p.logic.op);
-			for(i=0;i<arity;i++)
-				enumerate_bit(head, n->p.logic.operands[i], bit);
-			break;
-		case LLHDL_NODE_MUX:
-			enumerate_bit(head, n->p.mux.select, -1);
-			for(i=0;i<n->p.mux.nsources;i++)
-				enumerate_bit(head, n->p.mux.sources[i], bit);
-			break;
-		case LLHDL_NODE_VECT:
-			if(bit == -1) {
-				for(i=0;i<n->p.vect.nslices;i++)
-					for(j=n->p.vect.slices[i].start;j<=n->p.vect.slices[i].end;j++)
-						enumerate_bit(head, n->p.vect.slices[i].source, j);
-			} else {
-				for(i=0;i<n->p.vect.nslices;i++) {
-					len = n->p.vect.slices[i].end - n->p.vect.slices[i].start + 1;
-					if(bit < len) {
-						enumerate_bit(head, n->p.vect.slices[i].source, n->p.vect.slices[i].start+bit);
-						break;
+	int vectorsize;
+
+	push_pending(r, n, bit);
+	while(r->npending > 0) {
+		r->npending--;
+		n = r->pending[r->npending].n;
+		bit = r->pending[r->npending].bit;
+
+		/* Bit 0 always exists, which saves walking long chains of single bits */
+		if(bit > 0) {
+			vectorsize = mapkit_get_vectorsize(r->mapkit, n);
+			if(bit >= vectorsize) {
+				if(!mapkit_get_sign(r->mapkit, n))
+					continue;
+				bit = vectorsize - 1;
+			}
+		}
+
+		if(tilm_find_leaf(r, n) != NULL) {
+			/* Already mapped, or left to another partition */
+			add_variable(r, obit, n, bit);
+			continue;
+		}
+
+		switch(n->type) {
+			case LLHDL_NODE_CONSTANT:
+				/* nothing to do */
+				break;
+			case LLHDL_NODE_LOGIC:
+				arity = llhdl_get_logic_arity(n->p.logic.op);
+				for(i=arity-1;i>=0;i--)
+					push_pending(r, n->p.logic.operands[i], bit);
+				break;
+			case LLHDL_NODE_MUX:
+				for(i=n->p.mux.nsources-1;i>=0;i--)
+					push_pending(r, n->p.mux.sources[i], bit);
+				push_pending(r, n->p.mux.select, -1);
+				break;
+			case LLHDL_NODE_VECT:
+				if(bit == -1) {
+					for(i=n->p.vect.nslices-1;i>=0;i--)
+						for(j=n->p.vect.slices[i].end;j>=n->p.vect.slices[i].start;j--)
+							push_pending(r, n->p.vect.slices[i].source, j);
+				} else {
+					for(i=0;i<n->p.vect.nslices;i++) {
+						len = n->p.vect.slices[i].end - n->p.vect.slices[i].start + 1;
+						if(bit < len) {
+							push_pending(r, n->p.vect.slices[i].source, n->p.vect.slices[i].start+bit);
+							break;
+						}
+						bit -= len;
 					}
-					bit -= len;
 				}
-			}
-			break;
-		default:
-			add_variable(head, n, bit);
-			break;
+				break;
+			default:
+				add_variable(r, obit, n, bit);
+				break;
+		}
 	}
 }
 
-struct tilm_variables *tilm_variables_enumerate(struct llhdl_node *n)
+struct tilm_variables *tilm_variables_enumerate(struct tilm_sc *sc, struct mapkit_result *mr, struct llhdl_node *n, char *observed)
 {
 	struct tilm_variables *r;
+	int ninput_bits;
 	int i;
 
 	r = alloc_type(struct tilm_variables);
-	r->vectorsize = llhdl_get_vectorsize(n);
-	r->heads = alloc_size0(r->vectorsize*sizeof(struct tilm_variable **));
+	r->mapkit = sc->mapkit;
+	r->vectorsize = mapkit_get_vectorsize(r->mapkit, n);
+	r->heads = alloc_size0(r->vectorsize*sizeof(struct tilm_variable *));
+	index_leaves(r, mr);
+
+	/* there cannot be more variables than input bits */
+	ninput_bits = 0;
+	for(i=0;i<mr->ninput_nodes;i++)
+		ninput_bits += mapkit_get_vectorsize(r->mapkit, *mr->input_nodes[i]);
+	r->nvars = 0;
+	r->nets = alloc_size((ninput_bits+1)*sizeof(void *));
+	r->marks = alloc_size((ninput_bits+1)*sizeof(int));
 	
+	r->observed = observed;
+	r->npending = 0;
+	r->pending_size = 0;
+	r->pending = NULL;
 	for(i=0;i<r->vectorsize;i++)
-		enumerate_bit(&r->heads[i], n, i);
+		if((observed == NULL) || observed[i])
+			enumerate_bit(r, i, n, i);
+	free(r->pending);
+	r->pending = NULL;
 	
 	return r;
 }
@@ -118,7 +228,7 @@ void tilm_variables_dump(struct tilm_variables *r)
 		printf("Bit %d:\n", i);
 		v = r->heads[i];
 		while(v != NULL) {
-			printf("  %s@%p:%d", llhdl_strtype(v->n->type), v->n, v->bit);
+			printf("  #%d %s@%p:%d", v->index, llhdl_strtype(v->n->type), v->n, v->bit);
 			if(v->n->type == LLHDL_NODE_SIGNAL)
 				printf(" (%s)", v->n->p.signal.name);
 			printf("\n");
@@ -127,38 +237,45 @@ void tilm_variables_dump(struct tilm_variables *r)
 	}
 }
 
-int tilm_variables_remaining(struct tilm_variable *v)
+int tilm_variables_max_support(struct tilm_variables *r)
 {
-	int r;
-	
-	r = 0;
-	while(v != NULL) {
-		r++;
-		v = v->next;
+	int i, n, max;
+
+	max = 0;
+	for(i=0;i<r->vectorsize;i++) {
+		n = tilm_variables_remaining(r->heads[i]);
+		if(n > max)
+			max = n;
 	}
-	return r;
+	return max;
 }
 
-int tilm_variable_value(struct tilm_variables *r, int obit, struct llhdl_node *n, int bit)
+void tilm_variables_create_nets(struct tilm_sc *sc, struct tilm_variables *r)
 {
-	struct tilm_variable *v;
-	int vectorsize;
-	
-	vectorsize = llhdl_get_vectorsize(n);
-	if(bit >= vectorsize) {
-		if(llhdl_get_sign(n))
-			bit = vectorsize-1;	/* sign extend */
-		else
-			return 0;		/* fill with 0 */
+	struct tilm_leaf *l;
+	int i, j;
+
+	for(i=0;i<r->nleaves;i++) {
+		l = &r->leaves[i];
+		for(j=0;j<l->vectorsize;j++) {
+			if(l->index[j] != -1) {
+				l->nets[j] = TILM_CALL_CREATE_NET(sc);
+				r->nets[l->index[j]] = l->nets[j];
+			}
+		}
 	}
+}
+
+int tilm_variables_remaining(struct tilm_variable *v)
+{
+	int r;
 	
-	v = r->heads[obit];
+	r = 0;
 	while(v != NULL) {
-		if((v->n == n) && (v->bit == bit))
-			return v->value;
+		r++;
 		v = v->next;
 	}
-	return 0;
+	return r;
 }
 
 void tilm_variables_free(struct tilm_variables *r)
@@ -174,7 +291,12 @@ void tilm_variables_free(struct tilm_variables *r)
 			v1 = v2;
 		}
 	}
+	for(i=0;i<r->nleaves;i++)
+		free(r->leaves[i].index);
+	free(r->leaves);
+	free(r->table);
+	free(r->nets);
+	free(r->marks);
 	free(r->heads);
 	free(r);
 }
-
@@ -1,25 +1,61 @@
 #ifndef __VARIABLES_H
 #define __VARIABLES_H
 
+#include <mapkit/mapkit.h>
+
 #include "internal.h"
 
+/* A node at the partition boundary */
+struct tilm_leaf {
+	struct llhdl_node *n;
+	int vectorsize;
+	int sign;
+	int *index;		/* < variable index of each bit, -1 if the bit is not used */
+	void **nets;		/* < input net of each bit */
+};
+
+/* An element of the support of an output bit */
 struct tilm_variable {
+	int index;
 	struct llhdl_node *n;
 	int bit;
-	int value;
 	struct tilm_variable *next;
 };
 
+/*
+ * Variables are the bits of the leaves that output bits depend on.
+ * They have dense indices, which address the net table.
+ */
+struct pending_bit;
+
 struct tilm_variables {
+	struct mapkit_sc *mapkit;
 	int vectorsize;
-	struct tilm_variable **heads;
+	struct tilm_variable **heads;	/* < support of each output bit */
+	int nleaves;
+	struct tilm_leaf *leaves;
+	unsigned int mask;
+	struct tilm_leaf **table;	/* < leaves by node, open addressing */
+	char *observed;			/* < output bits to map, NULL for all */
+	int nvars;
+	void **nets;
+	int *marks;
+	int npending;
+	int pending_size;
+	struct pending_bit *pending;	/* < bits left to enumerate */
 };
 
-struct tilm_variables *tilm_variables_enumerate(struct llhdl_node *n);
+/* Output bits that are not observed have no support */
+struct tilm_variables *tilm_variables_enumerate(struct tilm_sc *sc, struct mapkit_result *r, struct llhdl_node *n, char *observed);
 void tilm_variables_dump(struct tilm_variables *r);
 int tilm_variables_remaining(struct tilm_variable *v);
-int tilm_variable_value(struct tilm_variables *r, int obit, struct llhdl_node *n, int bit);
+int tilm_variables_max_support(struct tilm_variables *r);
+/*
+ * Creates the input nets of the bits that are variables, once the partition
+ * is accepted, and fills the net table. The other input nets are left NULL.
+ */
+void tilm_variables_create_nets(struct tilm_sc *sc, struct tilm_variables *r);
+struct tilm_leaf *tilm_find_leaf(struct tilm_variables *r, struct llhdl_node *n);
 void tilm_variables_free(struct tilm_variables *r);
 
 #endif
-
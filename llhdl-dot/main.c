@@ -47,6 +47,7 @@ static unsigned int declare_down(FILE *fd, struct llhdl_node *n)
 	int i, arity;
 	unsigned int select;
 	unsigned int *operands;
+	mpz_t v;
 
 	this_id = new_id();
 	fprintf(fd, "N%x [label=\"<out> %s", this_id, 
@@ -62,7 +63,10 @@ static unsigned int declare_down(FILE *fd, struct llhdl_node *n)
 			fprintf(fd, "|<value>");
 			if(n->p.constant.sign || (n->p.constant.vectorsize != 1))
 				fprintf(fd, "%d%c", n->p.constant.vectorsize, n->p.constant.sign ? 's' : 'u');
-			mpz_out_str(fd, 10, n->p.constant.value);
+			mpz_init(v);
+			llhdl_get_constant_value(v, n);
+			mpz_out_str(fd, 10, v);
+			mpz_clear(v);
 			fprintf(fd, "\"];\n");
 			break;
 		case LLHDL_NODE_LOGIC:
@@ -209,6 +213,7 @@ int main(int argc, char *argv[])
 		outname = mk_outname(inname);
 	
 	m = llhdl_parse_file(inname);
+	llhdl_flatten(m);
 	fd = fopen(outname, "w");
 	if(fd == NULL) {
 		perror("Unable to write output file");
@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <util.h>
+
+#include <banner/banner.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/interchange.h>
+#include <llhdl/tools.h>
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/io.h>
+#include <netlist/symbol.h>
+#include <netlist/xilprims.h>
+#include <netlist/edif.h>
+#include <tilm/tilm.h>
+#include <equiv/equiv.h>
+
+#include "flow.h"
+#include "options.h"
+
+static void help()
+{
+	banner("Equivalence checker");
+	printf("Usage: llhdl-equiv [parameters] <input.lhd>\n\n");
+	printf("Maps the design like llhdl-spartan6-map does, and checks that the resulting\n");
+	printf("netlist is equivalent to the input design (input.lhd).\n");
+	printf("With -n, the netlist is read from an EDIF file instead, and the mapper\n");
+	printf("parameters are ignored.\n");
+	printf("Parameters are:\n");
+	printf("  -h Display this help text and exit.\n");
+	printf("  -p <part>: Select part. Supported values are:\n");
+	flow_list_parts();
+	printf("  -f <[no-]option>: Enable or disable mapper options. Supported options are:\n");
+	flow_list_options();
+	printf("  -l <algo>: Select LUT mapping algorithm. Supported values are:\n");
+	flow_list_lutmappers();
+	printf("  -i <n>: Use at most that many LUT inputs (3-6, default: %d)\n", flow_settings.lut_max_inputs);
+	printf("  -j <n>: Partition the design and map it with that many threads (default: %d)\n", flow_settings.threads);
+	printf("  -n <netlist.edf>: Check this netlist, written by llhdl-spartan6-map.\n");
+	printf("  -s <symbols.sym>: Symbols file written with the netlist, which names its nets\n");
+	printf("     so that the registers are paired by name.\n");
+	printf("  -c <n>: SAT solver conflict limit for each output or register\n");
+	printf("     (0 for no limit, default: 10000).\n");
+	printf("The exit status is 0 only if the designs are proven equivalent.\n");
+}
+
+static const char *status_names[] = {
+	"equivalent",
+	"different",
+	"undecided"
+};
+
+static void print_result(struct equiv_result *r)
+{
+	struct equiv_failure *f;
+
+	printf("Inputs: %d, outputs: %d\n", r->inputs, r->outputs);
+	printf("Registers: %d in the design, %d in the netlist, %d paired\n",
+		r->registers_ref, r->registers_impl, r->register_pairs);
+	printf("AND nodes: %d, merged: %d, SAT calls: %d\n", r->and_nodes, r->merged, r->sat_calls);
+	for(f=r->failures;f!=NULL;f=f->next) {
+		printf("%s %s: %s", f->type == EQUIV_POINT_OUTPUT ? "Output" : "Register",
+			f->name, status_names[f->status]);
+		if(f->cycle >= 0)
+			printf(" (cycle %d)", f->cycle);
+		printf("\n");
+	}
+	printf("Result: %s\n", status_names[r->status]);
+}
+
+/* The EDIF writer names the nets after their uids, which the symbols file of the mapper
+ * gives the names of.
+ */
+static void name_nets(struct netlist_sym_store *symbols, const char *filename)
+{
+	struct netlist_sym_store *mapped;
+	struct netlist_sym *sym, *net, *newsym;
+	char name[16];
+
+	mapped = netlist_sym_newstore();
+	netlist_sym_from_file(mapped, filename);
+	for(sym=mapped->head;sym!=NULL;sym=sym->next) {
+		if(sym->type != 'N')
+			continue;
+		sprintf(name, "N%08x", sym->uid);
+		net = netlist_sym_lookup(symbols, name, 'N');
+		if(net == NULL)
+			continue;
+		newsym = netlist_sym_add(symbols, net->uid, 'N', sym->name);
+		newsym->user = net->user;
+	}
+	netlist_sym_freestore(mapped);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	long int conflict_limit;
+	char *netlist_edf;
+	char *netlist_sym;
+	struct flow_sc sc;
+	struct edif_read_param param;
+	struct netlist_manager *netlist;
+	struct netlist_sym_store *symbols;
+	struct llhdl_module *m;
+	struct equiv_result r;
+
+	conflict_limit = 10000;
+	netlist_edf = NULL;
+	netlist_sym = NULL;
+	while((opt = getopt(argc, argv, "hp:f:l:i:j:n:s:c:")) != -1) {
+		switch(opt) {
+			case 'h':
+				help();
+				exit(EXIT_SUCCESS);
+				break;
+			case 'p':
+				flow_settings.part = (char *)flow_validate_part(optarg);
+				if(flow_settings.part == NULL) {
+					fprintf(stderr, "Unknown part: %s. Use -h to list supported parts.\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'f':
+				flow_handle_option(optarg);
+				break;
+			case 'l':
+				flow_settings.lut_mapper = tilm_get_mapper_by_handle(optarg);
+				if(flow_settings.lut_mapper < 0) {
+					fprintf(stderr, "Unknown LUT mapping algorithm: %s. Use -h to list supported algorithms.\n", optarg);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'i':
+				flow_settings.lut_max_inputs = atoi(optarg);
+				if((flow_settings.lut_max_inputs < 3) || (flow_settings.lut_max_inputs > 6)) {
+					fprintf(stderr, "Invalid number of maximum LUT inputs.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'j':
+				flow_settings.threads = atoi(optarg);
+				if(flow_settings.threads < 1) {
+					fprintf(stderr, "Invalid number of threads.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'n':
+				free(netlist_edf);
+				netlist_edf = stralloc(optarg);
+				break;
+			case 's':
+				free(netlist_sym);
+				netlist_sym = stralloc(optarg);
+				break;
+			case 'c':
+				conflict_limit = atol(optarg);
+				break;
+			default:
+				fprintf(stderr, "Invalid option passed. Use -h for help.\n");
+				exit(EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if((argc - optind) != 1) {
+		fprintf(stderr, "llhdl-equiv: missing input file. Use -h for help.\n");
+		exit(EXIT_FAILURE);
+	}
+	flow_settings.input_lhd = argv[optind];
+
+	if(netlist_edf != NULL) {
+		param.primitives = netlist_xilprims;
+		param.nprimitives = NETLIST_XIL_COUNT;
+		param.iops = netlist_create_iop_manager();
+		param.symbols = netlist_sym_newstore();
+		netlist = netlist_m_new();
+		netlist_m_edif_read_file(netlist, netlist_edf, &param);
+		symbols = param.symbols;
+		if(netlist_sym != NULL)
+			name_nets(symbols, netlist_sym);
+	} else {
+		flow_map(&sc, &flow_settings);
+		netlist = sc.netlist;
+		symbols = sc.symbols;
+	}
+	/* the mapper has transformed its copy of the design */
+	m = llhdl_parse_file(flow_settings.input_lhd);
+	llhdl_flatten(m);
+	equiv_check(m, netlist, symbols, conflict_limit, &r);
+	print_result(&r);
+
+	equiv_free_result(&r);
+	llhdl_free_module(m);
+	if(netlist_edf != NULL) {
+		netlist_sym_freestore(symbols);
+		netlist_m_free(netlist);
+		netlist_free_iop_manager(param.iops);
+	} else
+		flow_free(&sc);
+	free(netlist_edf);
+	free(netlist_sym);
+
+	return r.status == EQUIV_EQUIVALENT ? EXIT_SUCCESS : EXIT_FAILURE;
+}
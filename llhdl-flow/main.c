@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <util.h>
+
+#include <banner/banner.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/interchange.h>
+
+#include "verilog.h"
+#include "transform.h"
+#include "flow.h"
+#include "options.h"
+#include "resolveucf.h"
+
+static void help()
+{
+	banner("Verilog to Spartan-6 netlist flow");
+	printf("Usage: llhdl-flow [parameters] <input.v>\n\n");
+	printf("Compiles the input module in Verilog HDL (input.v) and maps it in one process,\n");
+	printf("like llhdl-verilog, llhdl-spartan6-map and llhdl-resolveucf do in sequence.\n");
+	printf("Parameters are:\n");
+	printf("  -h Display this help text and exit.\n");
+	flow_help_settings();
+	printf("  -u <input.ucf>: Resolve the net names of this UCF file against the netlist.\n");
+	printf("Output file(s) selection (can be combined):\n");
+	printf("  -o <netlist.anl>: Write a netlist in Antares format.\n");
+	printf("  -e <netlist.edf>: Write a netlist in EDIF format (default: input.edf,\n");
+	printf("     if no other netlist is selected).\n");
+	printf("  -d <netlist.dot>: Write a DOT (Graphviz) representation of the netlist.\n");
+	printf("  -s <symbols.sym>: Write a symbols file.\n");
+	printf("  -L <design.lhd>: Write the design in LLHDL interchange format.\n");
+	printf("  -r <resolved.ucf>: Write the resolved UCF file (default: input-resolved.ucf).\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *inname;
+	char *ucfname, *resolvedname, *lhdname;
+	struct verilog_module *vm;
+	struct llhdl_module *lm;
+	struct flow_sc sc;
+	int err;
+
+	ucfname = NULL;
+	resolvedname = NULL;
+	lhdname = NULL;
+	while((opt = getopt(argc, argv, "hu:L:r:" FLOW_GETOPT)) != -1) {
+		switch(opt) {
+			case 'h':
+				help();
+				exit(EXIT_SUCCESS);
+				break;
+			case 'u':
+				free(ucfname);
+				ucfname = stralloc(optarg);
+				break;
+			case 'L':
+				free(lhdname);
+				lhdname = stralloc(optarg);
+				break;
+			case 'r':
+				free(resolvedname);
+				resolvedname = stralloc(optarg);
+				break;
+			default:
+				if(!flow_handle_getopt(opt, optarg)) {
+					fprintf(stderr, "Invalid option passed. Use -h for help.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+		}
+	}
+
+	if((argc - optind) != 1) {
+		fprintf(stderr, "llhdl-flow: missing input file. Use -h for help.\n");
+		exit(EXIT_FAILURE);
+	}
+	inname = argv[optind];
+	flow_default_outputs(inname);
+	if((ucfname != NULL) && (resolvedname == NULL))
+		resolvedname = flow_file_suffix(ucfname, "-resolved.ucf");
+
+	/* Front-end */
+	vm = verilog_parse_file(inname);
+	lm = llhdl_new_module();
+	transform(lm, vm);
+	verilog_free_module(vm);
+	if(lhdname != NULL)
+		llhdl_write_file(lm, lhdname);
+
+	/* Mapping, on the in-memory design */
+	flow_load(&sc, &flow_settings, lm);
+	flow_metamap(&sc);
+	flow_prune(&sc);
+	flow_write(&sc);
+
+	/* Constraints, resolved against the in-memory symbols */
+	err = 0;
+	if(ucfname != NULL)
+		err = resolveucf(sc.symbols, ucfname, resolvedname);
+
+	flow_free(&sc);
+	free(ucfname);
+	free(resolvedname);
+	free(lhdname);
+	flow_free_outputs();
+
+	return err;
+}
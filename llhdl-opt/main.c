@@ -0,0 +1,123 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/interchange.h>
+#include <llhdl/opt.h>
+
+#include <banner/banner.h>
+
+static unsigned int passes = LLHDL_OPT_ALL;
+
+static void list_passes()
+{
+	int i;
+
+	for(i=0;i<LLHDL_OPT_COUNT;i++)
+		printf("    -f[no-]%s: %s (default: %s)\n",
+			llhdl_opt_passes[i].handle,
+			llhdl_opt_passes[i].description,
+			passes & (1 << i) ? "enabled" : "disabled");
+}
+
+static void help()
+{
+	banner("LLHDL optimizer");
+	printf("Usage: llhdl-opt [parameters] <input.lhd>\n");
+	printf("The input design in LLHDL interchange format (input.lhd) is mandatory.\n");
+	printf("Parameters are:\n");
+	printf("  -h Display this help text and exit.\n");
+	printf("  -o <output.lhd> Set the name of the output file.\n");
+	printf("  -f <[no-]pass>: Enable or disable passes. Supported passes are:\n");
+	list_passes();
+}
+
+static void handle_pass(char *pass)
+{
+	int val;
+	int i;
+
+	val = 1;
+	if(strncmp(pass, "no-", 3) == 0) {
+		val = 0;
+		pass += 3;
+	}
+	i = llhdl_opt_get_pass_by_handle(pass);
+	if(i < 0) {
+		fprintf(stderr, "Invalid pass: '%s'.\n", pass);
+		exit(EXIT_FAILURE);
+	}
+	if(val)
+		passes |= 1 << i;
+	else
+		passes &= ~(1 << i);
+}
+
+static char *mk_outname(char *inname)
+{
+	char *c;
+	int r;
+	char *out;
+
+	inname = stralloc(inname);
+	c = strrchr(inname, '.');
+	if(c != NULL)
+		*c = 0;
+	r = asprintf(&out, "%s-opt.lhd", inname);
+	if(r == -1) abort();
+	free(inname);
+	return out;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *inname;
+	char *outname;
+	struct llhdl_module *m;
+	int changes;
+
+	outname = NULL;
+	while((opt = getopt(argc, argv, "ho:f:")) != -1) {
+		switch(opt) {
+			case 'h':
+				help();
+				exit(EXIT_SUCCESS);
+				break;
+			case 'o':
+				free(outname);
+				outname = stralloc(optarg);
+				break;
+			case 'f':
+				handle_pass(optarg);
+				break;
+			default:
+				fprintf(stderr, "Invalid option passed. Use -h for help.\n");
+				exit(EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if((argc - optind) != 1) {
+		fprintf(stderr, "llhdl-opt: missing input file. Use -h for help.\n");
+		exit(EXIT_FAILURE);
+	}
+	inname = argv[optind];
+	if(outname == NULL)
+		outname = mk_outname(inname);
+
+	m = llhdl_parse_file(inname);
+	changes = llhdl_optimize(m, passes);
+	printf("%d change(s) made.\n", changes);
+	llhdl_write_file(m, outname);
+
+	llhdl_free_module(m);
+	free(outname);
+
+	return 0;
+}
@@ -0,0 +1,101 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <util.h>
+
+#include <netlist/symbol.h>
+
+#include "resolveucf.h"
+
+static char *process_line(struct netlist_sym_store *sym, char *line)
+{
+	char *c;
+	char *c2;
+	struct netlist_sym *s;
+	int r;
+	char *replacement;
+	
+	while(isblank(*line))
+		line++;
+	if(strncasecmp(line, "NET ", 4) != 0)
+		return stralloc(line);
+
+	c = line + 4;
+	while(isblank(*c))
+		c++;
+	if(*c == '"')
+		c++;
+	c2 = c;
+	while(!isblank(*c2) && (*c2 != '"'))
+		c2++;
+	if(*c2 == '"') {
+		*c2 = 0;
+		c2++;
+	}
+	if(*(c2+1) == 0) {
+		fprintf(stderr, "Malformed line: %s\n", line);
+		return NULL;
+	}
+	*c2 = 0;
+	c2++;
+
+	s = netlist_sym_lookup(sym, c, 'N');
+	if(s == NULL) {
+		fprintf(stderr, "Symbol not found: %s\n", c);
+		return NULL;
+	}
+	r = asprintf(&replacement, "NET N%08x %s", s->uid, c2);
+	assert(r != -1);
+
+	return replacement;
+}
+
+int resolveucf(struct netlist_sym_store *sym, const char *inname, const char *outname)
+{
+	FILE *fd_in, *fd_out;
+	int r;
+	char *line;
+	size_t linesize;
+	char *replacement;
+	int err;
+
+	fd_in = fopen(inname, "r");
+	if(fd_in == NULL) {
+		perror("Error opening input file");
+		exit(EXIT_FAILURE);
+	}
+	fd_out = fopen(outname, "w");
+	if(fd_out == NULL) {
+		perror("Error opening output file");
+		exit(EXIT_FAILURE);
+	}
+
+	line = NULL;
+	linesize = 0;
+	err = 0;
+	while(1) {
+		r = getline(&line, &linesize, fd_in);
+		if(r == -1) {
+			assert(feof(fd_in));
+			break;
+		}
+		replacement = process_line(sym, line);
+		if(replacement != NULL) {
+			r = fwrite(replacement, strlen(replacement), 1, fd_out);
+			assert(r == 1);
+			free(replacement);
+		} else {
+			err = 2;
+			break;
+		}
+	}
+
+	free(line);
+	fclose(fd_in);
+	r = fclose(fd_out);
+	assert(r == 0);
+
+	return err;
+}
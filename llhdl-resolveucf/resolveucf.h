@@ -0,0 +1,11 @@
+#ifndef __RESOLVEUCF_H
+#define __RESOLVEUCF_H
+
+#include <netlist/symbol.h>
+
+/* Replaces the net names of a UCF file with the netlist names of the symbols.
+ * Returns 0 on success, or 2 if a line could not be resolved.
+ */
+int resolveucf(struct netlist_sym_store *sym, const char *inname, const char *outname);
+
+#endif /* __RESOLVEUCF_H */
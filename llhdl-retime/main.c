@@ -0,0 +1,90 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/interchange.h>
+#include <llhdl/tools.h>
+#include <llhdl/retime.h>
+
+#include <banner/banner.h>
+
+static void help()
+{
+	banner("Register retiming");
+	printf("Usage: llhdl-retime [parameters] <input.lhd>\n");
+	printf("The input design in LLHDL interchange format (input.lhd) is mandatory.\n");
+	printf("Parameters are:\n");
+	printf("  -h Display this help text and exit.\n");
+	printf("  -o <output.lhd> Set the name of the output file.\n");
+}
+
+static char *mk_outname(char *inname)
+{
+	char *c;
+	int r;
+	char *out;
+
+	inname = stralloc(inname);
+	c = strrchr(inname, '.');
+	if(c != NULL)
+		*c = 0;
+	r = asprintf(&out, "%s-retimed.lhd", inname);
+	if(r == -1) abort();
+	free(inname);
+	return out;
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *inname;
+	char *outname;
+	struct llhdl_module *m;
+	int period_before, period_after;
+
+	outname = NULL;
+	while((opt = getopt(argc, argv, "ho:")) != -1) {
+		switch(opt) {
+			case 'h':
+				help();
+				exit(EXIT_SUCCESS);
+				break;
+			case 'o':
+				free(outname);
+				outname = stralloc(optarg);
+				break;
+			default:
+				fprintf(stderr, "Invalid option passed. Use -h for help.\n");
+				exit(EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if((argc - optind) != 1) {
+		fprintf(stderr, "llhdl-retime: missing input file. Use -h for help.\n");
+		exit(EXIT_FAILURE);
+	}
+	inname = argv[optind];
+	if(outname == NULL)
+		outname = mk_outname(inname);
+
+	m = llhdl_parse_file(inname);
+	/* registers are moved across the whole design */
+	llhdl_flatten(m);
+	period_after = llhdl_retime(m, &period_before);
+	if(period_after < 0)
+		printf("No registers to retime.\n");
+	else
+		printf("Estimated period: %d -> %d\n", period_before, period_after);
+	llhdl_write_file(m, outname);
+
+	llhdl_free_module(m);
+	free(outname);
+
+	return 0;
+}
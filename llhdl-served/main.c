@@ -0,0 +1,880 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libgen.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <util.h>
+
+#include <banner/banner.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/interchange.h>
+
+#include "verilog.h"
+#include "transform.h"
+#include "flow.h"
+#include "options.h"
+#include "resolveucf.h"
+
+/* Editors often write a file in several steps: wait for this many milliseconds
+ * without events before rebuilding.
+ */
+#define DEBOUNCE_MS 50
+
+enum {
+	BUILD_NONE,
+	BUILD_OK,
+	BUILD_UNCHANGED,
+	BUILD_FAILED
+};
+
+static const char *build_status_names[] = {
+	"none",
+	"ok",
+	"unchanged",
+	"failed"
+};
+
+struct client {
+	int fd;
+	int build;		/* < number of the build the client waits for */
+};
+
+struct served {
+	char *inname;
+	char *ucfname;
+	char *resolvedname;
+	char *lhdname;
+
+	int inotify_fd;
+	int listen_fd;
+
+	/* front end child, parsing the source */
+	pid_t front_pid;	/* < 0 if none */
+	int front_fd;		/* < receives the LLHDL design, -1 if none */
+	char *lhd;
+	size_t lhd_len;
+	size_t lhd_size;
+
+	/* builder process */
+	pid_t pid;		/* < 0 if none */
+	int cmd_fd;		/* < sends the build requests */
+	int fd;			/* < receives the status of the builds, -1 if none */
+	char line[64];
+	size_t len;
+
+	/* changes not sent to the builder yet */
+	int source_dirty;
+	int ucf_dirty;
+
+	int building;		/* < a build is running, in the front end or in the builder */
+	int forced;		/* < the running build was requested on the socket */
+	double start;
+
+	int force;		/* < a build was requested on the socket */
+	struct client *clients;
+	int nclients;
+
+	int builds;
+	int status;
+	double time;		/* < of the last build, in seconds */
+	int mapped;		/* < cones mapped by the last build */
+	int reused;		/* < cones of the last build taken from the previous ones */
+};
+
+static volatile sig_atomic_t quit;
+
+static void help()
+{
+	banner("Synthesis watcher");
+	printf("Usage: llhdl-served [parameters] <input.v>\n\n");
+	printf("Watches the input module in Verilog HDL (input.v) and the UCF file, and rebuilds\n");
+	printf("the outputs of llhdl-flow each time they are saved. A builder process keeps the\n");
+	printf("design and the netlists of its cones between builds, and maps only the cones\n");
+	printf("that changed. The netlist is left untouched if the change does not affect the\n");
+	printf("LLHDL design, and a change of the UCF file alone only resolves it again.\n");
+	printf("Commands are accepted on a UNIX socket, also while a build is running.\n");
+	printf("Parameters are:\n");
+	printf("  -h Display this help text and exit.\n");
+	flow_help_settings();
+	printf("  -j <n>: Map the changed cones with that many threads (default: %d)\n", flow_settings.threads);
+	printf("  -u <input.ucf>: Resolve the net names of this UCF file against the netlist.\n");
+	printf("  -S <socket>: Path of the command socket (default: input.sock).\n");
+	printf("  -c <command>: Send a command to a running watcher and print its reply.\n");
+	printf("     Commands are: status, build (run all steps again), quit.\n");
+	printf("Output file(s) selection (can be combined):\n");
+	printf("  -o <netlist.anl>: Write a netlist in Antares format.\n");
+	printf("  -e <netlist.edf>: Write a netlist in EDIF format (default: input.edf,\n");
+	printf("     if no other netlist is selected).\n");
+	printf("  -d <netlist.dot>: Write a DOT (Graphviz) representation of the netlist.\n");
+	printf("  -s <symbols.sym>: Write a symbols file.\n");
+	printf("  -L <design.lhd>: Write the design in LLHDL interchange format.\n");
+	printf("  -r <resolved.ucf>: Write the resolved UCF file (default: input-resolved.ucf).\n");
+}
+
+static double now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t r;
+
+	while(len > 0) {
+		r = write(fd, buf, len);
+		if(r == -1) {
+			if(errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += r;
+		len -= r;
+	}
+	return 0;
+}
+
+/*
+ * Builder process. It keeps the LLHDL design and the flow state of the last
+ * successful build, and the netlists of its cones.
+ * The steps that exit on errors in the input files run in short-lived children,
+ * so that these errors do not lose that state. The front end is forked from the
+ * watcher, which stays small: a child of the builder would copy the pages of its
+ * heap as it allocates.
+ */
+
+struct builder {
+	struct flow_cache *cache;
+	int has_design;
+	struct flow_sc sc;	/* < of the last successful build */
+	char *lhd;		/* < its design, in LLHDL interchange format */
+	size_t lhd_len;
+	int ucf_dirty;		/* < the UCF file must be resolved again */
+};
+
+/* Returns 1 if the child exited successfully */
+static int wait_child(pid_t pid)
+{
+	int status;
+
+	while(waitpid(pid, &status, 0) == -1)
+		if(errno != EINTR) {
+			perror("waitpid");
+			exit(EXIT_FAILURE);
+		}
+	return WIFEXITED(status) && (WEXITSTATUS(status) == EXIT_SUCCESS);
+}
+
+static pid_t fork_child()
+{
+	pid_t pid;
+
+	fflush(NULL);
+	pid = fork();
+	if(pid == -1) {
+		perror("fork");
+		exit(EXIT_FAILURE);
+	}
+	return pid;
+}
+
+static int resolve_ucf(struct served *s, struct builder *b)
+{
+	pid_t pid;
+
+	pid = fork_child();
+	if(pid == 0)
+		_exit(resolveucf(b->sc.symbols, s->ucfname, s->resolvedname) == 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+	return wait_child(pid);
+}
+
+static void map_design(struct served *s, struct builder *b, char *lhd, size_t lhd_len)
+{
+	struct llhdl_module *lm;
+	struct flow_sc sc;
+	FILE *f;
+
+	if(s->lhdname != NULL) {
+		f = fopen(s->lhdname, "w");
+		if(f == NULL) {
+			perror("Error opening LLHDL output file");
+			exit(EXIT_FAILURE);
+		}
+		fwrite(lhd, 1, lhd_len, f);
+		fclose(f);
+	}
+	f = fmemopen(lhd, lhd_len, "r");
+	if(f == NULL) {
+		perror("fmemopen");
+		exit(EXIT_FAILURE);
+	}
+	lm = llhdl_parse_fd(f);
+	fclose(f);
+
+	/* the previous netlist is freed first, for the new one to take its memory */
+	if(b->has_design)
+		flow_free(&b->sc);
+	flow_load(&sc, &flow_settings, lm);
+	flow_metamap_cached(&sc, b->cache);
+	flow_prune(&sc);
+	flow_write(&sc);
+
+	b->sc = sc;
+	b->has_design = 1;
+	free(b->lhd);
+	b->lhd = lhd;
+	b->lhd_len = lhd_len;
+}
+
+/* Takes the design parsed by the front end, or NULL if the source did not change */
+static int build(struct served *s, struct builder *b, char *lhd, size_t lhd_len, int force)
+{
+	int changed;
+
+	changed = 0;
+	b->cache->mapped = 0;
+	b->cache->reused = 0;
+	if(lhd != NULL) {
+		if(force || !b->has_design
+		  || (lhd_len != b->lhd_len) || (memcmp(lhd, b->lhd, lhd_len) != 0)) {
+			map_design(s, b, lhd, lhd_len);
+			/* the symbols changed */
+			b->ucf_dirty = 1;
+			changed = 1;
+		} else
+			free(lhd);
+	}
+	if((s->ucfname != NULL) && b->ucf_dirty && b->has_design) {
+		if(!resolve_ucf(s, b))
+			return BUILD_FAILED;
+		b->ucf_dirty = 0;
+		changed = 1;
+	}
+	return changed ? BUILD_OK : BUILD_UNCHANGED;
+}
+
+/* Serves the build requests of the watcher until it closes the pipe */
+static void run_builder(struct served *s, int cmd_fd, int status_fd)
+{
+	struct builder b;
+	FILE *in;
+	char *line;
+	size_t size;
+	char *lhd;
+	size_t lhd_len;
+	char *reply;
+	int ucf, force;
+	int status;
+	int i, r;
+
+	signal(SIGINT, SIG_DFL);
+	signal(SIGTERM, SIG_DFL);
+	close(s->inotify_fd);
+	close(s->listen_fd);
+	/* the clients must see the end of their connection when the watcher closes it */
+	for(i=0;i<s->nclients;i++)
+		close(s->clients[i].fd);
+
+	b.cache = flow_cache_new();
+	b.has_design = 0;
+	b.lhd = NULL;
+	b.lhd_len = 0;
+	b.ucf_dirty = 1;
+	in = fdopen(cmd_fd, "r");
+	if(in == NULL)
+		_exit(EXIT_FAILURE);
+	line = NULL;
+	size = 0;
+	while(getline(&line, &size, in) != -1) {
+		if(sscanf(line, "build %zu %d %d", &lhd_len, &ucf, &force) != 3)
+			continue;
+		lhd = NULL;
+		if(lhd_len > 0) {
+			lhd = alloc_size(lhd_len);
+			if(fread(lhd, 1, lhd_len, in) != lhd_len) {
+				free(lhd);
+				break;
+			}
+		}
+		b.ucf_dirty |= ucf;
+		status = build(s, &b, lhd, lhd_len, force);
+		fflush(NULL);
+		r = asprintf(&reply, "%s %d %d\n", build_status_names[status], b.cache->mapped, b.cache->reused);
+		if(r == -1) abort();
+		if(write_all(status_fd, reply, strlen(reply)) == -1)
+			break;
+		free(reply);
+	}
+
+	free(line);
+	fclose(in);
+	if(b.has_design)
+		flow_free(&b.sc);
+	flow_cache_free(b.cache);
+	free(b.lhd);
+	_exit(EXIT_SUCCESS);
+}
+
+static void start_builder(struct served *s)
+{
+	int cmd[2], status[2];
+	pid_t pid;
+
+	if((pipe(cmd) == -1) || (pipe(status) == -1)) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	pid = fork_child();
+	if(pid == 0) {
+		close(cmd[1]);
+		close(status[0]);
+		run_builder(s, cmd[0], status[1]);
+	}
+	close(cmd[0]);
+	close(status[1]);
+	fcntl(status[0], F_SETFL, O_NONBLOCK);
+
+	s->pid = pid;
+	s->cmd_fd = cmd[1];
+	s->fd = status[0];
+	s->len = 0;
+}
+
+static void stop_builder(struct served *s)
+{
+	if(s->pid == 0)
+		return;
+	kill(s->pid, SIGTERM);
+	close(s->cmd_fd);
+	close(s->fd);
+	s->fd = -1;
+	waitpid(s->pid, NULL, 0);
+	s->pid = 0;
+}
+
+static void reply_status(int fd, struct served *s)
+{
+	char *reply;
+	int r;
+
+	r = asprintf(&reply, "%s %d %.1f%s\n", build_status_names[s->status], s->builds, s->time*1000.0,
+		s->building ? " building" : "");
+	if(r == -1) abort();
+	write_all(fd, reply, strlen(reply));
+	free(reply);
+}
+
+static void reply_clients(struct served *s)
+{
+	int i, n;
+
+	n = 0;
+	for(i=0;i<s->nclients;i++) {
+		if(s->clients[i].build <= s->builds) {
+			reply_status(s->clients[i].fd, s);
+			close(s->clients[i].fd);
+		} else
+			s->clients[n++] = s->clients[i];
+	}
+	s->nclients = n;
+}
+
+static void end_build(struct served *s, int status)
+{
+	s->building = 0;
+	s->status = status;
+	s->builds++;
+	s->time = now() - s->start;
+	printf("Build %d: %s (%.1f ms", s->builds, build_status_names[s->status], s->time*1000.0);
+	if((s->mapped + s->reused) > 0)
+		printf(", %d of %d cones mapped", s->mapped, s->mapped + s->reused);
+	printf(")\n");
+	fflush(stdout);
+	reply_clients(s);
+}
+
+/* The builder starts again at the next build, without the state of the previous one */
+static void builder_died(struct served *s)
+{
+	stop_builder(s);
+	if(s->building && (s->front_pid == 0))
+		end_build(s, BUILD_FAILED);
+}
+
+/* Sends the design parsed by the front end, if any, and the changes to the builder */
+static void send_build(struct served *s)
+{
+	char request[64];
+
+	if(s->pid == 0)
+		start_builder(s);
+	sprintf(request, "build %zu %d %d\n", s->lhd_len, s->ucf_dirty, s->forced);
+	s->ucf_dirty = 0;
+	if((write_all(s->cmd_fd, request, strlen(request)) == -1)
+	  || (write_all(s->cmd_fd, s->lhd, s->lhd_len) == -1))
+		builder_died(s);
+	s->lhd_len = 0;
+}
+
+/* Parses the input in a child, which sends back the LLHDL design.
+ * The child exits with an error if the input has errors.
+ */
+static void start_front_end(struct served *s)
+{
+	struct verilog_module *vm;
+	struct llhdl_module *lm;
+	FILE *f;
+	int fds[2];
+
+	if(pipe(fds) == -1) {
+		perror("pipe");
+		exit(EXIT_FAILURE);
+	}
+	s->front_pid = fork_child();
+	if(s->front_pid == 0) {
+		signal(SIGINT, SIG_DFL);
+		signal(SIGTERM, SIG_DFL);
+		close(fds[0]);
+		vm = verilog_parse_file(s->inname);
+		lm = llhdl_new_module();
+		transform(lm, vm);
+		verilog_free_module(vm);
+		f = fdopen(fds[1], "w");
+		if(f == NULL)
+			_exit(EXIT_FAILURE);
+		llhdl_write_fd(lm, f);
+		if(fclose(f) != 0)
+			_exit(EXIT_FAILURE);
+		_exit(EXIT_SUCCESS);
+	}
+	close(fds[1]);
+	fcntl(fds[0], F_SETFL, O_NONBLOCK);
+	s->front_fd = fds[0];
+	s->lhd_len = 0;
+}
+
+static void stop_front_end(struct served *s)
+{
+	if(s->front_pid == 0)
+		return;
+	kill(s->front_pid, SIGTERM);
+	close(s->front_fd);
+	s->front_fd = -1;
+	waitpid(s->front_pid, NULL, 0);
+	s->front_pid = 0;
+}
+
+static void read_front_end(struct served *s)
+{
+	ssize_t r;
+	int ok;
+
+	if(s->lhd_len == s->lhd_size) {
+		s->lhd_size = 2*s->lhd_size + 4096;
+		s->lhd = realloc(s->lhd, s->lhd_size);
+		if(s->lhd == NULL) abort();
+	}
+	r = read(s->front_fd, s->lhd + s->lhd_len, s->lhd_size - s->lhd_len);
+	if(r > 0) {
+		s->lhd_len += r;
+		return;
+	}
+	if((r == -1) && ((errno == EAGAIN) || (errno == EINTR)))
+		return;
+	close(s->front_fd);
+	s->front_fd = -1;
+	ok = wait_child(s->front_pid) && (r == 0);
+	s->front_pid = 0;
+	if(!ok) {
+		/* the source stays dirty */
+		s->lhd_len = 0;
+		end_build(s, BUILD_FAILED);
+		return;
+	}
+	s->source_dirty = 0;
+	send_build(s);
+}
+
+/* A new builder has no design, the source is parsed again for it */
+static void start_build(struct served *s)
+{
+	s->forced = s->force;
+	s->force = 0;
+	s->building = 1;
+	s->start = now();
+	s->mapped = 0;
+	s->reused = 0;
+	if(s->source_dirty || s->forced || (s->pid == 0))
+		start_front_end(s);
+	else
+		send_build(s);
+}
+
+static void read_build(struct served *s)
+{
+	char status[16];
+	char *end;
+	ssize_t r;
+	int i;
+
+	r = read(s->fd, s->line + s->len, sizeof(s->line) - 1 - s->len);
+	if((r == 0) || ((r == -1) && (errno != EAGAIN) && (errno != EINTR))) {
+		builder_died(s);
+		return;
+	}
+	if(r == -1)
+		return;
+	s->len += r;
+	s->line[s->len] = 0;
+	end = strchr(s->line, '\n');
+	if(end == NULL) {
+		if(s->len == sizeof(s->line) - 1)
+			builder_died(s);
+		return;
+	}
+	*end = 0;
+	if(sscanf(s->line, "%15s %d %d", status, &s->mapped, &s->reused) != 3)
+		strcpy(status, "failed");
+	s->len = 0;
+	for(i=BUILD_OK;i<BUILD_FAILED;i++)
+		if(strcmp(status, build_status_names[i]) == 0)
+			break;
+	end_build(s, i);
+}
+
+static void stop_clients(struct served *s)
+{
+	int i;
+
+	for(i=0;i<s->nclients;i++)
+		close(s->clients[i].fd);
+	free(s->clients);
+}
+
+static int open_socket(const char *path, int server)
+{
+	struct sockaddr_un addr;
+	int fd;
+
+	if(strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "Socket path too long: %s\n", path);
+		exit(EXIT_FAILURE);
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path);
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1) {
+		perror("socket");
+		exit(EXIT_FAILURE);
+	}
+	if(server) {
+		unlink(path);
+		if((bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) || (listen(fd, 8) == -1)) {
+			perror("Error opening command socket");
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		if(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+			perror("Error connecting to the watcher");
+			exit(EXIT_FAILURE);
+		}
+	}
+	return fd;
+}
+
+static void send_command(const char *path, const char *command)
+{
+	int fd;
+	char buf[256];
+	ssize_t r;
+
+	fd = open_socket(path, 0);
+	write_all(fd, command, strlen(command));
+	write_all(fd, "\n", 1);
+	while((r = read(fd, buf, sizeof(buf))) > 0)
+		fwrite(buf, 1, r, stdout);
+	close(fd);
+}
+
+/* The reply to a build command is sent when the build it started is over */
+static void wait_build(int fd, struct served *s)
+{
+	s->clients = realloc(s->clients, (s->nclients + 1)*sizeof(struct client));
+	if(s->clients == NULL) abort();
+	s->clients[s->nclients].fd = fd;
+	s->clients[s->nclients].build = s->builds + (s->building ? 2 : 1);
+	s->nclients++;
+	s->force = 1;
+}
+
+/* One command per connection */
+static void handle_client(int listen_fd, struct served *s)
+{
+	struct timeval timeout;
+	int fd;
+	char line[64];
+	size_t len;
+	ssize_t r;
+
+	fd = accept(listen_fd, NULL, NULL);
+	if(fd == -1)
+		return;
+	/* do not let a silent client stall the watcher */
+	timeout.tv_sec = 1;
+	timeout.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	len = 0;
+	while(len < sizeof(line) - 1) {
+		r = read(fd, line + len, sizeof(line) - 1 - len);
+		if(r <= 0)
+			break;
+		len += r;
+		if(memchr(line, '\n', len) != NULL)
+			break;
+	}
+	line[len] = 0;
+	line[strcspn(line, "\r\n")] = 0;
+
+	if(strcmp(line, "status") == 0)
+		reply_status(fd, s);
+	else if(strcmp(line, "build") == 0) {
+		wait_build(fd, s);
+		return;
+	} else if(strcmp(line, "quit") == 0) {
+		write_all(fd, "bye\n", 4);
+		quit = 1;
+	} else
+		write_all(fd, "error unknown command\n", 22);
+	close(fd);
+}
+
+struct watch {
+	int wd;
+	char *name;	/* < base name of the file in the watched directory */
+};
+
+static void add_watch(int inotify_fd, struct watch *w, const char *filename)
+{
+	char *dir, *base;
+
+	dir = stralloc(filename);
+	base = stralloc(filename);
+	/* watch the directory, as editors often replace the file */
+	w->wd = inotify_add_watch(inotify_fd, dirname(dir), IN_CLOSE_WRITE|IN_MOVED_TO);
+	if(w->wd == -1) {
+		perror("inotify_add_watch");
+		exit(EXIT_FAILURE);
+	}
+	w->name = stralloc(basename(base));
+	free(dir);
+	free(base);
+}
+
+enum {
+	PENDING_SOURCE = 1,
+	PENDING_UCF = 2
+};
+
+static int read_events(int inotify_fd, struct watch *source, struct watch *ucf)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event *e;
+	ssize_t len;
+	char *p;
+	int pending;
+
+	pending = 0;
+	len = read(inotify_fd, buf, sizeof(buf));
+	if(len <= 0)
+		return 0;
+	for(p=buf;p<buf+len;p+=sizeof(struct inotify_event)+e->len) {
+		e = (struct inotify_event *)p;
+		if(e->len == 0)
+			continue;
+		if((e->wd == source->wd) && (strcmp(e->name, source->name) == 0))
+			pending |= PENDING_SOURCE;
+		if((ucf != NULL) && (e->wd == ucf->wd) && (strcmp(e->name, ucf->name) == 0))
+			pending |= PENDING_UCF;
+	}
+	return pending;
+}
+
+static void sig_quit(int sig)
+{
+	quit = 1;
+}
+
+static void serve(struct served *s, const char *socket_path)
+{
+	struct watch source, ucf;
+	struct pollfd fds[4];
+	struct sigaction sa;
+	int pending;
+	int r;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sig_quit;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	s->inotify_fd = inotify_init();
+	if(s->inotify_fd == -1) {
+		perror("inotify_init");
+		exit(EXIT_FAILURE);
+	}
+	add_watch(s->inotify_fd, &source, s->inname);
+	if(s->ucfname != NULL)
+		add_watch(s->inotify_fd, &ucf, s->ucfname);
+	s->listen_fd = open_socket(socket_path, 1);
+
+	s->front_fd = -1;
+	s->fd = -1;
+	s->force = 1;
+	fds[0].fd = s->inotify_fd;
+	fds[0].events = POLLIN;
+	fds[1].fd = s->listen_fd;
+	fds[1].events = POLLIN;
+	fds[2].events = POLLIN;
+	fds[3].events = POLLIN;
+	pending = 0;
+	while(!quit) {
+		if(!s->building && s->force)
+			start_build(s);
+		/* changes made during a build are debounced once it is over */
+		fds[2].fd = s->fd;
+		fds[3].fd = s->front_fd;
+		r = poll(fds, 4, (pending && !s->building) ? DEBOUNCE_MS : -1);
+		if(r == -1) {
+			if(errno == EINTR)
+				continue;
+			perror("poll");
+			exit(EXIT_FAILURE);
+		}
+		if(r == 0) {
+			if(pending & PENDING_SOURCE)
+				s->source_dirty = 1;
+			if(pending & PENDING_UCF)
+				s->ucf_dirty = 1;
+			pending = 0;
+			start_build(s);
+			continue;
+		}
+		if(fds[0].revents & POLLIN)
+			pending |= read_events(s->inotify_fd, &source, s->ucfname != NULL ? &ucf : NULL);
+		if(fds[1].revents & POLLIN)
+			handle_client(s->listen_fd, s);
+		/* the front end may start a new builder */
+		if(fds[2].revents & (POLLIN|POLLHUP|POLLERR))
+			read_build(s);
+		if(fds[3].revents & (POLLIN|POLLHUP|POLLERR))
+			read_front_end(s);
+	}
+
+	stop_front_end(s);
+	stop_builder(s);
+	stop_clients(s);
+	close(s->listen_fd);
+	unlink(socket_path);
+	close(s->inotify_fd);
+	free(source.name);
+	if(s->ucfname != NULL)
+		free(ucf.name);
+	free(s->lhd);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	struct served s;
+	char *socket_path;
+	char *command;
+
+	memset(&s, 0, sizeof(s));
+	socket_path = NULL;
+	command = NULL;
+	while((opt = getopt(argc, argv, "hj:u:S:c:L:r:" FLOW_GETOPT)) != -1) {
+		switch(opt) {
+			case 'h':
+				help();
+				exit(EXIT_SUCCESS);
+				break;
+			case 'j':
+				flow_settings.threads = atoi(optarg);
+				if(flow_settings.threads < 1) {
+					fprintf(stderr, "Invalid number of threads.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'u':
+				free(s.ucfname);
+				s.ucfname = stralloc(optarg);
+				break;
+			case 'S':
+				free(socket_path);
+				socket_path = stralloc(optarg);
+				break;
+			case 'c':
+				free(command);
+				command = stralloc(optarg);
+				break;
+			case 'L':
+				free(s.lhdname);
+				s.lhdname = stralloc(optarg);
+				break;
+			case 'r':
+				free(s.resolvedname);
+				s.resolvedname = stralloc(optarg);
+				break;
+			default:
+				if(!flow_handle_getopt(opt, optarg)) {
+					fprintf(stderr, "Invalid option passed. Use -h for help.\n");
+					exit(EXIT_FAILURE);
+				}
+				break;
+		}
+	}
+
+	if((argc - optind) != 1) {
+		fprintf(stderr, "llhdl-served: missing input file. Use -h for help.\n");
+		exit(EXIT_FAILURE);
+	}
+	s.inname = argv[optind];
+	if(socket_path == NULL)
+		socket_path = flow_file_suffix(s.inname, ".sock");
+	if(command != NULL) {
+		send_command(socket_path, command);
+		free(socket_path);
+		free(command);
+		return 0;
+	}
+
+	flow_default_outputs(s.inname);
+	if((s.ucfname != NULL) && (s.resolvedname == NULL))
+		s.resolvedname = flow_file_suffix(s.ucfname, "-resolved.ucf");
+
+	serve(&s, socket_path);
+
+	free(s.ucfname);
+	free(s.resolvedname);
+	free(s.lhdname);
+	free(socket_path);
+	free(command);
+	flow_free_outputs();
+
+	return 0;
+}
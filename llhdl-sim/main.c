@@ -0,0 +1,169 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/interchange.h>
+#include <llhdl/tools.h>
+#include <sim/sim.h>
+
+#include <banner/banner.h>
+
+#include "stimulus.h"
+#include "vcd.h"
+
+static void help()
+{
+	banner("Cycle simulator");
+	printf("Usage: llhdl-sim [parameters] <input.lhd>\n");
+	printf("The input design in LLHDL interchange format (input.lhd) is mandatory.\n");
+	printf("Parameters are:\n");
+	printf("  -h Display this help text and exit.\n");
+	printf("  -o <output.vcd> Set the name of the VCD output file.\n");
+	printf("  -s <stimulus.txt> Read input values from a stimulus file.\n");
+	printf("  -n <cycles> Number of clock cycles to simulate (default: length of\n");
+	printf("     the stimulus file, or 100).\n");
+	printf("  -l <lane> Test vector to dump into the VCD file (0-%d, default: 0).\n", SIM_LANES-1);
+	printf("  -r <seed> Seed for the random inputs.\n");
+	printf("Inputs that are not driven by the stimulus file get random values,\n");
+	printf("different in each of the %d simulated test vectors.\n", SIM_LANES);
+}
+
+static char *mk_outname(char *inname)
+{
+	char *c;
+	int r;
+	char *out;
+
+	inname = stralloc(inname);
+	c = strrchr(inname, '.');
+	if(c != NULL)
+		*c = 0;
+	r = asprintf(&out, "%s.vcd", inname);
+	if(r == -1) abort();
+	free(inname);
+	return out;
+}
+
+static void set_clocks(struct sim_sc *sim, sim_word v)
+{
+	struct sim_signal *s;
+
+	for(s=sim_get_signals(sim);s!=NULL;s=s->next)
+		if((s->signal->p.signal.type == LLHDL_SIGNAL_PORT_IN) && llhdl_is_clock(s->signal))
+			sim_set(sim, s, 0, v);
+}
+
+static void randomize_inputs(struct sim_sc *sim, struct stimulus *st)
+{
+	struct sim_signal *s;
+
+	for(s=sim_get_signals(sim);s!=NULL;s=s->next)
+		if((s->signal->p.signal.type == LLHDL_SIGNAL_PORT_IN) && !llhdl_is_clock(s->signal)
+		  && ((st == NULL) || !stimulus_drives(st, s)))
+			stimulus_random(sim, s);
+}
+
+int main(int argc, char *argv[])
+{
+	int opt;
+	char *inname;
+	char *outname;
+	char *stimname;
+	int cycles;
+	int lane;
+	struct llhdl_module *m;
+	struct sim_sc *sim;
+	struct stimulus *st;
+	struct vcd_writer *vcd;
+	int i;
+
+	outname = NULL;
+	stimname = NULL;
+	cycles = -1;
+	lane = 0;
+	while((opt = getopt(argc, argv, "ho:s:n:l:r:")) != -1) {
+		switch(opt) {
+			case 'h':
+				help();
+				exit(EXIT_SUCCESS);
+				break;
+			case 'o':
+				free(outname);
+				outname = stralloc(optarg);
+				break;
+			case 's':
+				stimname = optarg;
+				break;
+			case 'n':
+				cycles = atoi(optarg);
+				break;
+			case 'l':
+				lane = atoi(optarg);
+				if((lane < 0) || (lane >= SIM_LANES)) {
+					fprintf(stderr, "Invalid lane: %d\n", lane);
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case 'r':
+				srandom(atoi(optarg));
+				break;
+			default:
+				fprintf(stderr, "Invalid option passed. Use -h for help.\n");
+				exit(EXIT_FAILURE);
+				break;
+		}
+	}
+
+	if((argc - optind) != 1) {
+		fprintf(stderr, "llhdl-sim: missing input file. Use -h for help.\n");
+		exit(EXIT_FAILURE);
+	}
+	inname = argv[optind];
+	if(outname == NULL)
+		outname = mk_outname(inname);
+
+	m = llhdl_parse_file(inname);
+	llhdl_flatten(m);
+	llhdl_identify_clocks(m);
+	sim = sim_new(m);
+	st = NULL;
+	if(stimname != NULL) {
+		st = stimulus_load(stimname, sim);
+		if(cycles < 0)
+			cycles = stimulus_get_count(st);
+	}
+	if(cycles < 0)
+		cycles = 100;
+	vcd = vcd_open(outname, sim, m->name == NULL ? "top" : m->name, lane);
+
+	for(i=0;i<cycles;i++) {
+		randomize_inputs(sim, st);
+		/* inputs keep their last values when the stimulus file runs out */
+		if(st != NULL)
+			stimulus_next(st);
+		set_clocks(sim, 0);
+		sim_eval(sim);
+		vcd_sample(vcd, 2*i);
+		set_clocks(sim, ~(sim_word)0);
+		sim_clock(sim, NULL);
+		sim_eval(sim);
+		vcd_sample(vcd, 2*i+1);
+	}
+	vcd_sample(vcd, 2*cycles);
+	printf("Simulated %d cycles of %d test vectors (%d instructions).\n",
+		cycles, SIM_LANES, sim_get_instruction_count(sim));
+
+	vcd_close(vcd);
+	if(st != NULL)
+		stimulus_free(st);
+	sim_free(sim);
+	llhdl_free_module(m);
+	free(outname);
+
+	return 0;
+}
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <sim/sim.h>
+
+#include "stimulus.h"
+
+struct stimulus_row {
+	int *random;
+	mpz_t *values;
+	struct stimulus_row *next;
+};
+
+struct stimulus {
+	struct sim_sc *sim;
+	int ncolumns;
+	struct sim_signal **columns;
+	int count;
+	struct stimulus_row *rows;
+	struct stimulus_row *current;
+};
+
+static const char *separators = " \t\r\n";
+
+static int count_tokens(const char *line)
+{
+	int count;
+	int in_token;
+
+	count = 0;
+	in_token = 0;
+	for(;*line;line++) {
+		if(strchr(separators, *line) != NULL)
+			in_token = 0;
+		else if(!in_token) {
+			in_token = 1;
+			count++;
+		}
+	}
+	return count;
+}
+
+static void parse_header(struct stimulus *st, char *line, const char *filename, int lineno)
+{
+	char *token;
+	struct sim_signal *s;
+	int i;
+
+	st->ncolumns = count_tokens(line);
+	st->columns = alloc_size(st->ncolumns*sizeof(struct sim_signal *));
+	i = 0;
+	for(token=strtok(line, separators);token!=NULL;token=strtok(NULL, separators)) {
+		s = sim_find_signal(st->sim, token);
+		if((s == NULL) || (s->signal->p.signal.type != LLHDL_SIGNAL_PORT_IN)) {
+			fprintf(stderr, "%s:%d: '%s' is not an input\n", filename, lineno, token);
+			exit(EXIT_FAILURE);
+		}
+		st->columns[i++] = s;
+	}
+}
+
+static struct stimulus_row *parse_row(struct stimulus *st, char *line, const char *filename, int lineno)
+{
+	struct stimulus_row *row;
+	char *token;
+	int i;
+
+	if(count_tokens(line) != st->ncolumns) {
+		fprintf(stderr, "%s:%d: expected %d values\n", filename, lineno, st->ncolumns);
+		exit(EXIT_FAILURE);
+	}
+	row = alloc_type(struct stimulus_row);
+	row->random = alloc_size(st->ncolumns*sizeof(int));
+	row->values = alloc_size(st->ncolumns*sizeof(mpz_t));
+	row->next = NULL;
+	i = 0;
+	for(token=strtok(line, separators);token!=NULL;token=strtok(NULL, separators)) {
+		mpz_init(row->values[i]);
+		row->random[i] = strcmp(token, "x") == 0;
+		if(!row->random[i] && (mpz_set_str(row->values[i], token, 0) != 0)) {
+			fprintf(stderr, "%s:%d: invalid value '%s'\n", filename, lineno, token);
+			exit(EXIT_FAILURE);
+		}
+		/* two's complement */
+		mpz_fdiv_r_2exp(row->values[i], row->values[i], st->columns[i]->vectorsize);
+		i++;
+	}
+	return row;
+}
+
+struct stimulus *stimulus_load(const char *filename, struct sim_sc *sim)
+{
+	struct stimulus *st;
+	struct stimulus_row **last;
+	FILE *fd;
+	char *line;
+	size_t len;
+	int lineno;
+
+	fd = fopen(filename, "r");
+	if(fd == NULL) {
+		perror("Unable to open stimulus file");
+		exit(EXIT_FAILURE);
+	}
+	st = alloc_type(struct stimulus);
+	st->sim = sim;
+	st->ncolumns = -1;
+	st->columns = NULL;
+	st->count = 0;
+	st->rows = NULL;
+	last = &st->rows;
+	line = NULL;
+	len = 0;
+	lineno = 0;
+	while(getline(&line, &len, fd) != -1) {
+		lineno++;
+		if((line[0] == '#') || (count_tokens(line) == 0))
+			continue;
+		if(st->ncolumns < 0)
+			parse_header(st, line, filename, lineno);
+		else {
+			*last = parse_row(st, line, filename, lineno);
+			last = &(*last)->next;
+			st->count++;
+		}
+	}
+	free(line);
+	fclose(fd);
+	if(st->ncolumns < 0)
+		st->ncolumns = 0;
+	st->current = st->rows;
+	return st;
+}
+
+void stimulus_free(struct stimulus *st)
+{
+	struct stimulus_row *row, *next;
+	int i;
+
+	for(row=st->rows;row!=NULL;row=next) {
+		next = row->next;
+		for(i=0;i<st->ncolumns;i++)
+			mpz_clear(row->values[i]);
+		free(row->values);
+		free(row->random);
+		free(row);
+	}
+	free(st->columns);
+	free(st);
+}
+
+int stimulus_get_count(struct stimulus *st)
+{
+	return st->count;
+}
+
+int stimulus_drives(struct stimulus *st, struct sim_signal *s)
+{
+	int i;
+
+	for(i=0;i<st->ncolumns;i++)
+		if(st->columns[i] == s)
+			return 1;
+	return 0;
+}
+
+int stimulus_next(struct stimulus *st)
+{
+	struct stimulus_row *row;
+	int i, j;
+
+	row = st->current;
+	if(row == NULL)
+		return 0;
+	for(i=0;i<st->ncolumns;i++) {
+		if(row->random[i])
+			stimulus_random(st->sim, st->columns[i]);
+		else {
+			for(j=0;j<st->columns[i]->vectorsize;j++)
+				sim_set(st->sim, st->columns[i], j,
+					mpz_tstbit(row->values[i], j) ? ~(sim_word)0 : 0);
+		}
+	}
+	st->current = row->next;
+	return 1;
+}
+
+void stimulus_random(struct sim_sc *sim, struct sim_signal *s)
+{
+	sim_word v;
+	int i;
+
+	for(i=0;i<s->vectorsize;i++) {
+		v = ((sim_word)random() << 42) ^ ((sim_word)random() << 21) ^ (sim_word)random();
+		sim_set(sim, s, i, v);
+	}
+}
@@ -0,0 +1,27 @@
+#ifndef __STIMULUS_H
+#define __STIMULUS_H
+
+#include <sim/sim.h>
+
+/*
+ * Stimulus files are text files. The first line lists input names, and each
+ * following line gives their values for one clock cycle, in all lanes.
+ * Values use the C notation (decimal, 0x... or 0...). The value 'x'
+ * gives a different random value to each lane.
+ * Lines starting with '#' are comments.
+ */
+
+struct stimulus;
+
+struct stimulus *stimulus_load(const char *filename, struct sim_sc *sim);
+void stimulus_free(struct stimulus *st);
+int stimulus_get_count(struct stimulus *st);
+/* Returns 1 if <s> is driven by the stimulus file */
+int stimulus_drives(struct stimulus *st, struct sim_signal *s);
+/* Apply the next line of the file. Returns 0 if there is none left. */
+int stimulus_next(struct stimulus *st);
+
+/* Set all bits of <s> to random values */
+void stimulus_random(struct sim_sc *sim, struct sim_signal *s);
+
+#endif /* __STIMULUS_H */
@@ -0,0 +1,125 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <gmp.h>
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <sim/sim.h>
+
+#include "vcd.h"
+
+struct vcd_var {
+	struct sim_signal *signal;
+	char id[8];
+	mpz_t last;
+	struct vcd_var *next;
+};
+
+struct vcd_writer {
+	FILE *fd;
+	struct sim_sc *sim;
+	int lane;
+	int first;
+	struct vcd_var *vars;
+};
+
+static void make_id(char *id, int n)
+{
+	/* printable characters from '!' to '~' */
+	do {
+		*id++ = '!' + n % 94;
+		n /= 94;
+	} while(n > 0);
+	*id = 0;
+}
+
+struct vcd_writer *vcd_open(const char *filename, struct sim_sc *sim, const char *module, int lane)
+{
+	struct vcd_writer *w;
+	struct vcd_var *var, **last;
+	struct sim_signal *s;
+	int n;
+
+	w = alloc_type(struct vcd_writer);
+	w->fd = fopen(filename, "w");
+	if(w->fd == NULL) {
+		perror("Unable to open VCD file");
+		exit(EXIT_FAILURE);
+	}
+	w->sim = sim;
+	w->lane = lane;
+	w->first = 1;
+	w->vars = NULL;
+
+	fprintf(w->fd, "$version llhdl-sim $end\n");
+	fprintf(w->fd, "$timescale 1ns $end\n");
+	fprintf(w->fd, "$scope module %s $end\n", module);
+	last = &w->vars;
+	n = 0;
+	for(s=sim_get_signals(sim);s!=NULL;s=s->next) {
+		var = alloc_type(struct vcd_var);
+		var->signal = s;
+		make_id(var->id, n++);
+		mpz_init(var->last);
+		var->next = NULL;
+		*last = var;
+		last = &var->next;
+		if(s->vectorsize == 1)
+			fprintf(w->fd, "$var wire 1 %s %s $end\n", var->id, s->signal->p.signal.name);
+		else
+			fprintf(w->fd, "$var wire %d %s %s [%d:0] $end\n", s->vectorsize, var->id,
+				s->signal->p.signal.name, s->vectorsize-1);
+	}
+	fprintf(w->fd, "$upscope $end\n");
+	fprintf(w->fd, "$enddefinitions $end\n");
+	return w;
+}
+
+static void write_value(FILE *fd, struct vcd_var *var)
+{
+	int i;
+
+	if(var->signal->vectorsize == 1) {
+		fprintf(fd, "%d%s\n", mpz_tstbit(var->last, 0), var->id);
+		return;
+	}
+	fputc('b', fd);
+	for(i=var->signal->vectorsize-1;i>=0;i--)
+		fputc(mpz_tstbit(var->last, i) ? '1' : '0', fd);
+	fprintf(fd, " %s\n", var->id);
+}
+
+void vcd_sample(struct vcd_writer *w, unsigned int time)
+{
+	struct vcd_var *var;
+	mpz_t v;
+
+	mpz_init(v);
+	fprintf(w->fd, "#%u\n", time);
+	if(w->first)
+		fprintf(w->fd, "$dumpvars\n");
+	for(var=w->vars;var!=NULL;var=var->next) {
+		sim_get_lane(w->sim, var->signal, w->lane, v);
+		if(w->first || (mpz_cmp(v, var->last) != 0)) {
+			mpz_set(var->last, v);
+			write_value(w->fd, var);
+		}
+	}
+	if(w->first)
+		fprintf(w->fd, "$end\n");
+	w->first = 0;
+	mpz_clear(v);
+}
+
+void vcd_close(struct vcd_writer *w)
+{
+	struct vcd_var *var, *next;
+
+	for(var=w->vars;var!=NULL;var=next) {
+		next = var->next;
+		mpz_clear(var->last);
+		free(var);
+	}
+	fclose(w->fd);
+	free(w);
+}
@@ -0,0 +1,13 @@
+#ifndef __VCD_H
+#define __VCD_H
+
+#include <sim/sim.h>
+
+struct vcd_writer;
+
+/* Dump all signals of lane <lane> to a Value Change Dump file */
+struct vcd_writer *vcd_open(const char *filename, struct sim_sc *sim, const char *module, int lane);
+void vcd_sample(struct vcd_writer *w, unsigned int time);
+void vcd_close(struct vcd_writer *w);
+
+#endif /* __VCD_H */
@@ -0,0 +1,557 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/tools.h>
+
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/xilprims.h>
+
+#include <mapkit/mapkit.h>
+
+#include "flow.h"
+#include "commonstruct.h"
+#include "kcm.h"
+#include "addtree.h"
+
+struct addtree_input {
+	struct llhdl_node **node;
+	int n_bits;
+	int sign;
+	int index;
+	int offset;
+	struct addtree_input *next;
+};
+
+/* A row of the bit matrix: a shifted input, possibly ANDed with one bit of another input (partial product) */
+struct addtree_row {
+	struct addtree_input *input;
+	struct addtree_input *gate;
+	int gate_bit;
+	int shift;
+	int negative;
+	struct addtree_row *next;
+};
+
+struct addtree_bit {
+	struct netlist_net *net; /* < NULL for a constant 1 */
+	int invert;
+	struct addtree_bit *next;
+};
+
+struct addtree_sc {
+	struct flow_sc *sc;
+	int n_bits_r;
+	struct addtree_input *inputs;
+	int ninputs;
+	int ninput_nets;
+	struct addtree_row *rows;
+	int nrows;
+	mpz_t offset;
+	struct addtree_bit **columns;
+};
+
+static struct addtree_input *add_input(struct addtree_sc *at, struct llhdl_node **n)
+{
+	struct addtree_input *in;
+
+	in = alloc_type(struct addtree_input);
+	in->node = n;
+	in->n_bits = mapkit_get_vectorsize(at->sc->mapkit, *n);
+	in->sign = mapkit_get_sign(at->sc->mapkit, *n);
+	in->index = at->ninputs++;
+	in->offset = at->ninput_nets;
+	at->ninput_nets += in->n_bits;
+	in->next = at->inputs;
+	at->inputs = in;
+	return in;
+}
+
+static void add_row(struct addtree_sc *at, struct addtree_input *input, struct addtree_input *gate, int gate_bit, int shift, int negative)
+{
+	struct addtree_row *row;
+
+	row = alloc_type(struct addtree_row);
+	row->input = input;
+	row->gate = gate;
+	row->gate_bit = gate_bit;
+	row->shift = shift;
+	row->negative = negative;
+	row->next = at->rows;
+	at->rows = row;
+	at->nrows++;
+}
+
+static int is_sum(struct llhdl_node *n)
+{
+	return (n->type == LLHDL_NODE_EXTLOGIC)
+		&& ((n->p.logic.op == LLHDL_EXTLOGIC_ADD) || (n->p.logic.op == LLHDL_EXTLOGIC_SUB));
+}
+
+static int is_product(struct llhdl_node *n)
+{
+	return (n->type == LLHDL_NODE_EXTLOGIC) && (n->p.logic.op == LLHDL_EXTLOGIC_MUL);
+}
+
+/* Returns 1 if the node result is never truncated, so that it can be merged into the enclosing sum */
+static int is_exact(struct addtree_sc *at, struct llhdl_node *n)
+{
+	int sign_a, sign_b;
+	mpz_t k;
+	int r;
+
+	sign_a = mapkit_get_sign(at->sc->mapkit, n->p.logic.operands[0]);
+	sign_b = mapkit_get_sign(at->sc->mapkit, n->p.logic.operands[1]);
+	if(sign_a == sign_b)
+		return (n->p.logic.op != LLHDL_EXTLOGIC_SUB) || sign_a;
+	if(!is_product(n))
+		return 0;
+	/* unsigned product is exact if the signed operand is a non-negative constant */
+	if(sign_a)
+		n = n->p.logic.operands[0];
+	else
+		n = n->p.logic.operands[1];
+	if(n->type != LLHDL_NODE_CONSTANT)
+		return 0;
+	mpz_init(k);
+	llhdl_get_constant_value(k, n);
+	r = mpz_sgn(k) >= 0;
+	mpz_clear(k);
+	return r;
+}
+
+static int constant_operands(struct llhdl_node *n)
+{
+	return (n->p.logic.operands[0]->type == LLHDL_NODE_CONSTANT)
+		+ (n->p.logic.operands[1]->type == LLHDL_NODE_CONSTANT);
+}
+
+static void collect_product(struct addtree_sc *at, struct llhdl_node *n, int shift, int negative)
+{
+	int xi;
+	struct addtree_input *x, *y;
+	mpz_t k;
+	struct kcm_term *terms;
+	int nterms;
+	int i;
+
+	if(n->p.logic.operands[1]->type == LLHDL_NODE_CONSTANT)
+		xi = 0;
+	else if(n->p.logic.operands[0]->type == LLHDL_NODE_CONSTANT)
+		xi = 1;
+	else
+		xi = -1;
+	if(xi != -1) {
+		/* one row per non-zero digit of the constant */
+		x = add_input(at, &n->p.logic.operands[xi]);
+		mpz_init(k);
+		llhdl_get_constant_value(k, n->p.logic.operands[!xi]);
+		terms = alloc_size((at->n_bits_r-shift)*sizeof(struct kcm_term));
+		nterms = kcm_csd(k, at->n_bits_r-shift, terms);
+		for(i=0;i<nterms;i++)
+			add_row(at, x, NULL, 0, shift+terms[i].shift, negative ^ terms[i].negative);
+		free(terms);
+		mpz_clear(k);
+	} else {
+		/* one partial product row per bit of the narrower operand,
+		 * the row of the sign bit has negative weight.
+		 */
+		if(mapkit_get_vectorsize(at->sc->mapkit, n->p.logic.operands[0]) < mapkit_get_vectorsize(at->sc->mapkit, n->p.logic.operands[1]))
+			xi = 1;
+		else
+			xi = 0;
+		x = add_input(at, &n->p.logic.operands[xi]);
+		y = add_input(at, &n->p.logic.operands[!xi]);
+		for(i=0;(i<y->n_bits) && (shift+i<at->n_bits_r);i++)
+			add_row(at, x, y, i, shift+i, negative ^ (y->sign && (i == y->n_bits-1)));
+	}
+}
+
+static void collect(struct addtree_sc *at, struct llhdl_node **n, int shift, int negative, int root)
+{
+	mpz_t v;
+
+	if(shift >= at->n_bits_r)
+		return;
+	if((*n)->type == LLHDL_NODE_CONSTANT) {
+		mpz_init(v);
+		llhdl_get_constant_value(v, *n);
+		mpz_mul_2exp(v, v, shift);
+		if(negative)
+			mpz_sub(at->offset, at->offset, v);
+		else
+			mpz_add(at->offset, at->offset, v);
+		mpz_clear(v);
+	} else if(is_sum(*n) && (root || is_exact(at, *n))) {
+		collect(at, &(*n)->p.logic.operands[0], shift, negative, 0);
+		collect(at, &(*n)->p.logic.operands[1], shift, negative ^ ((*n)->p.logic.op == LLHDL_EXTLOGIC_SUB), 0);
+	} else if(is_product(*n) && (root || is_exact(at, *n)) && (constant_operands(*n) < 2))
+		collect_product(at, *n, shift, negative);
+	else
+		add_row(at, add_input(at, n), NULL, 0, shift, negative);
+}
+
+static void push_bit(struct addtree_bit **column, struct netlist_net *net, int invert)
+{
+	struct addtree_bit *bit;
+
+	bit = alloc_type(struct addtree_bit);
+	bit->net = net;
+	bit->invert = invert;
+	bit->next = *column;
+	*column = bit;
+}
+
+static int column_height(struct addtree_bit *column)
+{
+	int r;
+
+	r = 0;
+	while(column != NULL) {
+		r++;
+		column = column->next;
+	}
+	return r;
+}
+
+static struct netlist_net *and_net(struct addtree_sc *at, struct netlist_net *a, struct netlist_net *b)
+{
+	struct netlist_instance *lut;
+	mpz_t contents;
+
+	mpz_init_set_ui(contents, 0x8);
+	lut = cs_create_lut(at->sc, 2, contents);
+	mpz_clear(contents);
+	netlist_add_branch(a, lut, 0, NETLIST_XIL_LUT2_I0);
+	netlist_add_branch(b, lut, 0, NETLIST_XIL_LUT2_I1);
+	return netlist_m_create_net_with_branch(at->sc->netlist, lut, 1, NETLIST_XIL_LUT2_O);
+}
+
+/* Fill the columns of the bit matrix from the rows.
+ * Negated rows have their bits inverted, and signed rows their sign bit inverted,
+ * with the necessary corrections accumulated into the constant offset.
+ */
+static void expand_rows(struct addtree_sc *at, struct netlist_net **input_nets)
+{
+	struct addtree_row *row;
+	struct netlist_net **nets;
+	struct netlist_net *net;
+	mpz_t w;
+	int msb;
+	int i;
+
+	mpz_init(w);
+	for(row=at->rows;row!=NULL;row=row->next) {
+		nets = &input_nets[row->input->offset];
+		for(i=0;(i<row->input->n_bits) && (row->shift+i<at->n_bits_r);i++) {
+			net = nets[i];
+			if(row->gate != NULL)
+				net = and_net(at, net, input_nets[row->gate->offset+row->gate_bit]);
+			msb = row->input->sign && (i == row->input->n_bits-1);
+			push_bit(&at->columns[row->shift+i], net, row->negative ^ msb);
+			if(row->negative) {
+				mpz_set_ui(w, 0);
+				mpz_setbit(w, row->shift+i);
+				mpz_sub(at->offset, at->offset, w);
+			}
+		}
+		if(row->input->sign) {
+			mpz_set_ui(w, 0);
+			mpz_setbit(w, row->shift+row->input->n_bits-1);
+			if(row->negative)
+				mpz_add(at->offset, at->offset, w);
+			else
+				mpz_sub(at->offset, at->offset, w);
+		}
+	}
+	mpz_clear(w);
+
+	mpz_fdiv_r_2exp(at->offset, at->offset, at->n_bits_r);
+	for(i=0;i<at->n_bits_r;i++)
+		if(mpz_tstbit(at->offset, i))
+			push_bit(&at->columns[i], NULL, 0);
+}
+
+/* Bit <b> of the number of ones among <n> bits, implemented as a LUT
+ * with the input polarities and constants folded into the contents.
+ * Returns NULL if the result is constantly 0.
+ */
+static struct addtree_bit *count_bit(struct addtree_sc *at, struct addtree_bit **bits, int n, int b)
+{
+	struct netlist_net *nets[6];
+	int invert;
+	int nconst;
+	int pins;
+	int a, i, count;
+	mpz_t contents;
+	int ones;
+	struct netlist_instance *lut;
+	struct addtree_bit *r;
+
+	pins = 0;
+	invert = 0;
+	nconst = 0;
+	for(i=0;i<n;i++) {
+		if(bits[i]->net == NULL)
+			nconst++;
+		else {
+			assert(pins < 6);
+			if(bits[i]->invert)
+				invert |= 1 << pins;
+			nets[pins++] = bits[i]->net;
+		}
+	}
+
+	mpz_init(contents);
+	ones = 0;
+	for(a=0;a<(1 << pins);a++) {
+		count = nconst;
+		for(i=0;i<pins;i++)
+			if((a ^ invert) & (1 << i))
+				count++;
+		if(count & (1 << b)) {
+			mpz_setbit(contents, a);
+			ones++;
+		}
+	}
+
+	r = NULL;
+	if(ones == 0)
+		r = NULL;
+	else if(ones == (1 << pins)) {
+		r = alloc_type(struct addtree_bit);
+		r->net = NULL;
+		r->invert = 0;
+	} else if((pins == 1) && (mpz_cmp_ui(contents, 2) == 0)) {
+		r = alloc_type(struct addtree_bit);
+		r->net = nets[0];
+		r->invert = 0;
+	} else {
+		lut = cs_create_lut(at->sc, pins, contents);
+		for(i=0;i<pins;i++)
+			netlist_add_branch(nets[i], lut, 0, i);
+		r = alloc_type(struct addtree_bit);
+		r->net = netlist_m_create_net_with_branch(at->sc->netlist, lut, 1, 0);
+		r->invert = 0;
+	}
+	mpz_clear(contents);
+	return r;
+}
+
+static struct netlist_net *bit_net(struct addtree_sc *at, struct addtree_bit *bit)
+{
+	struct addtree_bit *r;
+	struct netlist_net *net;
+
+	if(bit == NULL)
+		return cs_constant_net(at->sc, 0);
+	if(bit->net == NULL)
+		return cs_constant_net(at->sc, 1);
+	if(!bit->invert)
+		return bit->net;
+	r = count_bit(at, &bit, 1, 0);
+	net = r->net;
+	free(r);
+	return net;
+}
+
+static void free_bits(struct addtree_bit *bit)
+{
+	struct addtree_bit *next;
+
+	while(bit != NULL) {
+		next = bit->next;
+		free(bit);
+		bit = next;
+	}
+}
+
+/* Reduce all columns to at most two bits, using 6:3, 5:3 and 3:2 counters */
+static void compress(struct addtree_sc *at)
+{
+	struct addtree_bit **next;
+	struct addtree_bit *bits[6];
+	struct addtree_bit *out;
+	int reduced;
+	int height;
+	int i, j, k, b;
+
+	next = alloc_size(at->n_bits_r*sizeof(struct addtree_bit *));
+	do {
+		reduced = 0;
+		memset(next, 0, at->n_bits_r*sizeof(struct addtree_bit *));
+		for(j=0;j<at->n_bits_r;j++) {
+			height = column_height(at->columns[j]);
+			while(height >= 3) {
+				if(height >= 6)
+					k = 6;
+				else if(height == 5)
+					k = 5;
+				else
+					k = 3;
+				for(i=0;i<k;i++) {
+					bits[i] = at->columns[j];
+					at->columns[j] = bits[i]->next;
+				}
+				height -= k;
+				for(b=0;(1 << b)<=k;b++) {
+					if(j+b >= at->n_bits_r)
+						break;
+					out = count_bit(at, bits, k, b);
+					if(out != NULL) {
+						out->next = next[j+b];
+						next[j+b] = out;
+					}
+				}
+				for(i=0;i<k;i++)
+					free(bits[i]);
+				reduced = 1;
+			}
+			while(at->columns[j] != NULL) {
+				out = at->columns[j];
+				at->columns[j] = out->next;
+				out->next = next[j];
+				next[j] = out;
+			}
+		}
+		memcpy(at->columns, next, at->n_bits_r*sizeof(struct addtree_bit *));
+	} while(reduced);
+	free(next);
+}
+
+/* Add the two remaining rows with the carry chain */
+static void final_adder(struct addtree_sc *at, struct netlist_net **r)
+{
+	struct addtree_bit *bits[2];
+	struct addtree_bit *p;
+	struct netlist_net *pn, *di, *mn, *rn;
+	struct netlist_instance *muxcy, *xorcy;
+	int j, n;
+
+	/* below the first column with two bits, no carry can be generated */
+	for(j=0;j<at->n_bits_r;j++) {
+		if(column_height(at->columns[j]) == 2)
+			break;
+		r[j] = bit_net(at, at->columns[j]);
+	}
+
+	mn = cs_constant_net(at->sc, 0);
+	for(;j<at->n_bits_r;j++) {
+		n = column_height(at->columns[j]);
+		assert(n <= 2);
+		bits[0] = at->columns[j];
+		bits[1] = n == 2 ? bits[0]->next : NULL;
+
+		p = count_bit(at, bits, n, 0);
+		pn = bit_net(at, p);
+		free(p);
+
+		/* when not propagating, both bits are equal and either one is the carry out */
+		if((n < 2) || (bits[1]->net == NULL))
+			di = bit_net(at, bits[1]);
+		else if(bits[0]->net == NULL)
+			di = bit_net(at, bits[0]);
+		else if(!bits[1]->invert)
+			di = bits[1]->net;
+		else
+			di = bit_net(at, bits[0]);
+
+		xorcy = netlist_m_instantiate(at->sc->netlist, &netlist_xilprims[NETLIST_XIL_XORCY]);
+		netlist_add_branch(pn, xorcy, 0, NETLIST_XIL_XORCY_LI);
+		netlist_add_branch(mn, xorcy, 0, NETLIST_XIL_XORCY_CI);
+		rn = netlist_m_create_net(at->sc->netlist);
+		netlist_add_branch(rn, xorcy, 1, NETLIST_XIL_XORCY_O);
+		r[j] = rn;
+
+		if(j < at->n_bits_r-1) {
+			muxcy = netlist_m_instantiate(at->sc->netlist, &netlist_xilprims[NETLIST_XIL_MUXCY]);
+			netlist_add_branch(pn, muxcy, 0, NETLIST_XIL_MUXCY_S);
+			netlist_add_branch(di, muxcy, 0, NETLIST_XIL_MUXCY_DI);
+			netlist_add_branch(mn, muxcy, 0, NETLIST_XIL_MUXCY_CI);
+			mn = netlist_m_create_net(at->sc->netlist);
+			netlist_add_branch(mn, muxcy, 1, NETLIST_XIL_MUXCY_O);
+		}
+	}
+}
+
+static void free_lists(struct addtree_sc *at)
+{
+	struct addtree_input *in, *in_next;
+	struct addtree_row *row, *row_next;
+
+	in = at->inputs;
+	while(in != NULL) {
+		in_next = in->next;
+		free(in);
+		in = in_next;
+	}
+	row = at->rows;
+	while(row != NULL) {
+		row_next = row->next;
+		free(row);
+		row = row_next;
+	}
+}
+
+static void mat_process(struct llhdl_node **n2, void *user)
+{
+	struct llhdl_node *n = *n2;
+	struct flow_sc *sc = user;
+	struct addtree_sc at;
+	struct mapkit_result *result;
+	struct addtree_input *in;
+	int i;
+
+	if(is_sum(n)) {
+		/* two-operand sums are better left to the carry chain adder */
+	} else if(is_product(n)) {
+		/* products by constants are left to the KCM mapper */
+		if(constant_operands(n) != 0)
+			return;
+	} else
+		return;
+
+	at.sc = sc;
+	at.n_bits_r = mapkit_get_vectorsize(sc->mapkit, n);
+	at.inputs = NULL;
+	at.ninputs = 0;
+	at.ninput_nets = 0;
+	at.rows = NULL;
+	at.nrows = 0;
+	mpz_init(at.offset);
+	collect(&at, n2, 0, 0, 1);
+	if(is_sum(n) && (at.nrows < 3)) {
+		free_lists(&at);
+		mpz_clear(at.offset);
+		return;
+	}
+
+	result = mapkit_create_result(at.ninputs, at.ninput_nets, at.n_bits_r);
+	for(in=at.inputs;in!=NULL;in=in->next)
+		result->input_nodes[in->index] = in->node;
+	for(i=0;i<at.ninput_nets;i++)
+		result->input_nets[i] = netlist_m_create_net(sc->netlist);
+
+	at.columns = alloc_size0(at.n_bits_r*sizeof(struct addtree_bit *));
+	expand_rows(&at, (struct netlist_net **)result->input_nets);
+	compress(&at);
+	final_adder(&at, (struct netlist_net **)result->output_nets);
+	for(i=0;i<at.n_bits_r;i++)
+		free_bits(at.columns[i]);
+	free(at.columns);
+
+	free_lists(&at);
+	mpz_clear(at.offset);
+	mapkit_consume(sc->mapkit, n, result);
+}
+
+void addtree_register(struct flow_sc *sc)
+{
+	mapkit_register_process(sc->mapkit, mat_process, NULL, sc);
+}
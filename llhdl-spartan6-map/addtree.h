@@ -0,0 +1,8 @@
+#ifndef __ADDTREE_H
+#define __ADDTREE_H
+
+#include "flow.h"
+
+void addtree_register(struct flow_sc *sc);
+
+#endif /* __ADDTREE_H */
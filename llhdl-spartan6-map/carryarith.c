@@ -30,73 +30,70 @@ static struct netlist_instance *make_input_lut(struct flow_sc *sc, int sub)
 	return lut;
 }
 
-static void mkc_process(struct llhdl_node **n2, void *user)
+static struct netlist_net *ext_net(struct flow_sc *sc, struct netlist_net **nets, int n_bits, int sign, int i)
 {
-	struct llhdl_node *n = *n2;
-	struct flow_sc *sc = user;
-	int sub;
-	int n_bits_a, n_bits_b, n_bits;
+	if(i < n_bits)
+		return nets[i];
+	if(sign)
+		return nets[n_bits-1];
+	return cs_constant_net(sc, 0);
+}
+
+void carryarith_build(struct flow_sc *sc, int sub,
+	struct netlist_net **a, int n_bits_a, int sign_a,
+	struct netlist_net **b, int n_bits_b, int sign_b,
+	struct netlist_net **r, int n_bits_r)
+{
+	int n_bits, n_chain;
 	int i;
-	struct mapkit_result *result;
 	struct netlist_net *an, *bn, *xn, *mn, *rn;
 	struct netlist_instance *lut2, *muxcy, *xorcy;
 	
-	if((n->type == LLHDL_NODE_EXTLOGIC)
-	  && ((n->p.logic.op == LLHDL_EXTLOGIC_ADD) || (n->p.logic.op == LLHDL_EXTLOGIC_SUB))) {
-		sub = n->p.logic.op == LLHDL_EXTLOGIC_SUB;
+	n_bits = max(n_bits_a, n_bits_b);
+	/* Length of the chain, beyond which the result is only extended.
+	 * Unsigned operations need an extra bit, that is provided by the carry out.
+	 * Signed operations need one extra chain bit, two if operands have mixed signs.
+	 */
+	if(!sign_a && !sign_b)
+		n_chain = n_bits;
+	else if(sign_a && sign_b)
+		n_chain = n_bits + 1;
+	else
+		n_chain = n_bits + 2;
+	n_chain = min(n_chain, n_bits_r);
+	
+	mn = cs_constant_net(sc, sub);
+	for(i=0;i<n_chain;i++) {
+		an = ext_net(sc, a, n_bits_a, sign_a, i);
+		bn = ext_net(sc, b, n_bits_b, sign_b, i);
 		
-		n_bits_a = llhdl_get_vectorsize(n->p.logic.operands[0]);
-		n_bits_b = llhdl_get_vectorsize(n->p.logic.operands[1]);
-		n_bits = max(n_bits_a, n_bits_b);
+		lut2 = make_input_lut(sc, sub);
+		muxcy = netlist_m_instantiate(sc->netlist, &netlist_xilprims[NETLIST_XIL_MUXCY]);
+		xorcy = netlist_m_instantiate(sc->netlist, &netlist_xilprims[NETLIST_XIL_XORCY]);
 		
-		result = mapkit_create_result(2, n_bits_a+n_bits_b, n_bits+1);
-		result->input_nodes[0] = &n->p.logic.operands[0];
-		result->input_nodes[1] = &n->p.logic.operands[1];
+		netlist_add_branch(an, lut2, 0, NETLIST_XIL_LUT2_I0);
+		netlist_add_branch(an, muxcy, 0, NETLIST_XIL_MUXCY_DI);
 		
-		an = bn = NULL;
-		mn = cs_constant_net(sc,sub);
-		for(i=0;i<n_bits;i++) {
-			if(i < n_bits_a) {
-				an = netlist_m_create_net(sc->netlist);
-				result->input_nets[i] = an;
-			} else {
-				if(!llhdl_get_sign(n->p.logic.operands[0]))
-					an = cs_constant_net(sc, 0);
-				/* otherwise, an keeps the MSB, which is what we want. */
-			}
-			if(i < n_bits_b) {
-				bn = netlist_m_create_net(sc->netlist);
-				result->input_nets[n_bits_a+i] = bn;
-			} else {
-				if(!llhdl_get_sign(n->p.logic.operands[1]))
-					bn = cs_constant_net(sc, 0);
-				/* otherwise, bn keeps the MSB, which is what we want. */
-			}
-			
-			lut2 = make_input_lut(sc, sub);
-			muxcy = netlist_m_instantiate(sc->netlist, &netlist_xilprims[NETLIST_XIL_MUXCY]);
-			xorcy = netlist_m_instantiate(sc->netlist, &netlist_xilprims[NETLIST_XIL_XORCY]);
-			
-			netlist_add_branch(an, lut2, 0, NETLIST_XIL_LUT2_I0);
-			netlist_add_branch(an, muxcy, 0, NETLIST_XIL_MUXCY_DI);
-			
-			netlist_add_branch(bn, lut2, 0, NETLIST_XIL_LUT2_I1);
-			
-			xn = netlist_m_create_net(sc->netlist);
-			netlist_add_branch(xn, lut2, 1, NETLIST_XIL_LUT2_O);
-			netlist_add_branch(xn, muxcy, 0, NETLIST_XIL_MUXCY_S);
-			netlist_add_branch(xn, xorcy, 0, NETLIST_XIL_XORCY_LI);
-			
-			netlist_add_branch(mn, xorcy, 0, NETLIST_XIL_XORCY_CI);
-			netlist_add_branch(mn, muxcy, 0, NETLIST_XIL_MUXCY_CI);
-			mn = netlist_m_create_net(sc->netlist);
-			netlist_add_branch(mn, muxcy, 1, NETLIST_XIL_MUXCY_O);
-			
-			rn = netlist_m_create_net(sc->netlist);
-			netlist_add_branch(rn, xorcy, 1, NETLIST_XIL_XORCY_O);
-			result->output_nets[i] = rn;
-		}
-		/* last bit of the result is carry out (addition) or ~carry out (subtraction) */
+		netlist_add_branch(bn, lut2, 0, NETLIST_XIL_LUT2_I1);
+		
+		xn = netlist_m_create_net(sc->netlist);
+		netlist_add_branch(xn, lut2, 1, NETLIST_XIL_LUT2_O);
+		netlist_add_branch(xn, muxcy, 0, NETLIST_XIL_MUXCY_S);
+		netlist_add_branch(xn, xorcy, 0, NETLIST_XIL_XORCY_LI);
+		
+		netlist_add_branch(mn, xorcy, 0, NETLIST_XIL_XORCY_CI);
+		netlist_add_branch(mn, muxcy, 0, NETLIST_XIL_MUXCY_CI);
+		mn = netlist_m_create_net(sc->netlist);
+		netlist_add_branch(mn, muxcy, 1, NETLIST_XIL_MUXCY_O);
+		
+		rn = netlist_m_create_net(sc->netlist);
+		netlist_add_branch(rn, xorcy, 1, NETLIST_XIL_XORCY_O);
+		r[i] = rn;
+	}
+	if(n_chain == n_bits_r)
+		return;
+	if(!sign_a && !sign_b) {
+		/* next bit of the result is carry out (addition) or ~carry out (subtraction) */
 		if(sub) {
 			xorcy = netlist_m_instantiate(sc->netlist, &netlist_xilprims[NETLIST_XIL_XORCY]);
 			netlist_add_branch(cs_constant_net(sc, 1), xorcy, 0, NETLIST_XIL_XORCY_LI);
@@ -105,7 +102,45 @@ static void mkc_process(struct llhdl_node **n2, void *user)
 			netlist_add_branch(rn, xorcy, 1, NETLIST_XIL_XORCY_O);
 		} else
 			rn = mn;
-		result->output_nets[n_bits] = rn;
+		r[n_chain++] = rn;
+		/* the unsigned sum is positive, the difference is signed */
+		for(i=n_chain;i<n_bits_r;i++)
+			r[i] = sub ? rn : cs_constant_net(sc, 0);
+	} else {
+		for(i=n_chain;i<n_bits_r;i++)
+			r[i] = r[n_chain-1];
+	}
+}
+
+static void mkc_process(struct llhdl_node **n2, void *user)
+{
+	struct llhdl_node *n = *n2;
+	struct flow_sc *sc = user;
+	int sub;
+	int n_bits_a, n_bits_b, n_bits;
+	int i;
+	struct mapkit_result *result;
+	struct netlist_net **an, **bn;
+	
+	if((n->type == LLHDL_NODE_EXTLOGIC)
+	  && ((n->p.logic.op == LLHDL_EXTLOGIC_ADD) || (n->p.logic.op == LLHDL_EXTLOGIC_SUB))) {
+		sub = n->p.logic.op == LLHDL_EXTLOGIC_SUB;
+		
+		n_bits_a = mapkit_get_vectorsize(sc->mapkit, n->p.logic.operands[0]);
+		n_bits_b = mapkit_get_vectorsize(sc->mapkit, n->p.logic.operands[1]);
+		n_bits = mapkit_get_vectorsize(sc->mapkit, n);
+		
+		result = mapkit_create_result(2, n_bits_a+n_bits_b, n_bits);
+		result->input_nodes[0] = &n->p.logic.operands[0];
+		result->input_nodes[1] = &n->p.logic.operands[1];
+		for(i=0;i<n_bits_a+n_bits_b;i++)
+			result->input_nets[i] = netlist_m_create_net(sc->netlist);
+		an = (struct netlist_net **)result->input_nets;
+		bn = (struct netlist_net **)&result->input_nets[n_bits_a];
+		carryarith_build(sc, sub,
+			an, n_bits_a, mapkit_get_sign(sc->mapkit, n->p.logic.operands[0]),
+			bn, n_bits_b, mapkit_get_sign(sc->mapkit, n->p.logic.operands[1]),
+			(struct netlist_net **)result->output_nets, n_bits);
 		
 		mapkit_consume(sc->mapkit, n, result);
 	}
@@ -1,9 +1,16 @@
 #ifndef __CARRYARITH_H
 #define __CARRYARITH_H
 
+#include <netlist/net.h>
 #include "flow.h"
 
+/* Build a carry chain computing <a>+<b> (or <a>-<b> if <sub> is set) into the <n_bits_r> nets of <r>.
+ * Operands are extended to the result width according to their sign.
+ */
+void carryarith_build(struct flow_sc *sc, int sub,
+	struct netlist_net **a, int n_bits_a, int sign_a,
+	struct netlist_net **b, int n_bits_b, int sign_b,
+	struct netlist_net **r, int n_bits_r);
 void carryarith_register(struct flow_sc *sc);
 
 #endif /* __CARRYARITH_H */
-
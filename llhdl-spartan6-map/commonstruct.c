@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <stdint.h>
 #include <gmp.h>
 
 #include <netlist/net.h>
@@ -29,42 +30,40 @@ struct netlist_net *cs_constant_net(struct flow_sc *sc, int v)
 	}
 }
 
+/* Same digits as "%Zx", zero-padded to the size of the LUT */
+static void format_init(char *val, int inputs, mpz_t contents)
+{
+	uint64_t v;
+	int i, digits;
+
+	v = 0;
+	mpz_export(&v, NULL, -1, sizeof(v), 0, 0, contents);
+	digits = inputs <= 2 ? 1 : 1 << (inputs - 2);
+	for(i=digits-1;i>=0;i--) {
+		val[i] = "0123456789abcdef"[v & 15];
+		v >>= 4;
+	}
+	val[digits] = 0;
+}
+
 struct netlist_instance *cs_create_lut(struct flow_sc *sc, int inputs, mpz_t contents)
 {
-	int primitive_type;
+	static const int primitive_types[7] = {
+		-1,
+		NETLIST_XIL_LUT1,
+		NETLIST_XIL_LUT2,
+		NETLIST_XIL_LUT3,
+		NETLIST_XIL_LUT4,
+		NETLIST_XIL_LUT5,
+		NETLIST_XIL_LUT6
+	};
 	char val[17];
 	struct netlist_instance *inst;
 
 	assert(inputs > 0);
 	assert(inputs < 7);
-	primitive_type = 0;
-	switch(inputs) {
-		case 1:
-			primitive_type = NETLIST_XIL_LUT1;
-			gmp_sprintf(val, "%Zx", contents);
-			break;
-		case 2:
-			primitive_type = NETLIST_XIL_LUT2;
-			gmp_sprintf(val, "%Zx", contents);
-			break;
-		case 3:
-			primitive_type = NETLIST_XIL_LUT3;
-			gmp_sprintf(val, "%02Zx", contents);
-			break;
-		case 4:
-			primitive_type = NETLIST_XIL_LUT4;
-			gmp_sprintf(val, "%04Zx", contents);
-			break;
-		case 5:
-			primitive_type = NETLIST_XIL_LUT5;
-			gmp_sprintf(val, "%08Zx", contents);
-			break;
-		case 6:
-			primitive_type = NETLIST_XIL_LUT6;
-			gmp_sprintf(val, "%016Zx", contents);
-			break;
-	}
-	inst = netlist_m_instantiate(sc->netlist, &netlist_xilprims[primitive_type]);
+	format_init(val, inputs, contents);
+	inst = netlist_m_instantiate(sc->netlist, &netlist_xilprims[primitive_types[inputs]]);
 	netlist_set_attribute(inst, "INIT", val);
 	return inst;
 }
@@ -24,11 +24,11 @@ static void mkc_process(struct llhdl_node **n2, void *user)
 	struct netlist_instance *inst;
 	
 	if(n->type == LLHDL_NODE_FD) {
-		if(llhdl_get_vectorsize(n->p.fd.clock) != 1) {
+		if(mapkit_get_vectorsize(sc->mapkit, n->p.fd.clock) != 1) {
 			fprintf(stderr, "Flip-flop clock must be a single signal\n");
 			exit(EXIT_FAILURE);
 		}
-		n_bits = llhdl_get_vectorsize(n->p.fd.data);
+		n_bits = mapkit_get_vectorsize(sc->mapkit, n->p.fd.data);
 		result = mapkit_create_result(2, 1+n_bits, n_bits);
 		result->input_nodes[0] = &n->p.fd.clock;
 		result->input_nodes[1] = &n->p.fd.data;
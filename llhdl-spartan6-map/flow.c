@@ -2,9 +2,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 
 #include <gmp.h>
 
+#include <util.h>
+
 #include <netlist/net.h>
 #include <netlist/manager.h>
 #include <netlist/io.h>
@@ -17,15 +20,21 @@
 #include <llhdl/structure.h>
 #include <llhdl/interchange.h>
 #include <llhdl/tools.h>
+#include <llhdl/opt.h>
+#include <llhdl/retime.h>
+#include <llhdl/partition.h>
 
 #include <mapkit/mapkit.h>
 
 #include <bd/bd.h>
 
 #include "commonstruct.h"
+#include "addtree.h"
+#include "kcm.h"
 #include "dsp.h"
 #include "carryarith.h"
 #include "srl.h"
+#include "muxtree.h"
 #include "lut.h"
 #include "fd.h"
 #include "flow.h"
@@ -61,8 +70,8 @@ static void create_io(struct flow_sc *sc, struct llhdl_node *n, struct netlist_n
 	struct netlist_primitive *ioprim;
 	struct netlist_instance *ioport;
 
+	isout = n->p.signal.type == LLHDL_SIGNAL_PORT_OUT;
 	if(sc->settings->io_buffers) {
-		isout = n->p.signal.type == LLHDL_SIGNAL_PORT_OUT;
 		if(llhdl_is_clock(n)) {
 			assert(!isout);
 			buf_type = NETLIST_XIL_BUFGP;
@@ -113,7 +122,7 @@ static void create_signal(struct flow_sc *sc, struct llhdl_node *n)
 		net = netlist_m_create_net(sc->netlist);
 		sym = netlist_sym_add(sc->symbols, net->uid, 'N', name);
 		sym->user = net;
-		if(n->p.signal.type != LLHDL_SIGNAL_INTERNAL)
+		if(sc->toplevel && (n->p.signal.type != LLHDL_SIGNAL_INTERNAL))
 			create_io(sc, n, net, name);
 		if(n->p.signal.vectorsize != 1)
 			free(name);
@@ -138,9 +147,9 @@ static void *mkc_constant(int v, void *user)
 	return cs_constant_net(sc, v);
 }
 
-static void *mkc_signal(struct llhdl_node *n, int bit, void *user)
+/* Fabric side net of a signal bit */
+static struct netlist_net *signal_net(struct flow_sc *sc, struct llhdl_node *n, int bit)
 {
-	struct flow_sc *sc = user;
 	struct netlist_sym *sym;
 	int is_vec;
 	int is_io;
@@ -148,7 +157,7 @@ static void *mkc_signal(struct llhdl_node *n, int bit, void *user)
 
 	assert(n->type == LLHDL_NODE_SIGNAL);
 	is_vec = n->p.signal.vectorsize != 1;
-	is_io = sc->settings->io_buffers && (n->p.signal.type != LLHDL_SIGNAL_INTERNAL);
+	is_io = sc->toplevel && sc->settings->io_buffers && (n->p.signal.type != LLHDL_SIGNAL_INTERNAL);
 	if(is_vec)
 		vecname = vecsuffix(n->p.signal.name, bit);
 	else
@@ -167,67 +176,873 @@ static void *mkc_signal(struct llhdl_node *n, int bit, void *user)
 	return sym->user;
 }
 
+static void *mkc_signal(struct llhdl_node *n, int bit, void *user)
+{
+	struct flow_sc *sc = user;
+	return signal_net(sc, n, bit);
+}
+
 static void mkc_join(void *a, void *b, void *user)
 {
 	netlist_join(a, b);
 }
 
-void run_flow(struct flow_settings *settings)
+/*
+ * Hierarchical designs: each definition is mapped once into a template netlist,
+ * whose ports are plain nets. The template is then copied into the instantiating
+ * netlist for each instance, with new uids and its port nets joined to the
+ * connected signals.
+ * Partitions of the top-level module are mapped the same way, on separate
+ * threads, and keep the names of their signals when copied.
+ */
+
+struct flow_port {
+	struct llhdl_node *signal;
+	struct netlist_net **nets;
+};
+
+struct flow_template {
+	struct llhdl_module *definition;
+	struct netlist_manager *netlist;
+	struct netlist_sym_store *symbols;
+	struct netlist_net *vcc_net;
+	struct netlist_net *gnd_net;
+	int nports;
+	struct flow_port *ports;
+	int flat; /* < partition of the top-level module */
+	int shared; /* < the netlist and the port nets belong to a cone of a flow_cache */
+	struct flow_template *next;
+};
+
+static int compare_templates(const void *a, const void *b)
 {
-	struct flow_sc sc;
+	const struct flow_template *ta = *(struct flow_template * const *)a;
+	const struct flow_template *tb = *(struct flow_template * const *)b;
+
+	if(ta->definition == tb->definition)
+		return 0;
+	return (uintptr_t)ta->definition < (uintptr_t)tb->definition ? -1 : 1;
+}
+
+/* Templates sorted by definition, as there can be one for each cone of the design */
+static struct flow_template **index_templates(struct flow_sc *sc, int *n)
+{
+	struct flow_template **index;
+	struct flow_template *t;
+	int i;
+
+	*n = 0;
+	for(t=sc->templates;t!=NULL;t=t->next)
+		(*n)++;
+	index = alloc_size((*n+1)*sizeof(struct flow_template *));
+	i = 0;
+	for(t=sc->templates;t!=NULL;t=t->next)
+		index[i++] = t;
+	qsort(index, *n, sizeof(struct flow_template *), compare_templates);
+	return index;
+}
+
+static struct flow_template *find_template(struct flow_template **index, int n, struct llhdl_module *definition)
+{
+	struct flow_template key;
+	struct flow_template *keyp;
+	struct flow_template **t;
+
+	key.definition = definition;
+	keyp = &key;
+	t = bsearch(&keyp, index, n, sizeof(struct flow_template *), compare_templates);
+	assert(t != NULL);
+	return *t;
+}
+
+static char *hiersuffix(const char *prefix, const char *name)
+{
+	int r;
+	char *ret;
+	r = asprintf(&ret, "%s/%s", prefix, name);
+	if(r == -1) abort();
+	return ret;
+}
+
+/* Records that the copy of the template net <tnet> is <net> */
+static void bind_net(struct netlist_net **nets, struct netlist_net *tnet, struct netlist_net *net)
+{
+	tnet = netlist_resolve_joined(tnet);
+	if(nets[tnet->uid] == NULL)
+		nets[tnet->uid] = net;
+	else
+		netlist_join(nets[tnet->uid], net);
+}
+
+static int is_constant_primitive(struct netlist_primitive *p)
+{
+	return (p == &netlist_xilprims[NETLIST_XIL_VCC]) || (p == &netlist_xilprims[NETLIST_XIL_GND]);
+}
+
+static void stamp_instance(struct flow_sc *sc, struct flow_template *t, struct llhdl_instance *inst)
+{
+	struct netlist_net **nets;
+	struct netlist_instance **insts;
+	struct netlist_net *net, *tnet;
+	struct netlist_instance *tinst, *copy;
+	struct netlist_branch *b;
+	struct netlist_sym *sym, *newsym;
+	struct llhdl_node *signal;
+	char *ports;
+	char *name;
+	int i, j;
+
+	nets = alloc_size0(t->netlist->next_uid*sizeof(struct netlist_net *));
+	insts = alloc_size0(t->netlist->next_uid*sizeof(struct netlist_instance *));
+
+	/* ports and constants are bound to existing nets, other nets are new */
+	for(i=0;i<t->nports;i++) {
+		signal = llhdl_find_connection(inst, t->ports[i].signal);
+		if(signal != NULL)
+			for(j=0;j<signal->p.signal.vectorsize;j++)
+				bind_net(nets, t->ports[i].nets[j], signal_net(sc, signal, j));
+	}
+	if(t->vcc_net != NULL)
+		bind_net(nets, t->vcc_net, cs_constant_net(sc, 1));
+	if(t->gnd_net != NULL)
+		bind_net(nets, t->gnd_net, cs_constant_net(sc, 0));
+	for(net=t->netlist->nhead;net!=NULL;net=net->next)
+		if((net->joined == NULL) && (nets[net->uid] == NULL))
+			nets[net->uid] = netlist_m_create_net(sc->netlist);
+
+	for(tinst=t->netlist->ihead;tinst!=NULL;tinst=tinst->next) {
+		if(is_constant_primitive(tinst->p))
+			continue;
+		copy = netlist_m_instantiate(sc->netlist, tinst->p);
+		copy->dont_touch = tinst->dont_touch;
+		for(i=0;i<tinst->p->attribute_count;i++)
+			netlist_set_attribute(copy, tinst->p->attribute_names[i], tinst->attributes[i]);
+		insts[tinst->uid] = copy;
+	}
+	for(net=t->netlist->nhead;net!=NULL;net=net->next) {
+		if(net->joined != NULL)
+			continue;
+		for(b=net->head;b!=NULL;b=b->next)
+			if(insts[b->inst->uid] != NULL)
+				netlist_add_branch(nets[net->uid], insts[b->inst->uid], b->output, b->pin_index);
+	}
+
+	/* the ports of partitions are signals of the instantiating module, which have symbols */
+	ports = alloc_size0(t->netlist->next_uid);
+	if(t->flat)
+		for(i=0;i<t->nports;i++)
+			for(j=0;j<t->ports[i].signal->p.signal.vectorsize;j++)
+				ports[t->ports[i].nets[j]->uid] = 1;
+	for(sym=t->symbols->head;sym!=NULL;sym=sym->next) {
+		if((sym->type != 'N') || (sym->user == NULL))
+			continue;
+		tnet = sym->user;
+		if(ports[tnet->uid])
+			continue;
+		net = nets[netlist_resolve_joined(tnet)->uid];
+		if(t->flat)
+			name = stralloc(sym->name);
+		else
+			name = hiersuffix(inst->name, sym->name);
+		newsym = netlist_sym_add(sc->symbols, net->uid, 'N', name);
+		newsym->user = net;
+		free(name);
+	}
+
+	free(ports);
+	free(insts);
+	free(nets);
+}
+
+void flow_load(struct flow_sc *sc, struct flow_settings *settings, struct llhdl_module *m)
+{
+	sc->settings = settings;
+	sc->module = m;
+	sc->toplevel = 1;
+	sc->templates = NULL;
+	/* registers are moved across the whole design */
+	if(settings->retime)
+		llhdl_flatten(sc->module);
+	if(settings->optimize)
+		llhdl_optimize(sc->module, LLHDL_OPT_ALL);
+	if(settings->retime)
+		llhdl_retime(sc->module, NULL);
+	sc->netlist_iop = netlist_create_iop_manager();
+	sc->netlist = netlist_m_new();
+	sc->symbols = netlist_sym_newstore();
+	sc->vcc_net = NULL;
+	sc->gnd_net = NULL;
+	sc->mapkit = NULL;
+}
+
+void flow_parse(struct flow_sc *sc, struct flow_settings *settings)
+{
+	flow_load(sc, settings, llhdl_parse_file(settings->input_lhd));
+}
 
-	/* Initialize */
-	sc.settings = settings;
-	sc.module = llhdl_parse_file(settings->input_lhd);
-	sc.netlist_iop = netlist_create_iop_manager();
-	sc.netlist = netlist_m_new();
-	sc.symbols = netlist_sym_newstore();
-	sc.vcc_net = NULL;
-	sc.gnd_net = NULL;
-	sc.mapkit = mapkit_new(sc.module, mkc_constant, mkc_signal, mkc_join, &sc);
+static void map_module(struct flow_sc *sc)
+{
+	struct flow_settings *settings = sc->settings;
+	struct llhdl_instance *inst;
+	struct flow_template **index;
+	int n;
+
+	sc->mapkit = mapkit_new(sc->module, mkc_constant, mkc_signal, mkc_join, sc);
 	
 	/* Build the meta-mapper process stack */
+	if(settings->addtree)
+		addtree_register(sc);
+	if(settings->kcm)
+		kcm_register(sc);
 	if(settings->dsp)
-		dsp_register(&sc);
+		dsp_register(sc);
 	if(settings->carry_arith)
-		carryarith_register(&sc);
+		carryarith_register(sc);
 	if(settings->srl)
-		srl_register(&sc);
-	bd_register(sc.mapkit);
-	lut_register(&sc);
-	fd_register(&sc);
+		srl_register(sc);
+	if(settings->wide_muxes)
+		muxtree_register(sc);
+	bd_register(sc->mapkit);
+	lut_register(sc);
+	fd_register(sc);
 	
 	/* Create netlist signals. I/O and clock buffers are also inserted here. */
-	llhdl_identify_clocks(sc.module);
-	create_signals(&sc);
+	create_signals(sc);
+	/* Copy the mapped definitions of the instances */
+	if(sc->module->ihead != NULL) {
+		index = index_templates(sc, &n);
+		for(inst=sc->module->ihead;inst!=NULL;inst=inst->next)
+			stamp_instance(sc, find_template(index, n, inst->definition), inst);
+		free(index);
+	}
 	/* Run the meta-mapper */
-	mapkit_metamap(sc.mapkit);
-	mapkit_free(sc.mapkit);
-	
-	/* Prune netlist */
-	if(settings->prune)
-		netlist_m_prune(sc.netlist);
-	
-	/* Write output files */
+	mapkit_metamap(sc->mapkit);
+	mapkit_free(sc->mapkit);
+	sc->mapkit = NULL;
+}
+
+static void init_definition(struct flow_sc *sc, struct flow_sc *sub, struct llhdl_module *d)
+{
+	sub->settings = sc->settings;
+	sub->module = d;
+	sub->toplevel = 0;
+	sub->templates = sc->templates;
+	sub->netlist_iop = sc->netlist_iop;
+	sub->netlist = netlist_m_new();
+	sub->symbols = netlist_sym_newstore();
+	sub->vcc_net = NULL;
+	sub->gnd_net = NULL;
+	sub->mapkit = NULL;
+}
+
+static void add_template(struct flow_sc *sc, struct flow_sc *sub, int flat)
+{
+	struct flow_template *t;
+	struct llhdl_module *d = sub->module;
+	struct llhdl_node *n;
+	int i, j;
+
+	t = alloc_type(struct flow_template);
+	t->definition = d;
+	t->netlist = sub->netlist;
+	t->symbols = sub->symbols;
+	t->vcc_net = sub->vcc_net;
+	t->gnd_net = sub->gnd_net;
+	t->nports = 0;
+	for(n=d->head;n!=NULL;n=n->p.signal.next)
+		if(n->p.signal.type != LLHDL_SIGNAL_INTERNAL)
+			t->nports++;
+	t->ports = alloc_size(t->nports*sizeof(struct flow_port));
+	i = 0;
+	for(n=d->head;n!=NULL;n=n->p.signal.next) {
+		if(n->p.signal.type == LLHDL_SIGNAL_INTERNAL)
+			continue;
+		t->ports[i].signal = n;
+		t->ports[i].nets = alloc_size(n->p.signal.vectorsize*sizeof(struct netlist_net *));
+		for(j=0;j<n->p.signal.vectorsize;j++)
+			t->ports[i].nets[j] = signal_net(sub, n, j);
+		i++;
+	}
+	t->flat = flat;
+	t->shared = 0;
+	t->next = sc->templates;
+	sc->templates = t;
+}
+
+static void map_definition(struct flow_sc *sc, struct llhdl_module *d)
+{
+	struct flow_sc sub;
+
+	init_definition(sc, &sub, d);
+	map_module(&sub);
+	add_template(sc, &sub, 0);
+}
+
+struct map_queue {
+	pthread_mutex_t lock;
+	struct flow_sc *subs;
+	int n;
+	int next;
+};
+
+static void *map_thread(void *arg)
+{
+	struct map_queue *q = arg;
+	int i;
+
+	while(1) {
+		pthread_mutex_lock(&q->lock);
+		i = q->next++;
+		pthread_mutex_unlock(&q->lock);
+		if(i >= q->n)
+			break;
+		map_module(&q->subs[i]);
+	}
+	return NULL;
+}
+
+/* Maps the definitions on at most <nthreads> threads.
+ * Partitions do not instantiate definitions, and share no nodes or nets.
+ */
+static void map_subs(struct flow_sc *subs, int n, int nthreads)
+{
+	struct map_queue q;
+	pthread_t *threads;
+	int i;
+
+	if(nthreads > n)
+		nthreads = n;
+	if(nthreads < 1)
+		nthreads = 1;
+	pthread_mutex_init(&q.lock, NULL);
+	q.subs = subs;
+	q.n = n;
+	q.next = 0;
+	threads = alloc_size(nthreads*sizeof(pthread_t));
+	for(i=0;i<nthreads;i++)
+		if(pthread_create(&threads[i], NULL, map_thread, &q) != 0) {
+			fprintf(stderr, "Failed to create mapping thread\n");
+			exit(EXIT_FAILURE);
+		}
+	for(i=0;i<nthreads;i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	pthread_mutex_destroy(&q.lock);
+}
+
+static void map_partitions(struct flow_sc *sc, struct llhdl_module *first)
+{
+	struct llhdl_module *d;
+	struct flow_sc *subs;
+	int n, i;
+
+	n = 0;
+	for(d=first;d!=NULL;d=d->next)
+		n++;
+	subs = alloc_size(n*sizeof(struct flow_sc));
+	i = 0;
+	for(d=first;d!=NULL;d=d->next)
+		init_definition(sc, &subs[i++], d);
+	map_subs(subs, n, n);
+	for(i=0;i<n;i++)
+		add_template(sc, &subs[i], 1);
+	free(subs);
+}
+
+void flow_metamap(struct flow_sc *sc)
+{
+	struct llhdl_module *d, *parts;
+
+	parts = llhdl_partition(sc->module, sc->settings->threads);
+	llhdl_identify_clocks(sc->module);
+	/* Definitions come before the modules that instantiate them */
+	for(d=sc->module->dhead;d!=parts;d=d->next)
+		map_definition(sc, d);
+	if(parts != NULL)
+		map_partitions(sc, parts);
+	map_module(sc);
+}
+
+/*
+ * Incremental mapping: the cones of the top-level module are mapped separately,
+ * and the netlists of the cones are kept in a cache from one build to the next.
+ * A cone is found in the cache if its signals and expressions are the same,
+ * whatever the names of its signals, which the front end numbers anew at each build.
+ */
+
+struct cone_writer {
+	FILE *fd;
+	unsigned int epoch;	/* < marks the nodes already written */
+	int nnodes;		/* < which are referred to by number */
+	int size;
+	struct llhdl_node **nodes;
+};
+
+static void write_cone_node(struct cone_writer *w, struct llhdl_node *n)
+{
+	mpz_t bits;
+	int i;
+
+	switch(n->type) {
+		case LLHDL_NODE_CONSTANT:
+			mpz_init(bits);
+			llhdl_get_constant_bits(bits, n);
+			fprintf(w->fd, " c%d.%d.", n->p.constant.sign, n->p.constant.vectorsize);
+			mpz_out_str(w->fd, 16, bits);
+			mpz_clear(bits);
+			break;
+		case LLHDL_NODE_LOGIC:
+		case LLHDL_NODE_EXTLOGIC:
+			fprintf(w->fd, " l%d", n->p.logic.op);
+			break;
+		case LLHDL_NODE_MUX:
+			fprintf(w->fd, " m%d", n->p.mux.nsources);
+			break;
+		case LLHDL_NODE_FD:
+			fprintf(w->fd, " f");
+			break;
+		case LLHDL_NODE_VECT:
+			fprintf(w->fd, " v%d", n->p.vect.sign);
+			for(i=0;i<n->p.vect.nslices;i++)
+				fprintf(w->fd, ".%d.%d", n->p.vect.slices[i].start, n->p.vect.slices[i].end);
+			break;
+		default:
+			assert(0);
+			break;
+	}
+}
+
+/* Pre-order, with the signals and the nodes already written given by number */
+static void write_cone_expression(struct cone_writer *w, struct llhdl_node *root)
+{
+	struct llhdl_node **stack;
+	struct llhdl_node **operand;
+	struct llhdl_node *n;
+	int depth, size;
+	int i, count;
+
+	size = 16;
+	stack = alloc_size(size*sizeof(struct llhdl_node *));
+	stack[0] = root;
+	depth = 1;
+	while(depth > 0) {
+		n = stack[--depth];
+		if(n == NULL) {
+			fprintf(w->fd, " -");
+			continue;
+		}
+		if(n->type == LLHDL_NODE_SIGNAL) {
+			fprintf(w->fd, " s%ld", (long)(intptr_t)n->user);
+			continue;
+		}
+		if(n->mark == w->epoch) {
+			fprintf(w->fd, " n%ld", (long)(intptr_t)n->user);
+			continue;
+		}
+		write_cone_node(w, n);
+		if(w->nnodes == w->size) {
+			w->size = 2*w->size + 16;
+			w->nodes = realloc(w->nodes, w->size*sizeof(struct llhdl_node *));
+			assert(w->nodes != NULL);
+		}
+		n->mark = w->epoch;
+		n->user = (void *)(intptr_t)w->nnodes;
+		w->nodes[w->nnodes++] = n;
+		count = 0;
+		while(llhdl_get_operand(n, count) != NULL)
+			count++;
+		if(depth + count > size) {
+			size = 2*(depth + count) + 16;
+			stack = realloc(stack, size*sizeof(struct llhdl_node *));
+			assert(stack != NULL);
+		}
+		/* the first operand is written first */
+		for(i=count-1;i>=0;i--) {
+			operand = llhdl_get_operand(n, i);
+			stack[depth++] = *operand;
+		}
+	}
+	free(stack);
+}
+
+/* Key of a cone in the cache. Uses the user fields of its nodes. */
+static char *cone_key(struct llhdl_module *d)
+{
+	struct cone_writer w;
+	struct llhdl_node *n;
+	char *key;
+	size_t len;
+	int i;
+
+	w.fd = open_memstream(&key, &len);
+	if(w.fd == NULL) abort();
+	w.epoch = llhdl_new_epoch();
+	w.nnodes = 0;
+	w.size = 0;
+	w.nodes = NULL;
+	i = 0;
+	for(n=d->head;n!=NULL;n=n->p.signal.next) {
+		fprintf(w.fd, "%d %d %d %d\n", n->p.signal.type, n->p.signal.sign, n->p.signal.vectorsize, n->p.signal.is_clock);
+		n->user = (void *)(intptr_t)i++;
+	}
+	for(n=d->head;n!=NULL;n=n->p.signal.next) {
+		if(n->p.signal.source != NULL)
+			write_cone_expression(&w, n->p.signal.source);
+		fprintf(w.fd, "\n");
+	}
+	fclose(w.fd);
+
+	for(n=d->head;n!=NULL;n=n->p.signal.next)
+		n->user = NULL;
+	for(i=0;i<w.nnodes;i++)
+		w.nodes[i]->user = NULL;
+	free(w.nodes);
+	return key;
+}
+
+struct flow_cone {
+	char *key;
+	unsigned int hash;
+	struct llhdl_module *definition; /* < cone of the current build mapped into the netlist */
+	struct netlist_manager *netlist;
+	struct netlist_net *vcc_net;
+	struct netlist_net *gnd_net;
+	int nsignals;
+	struct netlist_net ***nets; /* < nets of each signal of the cone, in order */
+	int build; /* < last build that used the cone */
+	struct flow_cone *next; /* < next cone in the same bucket */
+};
+
+static unsigned int key_hash(const char *s)
+{
+	unsigned int h;
+
+	h = 2166136261U;
+	while(*s)
+		h = (h ^ (unsigned char)*s++)*16777619U;
+	return h;
+}
+
+struct flow_cache *flow_cache_new()
+{
+	struct flow_cache *c;
+
+	c = alloc_type(struct flow_cache);
+	c->mask = 255;
+	c->count = 0;
+	c->table = alloc_size0((c->mask+1)*sizeof(struct flow_cone *));
+	c->build = 0;
+	c->mapped = 0;
+	c->reused = 0;
+	return c;
+}
+
+static void free_cone(struct flow_cone *e)
+{
+	int i;
+
+	for(i=0;i<e->nsignals;i++)
+		free(e->nets[i]);
+	free(e->nets);
+	if(e->netlist != NULL)
+		netlist_m_free(e->netlist);
+	free(e->key);
+	free(e);
+}
+
+void flow_cache_free(struct flow_cache *c)
+{
+	struct flow_cone *e, *next;
+	unsigned int i;
+
+	for(i=0;i<=c->mask;i++)
+		for(e=c->table[i];e!=NULL;e=next) {
+			next = e->next;
+			free_cone(e);
+		}
+	free(c->table);
+	free(c);
+}
+
+static void grow_cache(struct flow_cache *c)
+{
+	struct flow_cone **table;
+	struct flow_cone *e, *next;
+	unsigned int mask, i;
+
+	mask = 2*c->mask + 1;
+	table = alloc_size0((mask+1)*sizeof(struct flow_cone *));
+	for(i=0;i<=c->mask;i++)
+		for(e=c->table[i];e!=NULL;e=next) {
+			next = e->next;
+			e->next = table[e->hash & mask];
+			table[e->hash & mask] = e;
+		}
+	free(c->table);
+	c->table = table;
+	c->mask = mask;
+}
+
+/* Takes ownership of the key. Cones that are not in the cache yet have no netlist. */
+static struct flow_cone *get_cone(struct flow_cache *c, char *key, struct llhdl_module *d)
+{
+	struct flow_cone *e;
+	unsigned int h;
+
+	h = key_hash(key);
+	for(e=c->table[h & c->mask];e!=NULL;e=e->next)
+		if((e->hash == h) && (strcmp(e->key, key) == 0)) {
+			free(key);
+			return e;
+		}
+	e = alloc_type(struct flow_cone);
+	e->key = key;
+	e->hash = h;
+	e->definition = d;
+	e->netlist = NULL;
+	e->vcc_net = NULL;
+	e->gnd_net = NULL;
+	e->nsignals = 0;
+	e->nets = NULL;
+	e->build = c->build;
+	e->next = c->table[h & c->mask];
+	c->table[h & c->mask] = e;
+	if(++c->count > c->mask)
+		grow_cache(c);
+	return e;
+}
+
+/* Cones that the last build did not use are freed */
+static void evict_cones(struct flow_cache *c)
+{
+	struct flow_cone **prev;
+	struct flow_cone *e;
+	unsigned int i;
+
+	for(i=0;i<=c->mask;i++) {
+		prev = &c->table[i];
+		while(*prev != NULL) {
+			e = *prev;
+			if(e->build != c->build) {
+				*prev = e->next;
+				free_cone(e);
+				c->count--;
+			} else
+				prev = &e->next;
+		}
+	}
+}
+
+static void store_cone(struct flow_cone *e, struct flow_sc *sub)
+{
+	struct llhdl_node *n;
+	int i, j;
+
+	e->nsignals = 0;
+	for(n=sub->module->head;n!=NULL;n=n->p.signal.next)
+		e->nsignals++;
+	e->nets = alloc_size((e->nsignals+1)*sizeof(struct netlist_net **));
+	i = 0;
+	for(n=sub->module->head;n!=NULL;n=n->p.signal.next) {
+		e->nets[i] = alloc_size(n->p.signal.vectorsize*sizeof(struct netlist_net *));
+		for(j=0;j<n->p.signal.vectorsize;j++)
+			e->nets[i][j] = signal_net(sub, n, j);
+		i++;
+	}
+	e->netlist = sub->netlist;
+	e->vcc_net = sub->vcc_net;
+	e->gnd_net = sub->gnd_net;
+	netlist_sym_freestore(sub->symbols);
+}
+
+/* The symbols are named after the signals of <d>, with the nets of the cone */
+static void add_cone_template(struct flow_sc *sc, struct llhdl_module *d, struct flow_cone *e)
+{
+	struct flow_template *t;
+	struct netlist_sym *sym;
+	struct llhdl_node *n;
+	char *name;
+	int i, j, k;
+
+	t = alloc_type(struct flow_template);
+	t->definition = d;
+	t->netlist = e->netlist;
+	t->symbols = netlist_sym_newstore();
+	t->vcc_net = e->vcc_net;
+	t->gnd_net = e->gnd_net;
+	t->nports = 0;
+	for(n=d->head;n!=NULL;n=n->p.signal.next)
+		if(n->p.signal.type != LLHDL_SIGNAL_INTERNAL)
+			t->nports++;
+	t->ports = alloc_size(t->nports*sizeof(struct flow_port));
+	i = 0;
+	k = 0;
+	for(n=d->head;n!=NULL;n=n->p.signal.next) {
+		if(n->p.signal.type != LLHDL_SIGNAL_INTERNAL) {
+			t->ports[k].signal = n;
+			t->ports[k].nets = e->nets[i];
+			k++;
+		} else {
+			for(j=0;j<n->p.signal.vectorsize;j++) {
+				if(n->p.signal.vectorsize == 1)
+					name = n->p.signal.name;
+				else
+					name = vecsuffix(n->p.signal.name, j);
+				sym = netlist_sym_add(t->symbols, e->nets[i][j]->uid, 'N', name);
+				sym->user = e->nets[i][j];
+				if(n->p.signal.vectorsize != 1)
+					free(name);
+			}
+		}
+		i++;
+	}
+	t->flat = 1;
+	t->shared = 1;
+	t->next = sc->templates;
+	sc->templates = t;
+}
+
+void flow_metamap_cached(struct flow_sc *sc, struct flow_cache *cache)
+{
+	struct llhdl_module *d, *parts;
+	struct flow_cone **cones, **misses;
+	struct flow_sc *subs;
+	int n, nmisses, i;
+
+	parts = llhdl_partition_cones(sc->module);
+	llhdl_identify_clocks(sc->module);
+	for(d=sc->module->dhead;d!=parts;d=d->next)
+		map_definition(sc, d);
+
+	/* identical cones of the same build are mapped once */
+	cache->build++;
+	n = 0;
+	for(d=parts;d!=NULL;d=d->next)
+		n++;
+	cones = alloc_size((n+1)*sizeof(struct flow_cone *));
+	misses = alloc_size((n+1)*sizeof(struct flow_cone *));
+	nmisses = 0;
+	i = 0;
+	for(d=parts;d!=NULL;d=d->next) {
+		cones[i] = get_cone(cache, cone_key(d), d);
+		if(cones[i]->netlist == NULL) {
+			if(cones[i]->definition == d)
+				misses[nmisses++] = cones[i];
+		} else
+			cones[i]->build = cache->build;
+		i++;
+	}
+	subs = alloc_size((nmisses+1)*sizeof(struct flow_sc));
+	for(i=0;i<nmisses;i++)
+		init_definition(sc, &subs[i], misses[i]->definition);
+	map_subs(subs, nmisses, sc->settings->threads);
+	for(i=0;i<nmisses;i++) {
+		store_cone(misses[i], &subs[i]);
+		misses[i]->definition = NULL;
+	}
+	free(subs);
+
+	i = 0;
+	for(d=parts;d!=NULL;d=d->next)
+		add_cone_template(sc, d, cones[i++]);
+	cache->mapped = nmisses;
+	cache->reused = n - nmisses;
+	evict_cones(cache);
+	free(misses);
+	free(cones);
+
+	map_module(sc);
+}
+
+void flow_prune(struct flow_sc *sc)
+{
+	if(sc->settings->prune)
+		netlist_m_prune(sc->netlist);
+}
+
+void flow_map(struct flow_sc *sc, struct flow_settings *settings)
+{
+	flow_parse(sc, settings);
+	flow_metamap(sc);
+	flow_prune(sc);
+}
+
+/* Nets joined during mapping are written under the uid of the net they were
+ * joined to, which is the one the netlist files use.
+ */
+static void write_symbols(struct flow_sc *sc, const char *filename)
+{
+	struct netlist_sym_store *resolved;
+	struct netlist_sym **syms;
+	struct netlist_sym *sym;
+	unsigned int uid;
+	int i, n;
+
+	syms = alloc_size(sc->symbols->count*sizeof(struct netlist_sym *));
+	n = 0;
+	for(sym=sc->symbols->head;sym!=NULL;sym=sym->next)
+		syms[n++] = sym;
+	resolved = netlist_sym_newstore();
+	for(i=n-1;i>=0;i--) {
+		uid = syms[i]->uid;
+		if((syms[i]->type == 'N') && (syms[i]->user != NULL))
+			uid = netlist_resolve_joined(syms[i]->user)->uid;
+		netlist_sym_add(resolved, uid, syms[i]->type, syms[i]->name);
+	}
+	netlist_sym_to_file(resolved, filename);
+	netlist_sym_freestore(resolved);
+	free(syms);
+}
+
+void flow_write(struct flow_sc *sc)
+{
+	struct flow_settings *settings = sc->settings;
+
 	if(settings->output_anl != NULL)
-		netlist_m_antares_file(sc.netlist, settings->output_anl, sc.module->name, settings->part);
+		netlist_m_antares_file(sc->netlist, settings->output_anl, sc->module->name, settings->part);
 	if(settings->output_edf != NULL) {
 		struct edif_param edif_param;
 		edif_param.flavor = EDIF_FLAVOR_XILINX;
-		edif_param.design_name = sc.module->name;
+		edif_param.design_name = sc->module->name;
 		edif_param.cell_library = "UNISIMS";
 		edif_param.part = settings->part;
 		edif_param.manufacturer = "Xilinx";
-		netlist_m_edif_file(sc.netlist, settings->output_edf, &edif_param);
+		netlist_m_edif_file(sc->netlist, settings->output_edf, &edif_param);
 	}
 	if(settings->output_dot != NULL)
-		netlist_m_dot_file(sc.netlist, settings->output_dot, sc.module->name);
+		netlist_m_dot_file(sc->netlist, settings->output_dot, sc->module->name);
 	if(settings->output_sym)
-		netlist_sym_to_file(sc.symbols, settings->output_sym);
-	
-	/* Clean up */
-	netlist_sym_freestore(sc.symbols);
-	netlist_m_free(sc.netlist);
-	netlist_free_iop_manager(sc.netlist_iop);
-	llhdl_free_module(sc.module);
+		write_symbols(sc, settings->output_sym);
+}
+
+void flow_free(struct flow_sc *sc)
+{
+	struct flow_template *t;
+	int i;
+
+	while(sc->templates != NULL) {
+		t = sc->templates;
+		sc->templates = t->next;
+		if(!t->shared) {
+			for(i=0;i<t->nports;i++)
+				free(t->ports[i].nets);
+			netlist_m_free(t->netlist);
+		}
+		free(t->ports);
+		netlist_sym_freestore(t->symbols);
+		free(t);
+	}
+	netlist_sym_freestore(sc->symbols);
+	netlist_m_free(sc->netlist);
+	netlist_free_iop_manager(sc->netlist_iop);
+	llhdl_free_module(sc->module);
+}
+
+void run_flow(struct flow_settings *settings)
+{
+	struct flow_sc sc;
+
+	flow_map(&sc, settings);
+	flow_write(&sc);
+	flow_free(&sc);
 }
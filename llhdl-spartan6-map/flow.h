@@ -13,12 +13,18 @@ struct flow_settings {
 	
 	char *part;
 
+	int optimize;
+	int retime;
 	int io_buffers;
+	int addtree;
+	int kcm;
 	int dsp;
 	int carry_arith;
 	int srl;
 	int dedicated_muxes;
+	int wide_muxes;
 	int prune;
+	int threads; /* < the module is partitioned for that many mapping threads */
 	
 	int lut_mapper;
 	int lut_max_inputs;
@@ -30,10 +36,14 @@ struct flow_settings {
 	char *output_sym;
 };
 
+struct flow_template;
+
 struct flow_sc {
 	struct flow_settings *settings;
 	
 	struct llhdl_module *module;
+	int toplevel; /* < ports get I/O buffers and pads */
+	struct flow_template *templates; /* < mapped definitions */
 	struct netlist_iop_manager *netlist_iop;
 	struct netlist_manager *netlist;
 	struct netlist_sym_store *symbols;
@@ -42,6 +52,37 @@ struct flow_sc {
 	struct mapkit_sc *mapkit;
 };
 
+/* Use an in-memory design instead of input_lhd. The flow takes ownership of the module. */
+void flow_load(struct flow_sc *sc, struct flow_settings *settings, struct llhdl_module *m);
+
+/* Stages of flow_map(), also run separately by the benchmarks */
+void flow_parse(struct flow_sc *sc, struct flow_settings *settings);
+void flow_metamap(struct flow_sc *sc);
+void flow_prune(struct flow_sc *sc);
+
+/* Netlists of the cones mapped by the previous builds of a design */
+struct flow_cache {
+	unsigned int mask; /* < number of buckets - 1 */
+	unsigned int count;
+	struct flow_cone **table;
+	int build;
+	int mapped; /* < cones of the last build that were mapped */
+	int reused; /* < cones of the last build that were copied from the cache */
+};
+
+struct flow_cache *flow_cache_new();
+void flow_cache_free(struct flow_cache *c);
+/* Like flow_metamap(), but maps each cone of the top-level module separately,
+ * and only the cones that the cache does not have yet.
+ * The cache keeps the cones of the last build only. */
+void flow_metamap_cached(struct flow_sc *sc, struct flow_cache *cache);
+
+/* Parse, optimize and map the input design */
+void flow_map(struct flow_sc *sc, struct flow_settings *settings);
+/* Write the output files selected in the settings */
+void flow_write(struct flow_sc *sc);
+void flow_free(struct flow_sc *sc);
+
 void run_flow(struct flow_settings *settings);
 
 #endif /* __FLOW_H */
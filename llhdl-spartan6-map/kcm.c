@@ -0,0 +1,272 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/tools.h>
+
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/xilprims.h>
+
+#include <mapkit/mapkit.h>
+
+#include "flow.h"
+#include "commonstruct.h"
+#include "carryarith.h"
+#include "kcm.h"
+
+int kcm_csd(mpz_t k, int n_bits, struct kcm_term *terms)
+{
+	mpz_t v;
+	int negate;
+	int i, n;
+
+	mpz_init(v);
+	mpz_abs(v, k);
+	negate = mpz_sgn(k) < 0;
+	n = 0;
+	i = 0;
+	while((mpz_sgn(v) != 0) && (i < n_bits)) {
+		if(mpz_odd_p(v)) {
+			terms[n].shift = i;
+			if(mpz_tstbit(v, 1)) {
+				/* ...11 becomes ...(+1)0(-1) */
+				terms[n].negative = !negate;
+				mpz_add_ui(v, v, 1);
+			} else {
+				terms[n].negative = negate;
+				mpz_sub_ui(v, v, 1);
+			}
+			n++;
+		}
+		mpz_fdiv_q_2exp(v, v, 1);
+		i++;
+	}
+	mpz_clear(v);
+	return n;
+}
+
+static struct netlist_net *shifted_net(struct flow_sc *sc, struct netlist_net **nets, int n_bits, int sign, int shift, int i)
+{
+	i -= shift;
+	if(i < 0)
+		return cs_constant_net(sc, 0);
+	if(i < n_bits)
+		return nets[i];
+	if(sign)
+		return nets[n_bits-1];
+	return cs_constant_net(sc, 0);
+}
+
+/* Add or subtract <b> to the upper bits of the accumulator, starting at <shift>.
+ * Lower bits are unaffected and are passed through.
+ */
+static void accumulate(struct flow_sc *sc, int sub, struct netlist_net **acc, int n_bits_acc,
+	struct netlist_net **b, int n_bits_b, int sign_b, int shift)
+{
+	struct netlist_net **r;
+
+	r = alloc_size((n_bits_acc-shift)*sizeof(struct netlist_net *));
+	carryarith_build(sc, sub, &acc[shift], n_bits_acc-shift, 0, b, n_bits_b, sign_b, r, n_bits_acc-shift);
+	memcpy(&acc[shift], r, (n_bits_acc-shift)*sizeof(struct netlist_net *));
+	free(r);
+}
+
+static int shift_add_base(struct kcm_term *terms, int nterms)
+{
+	int i;
+
+	for(i=0;i<nterms;i++)
+		if(!terms[i].negative)
+			return i;
+	return -1;
+}
+
+static int shift_add_cost(struct kcm_term *terms, int nterms, int n_bits_r)
+{
+	int base;
+	int i;
+	int cost;
+
+	base = shift_add_base(terms, nterms);
+	cost = 0;
+	for(i=0;i<nterms;i++)
+		if(i != base)
+			cost += n_bits_r - terms[i].shift;
+	return cost;
+}
+
+static void build_shift_add(struct flow_sc *sc, struct netlist_net **x, int n_bits_x, int sign_x,
+	struct kcm_term *terms, int nterms, struct netlist_net **r, int n_bits_r)
+{
+	int base;
+	int i;
+
+	/* The first positive term is a mere wire remap */
+	base = shift_add_base(terms, nterms);
+	for(i=0;i<n_bits_r;i++) {
+		if(base == -1)
+			r[i] = cs_constant_net(sc, 0);
+		else
+			r[i] = shifted_net(sc, x, n_bits_x, sign_x, terms[base].shift, i);
+	}
+	for(i=0;i<nterms;i++)
+		if(i != base)
+			accumulate(sc, terms[i].negative, r, n_bits_r, x, n_bits_x, sign_x, terms[i].shift);
+}
+
+/* Partial products of a chunk of <x> with the constant.
+ * If <x> is NULL, only returns the number of LUTs that would be used.
+ */
+static int build_table(struct flow_sc *sc, mpz_t k, struct netlist_net **x, int n_bits_chunk, int sign_chunk,
+	struct netlist_net **r, int *n_bits_t, int *sign_t, int max_bits)
+{
+	int nvalues;
+	mpz_t *products;
+	mpz_t contents;
+	int i, j;
+	int needed;
+	int ones;
+	int cost;
+	struct netlist_instance *lut;
+
+	nvalues = 1 << n_bits_chunk;
+	products = alloc_size(nvalues*sizeof(mpz_t));
+	needed = 1;
+	*sign_t = 0;
+	for(i=0;i<nvalues;i++) {
+		mpz_init_set_si(products[i], i);
+		if(sign_chunk && (i & (1 << (n_bits_chunk-1))))
+			mpz_sub_ui(products[i], products[i], nvalues);
+		mpz_mul(products[i], products[i], k);
+		if(mpz_sgn(products[i]) < 0)
+			*sign_t = 1;
+		needed = max(needed, mpz_sizeinbase(products[i], 2));
+	}
+	*n_bits_t = min(needed + *sign_t, max_bits);
+
+	cost = 0;
+	mpz_init(contents);
+	for(j=0;j<*n_bits_t;j++) {
+		mpz_set_ui(contents, 0);
+		ones = 0;
+		for(i=0;i<nvalues;i++)
+			if(mpz_tstbit(products[i], j)) {
+				mpz_setbit(contents, i);
+				ones++;
+			}
+		if((ones == 0) || (ones == nvalues)) {
+			if(x != NULL)
+				r[j] = cs_constant_net(sc, ones != 0);
+			continue;
+		}
+		cost++;
+		if(x != NULL) {
+			lut = cs_create_lut(sc, n_bits_chunk, contents);
+			for(i=0;i<n_bits_chunk;i++)
+				netlist_add_branch(x[i], lut, 0, i);
+			r[j] = netlist_m_create_net_with_branch(sc->netlist, lut, 1, 0);
+		}
+	}
+	mpz_clear(contents);
+
+	for(i=0;i<nvalues;i++)
+		mpz_clear(products[i]);
+	free(products);
+	return cost;
+}
+
+/* LUT-based constant multiplier: <x> is split into chunks addressing
+ * tables of partial products, which are then summed.
+ * If <x> is NULL, only returns the number of LUTs that would be used.
+ */
+static int build_kcm(struct flow_sc *sc, mpz_t k, struct netlist_net **x, int n_bits_x, int sign_x,
+	struct netlist_net **r, int n_bits_r)
+{
+	int chunk;
+	int shift;
+	int n_bits_chunk;
+	struct netlist_net **t;
+	int n_bits_t, sign_t;
+	int i;
+	int cost;
+
+	chunk = sc->settings->lut_max_inputs;
+	t = x == NULL ? NULL : alloc_size(n_bits_r*sizeof(struct netlist_net *));
+	cost = 0;
+	for(shift=0;(shift<n_bits_x) && (shift<n_bits_r);shift+=chunk) {
+		n_bits_chunk = min(chunk, n_bits_x-shift);
+		cost += build_table(sc, k, x == NULL ? NULL : &x[shift], n_bits_chunk,
+			sign_x && (shift+n_bits_chunk == n_bits_x),
+			t, &n_bits_t, &sign_t, n_bits_r-shift);
+		if(shift == 0) {
+			if(x != NULL)
+				for(i=0;i<n_bits_r;i++)
+					r[i] = shifted_net(sc, t, n_bits_t, sign_t, 0, i);
+		} else {
+			cost += n_bits_r-shift;
+			if(x != NULL)
+				accumulate(sc, 0, r, n_bits_r, t, n_bits_t, sign_t, shift);
+		}
+	}
+	free(t);
+	return cost;
+}
+
+static void mkc_process(struct llhdl_node **n2, void *user)
+{
+	struct llhdl_node *n = *n2;
+	struct flow_sc *sc = user;
+	int xi;
+	struct llhdl_node *x;
+	int n_bits_x, sign_x, n_bits_r;
+	mpz_t k;
+	struct kcm_term *terms;
+	int nterms;
+	struct mapkit_result *result;
+	int i;
+
+	if((n->type != LLHDL_NODE_EXTLOGIC) || (n->p.logic.op != LLHDL_EXTLOGIC_MUL))
+		return;
+	if(n->p.logic.operands[1]->type == LLHDL_NODE_CONSTANT)
+		xi = 0;
+	else if(n->p.logic.operands[0]->type == LLHDL_NODE_CONSTANT)
+		xi = 1;
+	else
+		return;
+	x = n->p.logic.operands[xi];
+	n_bits_x = mapkit_get_vectorsize(sc->mapkit, x);
+	sign_x = mapkit_get_sign(sc->mapkit, x);
+	n_bits_r = mapkit_get_vectorsize(sc->mapkit, n);
+
+	mpz_init(k);
+	llhdl_get_constant_value(k, n->p.logic.operands[!xi]);
+	terms = alloc_size(n_bits_r*sizeof(struct kcm_term));
+	nterms = kcm_csd(k, n_bits_r, terms);
+
+	result = mapkit_create_result(1, n_bits_x, n_bits_r);
+	result->input_nodes[0] = &n->p.logic.operands[xi];
+	for(i=0;i<n_bits_x;i++)
+		result->input_nets[i] = netlist_m_create_net(sc->netlist);
+
+	if(build_kcm(sc, k, NULL, n_bits_x, sign_x, NULL, n_bits_r) < shift_add_cost(terms, nterms, n_bits_r))
+		build_kcm(sc, k, (struct netlist_net **)result->input_nets, n_bits_x, sign_x,
+			(struct netlist_net **)result->output_nets, n_bits_r);
+	else
+		build_shift_add(sc, (struct netlist_net **)result->input_nets, n_bits_x, sign_x,
+			terms, nterms, (struct netlist_net **)result->output_nets, n_bits_r);
+
+	free(terms);
+	mpz_clear(k);
+	mapkit_consume(sc->mapkit, n, result);
+}
+
+void kcm_register(struct flow_sc *sc)
+{
+	mapkit_register_process(sc->mapkit, mkc_process, NULL, sc);
+}
@@ -0,0 +1,18 @@
+#ifndef __KCM_H
+#define __KCM_H
+
+#include <gmp.h>
+#include "flow.h"
+
+struct kcm_term {
+	int shift;
+	int negative;
+};
+
+/* Canonical signed digit recoding of <k>, keeping only digits below <n_bits>.
+ * <terms> must have room for <n_bits> entries. Returns the number of terms.
+ */
+int kcm_csd(mpz_t k, int n_bits, struct kcm_term *terms);
+void kcm_register(struct flow_sc *sc);
+
+#endif /* __KCM_H */
@@ -0,0 +1,245 @@
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <gmp.h>
+
+#include <util.h>
+
+#include <llhdl/structure.h>
+#include <llhdl/tools.h>
+
+#include <netlist/net.h>
+#include <netlist/manager.h>
+#include <netlist/xilprims.h>
+
+#include <mapkit/mapkit.h>
+
+#include "flow.h"
+#include "commonstruct.h"
+#include "muxtree.h"
+
+/*
+ * Wide multiplexers are mapped structurally, one tree per output bit,
+ * consuming the select bits from the LSB:
+ *  - first a level of LUT6 4:1 multiplexers,
+ *  - then MUXF7 and MUXF8 for the next two select bits (8:1 and 16:1),
+ *  - then more levels of LUT6 4:1 multiplexers, as needed.
+ * With fewer than 6 LUT inputs, each LUT level is a 2:1 multiplexer.
+ * All data inputs go through the same number of levels.
+ *
+ * A NULL net stands for a constant 0, which is the value of missing sources.
+ * Identical sources are mapped once, and a group of inputs that are all
+ * the same net, or all 0, is passed through without a multiplexer.
+ */
+
+static struct netlist_net *lut_mux(struct flow_sc *sc, struct netlist_net **select, int nselect, struct netlist_net **data)
+{
+	int ndata, inputs;
+	int i, j;
+	mpz_t contents;
+	struct netlist_instance *lut;
+	struct netlist_net *output;
+
+	ndata = 1 << nselect;
+	for(i=1;i<ndata;i++)
+		if(data[i] != data[0])
+			break;
+	if(i == ndata)
+		return data[0];
+
+	/* Inputs are the select bits, then the data bits */
+	inputs = nselect + ndata;
+	mpz_init(contents);
+	for(i=0;i<(1 << inputs);i++) {
+		j = i & (ndata - 1);
+		if(i & (1 << (nselect + j)))
+			mpz_setbit(contents, i);
+	}
+	lut = cs_create_lut(sc, inputs, contents);
+	mpz_clear(contents);
+
+	for(i=0;i<nselect;i++)
+		netlist_add_branch(select[i], lut, 0, i);
+	for(i=0;i<ndata;i++)
+		netlist_add_branch(data[i] != NULL ? data[i] : cs_constant_net(sc, 0), lut, 0, nselect + i);
+	output = netlist_m_create_net(sc->netlist);
+	netlist_add_branch(output, lut, 1, 0);
+	return output;
+}
+
+static struct netlist_net *dedicated_mux(struct flow_sc *sc, int type, struct netlist_net *select, struct netlist_net **data)
+{
+	struct netlist_instance *mux;
+	struct netlist_net *output;
+
+	if(data[0] == data[1])
+		return data[0];
+	/* MUXF7 and MUXF8 have the same pinout */
+	mux = netlist_m_instantiate(sc->netlist, &netlist_xilprims[type]);
+	netlist_add_branch(select, mux, 0, NETLIST_XIL_MUXF7_S);
+	netlist_add_branch(data[0] != NULL ? data[0] : cs_constant_net(sc, 0), mux, 0, NETLIST_XIL_MUXF7_I0);
+	netlist_add_branch(data[1] != NULL ? data[1] : cs_constant_net(sc, 0), mux, 0, NETLIST_XIL_MUXF7_I1);
+	output = netlist_m_create_net(sc->netlist);
+	netlist_add_branch(output, mux, 1, NETLIST_XIL_MUXF7_O);
+	return output;
+}
+
+/* Reduces <count> nets to (<count> + 2^<nselect> - 1) >> <nselect> nets, in place.
+ * <type> is -1 for a level of LUTs, or the dedicated multiplexer primitive.
+ */
+static int mux_level(struct flow_sc *sc, int type, struct netlist_net **select, int nselect, struct netlist_net **nets, int count)
+{
+	struct netlist_net *data[4];
+	int ndata, noutputs;
+	int i, j;
+
+	assert(nselect <= 2);
+	ndata = 1 << nselect;
+	noutputs = (count + ndata - 1) >> nselect;
+	for(i=0;i<noutputs;i++) {
+		for(j=0;j<ndata;j++)
+			data[j] = i*ndata + j < count ? nets[i*ndata + j] : NULL;
+		if(type == -1)
+			nets[i] = lut_mux(sc, select, nselect, data);
+		else
+			nets[i] = dedicated_mux(sc, type, select[0], data);
+	}
+	return noutputs;
+}
+
+static struct netlist_net *mux_tree(struct flow_sc *sc, struct netlist_net **select, int nselect, struct netlist_net **nets, int count)
+{
+	int lut_select;
+	int m, used;
+
+	lut_select = sc->settings->lut_max_inputs >= 6 ? 2 : 1;
+	used = 0;
+
+	m = min(lut_select, nselect - used);
+	count = mux_level(sc, -1, &select[used], m, nets, count);
+	used += m;
+	if(sc->settings->dedicated_muxes) {
+		if(used < nselect)
+			count = mux_level(sc, NETLIST_XIL_MUXF7, &select[used++], 1, nets, count);
+		if(used < nselect)
+			count = mux_level(sc, NETLIST_XIL_MUXF8, &select[used++], 1, nets, count);
+	}
+	while(used < nselect) {
+		m = min(lut_select, nselect - used);
+		count = mux_level(sc, -1, &select[used], m, nets, count);
+		used += m;
+	}
+	assert(count == 1);
+	return nets[0];
+}
+
+/* Net of bit <bit> of a mux source, extended according to its sign */
+static struct netlist_net *source_net(struct flow_sc *sc, struct llhdl_node *source, struct netlist_net **nets, int bit)
+{
+	int vectorsize;
+	int sign;
+
+	vectorsize = mapkit_get_vectorsize(sc->mapkit, source);
+	sign = mapkit_get_sign(sc->mapkit, source);
+	if(bit >= vectorsize) {
+		if(!sign)
+			return NULL;
+		bit = vectorsize - 1;
+	}
+	if(source->type == LLHDL_NODE_CONSTANT) {
+		if(llhdl_get_constant_bit(source, bit))
+			return cs_constant_net(sc, 1);
+		return NULL;
+	}
+	return nets[bit];
+}
+
+static void mkc_process(struct llhdl_node **n2, void *user)
+{
+	struct llhdl_node *n = *n2;
+	struct flow_sc *sc = user;
+	int nselect, n_bits, nsources, nreachable;
+	int ninput_nodes, ninput_nets;
+	int *first;
+	int i, j, offset;
+	struct mapkit_result *result;
+	struct netlist_net **select;
+	struct netlist_net ***source_nets;
+	struct netlist_net **nets;
+	struct netlist_net *output;
+
+	if((n->type != LLHDL_NODE_MUX) || (n->p.mux.nsources < 3))
+		return;
+	if(n->p.mux.select->type == LLHDL_NODE_CONSTANT)
+		return;
+	nselect = mapkit_get_vectorsize(sc->mapkit, n->p.mux.select);
+	nsources = n->p.mux.nsources;
+	n_bits = mapkit_get_vectorsize(sc->mapkit, n);
+
+	/* Constant sources are not mapped, their bits are tied to VCC or GND.
+	 * Sources identical to a previous one share its input node.
+	 */
+	first = alloc_size(nsources*sizeof(int));
+	ninput_nodes = 1;
+	ninput_nets = nselect;
+	for(i=0;i<nsources;i++) {
+		first[i] = i;
+		if(n->p.mux.sources[i]->type == LLHDL_NODE_CONSTANT)
+			continue;
+		for(j=0;j<i;j++)
+			if((first[j] == j) && (n->p.mux.sources[j]->type != LLHDL_NODE_CONSTANT)
+			  && llhdl_equiv(n->p.mux.sources[j], n->p.mux.sources[i])) {
+				first[i] = j;
+				break;
+			}
+		if(first[i] == i) {
+			ninput_nodes++;
+			ninput_nets += mapkit_get_vectorsize(sc->mapkit, n->p.mux.sources[i]);
+		}
+	}
+	result = mapkit_create_result(ninput_nodes, ninput_nets, n_bits);
+	for(i=0;i<ninput_nets;i++)
+		result->input_nets[i] = netlist_m_create_net(sc->netlist);
+
+	result->input_nodes[0] = &n->p.mux.select;
+	select = (struct netlist_net **)result->input_nets;
+	source_nets = alloc_size(nsources*sizeof(struct netlist_net **));
+	j = 1;
+	offset = nselect;
+	for(i=0;i<nsources;i++) {
+		if(n->p.mux.sources[i]->type == LLHDL_NODE_CONSTANT)
+			source_nets[i] = NULL;
+		else if(first[i] != i)
+			source_nets[i] = source_nets[first[i]];
+		else {
+			result->input_nodes[j++] = &n->p.mux.sources[i];
+			source_nets[i] = (struct netlist_net **)&result->input_nets[offset];
+			offset += mapkit_get_vectorsize(sc->mapkit, n->p.mux.sources[i]);
+		}
+	}
+
+	/* Select values past the last source give 0.
+	 * Sources past the last select value are unreachable.
+	 */
+	nreachable = nsources;
+	if((nselect < 30) && (nreachable > (1 << nselect)))
+		nreachable = 1 << nselect;
+	nets = alloc_size(nreachable*sizeof(struct netlist_net *));
+	for(i=0;i<n_bits;i++) {
+		for(j=0;j<nreachable;j++)
+			nets[j] = source_net(sc, n->p.mux.sources[j], source_nets[j], i);
+		output = mux_tree(sc, select, nselect, nets, nreachable);
+		result->output_nets[i] = output != NULL ? output : cs_constant_net(sc, 0);
+	}
+	free(nets);
+	free(source_nets);
+	free(first);
+
+	mapkit_consume(sc->mapkit, n, result);
+}
+
+void muxtree_register(struct flow_sc *sc)
+{
+	mapkit_register_process(sc->mapkit, mkc_process, NULL, sc);
+}
@@ -0,0 +1,8 @@
+#ifndef __MUXTREE_H
+#define __MUXTREE_H
+
+#include "flow.h"
+
+void muxtree_register(struct flow_sc *sc);
+
+#endif /* __MUXTREE_H */
@@ -0,0 +1,249 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util.h>
+
+#include <tilm/tilm.h>
+
+#include "flow.h"
+#include "options.h"
+
+struct flow_settings flow_settings = {
+	.part = "xc6slx45-fgg484-2",
+
+	.optimize = 1,
+	.retime = 0,
+	.io_buffers = 1,
+	.addtree = 1,
+	.kcm = 1,
+	.dsp = 1,
+	.carry_arith = 1,
+	.srl = 1,
+	.dedicated_muxes = 1,
+	.wide_muxes = 1,
+	.prune = 1,
+	.threads = 1,
+	
+	.lut_mapper = TILM_DEFAULT,
+	.lut_max_inputs = 6
+};
+
+static const char *parts[] = {
+	"xc6slx45-fgg484-2",
+	"xc6slx45-fgg484-3",
+	NULL
+};
+
+static struct option_desc options[] = {
+	{
+		.handle = "optimize",
+		.description = "Optimize the design before mapping",
+		.sw = &flow_settings.optimize
+	},
+	{
+		.handle = "retime",
+		.description = "Retime registers before mapping",
+		.sw = &flow_settings.retime
+	},
+	{
+		.handle = "io-buffers",
+		.description = "Insert I/O buffers",
+		.sw = &flow_settings.io_buffers
+	},
+	{
+		.handle = "addtree",
+		.description = "Map multi-operand sums to compressor trees",
+		.sw = &flow_settings.addtree
+	},
+	{
+		.handle = "kcm",
+		.description = "Map multiplications by constants to adders or LUT tables",
+		.sw = &flow_settings.kcm
+	},
+	{
+		.handle = "dsp",
+		.description = "Use dedicated DSP blocks",
+		.sw = &flow_settings.dsp
+	},
+	{
+		.handle = "carry-arith",
+		.description = "Use carry chain arithmetic",
+		.sw = &flow_settings.carry_arith
+	},
+	{
+		.handle = "srl",
+		.description = "Use the shift register mode of LUTs",
+		.sw = &flow_settings.srl
+	},
+	{
+		.handle = "dedicated-muxes",
+		.description = "Use dedicated multiplexers (MUXF7, MUXF8)",
+		.sw = &flow_settings.dedicated_muxes
+	},
+	{
+		.handle = "wide-muxes",
+		.description = "Map wide multiplexers to balanced trees",
+		.sw = &flow_settings.wide_muxes
+	},
+	{
+		.handle = "prune",
+		.description = "Prune final netlist",
+		.sw = &flow_settings.prune
+	},
+};
+
+const char *flow_validate_part(const char *part)
+{
+	int i;
+	
+	i = 0;
+	while(parts[i] != NULL) {
+		if(strcmp(parts[i], part) == 0)
+			return parts[i];
+		i++;
+	}
+	return NULL;
+}
+
+void flow_list_parts()
+{
+	int i;
+	
+	i = 0;
+	while(parts[i] != NULL) {
+		printf("      %s%s\n", parts[i], strcmp(parts[i], flow_settings.part) == 0 ? " (default)" : "");
+		i++;
+	}
+}
+
+void flow_list_lutmappers()
+{
+	int i;
+	
+	for(i=0;i<TILM_COUNT;i++)
+		printf("      %s: %s mapper%s\n",
+			tilm_mappers[i].handle,
+			tilm_mappers[i].description,
+			i == flow_settings.lut_mapper ? " (default)" : "");
+}
+
+void flow_list_options()
+{
+	int i;
+	
+	for(i=0;i<sizeof(options)/sizeof(options[0]);i++)
+		printf("    -f[no-]%s: %s (default: %s)\n",
+			options[i].handle,
+			options[i].description,
+			*(options[i].sw) ? "enabled" : "disabled");
+}
+
+void flow_handle_option(char *opt)
+{
+	int val;
+	int i;
+	
+	val = 1;
+	if(strncmp(opt, "no-", 3) == 0) {
+		val = 0;
+		opt += 3;
+	}
+	for(i=0;i<sizeof(options)/sizeof(options[0]);i++)
+		if(strcmp(opt, options[i].handle) == 0) {
+			*(options[i].sw) = val;
+			return;
+		}
+	fprintf(stderr, "Invalid option: '%s'.\n", opt);
+	exit(EXIT_FAILURE);
+}
+
+void flow_help_settings()
+{
+	printf("  -p <part>: Select part. Supported values are:\n");
+	flow_list_parts();
+	printf("  -f <[no-]option>: Enable or disable options. Supported options are:\n");
+	flow_list_options();
+	printf("  -l <algo>: Select LUT mapping algorithm. Supported values are:\n");
+	flow_list_lutmappers();
+	printf("  -i <n>: Use at most that many LUT inputs (3-6, default: %d)\n", flow_settings.lut_max_inputs);
+}
+
+int flow_handle_getopt(int opt, char *arg)
+{
+	switch(opt) {
+		case 'p':
+			flow_settings.part = (char *)flow_validate_part(arg);
+			if(flow_settings.part == NULL) {
+				fprintf(stderr, "Unknown part: %s. Use -h to list supported parts.\n", arg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'f':
+			flow_handle_option(arg);
+			break;
+		case 'l':
+			flow_settings.lut_mapper = tilm_get_mapper_by_handle(arg);
+			if(flow_settings.lut_mapper < 0) {
+				fprintf(stderr, "Unknown LUT mapping algorithm: %s. Use -h to list supported algorithms.\n", arg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'i':
+			flow_settings.lut_max_inputs = atoi(arg);
+			if((flow_settings.lut_max_inputs < 3) || (flow_settings.lut_max_inputs > 6)) {
+				fprintf(stderr, "Invalid number of maximum LUT inputs.\n");
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'o':
+			free(flow_settings.output_anl);
+			flow_settings.output_anl = stralloc(arg);
+			break;
+		case 'e':
+			free(flow_settings.output_edf);
+			flow_settings.output_edf = stralloc(arg);
+			break;
+		case 'd':
+			free(flow_settings.output_dot);
+			flow_settings.output_dot = stralloc(arg);
+			break;
+		case 's':
+			free(flow_settings.output_sym);
+			flow_settings.output_sym = stralloc(arg);
+			break;
+		default:
+			return 0;
+	}
+	return 1;
+}
+
+void flow_default_outputs(const char *inname)
+{
+	if((flow_settings.output_anl == NULL) && (flow_settings.output_edf == NULL) && (flow_settings.output_dot == NULL))
+		flow_settings.output_edf = flow_file_suffix(inname, ".edf");
+}
+
+void flow_free_outputs()
+{
+	free(flow_settings.output_anl);
+	free(flow_settings.output_edf);
+	free(flow_settings.output_dot);
+	free(flow_settings.output_sym);
+}
+
+char *flow_file_suffix(const char *inname, const char *suffix)
+{
+	char *c;
+	int r;
+	char *base;
+	char *out;
+
+	base = stralloc(inname);
+	c = strrchr(base, '.');
+	if(c != NULL)
+		*c = 0;
+	r = asprintf(&out, "%s%s", base, suffix);
+	if(r == -1) abort();
+	free(base);
+	return out;
+}
@@ -0,0 +1,34 @@
+#ifndef __OPTIONS_H
+#define __OPTIONS_H
+
+#include "flow.h"
+
+/* Settings with their default values, modified by flow_handle_option() */
+extern struct flow_settings flow_settings;
+
+struct option_desc {
+	const char *handle;
+	const char *description;
+	int *sw;
+};
+
+const char *flow_validate_part(const char *part);
+void flow_list_parts();
+void flow_list_lutmappers();
+void flow_list_options();
+/* Handle a -f [no-]option argument */
+void flow_handle_option(char *opt);
+
+/* Command line parameters common to the programs running the mapping flow */
+#define FLOW_GETOPT "p:f:l:i:o:e:d:s:"
+void flow_help_settings();
+/* Returns 0 if the parameter is not one of FLOW_GETOPT */
+int flow_handle_getopt(int opt, char *arg);
+/* Writes an EDIF netlist named after the input if no netlist is selected */
+void flow_default_outputs(const char *inname);
+void flow_free_outputs();
+
+/* Replaces the extension of the file name */
+char *flow_file_suffix(const char *inname, const char *suffix);
+
+#endif /* __OPTIONS_H */
@@ -1,15 +1,16 @@
 %include {
 	#include <assert.h>
+	#include <stdio.h>
 	#include <string.h>
 	#include <stdlib.h>
+	#include "scanner.h"
 	#include "verilog.h"
 }
 
 %start_symbol module
 %extra_argument {struct verilog_module *outm}
 
-%token_type {void *}
-%token_destructor { free($$); }
+%token_type {struct scanner_token}
 
 %syntax_error {
 	fprintf(stderr, "Syntax error in Verilog input\n");
@@ -20,13 +21,11 @@
 %destructor constant { verilog_free_constant($$); }
 
 constant(C) ::= TOK_VCON(V). {
-	C = verilog_new_constant_str(V);
-	free(V);
+	C = verilog_new_constant_str(V.str, V.len);
 }
 
 constant(C) ::= TOK_PINT(V). {
-	C = verilog_new_constant_str(V);
-	free(V);
+	C = verilog_new_constant_str(V.str, V.len);
 }
 
 %type width {int}
@@ -37,10 +36,8 @@ width(W) ::= . {
 
 width(W) ::= TOK_LBRACKET TOK_PINT(H) TOK_COLON TOK_PINT(L) TOK_RBRACKET . {
 	int h, l;
-	h = atoi(H);
-	l = atoi(L);
-	free(H);
-	free(L);
+	h = atoi(H.str);
+	l = atoi(L.str);
 	if(l != 0) {
 		fprintf(stderr, "Right half of width specifier must be 0\n");
 		exit(EXIT_FAILURE);
@@ -58,15 +55,12 @@ width(W) ::= TOK_LBRACKET TOK_PINT(H) TOK_COLON TOK_PINT(L) TOK_RBRACKET . {
 %type slice {struct slice}
 
 slice(C) ::= TOK_LBRACKET TOK_PINT(H) TOK_COLON TOK_PINT(L) TOK_RBRACKET . {
-	C.start = atoi(L);
-	C.end = atoi(H);
-	free(H);
-	free(L);
+	C.start = atoi(L.str);
+	C.end = atoi(H.str);
 }
 
 slice(C) ::= TOK_LBRACKET TOK_PINT(B) TOK_RBRACKET . {
-	C.start = C.end = atoi(B);
-	free(B);
+	C.start = C.end = atoi(B.str);
 }
 
 %type sgn {int}
@@ -83,39 +77,33 @@ sgn(N) ::= TOK_SIGNED . {
 %destructor newsignal { verilog_free_signal(outm, $$); }
 
 newsignal(S) ::= TOK_REGWIRE sgn(N) width(W) TOK_ID(I). {
-	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_REGWIRE, I, W, N);
-	free(I);
+	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_REGWIRE, I.str, I.len, W, N);
 }
 
 newsignal(S) ::= TOK_OUTPUT sgn(N) width(W) TOK_ID(I). {
-	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_OUTPUT, I, W, N);
-	free(I);
+	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_OUTPUT, I.str, I.len, W, N);
 }
 
 newsignal(S) ::= TOK_INPUT sgn(N) width(W) TOK_ID(I). {
-	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_INPUT, I, W, N);
-	free(I);
+	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_INPUT, I.str, I.len, W, N);
 }
 
 newsignal(S) ::= TOK_OUTPUT TOK_REGWIRE sgn(N) width(W) TOK_ID(I). {
-	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_OUTPUT, I, W, N);
-	free(I);
+	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_OUTPUT, I.str, I.len, W, N);
 }
 
 newsignal(S) ::= TOK_INPUT TOK_REGWIRE sgn(N) width(W) TOK_ID(I). {
-	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_INPUT, I, W, N);
-	free(I);
+	S = verilog_new_update_signal(outm, VERILOG_SIGNAL_INPUT, I.str, I.len, W, N);
 }
 
 %type signal {struct verilog_signal *}
 
 signal(S) ::= TOK_ID(I). {
-	S = verilog_find_signal(outm, I);
+	S = verilog_find_signal(outm, I.str, I.len);
 	if(S == NULL) {
-		fprintf(stderr, "Signal not found: %s\n", I);
+		fprintf(stderr, "Signal not found: %.*s\n", I.len, I.str);
 		exit(EXIT_FAILURE);
 	}
-	free(I);
 }
 
 %type node {struct verilog_node *}
@@ -137,8 +125,8 @@ node(N) ::= signal(S) slice(C). {
 	sig->branches[0] = S;
 	N = verilog_new_op_node(VERILOG_NODE_SLICE);
 	N->branches[0] = sig;
-	N->branches[1] = (void *)C.start;
-	N->branches[2] = (void *)C.end;
+	N->branches[1] = (void *)(long)C.start;
+	N->branches[2] = (void *)(long)C.end;
 }
 
 %type lnode {struct verilog_node *}
@@ -278,6 +266,70 @@ unmatched(C) ::= TOK_IF TOK_LPAREN node(E) TOK_RPAREN matched(P) TOK_ELSE unmatc
 
 matched(S) ::= singleassignment(A) TOK_SEMICOLON. { S = A; }
 
+%include {
+	struct case_label_list {
+		struct verilog_case_label *head;
+		struct verilog_case_label *tail;
+	};
+	struct case_item_list {
+		struct verilog_case_item *head;
+		struct verilog_case_item *tail;
+	};
+}
+
+%type caselabels {struct case_label_list}
+%destructor caselabels { verilog_free_case_label_list($$.head); }
+
+caselabels(L) ::= constant(C). {
+	L.head = L.tail = verilog_new_case_label(C);
+}
+
+caselabels(L) ::= caselabels(B) TOK_COMMA constant(C). {
+	L = B;
+	L.tail->next = verilog_new_case_label(C);
+	L.tail = L.tail->next;
+}
+
+%type caseitem {struct verilog_case_item *}
+%destructor caseitem { verilog_free_case_item_list($$); }
+
+caseitem(I) ::= caselabels(L) TOK_COLON statement(S). {
+	I = verilog_new_case_item(L.head, S);
+}
+
+caseitem(I) ::= TOK_DEFAULT TOK_COLON statement(S). {
+	I = verilog_new_case_item(NULL, S);
+}
+
+caseitem(I) ::= caselabels(L) TOK_COLON TOK_SEMICOLON. {
+	I = verilog_new_case_item(L.head, NULL);
+}
+
+caseitem(I) ::= TOK_DEFAULT TOK_COLON TOK_SEMICOLON. {
+	I = verilog_new_case_item(NULL, NULL);
+}
+
+%type caseitems {struct case_item_list}
+%destructor caseitems { verilog_free_case_item_list($$.head); }
+
+caseitems(L) ::= caseitems(B) caseitem(I). {
+	L = B;
+	if(L.tail != NULL)
+		L.tail->next = I;
+	else
+		L.head = I;
+	L.tail = I;
+}
+caseitems(L) ::= . { L.head = L.tail = NULL; }
+
+matched(C) ::= TOK_CASE TOK_LPAREN node(E) TOK_RPAREN caseitems(I) TOK_ENDCASE. {
+	C = verilog_new_case(E, 0, I.head);
+}
+
+matched(C) ::= TOK_CASEZ TOK_LPAREN node(E) TOK_RPAREN caseitems(I) TOK_ENDCASE. {
+	C = verilog_new_case(E, 1, I.head);
+}
+
 statement(S) ::= matched(M). { S = M; }
 statement(S) ::= unmatched(U). { S = U; }
 
@@ -319,6 +371,12 @@ process(P) ::= TOK_ALWAYS TOK_AT TOK_LPAREN TOK_POSEDGE signal(C) TOK_RPAREN sta
 
 /* FIXME: add destructors for io and body */
 
+/* The values of io and body are not used. The labels keep the
+ * parser from destroying the signals and processes.
+ */
+%type io {struct verilog_signal *}
+%type body {void *}
+
 io(I) ::= io TOK_COMMA newsignal(S). { I = S; }
 io(I) ::= newsignal(S). { I = S; }
 io ::= .
@@ -328,6 +386,5 @@ body(B) ::= body process(P). { B = P; }
 body ::= .
 
 module ::= TOK_MODULE TOK_ID(N) TOK_LPAREN io TOK_RPAREN TOK_SEMICOLON body TOK_ENDMODULE. {
-	verilog_set_module_name(outm, N);
-	free(N);
+	verilog_set_module_name(outm, N.str, N.len);
 }
@@ -1,23 +1,37 @@
 #ifndef __SCANNER_H
 #define __SCANNER_H
 
+#include <stdio.h>
+#include <stddef.h>
+
 /* Must be 0 to tell the parser to start */
 #define TOK_EOF 0
 
+/* The whole input is in memory, followed by a newline sentinel and padding,
+ * so that the scanner never needs to refill its buffer.
+ */
 struct scanner {
-	FILE *fd;
-	unsigned char *bot, *tok, *ptr, *cur, *pos, *lim, *top, *eof;
+	unsigned char *buf;
+	size_t size;		/* < of the mapping or of the allocation */
+	int mapped;
+	unsigned char *tok, *ptr, *cur, *pos, *eof;
 	unsigned int line;
 };
 
+/* Tokens point into the scanner buffer and are not NUL-terminated */
+struct scanner_token {
+	const char *str;
+	int len;
+};
+
+/* Regular files are mapped in memory, other streams are read in full */
 struct scanner *scanner_new(FILE *fd);
 void scanner_free(struct scanner *s);
 
 /* get to the next token and return its type */
 int scanner_scan(struct scanner *s);
 
-/* get a newly allocated string with the current token */
-char *scanner_get_token(struct scanner *s);
+/* get the current token, valid until the scanner is freed */
+struct scanner_token scanner_get_token(struct scanner *s);
 
 #endif /* __SCANNER_H */
-
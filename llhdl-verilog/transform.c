@@ -1,6 +1,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <util.h>
 #include <gmp.h>
 
@@ -49,13 +50,17 @@ static void transfer_signals(struct llhdl_module *lm, struct verilog_module *vm)
 	}
 }
 
-struct enumerated_output {
-	struct llhdl_node *signal;
-	struct enumerated_output *next;
-};
-
+/* Set of the signals assigned so far in a process.
+ * Signals are kept both in an open addressing hash table, for constant time
+ * membership tests, and in insertion order, so that the outputs of a branch
+ * can be rolled back (in LIFO order, which keeps the probe chains valid).
+ */
 struct output_enumerator {
-	struct enumerated_output *head;
+	struct llhdl_node **table;
+	unsigned int mask;
+	struct llhdl_node **outputs;
+	int count;
+	int max;
 };
 
 static struct output_enumerator *create_output_enumerator()
@@ -63,56 +68,75 @@ static struct output_enumerator *create_output_enumerator()
 	struct output_enumerator *e;
 	
 	e = alloc_type(struct output_enumerator);
-	e->head = NULL;
+	e->mask = 63;
+	e->table = alloc_size((e->mask+1)*sizeof(struct llhdl_node *));
+	memset(e->table, 0, (e->mask+1)*sizeof(struct llhdl_node *));
+	e->max = 32;
+	e->outputs = alloc_size(e->max*sizeof(struct llhdl_node *));
+	e->count = 0;
 	return e;
 }
 
 static void free_output_enumerator(struct output_enumerator *e)
 {
-	struct enumerated_output *o1, *o2;
-	
-	o1 = e->head;
-	while(o1 != NULL) {
-		o2 = o1->next;
-		free(o1);
-		o1 = o2;
-	}
+	free(e->table);
+	free(e->outputs);
 	free(e);
 }
 
+static unsigned int enumerate_slot(struct output_enumerator *e, struct llhdl_node *signal)
+{
+	unsigned int h;
+	
+	h = (((unsigned long)signal) >> 4)*2654435761U;
+	h &= e->mask;
+	while((e->table[h] != NULL) && (e->table[h] != signal))
+		h = (h + 1) & e->mask;
+	return h;
+}
+
 static int enumerate_output_is_in(struct output_enumerator *e, struct llhdl_node *signal)
 {
-	struct enumerated_output *o;
+	return e->table[enumerate_slot(e, signal)] != NULL;
+}
+
+static void enumerate_grow(struct output_enumerator *e)
+{
+	int i;
 	
-	o = e->head;
-	while(o != NULL) {
-		if(o->signal == signal)
-			return 1;
-		o = o->next;
-	}
-	return 0;
+	free(e->table);
+	e->mask = 2*e->mask + 1;
+	e->table = alloc_size((e->mask+1)*sizeof(struct llhdl_node *));
+	memset(e->table, 0, (e->mask+1)*sizeof(struct llhdl_node *));
+	/* Reinsert in order so that rollbacks remain possible */
+	for(i=0;i<e->count;i++)
+		e->table[enumerate_slot(e, e->outputs[i])] = e->outputs[i];
+	e->max *= 2;
+	e->outputs = realloc(e->outputs, e->max*sizeof(struct llhdl_node *));
+	if(e->outputs == NULL) abort();
 }
 
 static void enumerate_output(struct output_enumerator *e, struct llhdl_node *signal)
 {
-	struct enumerated_output *o;
+	unsigned int h;
 	
-	if(enumerate_output_is_in(e, signal))
+	h = enumerate_slot(e, signal);
+	if(e->table[h] != NULL)
 		return;
-	o = alloc_type(struct enumerated_output);
-	o->signal = signal;
-	o->next = e->head;
-	e->head = o;
+	if(e->count == e->max) {
+		enumerate_grow(e);
+		h = enumerate_slot(e, signal);
+	}
+	e->table[h] = signal;
+	e->outputs[e->count++] = signal;
 }
 
-static void enumerate_merge(struct output_enumerator *resulting, struct output_enumerator *tomerge)
+/* Removes the outputs enumerated after the first "mark" ones */
+static void enumerate_rollback(struct output_enumerator *e, int mark)
 {
-	struct enumerated_output *o;
-	
-	o = tomerge->head;
-	while(o != NULL) {
-		enumerate_output(resulting, o->signal);
-		o = o->next;
+	while(e->count > mark) {
+		e->count--;
+		e->table[enumerate_slot(e, e->outputs[e->count])] = NULL;
 	}
 }
 
@@ -125,6 +149,10 @@ static struct llhdl_node *compile_node(struct output_enumerator *e, struct veril
 		case VERILOG_NODE_CONSTANT: {
 			struct verilog_constant *c;
 			c = n->branches[0];
+			if(mpz_sgn(c->dontcare) != 0) {
+				fprintf(stderr, "Don't care bits are only allowed in casez labels\n");
+				exit(EXIT_FAILURE);
+			}
 			r = llhdl_create_constant(c->value, c->sign, c->vectorsize);
 			break;
 		}
@@ -140,8 +168,8 @@ static struct llhdl_node *compile_node(struct output_enumerator *e, struct veril
 		case VERILOG_NODE_SLICE: {
 			struct llhdl_slice slice;
 			slice.source = compile_node(e, n->branches[0]);
-			slice.start = (int)n->branches[1];
-			slice.end = (int)n->branches[2];
+			slice.start = (long)n->branches[1];
+			slice.end = (long)n->branches[2];
 			r = llhdl_create_vect(llhdl_get_sign(slice.source), 1, &slice);
 			break;
 		}
@@ -198,119 +226,484 @@ static struct llhdl_node *compile_node(struct output_enumerator *e, struct veril
 struct compile_statement_param {
 	int bl;
 	struct llhdl_module *lm;
+	int next_id;
 };
 
+/* A branch is taken when expr evaluates to any i such that taken[i] is set.
+ * If statements have two-way conditions, case statements have one source
+ * per item.
+ */
 struct compile_condition {
 	struct llhdl_node *expr;
-	int negate;
+	int nsources;
+	char *taken;
 	struct compile_condition *next;
 };
 
-static struct output_enumerator *compile_statements(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e);
+static void compile_statements(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e);
 
 static struct llhdl_node *generate_cond_muxes(struct compile_condition *condition, struct llhdl_node *others, struct llhdl_node *final)
 {
-	struct llhdl_node *sources[2];
+	struct llhdl_node **sources;
+	struct llhdl_node *r;
+	int i, used;
 
 	if(condition == NULL)
 		return final;
-	if(condition->negate) {
-		sources[0] = generate_cond_muxes(condition->next, others, final);
-		sources[1] = others;
-	} else {
-		sources[0] = others;
-		sources[1] = generate_cond_muxes(condition->next, others, final);
+	sources = alloc_size(condition->nsources*sizeof(struct llhdl_node *));
+	used = 0;
+	for(i=0;i<condition->nsources;i++) {
+		if(condition->taken[i]) {
+			sources[i] = generate_cond_muxes(condition->next, others, used ? llhdl_dup(final) : final);
+			used = 1;
+		} else
+			sources[i] = llhdl_dup(others);
+	}
+	if(!used)
+		llhdl_free_node(final);
+	r = llhdl_create_mux(condition->nsources, llhdl_dup(condition->expr), sources);
+	free(sources);
+	return r;
+}
+
+/* Number of mux inputs that generate_cond_muxes fills with the previous value, saturated at 2 */
+static int count_untaken(struct compile_condition *condition)
+{
+	int i, below, r;
+
+	if(condition == NULL)
+		return 0;
+	below = count_untaken(condition->next);
+	r = 0;
+	for(i=0;i<condition->nsources;i++) {
+		r += condition->taken[i] ? below : 1;
+		if(r > 1)
+			return 2;
+	}
+	return r;
+}
+
+/* Internal signal named <base><n> */
+static struct llhdl_node *create_internal(struct compile_statement_param *csp, const char *base, struct llhdl_node *source)
+{
+	struct llhdl_node *s;
+	char *name;
+
+	name = NULL;
+	do {
+		free(name);
+		if(asprintf(&name, "%s%d", base, csp->next_id++) == -1) abort();
+	} while(llhdl_find_signal(csp->lm, name) != NULL);
+	s = llhdl_create_signal(csp->lm, LLHDL_SIGNAL_INTERNAL, name,
+		llhdl_get_sign(source), llhdl_get_vectorsize(source));
+	s->p.signal.source = source;
+	free(name);
+	return s;
+}
+
+static void assign_conditional(struct compile_statement_param *csp, struct llhdl_node **target, struct compile_condition *condition, struct llhdl_node *ls, struct llhdl_node *expr)
+{
+	struct llhdl_node *others;
+	char *base;
+	int i, used;
+
+	/* Walk existing conditional muxes that match the specified condition */
+	if((*target != NULL)
+	  && (condition != NULL)
+	  && ((*target)->type == LLHDL_NODE_MUX)
+	  && ((*target)->p.mux.nsources == condition->nsources)
+	  && (llhdl_equiv(condition->expr, (*target)->p.mux.select))) {
+		used = 0;
+		for(i=0;i<condition->nsources;i++) {
+			if(condition->taken[i]) {
+				assign_conditional(csp, &(*target)->p.mux.sources[i], condition->next, ls, used ? llhdl_dup(expr) : expr);
+				used = 1;
+			}
+		}
+		if(!used)
+			llhdl_free_node(expr);
+		return;
+	}
+
+	/* Generate extra conditional muxes. When the condition is not met,
+	 * the signal keeps the value of the previous assignments, if any.
+	 * That value goes through an internal signal rather than being copied
+	 * into several mux inputs.
+	 */
+	others = *target != NULL ? *target : ls;
+	if((others->type != LLHDL_NODE_SIGNAL) && (others->type != LLHDL_NODE_CONSTANT)
+	  && (count_untaken(condition) > 1)) {
+		if(asprintf(&base, "%s$prev", ls->p.signal.name) == -1) abort();
+		others = create_internal(csp, base, others);
+		free(base);
+		*target = NULL;
 	}
-	return llhdl_create_mux(2, llhdl_dup(condition->expr), sources);
+	expr = generate_cond_muxes(condition, others, expr);
+
+	llhdl_free_node(*target);
+	*target = expr;
 }
 
 static struct llhdl_node *compile_assignment(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e)
 {
 	struct llhdl_node *ls;
 	struct llhdl_node *expr;
-	struct llhdl_node **target;
-	struct compile_condition *condition;
 
 	ls = s->p.assignment.target->llhdl_signal;
 	expr = compile_node(csp->bl ? e : NULL, s->p.assignment.source);
+	assign_conditional(csp, &ls->p.signal.source, conditions, ls, expr);
+	return ls;
+}
 
-	target = &ls->p.signal.source;
-	condition = conditions;
+/* Returns the head of the condition list, with new_condition appended */
+static struct compile_condition *push_condition(struct compile_condition *conditions, struct compile_condition *new_condition, struct compile_condition **last)
+{
+	new_condition->next = NULL;
+	if(conditions == NULL) {
+		*last = NULL;
+		return new_condition;
+	}
+	*last = conditions;
+	while((*last)->next != NULL)
+		*last = (*last)->next;
+	(*last)->next = new_condition;
+	return conditions;
+}
 
-	/* Walk existing conditional muxes that match the specified condition */
-	if(*target != NULL) {
-		while((condition != NULL)
-		  && ((*target)->type == LLHDL_NODE_MUX)
-		  && ((*target)->p.mux.nsources == 2)
-		  && (llhdl_equiv(condition->expr, (*target)->p.mux.select))) {
-			if(condition->negate)
-				target = &(*target)->p.mux.sources[0];
-			else
-				target = &(*target)->p.mux.sources[1];
-			condition = condition->next;
+static void pop_condition(struct compile_condition *last)
+{
+	if(last != NULL)
+		last->next = NULL;
+}
+
+/* All branches start from the outputs enumerated before the statement.
+ * Those enumerated in a branch are rolled back and collected into
+ * branch_outputs, which is merged back once all branches are compiled.
+ */
+static void compile_branch(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e, struct output_enumerator *branch_outputs)
+{
+	int mark;
+	int i;
+
+	mark = e->count;
+	compile_statements(csp, s, conditions, e);
+	for(i=mark;i<e->count;i++)
+		enumerate_output(branch_outputs, e->outputs[i]);
+	enumerate_rollback(e, mark);
+}
+
+static void merge_branches(struct output_enumerator *e, struct output_enumerator *branch_outputs)
+{
+	int i;
+
+	for(i=0;i<branch_outputs->count;i++)
+		enumerate_output(e, branch_outputs->outputs[i]);
+	free_output_enumerator(branch_outputs);
+}
+
+static void compile_condition(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e)
+{
+	struct compile_condition new_condition;
+	struct compile_condition *last, *head;
+	struct output_enumerator *branch_outputs;
+	char taken[2];
+
+	new_condition.expr = compile_node(csp->bl ? e : NULL, s->p.condition.condition);
+	new_condition.nsources = 2;
+	new_condition.taken = taken;
+	head = push_condition(conditions, &new_condition, &last);
+	
+	branch_outputs = create_output_enumerator();
+	taken[0] = 1;
+	taken[1] = 0;
+	compile_branch(csp, s->p.condition.negative, head, e, branch_outputs);
+	taken[0] = 0;
+	taken[1] = 1;
+	compile_branch(csp, s->p.condition.positive, head, e, branch_outputs);
+
+	llhdl_free_node(new_condition.expr);
+	pop_condition(last);
+	merge_branches(e, branch_outputs);
+}
+
+#define CASE_MAX_SELECTOR 8
+
+/* Checks the items of a case statement and returns its default item, if any */
+static struct verilog_case_item *check_case_items(struct verilog_statement *s)
+{
+	struct verilog_case_item *item;
+	struct verilog_case_label *label;
+	struct verilog_case_item *default_item;
+
+	default_item = NULL;
+	for(item=s->p.vcase.items;item!=NULL;item=item->next) {
+		if(item->labels == NULL) {
+			if(default_item != NULL) {
+				fprintf(stderr, "Multiple default items in case statement\n");
+				exit(EXIT_FAILURE);
+			}
+			default_item = item;
+		}
+		for(label=item->labels;label!=NULL;label=label->next) {
+			if(!s->p.vcase.casez && (mpz_sgn(label->value->dontcare) != 0)) {
+				fprintf(stderr, "Don't care bits in case labels require casez\n");
+				exit(EXIT_FAILURE);
+			}
 		}
 	}
-	
-	/* Generate extra conditional muxes */
-	expr = generate_cond_muxes(condition, ls, expr);
-	
-	llhdl_free_node(*target);
-	*target = expr;
-	
-	return ls;
+	return default_item;
+}
+
+/* A label with significant bits above the selector width matches nothing */
+static int label_fits(struct verilog_case_label *label, int selector_size)
+{
+	mpz_t care;
+	int r;
+
+	mpz_init(care);
+	mpz_com(care, label->value->dontcare);
+	mpz_and(care, care, label->value->value);
+	r = mpz_scan1(care, selector_size) == ~0UL;
+	mpz_clear(care);
+	return r;
 }
 
-static struct output_enumerator *compile_condition(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e)
+/* Returns a one-bit node that is set when the selector matches one of the
+ * labels, or NULL if none of them can match.
+ */
+static struct llhdl_node *compile_case_match(struct llhdl_node *selector, int selector_size, struct verilog_case_label *labels)
+{
+	struct verilog_case_label *label;
+	struct llhdl_node *match, *term, *bit;
+	struct llhdl_node *operands[2];
+	struct llhdl_slice slice;
+	int i;
+
+	match = NULL;
+	for(label=labels;label!=NULL;label=label->next) {
+		if(!label_fits(label, selector_size))
+			continue;
+		term = NULL;
+		for(i=0;i<selector_size;i++) {
+			if(mpz_tstbit(label->value->dontcare, i))
+				continue;
+			slice.source = llhdl_dup(selector);
+			slice.start = i;
+			slice.end = i;
+			bit = llhdl_create_vect(0, 1, &slice);
+			if(!mpz_tstbit(label->value->value, i))
+				bit = llhdl_create_logic(LLHDL_LOGIC_NOT, &bit);
+			if(term == NULL)
+				term = bit;
+			else {
+				operands[0] = term;
+				operands[1] = bit;
+				term = llhdl_create_logic(LLHDL_LOGIC_AND, operands);
+			}
+		}
+		if(term == NULL)
+			term = llhdl_create_constant_ui(1, 0, 1);
+		if(match == NULL)
+			match = term;
+		else {
+			operands[0] = match;
+			operands[1] = term;
+			match = llhdl_create_logic(LLHDL_LOGIC_OR, operands);
+		}
+	}
+	return match;
+}
+
+/* Lowers the items of a case statement with a selector too wide for a mux
+ * to a chain of two-way conditions, in priority order. The default item
+ * goes into the last else branch.
+ */
+static void compile_case_chain(struct compile_statement_param *csp, struct verilog_case_item *item, struct llhdl_node *selector, int selector_size, struct verilog_case_item *default_item, struct compile_condition *conditions, struct output_enumerator *e)
 {
 	struct compile_condition new_condition;
 	struct compile_condition *last, *head;
-	struct output_enumerator *e1, *e2;
+	struct output_enumerator *branch_outputs;
+	char taken[2];
+	int mark;
+	int i;
+
+	new_condition.expr = NULL;
+	while(item != NULL) {
+		if(item->labels != NULL) {
+			new_condition.expr = compile_case_match(selector, selector_size, item->labels);
+			if(new_condition.expr != NULL)
+				break;
+		}
+		item = item->next;
+	}
+	if(item == NULL) {
+		if(default_item != NULL)
+			compile_statements(csp, default_item->statements, conditions, e);
+		return;
+	}
 
-	if(conditions == NULL) {
-		head = &new_condition;
-		last = NULL;
+	new_condition.nsources = 2;
+	new_condition.taken = taken;
+	head = push_condition(conditions, &new_condition, &last);
+
+	branch_outputs = create_output_enumerator();
+	taken[0] = 1;
+	taken[1] = 0;
+	mark = e->count;
+	compile_case_chain(csp, item->next, selector, selector_size, default_item, head, e);
+	for(i=mark;i<e->count;i++)
+		enumerate_output(branch_outputs, e->outputs[i]);
+	enumerate_rollback(e, mark);
+	taken[0] = 0;
+	taken[1] = 1;
+	compile_branch(csp, item->statements, head, e, branch_outputs);
+
+	llhdl_free_node(new_condition.expr);
+	pop_condition(last);
+	merge_branches(e, branch_outputs);
+}
+
+/* Lowers a case statement to one mux per assigned signal, with a source for
+ * each reachable item. Items are matched in order and the default item takes
+ * all values that no label matches. Unless each value of the selector has its
+ * own source, the muxes are selected by an internal signal holding the index
+ * of the matching item, the values that match no item having an extra index.
+ */
+static void compile_case(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e)
+{
+	struct compile_condition new_condition;
+	struct compile_condition *last, *head;
+	struct output_enumerator *branch_outputs;
+	struct verilog_case_item *item, *default_item;
+	struct verilog_case_label *label;
+	struct llhdl_node *selector;
+	struct llhdl_node **sources;
+	int selector_size, index_size;
+	int nvalues, nitems, nreachable;
+	int *owners, *indices;
+	int i, index, default_index;
+	int unmatched;
+	unsigned long int value, dontcare;
+
+	default_item = check_case_items(s);
+	selector = compile_node(csp->bl ? e : NULL, s->p.vcase.selector);
+	selector_size = llhdl_get_vectorsize(selector);
+	if(selector_size > CASE_MAX_SELECTOR) {
+		compile_case_chain(csp, s->p.vcase.items, selector, selector_size, default_item, conditions, e);
+		llhdl_free_node(selector);
+		return;
+	}
+	nvalues = 1 << selector_size;
+
+	/* Resolve which item each selector value goes to */
+	owners = alloc_size(nvalues*sizeof(int));
+	for(i=0;i<nvalues;i++)
+		owners[i] = -1;
+	default_index = -1;
+	for(item=s->p.vcase.items,index=0;item!=NULL;item=item->next,index++) {
+		if(item == default_item)
+			default_index = index;
+		for(label=item->labels;label!=NULL;label=label->next) {
+			if(!label_fits(label, selector_size))
+				continue;
+			/* The selector is at most CASE_MAX_SELECTOR bits wide */
+			value = mpz_get_ui(label->value->value) & ((1UL << selector_size) - 1);
+			dontcare = mpz_get_ui(label->value->dontcare);
+			for(i=0;i<nvalues;i++)
+				if((owners[i] == -1) && ((((unsigned long int)i ^ value) & ~dontcare) == 0))
+					owners[i] = index;
+		}
+	}
+	nitems = index;
+	if(default_index != -1) {
+		for(i=0;i<nvalues;i++)
+			if(owners[i] == -1)
+				owners[i] = default_index;
+	}
+
+	/* Number the reachable items, in order. Items entirely shadowed
+	 * by previous labels are unreachable.
+	 */
+	indices = alloc_size((nitems+1)*sizeof(int));
+	for(index=0;index<nitems;index++)
+		indices[index] = -1;
+	unmatched = 0;
+	for(i=0;i<nvalues;i++) {
+		if(owners[i] == -1)
+			unmatched = 1;
+		else
+			indices[owners[i]] = 0;
+	}
+	nreachable = 0;
+	for(index=0;index<nitems;index++)
+		if(indices[index] != -1)
+			indices[index] = nreachable++;
+
+	if((nreachable == 0) || ((nreachable == 1) && !unmatched)) {
+		/* no item, or a single item that takes all values */
+		for(item=s->p.vcase.items,index=0;item!=NULL;item=item->next,index++)
+			if(indices[index] != -1)
+				compile_statements(csp, item->statements, conditions, e);
+		llhdl_free_node(selector);
+		free(indices);
+		free(owners);
+		return;
+	}
+
+	if(nreachable + unmatched == nvalues) {
+		new_condition.expr = selector;
+		new_condition.nsources = nvalues;
 	} else {
-		head = conditions;
-		last = conditions;
-		while(last->next != NULL)
-			last = last->next;
-		last->next = &new_condition;
+		new_condition.nsources = nreachable + unmatched;
+		index_size = 1;
+		while((1 << index_size) < new_condition.nsources)
+			index_size++;
+		sources = alloc_size(nvalues*sizeof(struct llhdl_node *));
+		for(i=0;i<nvalues;i++)
+			sources[i] = llhdl_create_constant_ui(owners[i] == -1 ? nreachable : indices[owners[i]], 0, index_size);
+		new_condition.expr = create_internal(csp, "$case", llhdl_create_mux(nvalues, selector, sources));
+		free(sources);
+	}
+	new_condition.taken = alloc_size(new_condition.nsources);
+
+	head = push_condition(conditions, &new_condition, &last);
+	branch_outputs = create_output_enumerator();
+	for(item=s->p.vcase.items,index=0;item!=NULL;item=item->next,index++) {
+		if(indices[index] == -1)
+			continue;
+		if(new_condition.expr == selector) {
+			for(i=0;i<nvalues;i++)
+				new_condition.taken[i] = owners[i] == index;
+		} else {
+			for(i=0;i<new_condition.nsources;i++)
+				new_condition.taken[i] = i == indices[index];
+		}
+		compile_branch(csp, item->statements, head, e, branch_outputs);
 	}
-	
-	new_condition.expr = compile_node(csp->bl ? e : NULL, s->p.condition.condition);
-	new_condition.next = NULL;
-	
-	new_condition.negate = 1;
-	e1 = compile_statements(csp, s->p.condition.negative, head, e);
-	new_condition.negate = 0;
-	e2 = compile_statements(csp, s->p.condition.positive, head, e);
 
 	llhdl_free_node(new_condition.expr);
-	if(last != NULL)
-		last->next = NULL;
-	
-	enumerate_merge(e1, e2);
-	free_output_enumerator(e2);
-	return e1;
+	pop_condition(last);
+	merge_branches(e, branch_outputs);
+	free(new_condition.taken);
+	free(indices);
+	free(owners);
 }
 
-static struct output_enumerator *compile_statements(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e)
+static void compile_statements(struct compile_statement_param *csp, struct verilog_statement *s, struct compile_condition *conditions, struct output_enumerator *e)
 {
 	struct llhdl_node *n;
-	struct output_enumerator *e1, *e2;
 	
-	e1 = create_output_enumerator();
-	enumerate_merge(e1, e);
 	while(s != NULL) {
 		switch(s->type) {
 			case VERILOG_STATEMENT_ASSIGNMENT:
-				n = compile_assignment(csp, s, conditions, e1);
-				enumerate_output(e1, n);
+				n = compile_assignment(csp, s, conditions, e);
+				enumerate_output(e, n);
 				break;
 			case VERILOG_STATEMENT_CONDITION:
-				e2 = compile_condition(csp, s, conditions, e1);
-				enumerate_merge(e1, e2);
-				free_output_enumerator(e2);
+				compile_condition(csp, s, conditions, e);
+				break;
+			case VERILOG_STATEMENT_CASE:
+				compile_case(csp, s, conditions, e);
 				break;
 			default:
 				assert(0);
@@ -318,18 +711,15 @@ static struct output_enumerator *compile_statements(struct compile_statement_par
 		}
 		s = s->next;
 	}
-	return e1;
 }
 
 static void register_outputs(struct output_enumerator *e, struct llhdl_node *clock)
 {
-	struct enumerated_output *o;
+	int i;
 	
-	o = e->head;
-	while(o != NULL) {
-		assert(o->signal->type == LLHDL_NODE_SIGNAL);
-		o->signal->p.signal.source = llhdl_create_fd(clock, o->signal->p.signal.source);
-		o = o->next;
+	for(i=0;i<e->count;i++) {
+		assert(e->outputs[i]->type == LLHDL_NODE_SIGNAL);
+		e->outputs[i]->p.signal.source = llhdl_create_fd(clock, e->outputs[i]->p.signal.source);
 	}
 }
 
@@ -337,7 +727,7 @@ static void transfer_process(struct llhdl_module *lm, struct verilog_process *p)
 {
 	int bl;
 	struct compile_statement_param csp;
-	struct output_enumerator *e1, *e2;
+	struct output_enumerator *e;
 	
 	bl = verilog_process_blocking(p);
 	if(bl == VERILOG_BL_MIXED) {
@@ -347,15 +737,15 @@ static void transfer_process(struct llhdl_module *lm, struct verilog_process *p)
 	
 	csp.bl = bl == VERILOG_BL_BLOCKING;
 	csp.lm = lm;
+	csp.next_id = 0;
 	
-	e1 = create_output_enumerator();
-	e2 = compile_statements(&csp, p->head, NULL, e1);
-	free_output_enumerator(e1);
+	e = create_output_enumerator();
+	compile_statements(&csp, p->head, NULL, e);
 
 	if(p->clock != NULL)
-		register_outputs(e2, p->clock->llhdl_signal);
+		register_outputs(e, p->clock->llhdl_signal);
 
-	free_output_enumerator(e2);
+	free_output_enumerator(e);
 }
 
 static void transfer_processes(struct llhdl_module *lm, struct verilog_module *vm)
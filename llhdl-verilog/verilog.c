@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <util.h>
@@ -17,14 +18,21 @@ struct verilog_constant *verilog_new_constant(int vectorsize, int sign, mpz_t va
 	c->vectorsize = vectorsize;
 	c->sign = sign;
 	mpz_init_set(c->value, value);
+	mpz_init(c->dontcare);
 	return c;
 }
 
-struct verilog_constant *verilog_new_constant_str(char *str)
+struct verilog_constant *verilog_new_constant_str(const char *token, int len)
 {
-	char *q;
+	char *str, *q, *dc;
 	struct verilog_constant *c;
 	int base;
+	int i;
+
+	/* tokens are not NUL-terminated */
+	str = alloc_size(len+1);
+	memcpy(str, token, len);
+	str[len] = 0;
 
 	base = 0;
 	c = alloc_type(struct verilog_constant);
@@ -33,6 +41,7 @@ struct verilog_constant *verilog_new_constant_str(char *str)
 		c->vectorsize = 32;
 		c->sign = 0;
 		base = 10;
+		q = str;
 	} else {
 		*q = 0;
 		q++;
@@ -60,57 +69,113 @@ struct verilog_constant *verilog_new_constant_str(char *str)
 				exit(EXIT_FAILURE);
 				break;
 		}
-		str = q+1;
+		q++;
 	}
-	mpz_init_set_str(c->value, str, base);
+
+	/* Split z/? digits into a separate don't care mask */
+	dc = stralloc(q);
+	for(i=0;q[i]!=0;i++) {
+		if((q[i] == 'z') || (q[i] == 'Z') || (q[i] == '?')) {
+			q[i] = '0';
+			dc[i] = base == 16 ? 'f' : base - 1 + '0';
+		} else
+			dc[i] = '0';
+	}
+	mpz_init_set_str(c->value, q, base);
+	mpz_init_set_str(c->dontcare, dc, base);
+	free(dc);
+	free(str);
 	return c;
 }
 
 void verilog_free_constant(struct verilog_constant *c)
 {
 	mpz_clear(c->value);
+	mpz_clear(c->dontcare);
 	free(c);
 }
 
-struct verilog_signal *verilog_find_signal(struct verilog_module *m, const char *signal)
+static unsigned int name_hash(const char *s, int len)
+{
+	unsigned int h;
+	int i;
+
+	h = 2166136261U;
+	for(i=0;i<len;i++) {
+		h ^= (unsigned char)s[i];
+		h *= 16777619U;
+	}
+	return h;
+}
+
+struct verilog_signal *verilog_find_signal(struct verilog_module *m, const char *signal, int len)
 {
 	struct verilog_signal *s;
 
-	s = m->shead;
+	s = m->names[name_hash(signal, len) & m->name_mask];
 	while(s != NULL) {
-		if(strcmp(s->name, signal) == 0)
+		if((strncmp(s->name, signal, len) == 0) && (s->name[len] == 0))
 			return s;
-		s = s->next;
+		s = s->name_next;
 	}
 	return NULL;
 }
 
-struct verilog_signal *verilog_new_update_signal(struct verilog_module *m, int type, const char *name, int vectorsize, int sign)
+static void grow_names(struct verilog_module *m)
 {
 	struct verilog_signal *s;
-	int len;
+	unsigned int h;
+
+	free(m->names);
+	m->name_mask = 2*m->name_mask + 1;
+	m->names = alloc_size0((m->name_mask+1)*sizeof(struct verilog_signal *));
+	for(s=m->shead;s!=NULL;s=s->next) {
+		h = name_hash(s->name, strlen(s->name)) & m->name_mask;
+		s->name_next = m->names[h];
+		m->names[h] = s;
+	}
+}
+
+struct verilog_signal *verilog_new_update_signal(struct verilog_module *m, int type, const char *name, int len, int vectorsize, int sign)
+{
+	struct verilog_signal *s;
+	unsigned int h;
 
-	s = verilog_find_signal(m, name);
+	s = verilog_find_signal(m, name, len);
 	if(s != NULL) {
 		s->type = type;
 		if(s->vectorsize != vectorsize) return NULL;
 		if(s->sign != sign) return NULL;
 		return s;
 	}
-	len = strlen(name)+1;
-	s = alloc_size(sizeof(struct verilog_signal)+len);
+	s = alloc_size(sizeof(struct verilog_signal)+len+1);
 	s->type = type;
 	s->vectorsize = vectorsize;
 	s->sign = sign;
 	s->next = m->shead;
 	s->llhdl_signal = NULL;
 	memcpy(s->name, name, len);
+	s->name[len] = 0;
 	m->shead = s;
+	h = name_hash(name, len) & m->name_mask;
+	s->name_next = m->names[h];
+	m->names[h] = s;
+	if(++m->nsignals > m->name_mask)
+		grow_names(m);
 	return s;
 }
 
 void verilog_free_signal(struct verilog_module *m, struct verilog_signal *s)
 {
+	struct verilog_signal **prev;
+
+	prev = &m->names[name_hash(s->name, strlen(s->name)) & m->name_mask];
+	while(*prev != s) {
+		assert(*prev != NULL);
+		prev = &(*prev)->name_next;
+	}
+	*prev = s->name_next;
+	m->nsignals--;
 	if(s == m->shead) {
 		m->shead = m->shead->next;
 	} else {
@@ -165,7 +230,7 @@ struct verilog_node *verilog_new_op_node(int type)
 	int i;
 
 	arity = verilog_get_node_arity(type);
-	n = alloc_size(sizeof(int)+arity*sizeof(void *));
+	n = alloc_size(sizeof(struct verilog_node)+arity*sizeof(void *));
 	n->type = type;
 	for(i=0;i<arity;i++)
 		n->branches[i] = NULL;
@@ -194,7 +259,7 @@ static struct verilog_statement *alloc_base_statement(int extra, int type)
 {
 	struct verilog_statement *s;
 	
-	s = alloc_size(sizeof(int)+sizeof(void *)+extra);
+	s = alloc_size(offsetof(struct verilog_statement, p)+extra);
 	s->type = type;
 	s->next = NULL;
 	return s;
@@ -222,6 +287,65 @@ struct verilog_statement *verilog_new_condition(struct verilog_node *condition,
 	return s;
 }
 
+struct verilog_case_label *verilog_new_case_label(struct verilog_constant *value)
+{
+	struct verilog_case_label *l;
+
+	l = alloc_type(struct verilog_case_label);
+	l->value = value;
+	l->next = NULL;
+	return l;
+}
+
+void verilog_free_case_label_list(struct verilog_case_label *head)
+{
+	struct verilog_case_label *l1, *l2;
+
+	l1 = head;
+	while(l1 != NULL) {
+		l2 = l1->next;
+		verilog_free_constant(l1->value);
+		free(l1);
+		l1 = l2;
+	}
+}
+
+struct verilog_case_item *verilog_new_case_item(struct verilog_case_label *labels, struct verilog_statement *statements)
+{
+	struct verilog_case_item *i;
+
+	i = alloc_type(struct verilog_case_item);
+	i->labels = labels;
+	i->statements = statements;
+	i->next = NULL;
+	return i;
+}
+
+void verilog_free_case_item_list(struct verilog_case_item *head)
+{
+	struct verilog_case_item *i1, *i2;
+
+	i1 = head;
+	while(i1 != NULL) {
+		i2 = i1->next;
+		verilog_free_case_label_list(i1->labels);
+		verilog_free_statement_list(i1->statements);
+		free(i1);
+		i1 = i2;
+	}
+}
+
+struct verilog_statement *verilog_new_case(struct verilog_node *selector, int casez, struct verilog_case_item *items)
+{
+	struct verilog_statement *s;
+
+	s = alloc_base_statement(sizeof(struct verilog_case), VERILOG_STATEMENT_CASE);
+	s->p.vcase.selector = selector;
+	s->p.vcase.casez = casez;
+	s->p.vcase.items = items;
+	return s;
+}
+
 void verilog_free_statement(struct verilog_statement *s)
 {
 	switch(s->type) {
@@ -233,6 +357,10 @@ void verilog_free_statement(struct verilog_statement *s)
 			verilog_free_statement_list(s->p.condition.negative);
 			verilog_free_statement_list(s->p.condition.positive);
 			break;
+		case VERILOG_STATEMENT_CASE:
+			verilog_free_node(s->p.vcase.selector);
+			verilog_free_case_item_list(s->p.vcase.items);
+			break;
 		default:
 			assert(0);
 			break;
@@ -301,19 +429,25 @@ struct verilog_module *verilog_new_module()
 	m = alloc_type(struct verilog_module);
 	m->name = NULL;
 	m->shead = NULL;
+	m->nsignals = 0;
+	m->name_mask = 255;
+	m->names = alloc_size0((m->name_mask+1)*sizeof(struct verilog_signal *));
 	m->phead = NULL;
 	return m;
 }
 
-void verilog_set_module_name(struct verilog_module *m, const char *name)
+void verilog_set_module_name(struct verilog_module *m, const char *name, int len)
 {
 	free(m->name);
-	m->name = stralloc(name);
+	m->name = alloc_size(len+1);
+	memcpy(m->name, name, len);
+	m->name[len] = 0;
 }
 
 void verilog_free_module(struct verilog_module *m)
 {
 	verilog_free_signal_list(m->shead);
+	free(m->names);
 	verilog_free_process_list(m->phead);
 	free(m->name);
 	free(m);
@@ -321,7 +455,7 @@ void verilog_free_module(struct verilog_module *m)
 
 extern void *ParseAlloc(void *(*mallocProc)(size_t));
 extern void ParseFree(void *p, void (*freeProc)(void *));
-extern void Parse(void *yyp, int yymajor, void *yyminor, struct verilog_module *outm);
+extern void Parse(void *yyp, int yymajor, struct scanner_token yyminor, struct verilog_module *outm);
 extern void ParseTrace(FILE *TraceFILE, char *zTracePrompt);
 
 struct verilog_module *verilog_parse_fd(FILE *fd)
@@ -329,7 +463,7 @@ struct verilog_module *verilog_parse_fd(FILE *fd)
 	struct scanner *s;
 	int tok;
 	void *p;
-	char *stoken;
+	struct scanner_token stoken;
 	struct verilog_module *m;
 
 	//ParseTrace(stdout, "parser: ");
@@ -343,7 +477,9 @@ struct verilog_module *verilog_parse_fd(FILE *fd)
 		Parse(p, tok, stoken, m);
 		tok = scanner_scan(s);
 	}
-	Parse(p, TOK_EOF, NULL, m);
+	stoken.str = NULL;
+	stoken.len = 0;
+	Parse(p, TOK_EOF, stoken, m);
 	ParseFree(p, free);
 	scanner_free(s);
 
@@ -494,6 +630,31 @@ void verilog_dump_statement_list(int level, struct verilog_statement *head)
 					verilog_dump_statement_list(level, head->p.condition.negative);
 				}
 				break;
+			case VERILOG_STATEMENT_CASE: {
+				struct verilog_case_item *item;
+				struct verilog_case_label *label;
+				indent(level);
+				printf("%s", head->p.vcase.casez ? "casez" : "case");
+				verilog_dump_node(head->p.vcase.selector);
+				printf(":\n");
+				for(item=head->p.vcase.items;item!=NULL;item=item->next) {
+					indent(level);
+					if(item->labels == NULL)
+						printf("default");
+					for(label=item->labels;label!=NULL;label=label->next) {
+						mpz_out_str(stdout, 10, label->value->value);
+						if(mpz_sgn(label->value->dontcare) != 0) {
+							printf("/");
+							mpz_out_str(stdout, 10, label->value->dontcare);
+						}
+						if(label->next != NULL)
+							printf(",");
+					}
+					printf(":\n");
+					verilog_dump_statement_list(level, item->statements);
+				}
+				break;
+			}
 			default:
 				assert(0);
 				break;
@@ -554,6 +715,12 @@ int verilog_statements_blocking(struct verilog_statement *s)
 				verilog_update_bl(&r, verilog_statements_blocking(s->p.condition.negative));
 				verilog_update_bl(&r, verilog_statements_blocking(s->p.condition.positive));
 				break;
+			case VERILOG_STATEMENT_CASE: {
+				struct verilog_case_item *item;
+				for(item=s->p.vcase.items;item!=NULL;item=item->next)
+					verilog_update_bl(&r, verilog_statements_blocking(item->statements));
+				break;
+			}
 			default:
 				assert(0);
 				break;
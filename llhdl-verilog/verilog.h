@@ -9,6 +9,7 @@ struct verilog_constant {
 	int vectorsize;
 	int sign;
 	mpz_t value;
+	mpz_t dontcare;		/* < z/? bits, only allowed in casez labels */
 };
 
 enum {
@@ -22,6 +23,7 @@ struct verilog_signal {
 	int vectorsize;
 	int sign;
 	struct verilog_signal *next;
+	struct verilog_signal *name_next;	/* < next signal in the same name bucket */
 	struct llhdl_node *llhdl_signal;	/* < transformed LLHDL signal */
 	char name[];
 };
@@ -62,9 +64,27 @@ struct verilog_condition {
 	struct verilog_statement *positive;
 };
 
+struct verilog_case_label {
+	struct verilog_constant *value;
+	struct verilog_case_label *next;
+};
+
+struct verilog_case_item {
+	struct verilog_case_label *labels;	/* < NULL for the default item */
+	struct verilog_statement *statements;
+	struct verilog_case_item *next;
+};
+
+struct verilog_case {
+	struct verilog_node *selector;
+	int casez;
+	struct verilog_case_item *items;
+};
+
 enum {
 	VERILOG_STATEMENT_ASSIGNMENT,
-	VERILOG_STATEMENT_CONDITION
+	VERILOG_STATEMENT_CONDITION,
+	VERILOG_STATEMENT_CASE
 };
 
 struct verilog_statement {
@@ -73,6 +93,7 @@ struct verilog_statement {
 	union {
 		struct verilog_assignment assignment;
 		struct verilog_condition condition;
+		struct verilog_case vcase;
 	} p;
 };
 
@@ -85,16 +106,19 @@ struct verilog_process {
 struct verilog_module {
 	char *name;
 	struct verilog_signal *shead;
+	int nsignals;
+	unsigned int name_mask;
+	struct verilog_signal **names;		/* < hash buckets of the signals, by name */
 	struct verilog_process *phead;
 };
 
 /* structure manipulation */
 struct verilog_constant *verilog_new_constant(int vectorsize, int sign, mpz_t value);
-struct verilog_constant *verilog_new_constant_str(char *str);
+struct verilog_constant *verilog_new_constant_str(const char *token, int len);
 void verilog_free_constant(struct verilog_constant *c);
 
-struct verilog_signal *verilog_find_signal(struct verilog_module *m, const char *signal);
-struct verilog_signal *verilog_new_update_signal(struct verilog_module *m, int type, const char *name, int vectorsize, int sign);
+struct verilog_signal *verilog_find_signal(struct verilog_module *m, const char *signal, int len);
+struct verilog_signal *verilog_new_update_signal(struct verilog_module *m, int type, const char *name, int len, int vectorsize, int sign);
 void verilog_free_signal(struct verilog_module *m, struct verilog_signal *s);
 void verilog_free_signal_list(struct verilog_signal *head);
 
@@ -104,6 +128,11 @@ void verilog_free_node(struct verilog_node *n);
 
 struct verilog_statement *verilog_new_assignment(struct verilog_signal *target, int blocking, struct verilog_node *source);
 struct verilog_statement *verilog_new_condition(struct verilog_node *condition, struct verilog_statement *negative, struct verilog_statement *positive);
+struct verilog_case_label *verilog_new_case_label(struct verilog_constant *value);
+void verilog_free_case_label_list(struct verilog_case_label *head);
+struct verilog_case_item *verilog_new_case_item(struct verilog_case_label *labels, struct verilog_statement *statements);
+void verilog_free_case_item_list(struct verilog_case_item *head);
+struct verilog_statement *verilog_new_case(struct verilog_node *selector, int casez, struct verilog_case_item *items);
 void verilog_free_statement(struct verilog_statement *s);
 void verilog_free_statement_list(struct verilog_statement *head);
 
@@ -112,7 +141,7 @@ void verilog_free_process(struct verilog_module *m, struct verilog_process *p);
 void verilog_free_process_list(struct verilog_process *head);
 
 struct verilog_module *verilog_new_module();
-void verilog_set_module_name(struct verilog_module *m, const char *name);
+void verilog_set_module_name(struct verilog_module *m, const char *name, int len);
 void verilog_free_module(struct verilog_module *m);
 
 /* parsing */